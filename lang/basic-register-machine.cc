@@ -12,6 +12,8 @@
 #include "pjit/base/unsafe-cast.h"
 #include "pjit/hir/hir-to-mir.h"
 #include "pjit/mir/logging.h"
+#include "pjit/mir/transforms/pipeline/transform.h"
+#include "pjit/arch/x86-64/codegen/code-generator.h"
 
 
 static pjit::mir::Context C;
@@ -170,32 +172,40 @@ static int eval(INS *ins, MSTATE *state) {
 
 
 
-static void pjit_eval_ins(void) {
+// Decode loop of `eval`. Each case ends in `NEXT`, so that the generated code
+// for each opcode jumps directly to the code for the next opcode.
+static const pjit::mir::Symbol *pjit_eval_ins(void) {
   using namespace pjit::hir;
 
-  PJIT_HIR_DECLARE(C, (INS *), ins);
-  PJIT_HIR_DECLARE(C, (INS), in);
+  PJIT_HIR_DECLARE_PROGRAM_COUNTER(C, (INS *), ins);
+  PJIT_HIR_DECLARE(C, (INS *), in);
 
-  ASSIGN(C, in, LOAD_MEMORY(C, ins));
+  ASSIGN(C, in, ins);
   ASSIGN(C, ins, pjit::hir::ADD(C, ins, 1));
 
-  PJIT_HIR_SWITCH(C, PJIT_HIR_ACCESS_FIELD(C, ins, opcode))
+  PJIT_HIR_SWITCH(C, PJIT_HIR_ACCESS_FIELD(C, in, opcode))
     PJIT_HIR_CASE(C, OPC::ASSIGN_VAL)
+      NEXT(C);
     PJIT_HIR_END_CASE
 
     PJIT_HIR_CASE(C, OPC::ASSIGN_REG)
+      NEXT(C);
     PJIT_HIR_END_CASE
 
     PJIT_HIR_CASE(C, OPC::ADD)
+      NEXT(C);
     PJIT_HIR_END_CASE
 
     PJIT_HIR_CASE(C, OPC::INC)
+      NEXT(C);
     PJIT_HIR_END_CASE
 
     PJIT_HIR_CASE(C, OPC::JUMP_IF_ZERO)
+      NEXT(C);
     PJIT_HIR_END_CASE
 
     PJIT_HIR_CASE(C, OPC::CALL)
+      NEXT(C);
     PJIT_HIR_END_CASE
 
     PJIT_HIR_CASE(C, OPC::RET)
@@ -230,6 +240,8 @@ static void pjit_eval_ins(void) {
           return state->regs[in.operands[0].reg];
       }
 #endif
+
+  return ins.GetSymbol();
 }
 
 
@@ -243,9 +255,27 @@ int main(void) {
     frame->regs[REG::I1] = i;
     printf("eval-fib(%d) = %d\n\n", i, eval(&(FIBONNACI[0]), frame));
   }
+
+  // Optimize the generated decode loop, and then run it over `FIBONNACI`
+  // until the first `RET`.
+  const pjit::mir::Symbol *ins(pjit_eval_ins());
+  pjit::mir::OptimizationPipeline pipeline(&C);
+  pipeline.Transform();
+  pjit::x86_64::CompiledCode code;
+  pjit::x86_64::CodeGenerator generator(&C);
+  unsigned ins_offset(0);
+  pjit::U64 code_frame[8] = {0};
+  if (generator.Generate(&code) && code.GetFrameOffset(ins, &ins_offset) &&
+      sizeof(code_frame) >= code.FrameSize()) {
+    code_frame[ins_offset / sizeof(pjit::U64)] = pjit::UnsafeCast<pjit::U64>(
+        &(FIBONNACI[0]));
+    code.Run(&(code_frame[0]));
+    printf("jit-decode(FIBONNACI) = %d instructions\n", static_cast<int>(
+        pjit::UnsafeCast<INS *>(code_frame[ins_offset / sizeof(pjit::U64)]) -
+        &(FIBONNACI[0])));
+  }
   printf("*/\n");
 
-  pjit_eval_ins();
   C.GarbageCollect();
   pjit::Log(pjit::LogLevel::LogWarning, &C);
 
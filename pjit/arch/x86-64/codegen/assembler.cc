@@ -0,0 +1,535 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * assembler.cc
+ *
+ *  Created on: 2014-01-08
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/arch/x86-64/codegen/assembler.h"
+
+#include "pjit/base/libc.h"
+
+namespace pjit {
+namespace x86_64 {
+
+
+enum : unsigned {
+  REX = 0x40,
+  REX_W = 0x08,
+  REX_R = 0x04,
+  REX_X = 0x02,
+  REX_B = 0x01,
+
+  PREFIX_OPERAND_SIZE = 0x66,
+  PREFIX_REPE = 0xF3,
+  PREFIX_REPNE = 0xF2,
+
+  MOD_INDIRECT = 0x00,
+  MOD_DISP8 = 0x40,
+  MOD_DISP32 = 0x80,
+  MOD_DIRECT = 0xC0,
+
+  RM_SIB = 4,
+  RM_RIP_RELATIVE = 5,
+  SIB_NO_INDEX = 0x24,
+  SIB_SCALE_4 = 0x80,
+
+  OPCODE_INT3 = 0xCC
+};
+
+
+static inline unsigned Encoding(Register reg) {
+  return static_cast<unsigned>(reg);
+}
+
+
+static inline unsigned Encoding(FloatRegister reg) {
+  return static_cast<unsigned>(reg);
+}
+
+
+static inline unsigned Encoding(Condition cond) {
+  return static_cast<unsigned>(cond);
+}
+
+
+static inline bool IsInt8(S32 val) {
+  return -128 <= val && val <= 127;
+}
+
+
+void Assembler::CopyTo(U8 *dest) const {
+  for (unsigned i(0); i < code.NumSpans(); ++i) {
+    const Vector<U8>::Span span(code.GetSpan(i));
+    memcpy(dest, span.entries, span.size);
+    dest += span.size;
+  }
+}
+
+
+void Assembler::Emit32(U32 val) {
+  for (unsigned i(0); i < 4; ++i, val >>= 8) {
+    Emit8(val & 0xFF);
+  }
+}
+
+
+void Assembler::Emit64(U64 val) {
+  Emit32(static_cast<U32>(val));
+  Emit32(static_cast<U32>(val >> 32));
+}
+
+
+void Assembler::Patch32(unsigned offset, U32 val) {
+  for (unsigned i(0); i < 4; ++i, val >>= 8) {
+    code.Get(offset + i) = static_cast<U8>(val & 0xFF);
+  }
+}
+
+
+U32 Assembler::Read32(unsigned offset) {
+  U32 val(0);
+  for (unsigned i(4); i--; ) {
+    val = (val << 8) | code.Get(offset + i);
+  }
+  return val;
+}
+
+
+// Emit a REX prefix if one is needed. A REX prefix is needed to access the
+// 64-bit form of an instruction, to access the registers `R8` through `R15`,
+// or (when `force` is true) to access the low bytes of `RSP`, `RBP`, `RSI`,
+// and `RDI`.
+void Assembler::EmitRex(bool is_64_bit, unsigned reg, unsigned base,
+                        bool force) {
+  unsigned rex(REX);
+  if (is_64_bit) {
+    rex |= REX_W;
+  }
+  if (reg & 8) {
+    rex |= REX_R;
+  }
+  if (base & 8) {
+    rex |= REX_B;
+  }
+  if (REX != rex || force) {
+    Emit8(rex);
+  }
+}
+
+
+void Assembler::EmitRegisterOperand(unsigned reg, unsigned rm) {
+  Emit8(MOD_DIRECT | ((reg & 7) << 3) | (rm & 7));
+}
+
+
+// Emit the ModR/M byte (and SIB byte and displacement, if needed) for the
+// memory operand `[base + disp]`.
+void Assembler::EmitMemoryOperand(unsigned reg, Register base, S32 disp) {
+  const unsigned rm(Encoding(base) & 7);
+  unsigned mod(MOD_DISP32);
+
+  // `RBP` and `R13` can't be encoded as a base without a displacement.
+  if (!disp && 5 != rm) {
+    mod = MOD_INDIRECT;
+  } else if (IsInt8(disp)) {
+    mod = MOD_DISP8;
+  }
+
+  Emit8(mod | ((reg & 7) << 3) | rm);
+
+  // `RSP` and `R12` can only be encoded as a base with a SIB byte.
+  if (RM_SIB == rm) {
+    Emit8(SIB_NO_INDEX);
+  }
+
+  if (MOD_DISP8 == mod) {
+    Emit8(static_cast<U8>(disp));
+  } else if (MOD_DISP32 == mod) {
+    Emit32(static_cast<U32>(disp));
+  }
+}
+
+
+// Emit the 32-bit displacement of a jump to `label`.
+void Assembler::EmitLabelDisplacement(Label *label) {
+  const unsigned offset(code.Size());
+  if (label->is_bound) {
+    Emit32(label->offset - (offset + 4));
+  } else {
+    Emit32(label->last_use);
+    label->last_use = offset;
+  }
+}
+
+
+// Bind `label` to the current position in the code, and resolve all jumps
+// to the label.
+void Assembler::Bind(Label *label) {
+  label->offset = code.Size();
+  label->is_bound = true;
+
+  for (unsigned use(label->last_use); Label::NO_USE != use; ) {
+    const unsigned next_use(Read32(use));
+    Patch32(use, label->offset - (use + 4));
+    use = next_use;
+  }
+  label->last_use = Label::NO_USE;
+}
+
+
+void Assembler::Move(Register dest, Register src) {
+  EmitRex(true, Encoding(src), Encoding(dest), false);
+  Emit8(0x89);
+  EmitRegisterOperand(Encoding(src), Encoding(dest));
+}
+
+
+// Uses the shortest of the three encodings of moving an immediate into a
+// 64-bit register.
+void Assembler::MoveImmediate(Register dest, U64 imm) {
+  const unsigned reg(Encoding(dest));
+  const S64 simm(static_cast<S64>(imm));
+  if (imm <= 0xFFFFFFFFULL) {  // Zero-extended 32-bit immediate.
+    EmitRex(false, 0, reg, false);
+    Emit8(0xB8 + (reg & 7));
+    Emit32(static_cast<U32>(imm));
+  } else if (-2147483648LL <= simm && simm < 0) {  // Sign-extended.
+    EmitRex(true, 0, reg, false);
+    Emit8(0xC7);
+    EmitRegisterOperand(0, reg);
+    Emit32(static_cast<U32>(imm));
+  } else {
+    EmitRex(true, 0, reg, false);
+    Emit8(0xB8 + (reg & 7));
+    Emit64(imm);
+  }
+}
+
+
+// Load `size` bytes from memory into `dest`, extending the loaded value to
+// 64 bits.
+void Assembler::Load(Register dest, Register base, S32 disp, unsigned size,
+                     bool sign_extend) {
+  const unsigned reg(Encoding(dest));
+  switch (size) {
+    case 1:
+    case 2:
+      EmitRex(sign_extend, reg, Encoding(base), false);
+      Emit8(0x0F);
+      Emit8((1 == size ? 0xB6 : 0xB7) | (sign_extend ? 0x08 : 0));
+      break;
+    case 4:
+      EmitRex(sign_extend, reg, Encoding(base), false);
+      Emit8(sign_extend ? 0x63 : 0x8B);  // MOVSXD or MOV r32.
+      break;
+    default:
+      EmitRex(true, reg, Encoding(base), false);
+      Emit8(0x8B);
+      break;
+  }
+  EmitMemoryOperand(reg, base, disp);
+}
+
+
+// Store the low `size` bytes of `src` to memory.
+void Assembler::Store(Register base, S32 disp, Register src, unsigned size) {
+  const unsigned reg(Encoding(src));
+  switch (size) {
+    case 1:
+      EmitRex(false, reg, Encoding(base), 4 <= reg);
+      Emit8(0x88);
+      break;
+    case 2:
+      Emit8(PREFIX_OPERAND_SIZE);
+      EmitRex(false, reg, Encoding(base), false);
+      Emit8(0x89);
+      break;
+    case 4:
+      EmitRex(false, reg, Encoding(base), false);
+      Emit8(0x89);
+      break;
+    default:
+      EmitRex(true, reg, Encoding(base), false);
+      Emit8(0x89);
+      break;
+  }
+  EmitMemoryOperand(reg, base, disp);
+}
+
+
+void Assembler::LoadAddress(Register dest, Register base, S32 disp) {
+  EmitRex(true, Encoding(dest), Encoding(base), false);
+  Emit8(0x8D);
+  EmitMemoryOperand(Encoding(dest), base, disp);
+}
+
+
+// Uses a RIP-relative displacement, which (like the displacement of a jump)
+// is relative to the end of the instruction.
+void Assembler::LoadLabelAddress(Register dest, Label *label) {
+  const unsigned reg(Encoding(dest));
+  EmitRex(true, reg, 0, false);
+  Emit8(0x8D);
+  Emit8(MOD_INDIRECT | ((reg & 7) << 3) | RM_RIP_RELATIVE);
+  EmitLabelDisplacement(label);
+}
+
+
+void Assembler::LoadTableEntry(Register dest, Register table,
+                               Register index) {
+  const unsigned reg(Encoding(dest));
+  const unsigned base(Encoding(table));
+  const unsigned scaled(Encoding(index));
+
+  // `RBP` and `R13` can't be encoded as a base without a displacement.
+  const unsigned mod(5 == (base & 7) ? MOD_DISP8 : MOD_INDIRECT);
+
+  unsigned rex(REX | REX_W);
+  if (reg & 8) {
+    rex |= REX_R;
+  }
+  if (scaled & 8) {
+    rex |= REX_X;
+  }
+  if (base & 8) {
+    rex |= REX_B;
+  }
+  Emit8(rex);
+  Emit8(0x63);  // MOVSXD.
+  Emit8(mod | ((reg & 7) << 3) | RM_SIB);
+  Emit8(SIB_SCALE_4 | ((scaled & 7) << 3) | (base & 7));
+  if (MOD_DISP8 == mod) {
+    Emit8(0);
+  }
+}
+
+
+void Assembler::Extend(Register reg_, unsigned size, bool sign_extend) {
+  const unsigned reg(Encoding(reg_));
+  switch (size) {
+    case 1:
+    case 2:
+      EmitRex(sign_extend, reg, reg, 1 == size && 4 <= reg);
+      Emit8(0x0F);
+      Emit8((1 == size ? 0xB6 : 0xB7) | (sign_extend ? 0x08 : 0));
+      break;
+    case 4:
+      EmitRex(sign_extend, reg, reg, false);
+      Emit8(sign_extend ? 0x63 : 0x89);  // MOVSXD, or MOV r32 (zero-extends).
+      break;
+    default:
+      return;
+  }
+  EmitRegisterOperand(reg, reg);
+}
+
+
+void Assembler::Arithmetic(ArithmeticOperation op, Register dest,
+                           Register src) {
+  EmitRex(true, Encoding(src), Encoding(dest), false);
+  Emit8(static_cast<unsigned>(op));
+  EmitRegisterOperand(Encoding(src), Encoding(dest));
+}
+
+
+void Assembler::Test(Register a, Register b) {
+  EmitRex(true, Encoding(b), Encoding(a), false);
+  Emit8(0x85);
+  EmitRegisterOperand(Encoding(b), Encoding(a));
+}
+
+
+void Assembler::BitTest(Register bits, Register index) {
+  EmitRex(true, Encoding(index), Encoding(bits), false);
+  Emit8(0x0F);  // BT r/m64, r64.
+  Emit8(0xA3);
+  EmitRegisterOperand(Encoding(index), Encoding(bits));
+}
+
+
+void Assembler::Multiply(Register dest, Register src) {
+  EmitRex(true, Encoding(dest), Encoding(src), false);
+  Emit8(0x0F);
+  Emit8(0xAF);
+  EmitRegisterOperand(Encoding(dest), Encoding(src));
+}
+
+
+// Divide `RDX:RAX` by `divisor`. The quotient is placed in `RAX`, and the
+// remainder in `RDX`. `RDX` is first set up from `RAX`.
+void Assembler::Divide(Register divisor, bool is_signed) {
+  if (is_signed) {
+    Emit8(REX | REX_W);  // CQO.
+    Emit8(0x99);
+  } else {
+    Emit8(0x31);  // XOR EDX, EDX.
+    EmitRegisterOperand(Encoding(Register::RDX), Encoding(Register::RDX));
+  }
+  EmitRex(true, 0, Encoding(divisor), false);
+  Emit8(0xF7);
+  EmitRegisterOperand(is_signed ? 7 : 6, Encoding(divisor));
+}
+
+
+void Assembler::Not(Register reg) {
+  EmitRex(true, 0, Encoding(reg), false);
+  Emit8(0xF7);
+  EmitRegisterOperand(2, Encoding(reg));
+}
+
+
+void Assembler::Set(Condition cond, Register dest) {
+  const unsigned reg(Encoding(dest));
+  EmitRex(false, 0, reg, 4 <= reg);
+  Emit8(0x0F);
+  Emit8(0x90 + Encoding(cond));
+  EmitRegisterOperand(0, reg);
+  Extend(dest, 1, false);
+}
+
+
+void Assembler::Push(Register reg) {
+  EmitRex(false, 0, Encoding(reg), false);
+  Emit8(0x50 + (Encoding(reg) & 7));
+}
+
+
+void Assembler::Pop(Register reg) {
+  EmitRex(false, 0, Encoding(reg), false);
+  Emit8(0x58 + (Encoding(reg) & 7));
+}
+
+
+void Assembler::Call(Register target) {
+  EmitRex(false, 0, Encoding(target), false);
+  Emit8(0xFF);
+  EmitRegisterOperand(2, Encoding(target));
+}
+
+
+void Assembler::Return(void) {
+  Emit8(0xC3);
+}
+
+
+void Assembler::Jump(Label *label) {
+  Emit8(0xE9);
+  EmitLabelDisplacement(label);
+}
+
+
+void Assembler::Jump(Condition cond, Label *label) {
+  Emit8(0x0F);
+  Emit8(0x80 + Encoding(cond));
+  EmitLabelDisplacement(label);
+}
+
+
+void Assembler::Jump(Register target) {
+  EmitRex(false, 0, Encoding(target), false);
+  Emit8(0xFF);
+  EmitRegisterOperand(4, Encoding(target));
+}
+
+
+// Bind a jump table. The table is padded with `INT3`s so that its entries are
+// aligned, and the padding is never executed.
+void Assembler::BindJumpTable(Label *table, Vector<unsigned> &targets) {
+  BindJumpTable(table, targets, 0, targets.Size());
+}
+
+
+void Assembler::BindJumpTable(Label *table, Vector<unsigned> &targets,
+                              unsigned begin, unsigned size) {
+  while (code.Size() % 4) {
+    Emit8(OPCODE_INT3);
+  }
+  Bind(table);
+  for (unsigned i(begin); i < begin + size; ++i) {
+    Emit32(targets.Get(i) - table->offset);
+  }
+}
+
+
+void Assembler::CopyBytes(void) {
+  Emit8(PREFIX_REPE);  // REP MOVSB.
+  Emit8(0xA4);
+}
+
+
+void Assembler::MoveToFloat(FloatRegister dest, Register src) {
+  Emit8(PREFIX_OPERAND_SIZE);  // MOVQ xmm, r64.
+  EmitRex(true, Encoding(dest), Encoding(src), false);
+  Emit8(0x0F);
+  Emit8(0x6E);
+  EmitRegisterOperand(Encoding(dest), Encoding(src));
+}
+
+
+void Assembler::MoveFromFloat(Register dest, FloatRegister src) {
+  Emit8(PREFIX_OPERAND_SIZE);  // MOVQ r64, xmm.
+  EmitRex(true, Encoding(src), Encoding(dest), false);
+  Emit8(0x0F);
+  Emit8(0x7E);
+  EmitRegisterOperand(Encoding(src), Encoding(dest));
+}
+
+
+void Assembler::FloatArithmetic(FloatOperation op, FloatRegister dest,
+                                FloatRegister src, bool is_double) {
+  Emit8(is_double ? PREFIX_REPNE : PREFIX_REPE);
+  EmitRex(false, Encoding(dest), Encoding(src), false);
+  Emit8(0x0F);
+  Emit8(static_cast<unsigned>(op));
+  EmitRegisterOperand(Encoding(dest), Encoding(src));
+}
+
+
+// Compare two floating point values (UCOMISS or UCOMISD). The result is
+// reported in `ZF`, `PF`, and `CF`, as with an unsigned comparison. `PF` is
+// set if either value is NaN.
+void Assembler::FloatCompare(FloatRegister a, FloatRegister b,
+                             bool is_double) {
+  if (is_double) {
+    Emit8(PREFIX_OPERAND_SIZE);
+  }
+  EmitRex(false, Encoding(a), Encoding(b), false);
+  Emit8(0x0F);
+  Emit8(0x2E);
+  EmitRegisterOperand(Encoding(a), Encoding(b));
+}
+
+
+void Assembler::ConvertIntegerToFloat(FloatRegister dest, Register src,
+                                      bool is_double) {
+  Emit8(is_double ? PREFIX_REPNE : PREFIX_REPE);  // CVTSI2SD or CVTSI2SS.
+  EmitRex(true, Encoding(dest), Encoding(src), false);
+  Emit8(0x0F);
+  Emit8(0x2A);
+  EmitRegisterOperand(Encoding(dest), Encoding(src));
+}
+
+
+void Assembler::ConvertFloatToInteger(Register dest, FloatRegister src,
+                                      bool is_double) {
+  Emit8(is_double ? PREFIX_REPNE : PREFIX_REPE);  // CVTTSD2SI or CVTTSS2SI.
+  EmitRex(true, Encoding(dest), Encoding(src), false);
+  Emit8(0x0F);
+  Emit8(0x2C);
+  EmitRegisterOperand(Encoding(dest), Encoding(src));
+}
+
+
+void Assembler::ConvertFloatToFloat(FloatRegister dest, FloatRegister src,
+                                    bool to_double) {
+  Emit8(to_double ? PREFIX_REPE : PREFIX_REPNE);  // CVTSS2SD or CVTSD2SS.
+  EmitRex(false, Encoding(dest), Encoding(src), false);
+  Emit8(0x0F);
+  Emit8(0x5A);
+  EmitRegisterOperand(Encoding(dest), Encoding(src));
+}
+
+}  // namespace x86_64
+}  // namespace pjit
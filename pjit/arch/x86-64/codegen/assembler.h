@@ -0,0 +1,194 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * assembler.h
+ *
+ *  Created on: 2014-01-08
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_ARCH_X86_64_CODEGEN_ASSEMBLER_H_
+#define PJIT_ARCH_X86_64_CODEGEN_ASSEMBLER_H_
+
+#include "pjit/base/base.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/containers/vector.h"
+
+namespace pjit {
+namespace x86_64 {
+
+
+// General-purpose registers, numbered according to their encodings.
+enum class Register : unsigned {
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+
+// SSE registers.
+enum class FloatRegister : unsigned {
+  XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7
+};
+
+
+// Condition codes, numbered according to their encodings.
+enum class Condition : unsigned {
+  CC_O, CC_NO, CC_B, CC_AE, CC_E, CC_NE, CC_BE, CC_A,
+  CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_GE, CC_LE, CC_G
+};
+
+
+// Two-operand integer arithmetic instructions of the form `op r/m64, r64`,
+// identified by their opcodes.
+enum class ArithmeticOperation : unsigned {
+  ADD = 0x01,
+  OR = 0x09,
+  AND = 0x21,
+  SUB = 0x29,
+  XOR = 0x31,
+  CMP = 0x39
+};
+
+
+// Scalar SSE arithmetic instructions, identified by their opcodes.
+enum class FloatOperation : unsigned {
+  ADD = 0x58,
+  MUL = 0x59,
+  SUB = 0x5C,
+  DIV = 0x5E
+};
+
+
+// A location in the code that can be the target of a jump. Jumps to a label
+// that has not yet been bound are chained together through their (not yet
+// resolved) displacements, and are resolved when the label is bound.
+class Label {
+ public:
+  Label(void)
+      : offset(0),
+        is_bound(false),
+        last_use(NO_USE) {}
+
+ private:
+  friend class Assembler;
+
+  enum : unsigned {
+    NO_USE = ~0U
+  };
+
+  unsigned offset;
+  bool is_bound;
+
+  // Offset of the displacement of the most recent unresolved jump to this
+  // label.
+  unsigned last_use;
+
+  PJIT_DISALLOW_COPY_AND_ASSIGN(Label);
+};
+
+
+// Encodes x86-64 instructions into a growable buffer of bytes.
+//
+// Memory operands are always of the form `[base + disp32]`. Loads and stores
+// take the access size in bytes (1, 2, 4, or 8).
+class Assembler {
+ public:
+  Assembler(void) = default;
+
+  // Number of bytes of code emitted so far.
+  inline unsigned Size(void) const {
+    return code.Size();
+  }
+
+  // Copy the emitted code into `dest`, which must have room for `Size()`
+  // bytes.
+  void CopyTo(U8 *dest) const;
+
+  void Bind(Label *label);
+
+  void Move(Register dest, Register src);
+  void MoveImmediate(Register dest, U64 imm);
+
+  void Load(Register dest, Register base, S32 disp, unsigned size,
+            bool sign_extend);
+  void Store(Register base, S32 disp, Register src, unsigned size);
+  void LoadAddress(Register dest, Register base, S32 disp);
+
+  // Load the address of `label` into `dest`.
+  void LoadLabelAddress(Register dest, Label *label);
+
+  // Load the 32-bit entry `[table + index * 4]` of a jump table into `dest`,
+  // sign-extended to 64 bits.
+  void LoadTableEntry(Register dest, Register table, Register index);
+
+  // Sign- or zero-extend the low `size` bytes of `reg` into all of `reg`.
+  void Extend(Register reg, unsigned size, bool sign_extend);
+
+  void Arithmetic(ArithmeticOperation op, Register dest, Register src);
+  void Test(Register a, Register b);
+
+  // Set the carry flag to bit `index` (modulo 64) of `bits`.
+  void BitTest(Register bits, Register index);
+  void Multiply(Register dest, Register src);
+  void Divide(Register divisor, bool is_signed);
+  void Not(Register reg);
+
+  // Set `dest` to 1 if the condition holds, and to 0 otherwise.
+  void Set(Condition cond, Register dest);
+
+  void Push(Register reg);
+  void Pop(Register reg);
+  void Call(Register target);
+  void Return(void);
+
+  void Jump(Label *label);
+  void Jump(Condition cond, Label *label);
+  void Jump(Register target);
+
+  // Bind `table` to a 4-byte aligned table of 32-bit entries, one per entry
+  // of `targets`. Each entry is the offset of its target in the code relative
+  // to the beginning of the table.
+  void BindJumpTable(Label *table, Vector<unsigned> &targets);
+
+  // Bind `table` to the `size` entries of `targets` starting at `begin`.
+  void BindJumpTable(Label *table, Vector<unsigned> &targets, unsigned begin,
+                     unsigned size);
+
+  // Copy `RCX` bytes from `[RSI]` to `[RDI]`.
+  void CopyBytes(void);
+
+  void MoveToFloat(FloatRegister dest, Register src);
+  void MoveFromFloat(Register dest, FloatRegister src);
+  void FloatArithmetic(FloatOperation op, FloatRegister dest,
+                       FloatRegister src, bool is_double);
+  void FloatCompare(FloatRegister a, FloatRegister b, bool is_double);
+  void ConvertIntegerToFloat(FloatRegister dest, Register src,
+                             bool is_double);
+  void ConvertFloatToInteger(Register dest, FloatRegister src,
+                             bool is_double);
+  void ConvertFloatToFloat(FloatRegister dest, FloatRegister src,
+                           bool to_double);
+
+ private:
+  Vector<U8> code;
+
+  inline void Emit8(unsigned byte) {
+    code.PushBack(static_cast<U8>(byte));
+  }
+
+  void Emit32(U32 val);
+  void Emit64(U64 val);
+  void Patch32(unsigned offset, U32 val);
+  U32 Read32(unsigned offset);
+
+  void EmitRex(bool is_64_bit, unsigned reg, unsigned base, bool force);
+  void EmitRegisterOperand(unsigned reg, unsigned rm);
+  void EmitMemoryOperand(unsigned reg, Register base, S32 disp);
+  void EmitLabelDisplacement(Label *label);
+
+  PJIT_DISALLOW_COPY_AND_ASSIGN(Assembler);
+};
+
+}  // namespace x86_64
+}  // namespace pjit
+
+#endif  // PJIT_ARCH_X86_64_CODEGEN_ASSEMBLER_H_
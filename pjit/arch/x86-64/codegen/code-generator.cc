@@ -0,0 +1,1524 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * code-generator.cc
+ *
+ *  Created on: 2014-01-08
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/arch/x86-64/codegen/code-generator.h"
+
+#include "pjit/base/memory.h"
+#include "pjit/base/type-info.h"
+#include "pjit/base/unsafe-cast.h"
+#include "pjit/mir/context.h"
+#include "pjit/mir/instruction.h"
+#include "pjit/mir/symbol.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/cfg/sequential.h"
+#include "pjit/mir/cfg/conditional.h"
+#include "pjit/mir/cfg/multi-way-branch.h"
+#include "pjit/mir/cfg/loop.h"
+
+namespace pjit {
+namespace x86_64 {
+
+enum : unsigned {
+  FRAME_SLOT_SIZE = 8,
+
+  // Limits on the jump table of a dispatching multi-way branch. The table
+  // may have at most `JUMP_TABLE_SPARSENESS` entries per arm.
+  MAX_JUMP_TABLE_SIZE = 1024,
+  JUMP_TABLE_SPARSENESS = 4,
+  NO_TARGET = ~0U,
+
+  // Maximum number of instructions of the fetch / decode code that is
+  // replicated by every `OP_NEXT`.
+  MAX_NUM_REPLICATED_INSTRUCTIONS = 32,
+
+  // Limits on the lowering of the other multi-way branches. A range of cases
+  // is clustered into a set of bit tests if it spans fewer than
+  // `MAX_BIT_TEST_SPAN` values that go to at most `MAX_BIT_TEST_TARGETS`
+  // arms, or into a jump table if it has at least `MIN_SWITCH_TABLE_CASES`
+  // cases and is as dense as the dispatch table. A binary search over the
+  // clusters ends in a chain of comparisons once at most
+  // `MAX_SWITCH_COMPARISONS` single cases remain.
+  MIN_SWITCH_TABLE_CASES = 4,
+  MAX_BIT_TEST_SPAN = 64,
+  MAX_BIT_TEST_TARGETS = 3,
+  MAX_SWITCH_COMPARISONS = 3,
+
+  // Indexes of the labels of a lowered multi-way branch. The label of the
+  // `n`th non-default arm is `SWITCH_FIRST_ARM + n`.
+  SWITCH_DEFAULT = 0,
+  SWITCH_JOIN = 1,
+  SWITCH_FIRST_ARM = 2
+};
+
+// Minimum number of cases that make bit tests with a given number of targets
+// cheaper than comparisons.
+static const unsigned kMinBitTestCases[MAX_BIT_TEST_TARGETS + 1] = {
+  0, 3, 5, 6
+};
+
+// Callee-saved registers that might be used by the generated code. `RBX`
+// always holds the frame.
+static const Register kPreservedRegisters[] = {
+  Register::RBX, Register::RBP, Register::R12, Register::R13, Register::R14,
+  Register::R15
+};
+
+
+// Returns true if values of type `type` fit into a general-purpose register.
+static bool IsScalar(const TypeInfo *type) {
+  switch (type->kind) {
+    case TypeKind::TYPE_KIND_POINTER:
+    case TypeKind::TYPE_KIND_INTEGER:
+    case TypeKind::TYPE_KIND_BOOLEAN:
+    case TypeKind::TYPE_KIND_FLOATING_POINT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+static bool IsFloat(const TypeInfo *type) {
+  return TypeKind::TYPE_KIND_FLOATING_POINT == type->kind;
+}
+
+
+static bool IsDouble(const TypeInfo *type) {
+  return IsFloat(type) && 8 == type->size_in_bytes;
+}
+
+
+static bool IsSigned(const TypeInfo *type) {
+  return TypeKind::TYPE_KIND_INTEGER == type->kind &&
+         UnsafeCast<const IntegerTypeInfo *>(type)->is_signed;
+}
+
+
+// Compare two values of the type `type` that have been extended to 64 bits.
+static bool IsLessThan(U64 a, U64 b, const TypeInfo *type) {
+  if (IsSigned(type)) {
+    return static_cast<S64>(a) < static_cast<S64>(b);
+  }
+  return a < b;
+}
+
+
+// Returns the value of a constant symbol, sign- or zero-extended to 64 bits.
+// Floating point values are returned as their bit patterns.
+static U64 ConstantValue(const mir::Symbol *sym) {
+  const TypeInfo *type(sym->type);
+  if (TypeKind::TYPE_KIND_POINTER == type->kind) {
+    return UnsafeCast<U64>(sym->value.pointer);
+  }
+
+  const bool is_signed(IsSigned(type));
+  switch (type->size_in_bytes) {
+    case 1:
+      if (TypeKind::TYPE_KIND_BOOLEAN == type->kind) {
+        return 0 != sym->value.u8;
+      }
+      return is_signed ? static_cast<U64>(sym->value.s8) : sym->value.u8;
+    case 2:
+      return is_signed ? static_cast<U64>(sym->value.s16) : sym->value.u16;
+    case 4:
+      return is_signed ? static_cast<U64>(sym->value.s32) : sym->value.u32;
+    default:
+      return sym->value.u64;
+  }
+}
+
+
+// Count the instructions of a basic block, and find out if any of them is an
+// `OP_NEXT`.
+static unsigned CountInstructions(const mir::BasicBlock *bb, bool *has_next) {
+  unsigned num_instructions(0);
+  for (const mir::Instruction *in(bb->first); nullptr != in; in = in->next) {
+    if (mir::Operation::OP_NEXT == in->operation) {
+      *has_next = true;
+    }
+    ++num_instructions;
+  }
+  return num_instructions;
+}
+
+
+CompiledCode::CompiledCode(void)
+    : code(nullptr),
+      num_pages(0),
+      cache(nullptr),
+      cache_generation(0),
+      code_size(0),
+      entry_point(nullptr),
+      frame_size(0) {}
+
+
+CompiledCode::~CompiledCode(void) {
+  Reset();
+}
+
+
+// Get the offset of a symbol within the frame.
+bool CompiledCode::GetFrameOffset(const mir::Symbol *sym, unsigned *offset) {
+  if (!sym->id || sym->id >= frame_slots.Size()) {
+    return false;
+  }
+  const FrameSlot &slot(frame_slots.Get(sym->id));
+  if (!slot.is_allocated) {
+    return false;
+  }
+  *offset = slot.offset;
+  return true;
+}
+
+
+// Release the compiled code. Executable pages are made writable again before
+// being freed, as required by `FreePages`.
+void CompiledCode::Reset(void) {
+  if (code && cache) {
+    cache->Free(code, cache_generation);
+  } else if (code) {
+    ProtectPages(code, num_pages, MemoryProtection::MEMORY_READ_WRITE);
+    FreePages(code, num_pages);
+  }
+  while (frame_slots.Size()) {
+    frame_slots.PopBack();
+  }
+  code = nullptr;
+  num_pages = 0;
+  cache = nullptr;
+  cache_generation = 0;
+  code_size = 0;
+  entry_point = nullptr;
+  frame_size = 0;
+}
+
+
+CodeGenerator::CodeGenerator(mir::Context *context_)
+    : context(context_),
+      compiled(nullptr),
+      dispatch_mbr(nullptr),
+      can_replicate_dispatch(false),
+      dispatch_min_value(0),
+      num_structures(0),
+      is_valid(true),
+      has_assembled(false),
+      is_numbering(false),
+      next_cfg(nullptr) {}
+
+
+// Generate code into `compiled`. The code is first assembled into a buffer,
+// and then copied into freshly allocated pages that are made executable (and
+// therefore read-only) before the code is ever run.
+bool CodeGenerator::Generate(CompiledCode *compiled_) {
+  if (!Assemble(compiled_)) {
+    return false;
+  }
+
+  const unsigned code_size(assembler.Size());
+  const unsigned num_pages(
+      (code_size + PAGE_FRAME_SIZE - 1) / PAGE_FRAME_SIZE);
+  void *code(AllocatePages(num_pages));
+  if (!code) {
+    compiled->Reset();
+    return false;
+  }
+
+  assembler.CopyTo(UnsafeCast<U8 *>(code));
+  ProtectPages(code, num_pages, MemoryProtection::MEMORY_EXECUTABLE);
+
+  compiled->code = code;
+  compiled->num_pages = num_pages;
+  compiled->code_size = code_size;
+  compiled->entry_point = UnsafeCast<CompiledCode::EntryPoint>(code);
+  return true;
+}
+
+
+// Generate code into a region of `cache`.
+bool CodeGenerator::Generate(CompiledCode *compiled_, CodeCache *cache) {
+  if (!Assemble(compiled_)) {
+    return false;
+  }
+
+  const unsigned code_size(assembler.Size());
+  unsigned generation(0);
+  void *code(cache->Allocate(code_size, &generation));
+  if (!code) {
+    compiled->Reset();
+    return false;
+  }
+
+  assembler.CopyTo(UnsafeCast<U8 *>(code));
+
+  compiled->code = code;
+  compiled->cache = cache;
+  compiled->cache_generation = generation;
+  compiled->code_size = code_size;
+  compiled->entry_point = UnsafeCast<CompiledCode::EntryPoint>(code);
+  return true;
+}
+
+
+// Allocate registers, and assemble the code into the assembler's buffer.
+// Nothing is assembled, and `compiled_` is left untouched, if this code
+// generator has already been used.
+bool CodeGenerator::Assemble(CompiledCode *compiled_) {
+  if (has_assembled) {
+    return false;
+  }
+  has_assembled = true;
+  compiled = compiled_;
+  compiled->Reset();
+
+  is_numbering = true;
+  LowerChain(&(context->entry), nullptr);
+  allocator.Allocate();
+  is_numbering = false;
+
+  EmitPrologue();
+  LowerChain(&(context->entry), nullptr);
+  EmitEpilogue();
+  if (dispatch_mbr) {
+    assembler.BindJumpTable(&dispatch_table, dispatch_targets);
+  }
+  for (SwitchTable &table : switch_tables) {
+    assembler.BindJumpTable(&(table.label), switch_table_targets, table.begin,
+                            table.size);
+  }
+
+  if (!is_valid) {
+    compiled->Reset();
+  }
+  return is_valid;
+}
+
+
+// Save the callee-saved registers used by the code, and load the pinned
+// symbols into their registers. `RBX` is callee-saved, and so holds the frame
+// across C calls. An odd number of registers is pushed so that the stack is
+// 16-byte aligned for those calls.
+void CodeGenerator::EmitPrologue(void) {
+  unsigned num_pushes(0);
+  for (Register reg : kPreservedRegisters) {
+    if (Register::RBX == reg || allocator.IsUsed(reg)) {
+      assembler.Push(reg);
+      ++num_pushes;
+    }
+  }
+  if (!(num_pushes % 2)) {
+    assembler.Push(Register::RAX);
+  }
+
+  assembler.Move(Register::RBX, Register::RDI);
+  for (unsigned i(0); i < allocator.NumPinnedSymbols(); ++i) {
+    Register reg(Register::RAX);
+    const mir::Symbol *sym(allocator.GetPinnedSymbol(i, &reg));
+    assembler.Load(reg, Register::RBX, FrameOffset(sym), 8, false);
+  }
+
+  assembler.Bind(&dispatch);
+}
+
+
+// Store the pinned symbols back into the frame, and restore the callee-saved
+// registers.
+void CodeGenerator::EmitEpilogue(void) {
+  unsigned num_pushes(0);
+  for (unsigned i(0); i < allocator.NumPinnedSymbols(); ++i) {
+    Register reg(Register::RAX);
+    const mir::Symbol *sym(allocator.GetPinnedSymbol(i, &reg));
+    assembler.Store(Register::RBX, FrameOffset(sym), reg, 8);
+  }
+
+  for (Register reg : kPreservedRegisters) {
+    if (Register::RBX == reg || allocator.IsUsed(reg)) {
+      ++num_pushes;
+    }
+  }
+  if (!(num_pushes % 2)) {
+    assembler.Pop(Register::RCX);
+  }
+  for (unsigned i(sizeof(kPreservedRegisters) / sizeof(Register)); i-- > 0; ) {
+    const Register reg(kPreservedRegisters[i]);
+    if (Register::RBX == reg || allocator.IsUsed(reg)) {
+      assembler.Pop(reg);
+    }
+  }
+  assembler.Return();
+}
+
+
+// Returns the offset of a symbol within the frame, allocating a new slot for
+// the symbol if it does not yet have one.
+S32 CodeGenerator::FrameOffset(const mir::Symbol *sym) {
+  while (compiled->frame_slots.Size() <= sym->id) {
+    compiled->frame_slots.PushBack(CompiledCode::FrameSlot());
+  }
+
+  CompiledCode::FrameSlot &slot(compiled->frame_slots.Get(sym->id));
+  if (!slot.is_allocated) {
+    unsigned size(FRAME_SLOT_SIZE);
+    if (!IsScalar(sym->type)) {
+      size = (sym->type->size_in_bytes + FRAME_SLOT_SIZE - 1) &
+             ~(FRAME_SLOT_SIZE - 1U);
+    }
+    slot.offset = compiled->frame_size;
+    slot.is_allocated = true;
+    compiled->frame_size += size;
+  }
+  return static_cast<S32>(slot.offset);
+}
+
+
+// Load the (scalar) value of a symbol into a register.
+void CodeGenerator::LoadValue(Register dest, const mir::Symbol *sym) {
+  Register reg(Register::RAX);
+  if (!sym->id) {
+    assembler.MoveImmediate(dest, ConstantValue(sym));
+  } else if (allocator.GetRegister(sym, &reg)) {
+    if (reg != dest) {
+      assembler.Move(dest, reg);
+    }
+  } else {
+    assembler.Load(dest, Register::RBX, FrameOffset(sym), 8, false);
+  }
+}
+
+
+// Store the (scalar) value in a register into the register or frame slot of
+// a symbol.
+void CodeGenerator::StoreValue(const mir::Symbol *sym, Register src) {
+  Register reg(Register::RAX);
+  if (!sym->id) {
+    is_valid = false;
+    return;
+  } else if (allocator.GetRegister(sym, &reg)) {
+    assembler.Move(reg, src);
+    return;
+  }
+  assembler.Store(Register::RBX, FrameOffset(sym), src, 8);
+}
+
+
+// Load the address of the frame slot of a symbol into a register.
+void CodeGenerator::LoadAddress(Register dest, const mir::Symbol *sym) {
+  if (!sym->id) {
+    is_valid = false;
+    return;
+  }
+  assembler.LoadAddress(dest, Register::RBX, FrameOffset(sym));
+}
+
+
+// Load the address of a field into a register. The object is either a pointer
+// to a structure, or is itself a structure that lives in the frame.
+void CodeGenerator::LoadFieldAddress(Register dest, const mir::Symbol *obj,
+                                     const StructureFieldInfo *field) {
+  if (StructureFieldInfo::FIELD_BITFIELD == field->kind) {
+    is_valid = false;
+    return;
+  }
+
+  const S32 offset(static_cast<S32>(field->offset_in_bytes));
+  if (TypeKind::TYPE_KIND_POINTER == obj->type->kind) {
+    LoadValue(dest, obj);
+    if (offset) {
+      assembler.LoadAddress(dest, dest, offset);
+    }
+  } else if (obj->id) {
+    assembler.LoadAddress(dest, Register::RBX, FrameOffset(obj) + offset);
+  } else {
+    is_valid = false;
+  }
+}
+
+
+// Sign- or zero-extend the value in a register according to its type, so that
+// it matches the representation of values of that type in the frame.
+void CodeGenerator::Normalize(Register reg, const TypeInfo *type) {
+  if (TypeKind::TYPE_KIND_POINTER == type->kind) {
+    return;
+  }
+  const unsigned size(type->size_in_bytes);
+  if (8 > size) {
+    assembler.Extend(reg, size, IsSigned(type));
+  }
+}
+
+
+// Copy `size` bytes from `[RSI]` to `[RDI]`.
+void CodeGenerator::CopyAggregate(unsigned size) {
+  assembler.MoveImmediate(Register::RCX, size);
+  assembler.CopyBytes();
+}
+
+
+// Set the zero flag if the value of a symbol is false.
+void CodeGenerator::TestCondition(const mir::Symbol *sym) {
+  if (!sym) {
+    is_valid = false;
+    return;
+  } else if (is_numbering) {
+    NumberUse(sym);
+    return;
+  }
+  LoadValue(Register::RAX, sym);
+  assembler.Test(Register::RAX, Register::RAX);
+}
+
+
+// Lower the successor chain beginning at `cfg` and ending at (but not
+// including) `stop`.
+void CodeGenerator::LowerChain(mir::ControlFlowGraph *cfg,
+                               mir::ControlFlowGraph *stop) {
+  while (cfg != stop) {
+    cfg->DoVisitPreOrder(this);
+    cfg = next_cfg;
+  }
+}
+
+
+void CodeGenerator::LowerBlock(mir::BasicBlock *bb) {
+  if (is_numbering) {
+    allocator.NextBlock();
+    for (mir::Instruction *in(bb->first); nullptr != in; in = in->next) {
+      NumberInstruction(in);
+    }
+  } else {
+    for (mir::Instruction *in(bb->first); nullptr != in; in = in->next) {
+      LowerInstruction(in);
+    }
+  }
+}
+
+
+// Report the references of an instruction to the register allocator.
+void CodeGenerator::NumberInstruction(const mir::Instruction *in) {
+  for (unsigned i(0); i < mir::Instruction::kMaxNumOperands; ++i) {
+    if (mir::OperandKind::OPERAND_USE == GetOperandKind(in->operation, i)) {
+      allocator.AddUse(in->operands[i].symbol);
+    }
+  }
+  switch (in->operation) {
+    case mir::Operation::OP_CCALL1:
+    case mir::Operation::OP_CCALL2:
+    case mir::Operation::OP_CCALL3:
+      allocator.AddCall();
+      break;
+    default:
+      break;
+  }
+  allocator.AddDefinition(in->GetDefinition());
+  if (mir::Operation::OP_ASSIGN == in->operation) {
+    allocator.AddCopy(in->operands[0].symbol, in->operands[1].symbol);
+  }
+  allocator.NextInstruction();
+}
+
+
+void CodeGenerator::NumberUse(const mir::Symbol *sym) {
+  allocator.AddUse(sym);
+  allocator.NextInstruction();
+}
+
+
+void CodeGenerator::LowerInstruction(const mir::Instruction *in) {
+  const mir::Symbol *dest(in->operands[0].symbol);
+  switch (in->operation) {
+    case mir::Operation::OP_ADD:
+    case mir::Operation::OP_SUBTRACT:
+    case mir::Operation::OP_MULTIPLY:
+    case mir::Operation::OP_DIVIDE:
+    case mir::Operation::OP_BITWISE_XOR:
+    case mir::Operation::OP_BITWISE_OR:
+    case mir::Operation::OP_BITWISE_AND:
+    case mir::Operation::OP_LOGICAL_OR:
+    case mir::Operation::OP_LOGICAL_AND:
+      LowerBinary(in);
+      break;
+
+    case mir::Operation::OP_COMPARE_EQ:
+    case mir::Operation::OP_COMPARE_NE:
+    case mir::Operation::OP_COMPARE_LT:
+    case mir::Operation::OP_COMPARE_LTE:
+    case mir::Operation::OP_COMPARE_GT:
+    case mir::Operation::OP_COMPARE_GTE:
+      LowerCompare(in);
+      break;
+
+    case mir::Operation::OP_BITWISE_NOT:
+      LoadValue(Register::RAX, in->operands[1].symbol);
+      assembler.Not(Register::RAX);
+      Normalize(Register::RAX, dest->type);
+      StoreValue(dest, Register::RAX);
+      break;
+
+    case mir::Operation::OP_LOGICAL_NOT:
+      LoadValue(Register::RAX, in->operands[1].symbol);
+      assembler.Test(Register::RAX, Register::RAX);
+      assembler.Set(Condition::CC_E, Register::RAX);
+      StoreValue(dest, Register::RAX);
+      break;
+
+    case mir::Operation::OP_LOAD_MEMORY:
+      LoadValue(Register::RAX, in->operands[1].symbol);
+      LowerLoad(dest, dest->type);
+      break;
+
+    case mir::Operation::OP_STORE_MEMORY:
+      LoadValue(Register::RAX, in->operands[0].symbol);
+      LowerStore(in->operands[1].symbol, in->operands[1].symbol->type);
+      break;
+
+    case mir::Operation::OP_LOAD_FIELD:
+      LoadFieldAddress(Register::RAX, in->operands[1].symbol,
+                       in->operands[2].field);
+      LowerLoad(dest, in->operands[2].field->type);
+      break;
+
+    case mir::Operation::OP_STORE_FIELD:
+      LoadFieldAddress(Register::RAX, in->operands[0].symbol,
+                       in->operands[1].field);
+      LowerStore(in->operands[2].symbol, in->operands[1].field->type);
+      break;
+
+    case mir::Operation::OP_CONVERT_TYPE:
+      LowerConvert(in);
+      break;
+
+    case mir::Operation::OP_ASSIGN: {
+      const mir::Symbol *src(in->operands[1].symbol);
+      Register reg(Register::RAX);
+      if (IsScalar(dest->type) && allocator.GetRegister(dest, &reg)) {
+        LoadValue(reg, src);  // Nothing is emitted if `src` is also in `reg`.
+      } else if (IsScalar(dest->type)) {
+        LoadValue(Register::RAX, src);
+        StoreValue(dest, Register::RAX);
+      } else {
+        LoadAddress(Register::RSI, src);
+        LoadAddress(Register::RDI, dest);
+        CopyAggregate(dest->type->size_in_bytes);
+      }
+      break;
+    }
+
+    case mir::Operation::OP_CCALL1:
+      LowerCall(in, 1);
+      break;
+    case mir::Operation::OP_CCALL2:
+      LowerCall(in, 2);
+      break;
+    case mir::Operation::OP_CCALL3:
+      LowerCall(in, 3);
+      break;
+
+    case mir::Operation::OP_NEXT:
+      if (can_replicate_dispatch) {
+        EmitReplicatedDispatch();
+      } else {
+        assembler.Jump(&dispatch);
+      }
+      break;
+
+    // The MIR must be taken out of SSA form before code is generated.
+    case mir::Operation::OP_PHI:
+      is_valid = false;
+      break;
+  }
+}
+
+
+// Lower an arithmetic, bitwise, or logical operator.
+void CodeGenerator::LowerBinary(const mir::Instruction *in) {
+  const mir::Symbol *dest(in->operands[0].symbol);
+  if (IsFloat(dest->type)) {
+    LowerFloatBinary(in);
+    return;
+  }
+
+  LoadValue(Register::RAX, in->operands[1].symbol);
+  LoadValue(Register::RCX, in->operands[2].symbol);
+
+  // As in C, adding an integer to (or subtracting an integer from) a pointer
+  // moves the pointer by a number of elements. The HIR converts the integer
+  // to the pointer's type, so it is the right operand that is scaled. Constant
+  // operands (e.g. pointer increments) are scaled ahead of time.
+  if (TypeKind::TYPE_KIND_POINTER == dest->type->kind &&
+      (mir::Operation::OP_ADD == in->operation ||
+       mir::Operation::OP_SUBTRACT == in->operation)) {
+    const TypeInfo *elem_type(
+        UnsafeCast<const PointerTypeInfo *>(dest->type)->pointed_to_type);
+    const mir::Symbol *right(in->operands[2].symbol);
+    if (elem_type && 1 < elem_type->size_in_bytes) {
+      if (!right->id) {
+        assembler.MoveImmediate(
+            Register::RCX, ConstantValue(right) * elem_type->size_in_bytes);
+      } else {
+        assembler.MoveImmediate(Register::RDX, elem_type->size_in_bytes);
+        assembler.Multiply(Register::RCX, Register::RDX);
+      }
+    }
+  }
+
+  switch (in->operation) {
+    case mir::Operation::OP_ADD:
+      assembler.Arithmetic(
+          ArithmeticOperation::ADD, Register::RAX, Register::RCX);
+      break;
+    case mir::Operation::OP_SUBTRACT:
+      assembler.Arithmetic(
+          ArithmeticOperation::SUB, Register::RAX, Register::RCX);
+      break;
+    case mir::Operation::OP_MULTIPLY:
+      assembler.Multiply(Register::RAX, Register::RCX);
+      break;
+    case mir::Operation::OP_DIVIDE:
+      assembler.Divide(Register::RCX, IsSigned(dest->type));
+      break;
+    case mir::Operation::OP_BITWISE_XOR:
+      assembler.Arithmetic(
+          ArithmeticOperation::XOR, Register::RAX, Register::RCX);
+      break;
+    case mir::Operation::OP_BITWISE_OR:
+      assembler.Arithmetic(
+          ArithmeticOperation::OR, Register::RAX, Register::RCX);
+      break;
+    case mir::Operation::OP_BITWISE_AND:
+      assembler.Arithmetic(
+          ArithmeticOperation::AND, Register::RAX, Register::RCX);
+      break;
+
+    // Both operands are reduced to 0 or 1 before being combined.
+    case mir::Operation::OP_LOGICAL_OR:
+    case mir::Operation::OP_LOGICAL_AND:
+      assembler.Test(Register::RAX, Register::RAX);
+      assembler.Set(Condition::CC_NE, Register::RAX);
+      assembler.Test(Register::RCX, Register::RCX);
+      assembler.Set(Condition::CC_NE, Register::RCX);
+      assembler.Arithmetic(
+          mir::Operation::OP_LOGICAL_OR == in->operation ?
+              ArithmeticOperation::OR : ArithmeticOperation::AND,
+          Register::RAX, Register::RCX);
+      break;
+
+    default:
+      is_valid = false;
+      return;
+  }
+
+  Normalize(Register::RAX, dest->type);
+  StoreValue(dest, Register::RAX);
+}
+
+
+// Lower a floating point arithmetic operator.
+void CodeGenerator::LowerFloatBinary(const mir::Instruction *in) {
+  const mir::Symbol *dest(in->operands[0].symbol);
+  FloatOperation op(FloatOperation::ADD);
+  switch (in->operation) {
+    case mir::Operation::OP_ADD: op = FloatOperation::ADD; break;
+    case mir::Operation::OP_SUBTRACT: op = FloatOperation::SUB; break;
+    case mir::Operation::OP_MULTIPLY: op = FloatOperation::MUL; break;
+    case mir::Operation::OP_DIVIDE: op = FloatOperation::DIV; break;
+    default:
+      is_valid = false;
+      return;
+  }
+
+  LoadValue(Register::RAX, in->operands[1].symbol);
+  LoadValue(Register::RCX, in->operands[2].symbol);
+  assembler.MoveToFloat(FloatRegister::XMM0, Register::RAX);
+  assembler.MoveToFloat(FloatRegister::XMM1, Register::RCX);
+  assembler.FloatArithmetic(
+      op, FloatRegister::XMM0, FloatRegister::XMM1, IsDouble(dest->type));
+  assembler.MoveFromFloat(Register::RAX, FloatRegister::XMM0);
+  Normalize(Register::RAX, dest->type);
+  StoreValue(dest, Register::RAX);
+}
+
+
+// Lower a comparison operator. The signedness of an integer comparison is
+// determined by the type of the left operand.
+void CodeGenerator::LowerCompare(const mir::Instruction *in) {
+  const mir::Symbol *dest(in->operands[0].symbol);
+  const mir::Symbol *left(in->operands[1].symbol);
+  LoadValue(Register::RAX, left);
+  LoadValue(Register::RCX, in->operands[2].symbol);
+
+  if (IsFloat(left->type)) {
+    const bool is_double(IsDouble(left->type));
+    assembler.MoveToFloat(FloatRegister::XMM0, Register::RAX);
+    assembler.MoveToFloat(FloatRegister::XMM1, Register::RCX);
+
+    // Unordered comparisons set the parity flag. `CC_A` and `CC_AE` are false
+    // for unordered operands, so `<` and `<=` are computed by swapping the
+    // operands of `>` and `>=`.
+    switch (in->operation) {
+      case mir::Operation::OP_COMPARE_EQ:
+      case mir::Operation::OP_COMPARE_NE: {
+        const bool is_eq(mir::Operation::OP_COMPARE_EQ == in->operation);
+        assembler.FloatCompare(
+            FloatRegister::XMM0, FloatRegister::XMM1, is_double);
+        assembler.Set(is_eq ? Condition::CC_E : Condition::CC_NE,
+                      Register::RAX);
+        assembler.Set(is_eq ? Condition::CC_NP : Condition::CC_P,
+                      Register::RCX);
+        assembler.Arithmetic(
+            is_eq ? ArithmeticOperation::AND : ArithmeticOperation::OR,
+            Register::RAX, Register::RCX);
+        break;
+      }
+      case mir::Operation::OP_COMPARE_LT:
+      case mir::Operation::OP_COMPARE_LTE:
+        assembler.FloatCompare(
+            FloatRegister::XMM1, FloatRegister::XMM0, is_double);
+        assembler.Set(
+            mir::Operation::OP_COMPARE_LT == in->operation ?
+                Condition::CC_A : Condition::CC_AE,
+            Register::RAX);
+        break;
+      case mir::Operation::OP_COMPARE_GT:
+      case mir::Operation::OP_COMPARE_GTE:
+        assembler.FloatCompare(
+            FloatRegister::XMM0, FloatRegister::XMM1, is_double);
+        assembler.Set(
+            mir::Operation::OP_COMPARE_GT == in->operation ?
+                Condition::CC_A : Condition::CC_AE,
+            Register::RAX);
+        break;
+      default:
+        is_valid = false;
+        return;
+    }
+  } else {
+    const bool is_signed(IsSigned(left->type));
+    Condition cond(Condition::CC_E);
+    switch (in->operation) {
+      case mir::Operation::OP_COMPARE_EQ:
+        cond = Condition::CC_E;
+        break;
+      case mir::Operation::OP_COMPARE_NE:
+        cond = Condition::CC_NE;
+        break;
+      case mir::Operation::OP_COMPARE_LT:
+        cond = is_signed ? Condition::CC_L : Condition::CC_B;
+        break;
+      case mir::Operation::OP_COMPARE_LTE:
+        cond = is_signed ? Condition::CC_LE : Condition::CC_BE;
+        break;
+      case mir::Operation::OP_COMPARE_GT:
+        cond = is_signed ? Condition::CC_G : Condition::CC_A;
+        break;
+      case mir::Operation::OP_COMPARE_GTE:
+        cond = is_signed ? Condition::CC_GE : Condition::CC_AE;
+        break;
+      default:
+        is_valid = false;
+        return;
+    }
+    assembler.Arithmetic(
+        ArithmeticOperation::CMP, Register::RAX, Register::RCX);
+    assembler.Set(cond, Register::RAX);
+  }
+
+  StoreValue(dest, Register::RAX);
+}
+
+
+// Lower a conversion between two scalar types.
+void CodeGenerator::LowerConvert(const mir::Instruction *in) {
+  const mir::Symbol *dest(in->operands[0].symbol);
+  const mir::Symbol *src(in->operands[1].symbol);
+  const TypeInfo *to_type(dest->type);
+  const TypeInfo *from_type(src->type);
+
+  if (!IsScalar(to_type) || !IsScalar(from_type)) {
+    is_valid = false;
+    return;
+  }
+
+  LoadValue(Register::RAX, src);
+
+  if (IsFloat(from_type) && IsFloat(to_type)) {
+    if (from_type->size_in_bytes != to_type->size_in_bytes) {
+      assembler.MoveToFloat(FloatRegister::XMM0, Register::RAX);
+      assembler.ConvertFloatToFloat(
+          FloatRegister::XMM0, FloatRegister::XMM0, IsDouble(to_type));
+      assembler.MoveFromFloat(Register::RAX, FloatRegister::XMM0);
+      Normalize(Register::RAX, to_type);
+    }
+
+  } else if (IsFloat(to_type)) {
+    assembler.ConvertIntegerToFloat(
+        FloatRegister::XMM0, Register::RAX, IsDouble(to_type));
+    assembler.MoveFromFloat(Register::RAX, FloatRegister::XMM0);
+    Normalize(Register::RAX, to_type);
+
+  } else if (IsFloat(from_type)) {
+    if (TypeKind::TYPE_KIND_BOOLEAN == to_type->kind) {
+      is_valid = false;
+      return;
+    }
+    assembler.MoveToFloat(FloatRegister::XMM0, Register::RAX);
+    assembler.ConvertFloatToInteger(
+        Register::RAX, FloatRegister::XMM0, IsDouble(from_type));
+    Normalize(Register::RAX, to_type);
+
+  } else if (TypeKind::TYPE_KIND_BOOLEAN == to_type->kind) {
+    assembler.Test(Register::RAX, Register::RAX);
+    assembler.Set(Condition::CC_NE, Register::RAX);
+
+  } else {
+    Normalize(Register::RAX, to_type);
+  }
+
+  StoreValue(dest, Register::RAX);
+}
+
+
+// Load a value of type `type` from the address in `RAX` into `dest`.
+void CodeGenerator::LowerLoad(const mir::Symbol *dest, const TypeInfo *type) {
+  if (IsScalar(type)) {
+    assembler.Load(Register::RCX, Register::RAX, 0, type->size_in_bytes,
+                   IsSigned(type));
+    StoreValue(dest, Register::RCX);
+  } else {
+    assembler.Move(Register::RSI, Register::RAX);
+    LoadAddress(Register::RDI, dest);
+    CopyAggregate(type->size_in_bytes);
+  }
+}
+
+
+// Store the value of `src`, which has type `type`, to the address in `RAX`.
+void CodeGenerator::LowerStore(const mir::Symbol *src, const TypeInfo *type) {
+  if (IsScalar(type)) {
+    LoadValue(Register::RCX, src);
+    assembler.Store(Register::RAX, 0, Register::RCX, type->size_in_bytes);
+  } else {
+    assembler.Move(Register::RDI, Register::RAX);
+    LoadAddress(Register::RSI, src);
+    CopyAggregate(type->size_in_bytes);
+  }
+}
+
+
+// Lower a call to a C function. Operand 0 is the function, and the remaining
+// operands are passed as arguments according to the System V ABI.
+void CodeGenerator::LowerCall(const mir::Instruction *in,
+                              unsigned num_operands) {
+  static const Register kArgumentRegisters[] = {
+    Register::RDI, Register::RSI
+  };
+
+  for (unsigned i(1); i < num_operands; ++i) {
+    const mir::Symbol *arg(in->operands[i].symbol);
+    if (!IsScalar(arg->type) || IsFloat(arg->type)) {
+      is_valid = false;
+      return;
+    }
+    LoadValue(kArgumentRegisters[i - 1], arg);
+  }
+  LoadValue(Register::RAX, in->operands[0].symbol);
+  assembler.Call(Register::RAX);
+}
+
+
+void CodeGenerator::VisitPreOrder(mir::SequentialControlFlowGraph *cfg) {
+  if (is_numbering && !num_structures) {
+    dispatch_prefix.PushBack(&(cfg->bb));
+  }
+  LowerBlock(&(cfg->bb));
+  next_cfg = cfg->successor;
+}
+
+
+void CodeGenerator::VisitPreOrder(mir::ConditionalControlFlowGraph *cfg) {
+  if (is_numbering) {
+    ++num_structures;
+    LowerBlock(&(cfg->condition.bb));
+    TestCondition(cfg->conditional_value);
+    LowerChain(&(cfg->if_true), cfg->successor);
+    LowerChain(&(cfg->if_false), cfg->successor);
+    next_cfg = cfg->successor;
+    return;
+  }
+
+  Label if_false;
+  Label join;
+
+  LowerBlock(&(cfg->condition.bb));
+  TestCondition(cfg->conditional_value);
+  assembler.Jump(Condition::CC_E, &if_false);
+  LowerChain(&(cfg->if_true), cfg->successor);
+  assembler.Jump(&join);
+  assembler.Bind(&if_false);
+  LowerChain(&(cfg->if_false), cfg->successor);
+  assembler.Bind(&join);
+
+  next_cfg = cfg->successor;
+}
+
+
+// Multi-way branches whose arms are integer constants are lowered into a
+// search over the sorted values of the arms, and the others into a chain of
+// comparisons, one per arm. The default arm (if any) is tested last. The
+// dispatching multi-way branch is instead lowered into a jump table.
+void CodeGenerator::VisitPreOrder(mir::MultiWayBranchControlFlowGraph *cfg) {
+  if (is_numbering && !num_structures++) {
+    ChooseDispatch(cfg);
+  }
+  if (cfg == dispatch_mbr) {
+    LowerDispatch(cfg);
+    next_cfg = cfg->successor;
+    return;
+  }
+
+  Label join;
+
+  LowerBlock(&(cfg->condition.bb));
+  if (!cfg->conditional_value) {
+    is_valid = false;
+  }
+
+  Vector<SwitchCase> cases;
+  if (is_valid && CollectSwitchCases(cfg, cases)) {
+    LowerSwitch(cfg, cases);
+    next_cfg = cfg->successor;
+    return;
+  }
+
+  for (mir::MultiWayBranchArm *arm(cfg->arms); nullptr != arm;
+       arm = arm->next) {
+    if (arm == cfg->default_arm || !is_valid) {
+      continue;
+    } else if (is_numbering) {
+      allocator.AddUse(cfg->conditional_value);
+      NumberUse(arm->value);
+      LowerChain(&(arm->if_true), cfg->successor);
+      continue;
+    }
+    Label next_arm;
+    LoadValue(Register::RAX, cfg->conditional_value);
+    LoadValue(Register::RCX, arm->value);
+    assembler.Arithmetic(
+        ArithmeticOperation::CMP, Register::RAX, Register::RCX);
+    assembler.Jump(Condition::CC_NE, &next_arm);
+    LowerChain(&(arm->if_true), cfg->successor);
+    assembler.Jump(&join);
+    assembler.Bind(&next_arm);
+  }
+
+  if (cfg->default_arm) {
+    LowerChain(&(cfg->default_arm->if_true), cfg->successor);
+  }
+  assembler.Bind(&join);
+
+  next_cfg = cfg->successor;
+}
+
+
+// Decide whether or not the multi-way branch `cfg`, which is the first
+// structured control-flow graph of the MIR, decodes opcodes. It does if it
+// branches on an integer, and if its arms are integer constants that are
+// dense enough to make a reasonably sized jump table.
+void CodeGenerator::ChooseDispatch(mir::MultiWayBranchControlFlowGraph *cfg) {
+  const mir::Symbol *value(cfg->conditional_value);
+  if (!value || !IsScalar(value->type) || IsFloat(value->type)) {
+    return;
+  }
+
+  U64 min_value(0);
+  U64 max_value(0);
+  unsigned num_arms(0);
+  for (const mir::MultiWayBranchArm *arm(cfg->arms); nullptr != arm;
+       arm = arm->next) {
+    if (arm == cfg->default_arm) {
+      continue;
+    } else if (!arm->value || arm->value->id || !IsScalar(arm->value->type) ||
+               IsFloat(arm->value->type)) {
+      return;
+    }
+    const U64 arm_value(ConstantValue(arm->value));
+    if (!num_arms++) {
+      min_value = arm_value;
+      max_value = arm_value;
+    } else if (IsLessThan(arm_value, min_value, value->type)) {
+      min_value = arm_value;
+    } else if (IsLessThan(max_value, arm_value, value->type)) {
+      max_value = arm_value;
+    }
+  }
+
+  const U64 max_index(max_value - min_value);
+  if (!num_arms || MAX_JUMP_TABLE_SIZE <= max_index ||
+      (num_arms * JUMP_TABLE_SPARSENESS) <= max_index) {
+    return;
+  }
+
+  dispatch_prefix.PushBack(&(cfg->condition.bb));
+  unsigned num_instructions(0);
+  bool has_next(false);
+  for (const mir::BasicBlock *bb : dispatch_prefix) {
+    num_instructions += CountInstructions(bb, &has_next);
+  }
+
+  dispatch_mbr = cfg;
+  dispatch_min_value = min_value;
+  can_replicate_dispatch = !has_next &&
+      MAX_NUM_REPLICATED_INSTRUCTIONS >= num_instructions;
+  for (U64 i(0); i <= max_index; ++i) {
+    dispatch_targets.PushBack(NO_TARGET);
+  }
+}
+
+
+// Lower the dispatching multi-way branch. The code of each arm is placed
+// after the jump through the table, and the offsets of the arms are recorded
+// in the table. When an arm's value appears more than once, the first arm
+// wins, just as in a chain of comparisons.
+void CodeGenerator::LowerDispatch(mir::MultiWayBranchControlFlowGraph *cfg) {
+  LowerBlock(&(cfg->condition.bb));
+  if (is_numbering) {
+    NumberUse(cfg->conditional_value);
+    for (mir::MultiWayBranchArm *arm(cfg->arms); nullptr != arm;
+         arm = arm->next) {
+      LowerChain(&(arm->if_true), cfg->successor);
+    }
+    return;
+  }
+
+  Label join;
+  EmitTableJump();
+
+  for (mir::MultiWayBranchArm *arm(cfg->arms); nullptr != arm;
+       arm = arm->next) {
+    if (arm == cfg->default_arm) {
+      continue;
+    }
+    unsigned &target(dispatch_targets.Get(static_cast<unsigned>(
+        ConstantValue(arm->value) - dispatch_min_value)));
+    if (NO_TARGET != target) {
+      continue;
+    }
+    target = assembler.Size();
+    LowerChain(&(arm->if_true), cfg->successor);
+    assembler.Jump(&join);
+  }
+
+  assembler.Bind(&dispatch_default);
+  const unsigned default_target(assembler.Size());
+  if (cfg->default_arm) {
+    LowerChain(&(cfg->default_arm->if_true), cfg->successor);
+  }
+  assembler.Bind(&join);
+
+  for (unsigned &target : dispatch_targets) {
+    if (NO_TARGET == target) {
+      target = default_target;
+    }
+  }
+}
+
+
+// Jump through the table to the arm of the dispatching multi-way branch that
+// matches its (already computed) value. Values outside of the table go to the
+// default arm.
+void CodeGenerator::EmitTableJump(void) {
+  LoadValue(Register::RAX, dispatch_mbr->conditional_value);
+  if (dispatch_min_value) {
+    assembler.MoveImmediate(Register::RCX, dispatch_min_value);
+    assembler.Arithmetic(
+        ArithmeticOperation::SUB, Register::RAX, Register::RCX);
+  }
+  assembler.MoveImmediate(Register::RCX, dispatch_targets.Size());
+  assembler.Arithmetic(ArithmeticOperation::CMP, Register::RAX, Register::RCX);
+  assembler.Jump(Condition::CC_AE, &dispatch_default);
+
+  assembler.LoadLabelAddress(Register::RCX, &dispatch_table);
+  assembler.LoadTableEntry(Register::RAX, Register::RCX, Register::RAX);
+  assembler.Arithmetic(ArithmeticOperation::ADD, Register::RAX, Register::RCX);
+  assembler.Jump(Register::RAX);
+}
+
+
+// Lower `OP_NEXT` into a copy of the code from `dispatch` to the jump through
+// the table. Only persistent symbols are live across `OP_NEXT`, so the copied
+// code is free to clobber the registers of every other symbol, and it leaves
+// the registers of its own symbols exactly as the original code does.
+void CodeGenerator::EmitReplicatedDispatch(void) {
+  for (const mir::BasicBlock *bb : dispatch_prefix) {
+    for (const mir::Instruction *in(bb->first); nullptr != in;
+         in = in->next) {
+      LowerInstruction(in);
+    }
+  }
+  EmitTableJump();
+}
+
+
+// Collect the values of the arms of `cfg` into `cases`, sorted according to
+// the type of the conditional value. Returns false if some arm is not a
+// scalar, non-floating point constant. When an arm's value appears more than
+// once, the first arm wins, just as in a chain of comparisons. Arms with no
+// code target the join of `cfg`.
+bool CodeGenerator::CollectSwitchCases(
+    mir::MultiWayBranchControlFlowGraph *cfg, Vector<SwitchCase> &cases) {
+  const TypeInfo *type(cfg->conditional_value->type);
+  if (!IsScalar(type) || IsFloat(type)) {
+    return false;
+  }
+
+  unsigned target(SWITCH_FIRST_ARM);
+  for (const mir::MultiWayBranchArm *arm(cfg->arms); nullptr != arm;
+       arm = arm->next) {
+    if (arm == cfg->default_arm) {
+      continue;
+    } else if (!arm->value || arm->value->id || !IsScalar(arm->value->type) ||
+               IsFloat(arm->value->type)) {
+      return false;
+    }
+
+    SwitchCase new_case = {ConstantValue(arm->value), target++};
+    if (!arm->if_true.bb.first && arm->if_true.successor == cfg->successor) {
+      new_case.target = SWITCH_JOIN;
+    }
+
+    unsigned index(cases.Size());
+    while (index && IsLessThan(new_case.value, cases.Get(index - 1).value,
+                               type)) {
+      --index;
+    }
+    if (index && cases.Get(index - 1).value == new_case.value) {
+      continue;
+    }
+    cases.PushBack(new_case);
+    for (unsigned i(cases.Size() - 1); i > index; --i) {
+      cases.Get(i) = cases.Get(i - 1);
+    }
+    cases.Get(index) = new_case;
+  }
+  return true;
+}
+
+
+// Lower a multi-way branch with the sorted cases `cases`. The search for the
+// matching case is followed by the code of each arm, in order, and then by the
+// default arm. The entries of the jump tables of the search are label indexes
+// until the arms have been placed, and are then replaced by code offsets.
+void CodeGenerator::LowerSwitch(mir::MultiWayBranchControlFlowGraph *cfg,
+                                Vector<SwitchCase> &cases) {
+  if (is_numbering) {
+    NumberUse(cfg->conditional_value);
+    for (mir::MultiWayBranchArm *arm(cfg->arms); nullptr != arm;
+         arm = arm->next) {
+      if (arm != cfg->default_arm) {
+        LowerChain(&(arm->if_true), cfg->successor);
+      }
+    }
+    if (cfg->default_arm) {
+      LowerChain(&(cfg->default_arm->if_true), cfg->successor);
+    }
+    return;
+  }
+
+  Vector<Label> labels;
+  Vector<unsigned> offsets;
+  Vector<bool> is_target;
+  unsigned num_labels(SWITCH_FIRST_ARM);
+  for (const mir::MultiWayBranchArm *arm(cfg->arms); nullptr != arm;
+       arm = arm->next) {
+    if (arm != cfg->default_arm) {
+      ++num_labels;
+    }
+  }
+  labels.Get(num_labels - 1);
+  for (unsigned i(0); i < num_labels; ++i) {
+    offsets.PushBack(0U);
+    is_target.PushBack(false);
+  }
+  for (const SwitchCase &switch_case : cases) {
+    is_target.Get(switch_case.target) = true;
+  }
+
+  Vector<SwitchCluster> clusters;
+  ClusterSwitchCases(cases, clusters);
+
+  const unsigned first_table(switch_tables.Size());
+  LoadValue(Register::RAX, cfg->conditional_value);
+  EmitSwitch(cases, clusters, 0, clusters.Size(),
+             cfg->conditional_value->type, labels);
+  const unsigned last_table(switch_tables.Size());
+
+  unsigned target(SWITCH_FIRST_ARM);
+  for (mir::MultiWayBranchArm *arm(cfg->arms); nullptr != arm;
+       arm = arm->next) {
+    if (arm == cfg->default_arm || !is_target.Get(target++)) {
+      continue;
+    }
+    assembler.Bind(&(labels.Get(target - 1)));
+    offsets.Get(target - 1) = assembler.Size();
+    LowerChain(&(arm->if_true), cfg->successor);
+    assembler.Jump(&(labels.Get(SWITCH_JOIN)));
+  }
+
+  assembler.Bind(&(labels.Get(SWITCH_DEFAULT)));
+  offsets.Get(SWITCH_DEFAULT) = assembler.Size();
+  if (cfg->default_arm) {
+    LowerChain(&(cfg->default_arm->if_true), cfg->successor);
+  }
+  assembler.Bind(&(labels.Get(SWITCH_JOIN)));
+  offsets.Get(SWITCH_JOIN) = assembler.Size();
+
+  for (unsigned i(first_table); i < last_table; ++i) {
+    const SwitchTable &table(switch_tables.Get(i));
+    for (unsigned j(table.begin); j < table.begin + table.size; ++j) {
+      unsigned &entry(switch_table_targets.Get(j));
+      entry = offsets.Get(entry);
+    }
+  }
+}
+
+
+// Partition the sorted cases into clusters. Starting from the first case not
+// yet in a cluster, the longest range of cases that can be lowered into bit
+// tests becomes a cluster, or else the longest range that can be lowered into
+// a jump table, or else the case on its own.
+void CodeGenerator::ClusterSwitchCases(Vector<SwitchCase> &cases,
+                                       Vector<SwitchCluster> &clusters) {
+  for (unsigned begin(0); begin < cases.Size(); ) {
+    SwitchCluster cluster = {begin, begin + 1,
+                             SwitchClusterKind::SINGLE_CASE};
+    for (unsigned end(cases.Size()); end > begin + 1; --end) {
+      if (IsBitTestCluster(cases, begin, end)) {
+        cluster.end = end;
+        cluster.kind = SwitchClusterKind::BIT_TESTS;
+        break;
+      }
+    }
+    if (SwitchClusterKind::SINGLE_CASE == cluster.kind) {
+      for (unsigned end(cases.Size()); end > begin + 1; --end) {
+        if (IsSwitchTable(cases, begin, end)) {
+          cluster.end = end;
+          cluster.kind = SwitchClusterKind::JUMP_TABLE;
+          break;
+        }
+      }
+    }
+    clusters.PushBack(cluster);
+    begin = cluster.end;
+  }
+}
+
+
+// Returns true if the cases from `begin` up to (but excluding) `end` are dense
+// enough to be lowered into a jump table.
+bool CodeGenerator::IsSwitchTable(Vector<SwitchCase> &cases, unsigned begin,
+                                  unsigned end) {
+  const unsigned num_cases(end - begin);
+  const U64 span(cases.Get(end - 1).value - cases.Get(begin).value);
+  return MIN_SWITCH_TABLE_CASES <= num_cases && MAX_JUMP_TABLE_SIZE > span &&
+         (num_cases * JUMP_TABLE_SPARSENESS) > span;
+}
+
+
+// Returns true if the cases from `begin` up to (but excluding) `end` go to few
+// enough targets, and span few enough values, that bit tests are cheaper than
+// comparisons.
+bool CodeGenerator::IsBitTestCluster(Vector<SwitchCase> &cases,
+                                     unsigned begin, unsigned end) {
+  if (MAX_BIT_TEST_SPAN <= cases.Get(end - 1).value - cases.Get(begin).value) {
+    return false;
+  }
+  unsigned targets[MAX_BIT_TEST_TARGETS];
+  unsigned num_targets(0);
+  for (unsigned i(begin); i < end; ++i) {
+    const unsigned target(cases.Get(i).target);
+    unsigned j(0);
+    while (j < num_targets && targets[j] != target) {
+      ++j;
+    }
+    if (j == num_targets) {
+      if (MAX_BIT_TEST_TARGETS == num_targets) {
+        return false;
+      }
+      targets[num_targets++] = target;
+    }
+  }
+  return kMinBitTestCases[num_targets] <= (end - begin);
+}
+
+
+// Emit a binary search for the value in `RAX` among the clusters from `begin`
+// up to (but excluding) `end`. Every path through the emitted code ends with
+// a jump, so the code of a cluster may clobber `RAX`.
+void CodeGenerator::EmitSwitch(Vector<SwitchCase> &cases,
+                               Vector<SwitchCluster> &clusters,
+                               unsigned begin, unsigned end,
+                               const TypeInfo *type, Vector<Label> &labels) {
+  const unsigned num_clusters(end - begin);
+  if (!num_clusters) {
+    assembler.Jump(&(labels.Get(SWITCH_DEFAULT)));
+    return;
+  }
+
+  const SwitchCluster &first(clusters.Get(begin));
+  if (1 == num_clusters &&
+      SwitchClusterKind::JUMP_TABLE == first.kind) {
+    EmitSwitchTable(cases, first.begin, first.end, labels);
+    return;
+  } else if (1 == num_clusters &&
+             SwitchClusterKind::BIT_TESTS == first.kind) {
+    EmitSwitchBitTests(cases, first.begin, first.end, labels);
+    return;
+  }
+
+  bool has_only_single_cases(MAX_SWITCH_COMPARISONS >= num_clusters);
+  for (unsigned i(begin); has_only_single_cases && i < end; ++i) {
+    has_only_single_cases =
+        SwitchClusterKind::SINGLE_CASE == clusters.Get(i).kind;
+  }
+  if (has_only_single_cases) {
+    EmitSwitchComparisons(cases, first.begin, clusters.Get(end - 1).end,
+                          labels);
+    return;
+  }
+
+  Label upper_half;
+  const unsigned middle(begin + num_clusters / 2);
+  assembler.MoveImmediate(
+      Register::RCX, cases.Get(clusters.Get(middle).begin).value);
+  assembler.Arithmetic(ArithmeticOperation::CMP, Register::RAX, Register::RCX);
+  assembler.Jump(IsSigned(type) ? Condition::CC_GE : Condition::CC_AE,
+                 &upper_half);
+  EmitSwitch(cases, clusters, begin, middle, type, labels);
+  assembler.Bind(&upper_half);
+  EmitSwitch(cases, clusters, middle, end, type, labels);
+}
+
+
+// Emit a jump through a table that covers every value from the first to the
+// last of the cases. The table is bound after the epilogue.
+void CodeGenerator::EmitSwitchTable(Vector<SwitchCase> &cases, unsigned begin,
+                                    unsigned end, Vector<Label> &labels) {
+  const U64 min_value(cases.Get(begin).value);
+  SwitchTable &table(switch_tables.Get(switch_tables.Size()));
+  table.begin = switch_table_targets.Size();
+  table.size = static_cast<unsigned>(cases.Get(end - 1).value - min_value) + 1;
+  for (unsigned i(0); i < table.size; ++i) {
+    switch_table_targets.PushBack(SWITCH_DEFAULT);
+  }
+  for (unsigned i(begin); i < end; ++i) {
+    const SwitchCase &switch_case(cases.Get(i));
+    switch_table_targets.Get(table.begin + static_cast<unsigned>(
+        switch_case.value - min_value)) = switch_case.target;
+  }
+
+  if (min_value) {
+    assembler.MoveImmediate(Register::RCX, min_value);
+    assembler.Arithmetic(
+        ArithmeticOperation::SUB, Register::RAX, Register::RCX);
+  }
+  assembler.MoveImmediate(Register::RCX, table.size);
+  assembler.Arithmetic(ArithmeticOperation::CMP, Register::RAX, Register::RCX);
+  assembler.Jump(Condition::CC_AE, &(labels.Get(SWITCH_DEFAULT)));
+
+  assembler.LoadLabelAddress(Register::RCX, &(table.label));
+  assembler.LoadTableEntry(Register::RAX, Register::RCX, Register::RAX);
+  assembler.Arithmetic(ArithmeticOperation::ADD, Register::RAX, Register::RCX);
+  assembler.Jump(Register::RAX);
+}
+
+
+// Emit one bit test per target of the cases. Each bit test checks the value,
+// relative to the first case, against a mask of the values that go to the
+// same target.
+void CodeGenerator::EmitSwitchBitTests(Vector<SwitchCase> &cases,
+                                       unsigned begin, unsigned end,
+                                       Vector<Label> &labels) {
+  const U64 min_value(cases.Get(begin).value);
+  unsigned targets[MAX_BIT_TEST_TARGETS];
+  U64 masks[MAX_BIT_TEST_TARGETS];
+  unsigned num_targets(0);
+  for (unsigned i(begin); i < end; ++i) {
+    const SwitchCase &switch_case(cases.Get(i));
+    unsigned j(0);
+    while (j < num_targets && targets[j] != switch_case.target) {
+      ++j;
+    }
+    if (j == num_targets) {
+      targets[num_targets] = switch_case.target;
+      masks[num_targets++] = 0;
+    }
+    masks[j] |= 1UL << (switch_case.value - min_value);
+  }
+
+  if (min_value) {
+    assembler.MoveImmediate(Register::RCX, min_value);
+    assembler.Arithmetic(
+        ArithmeticOperation::SUB, Register::RAX, Register::RCX);
+  }
+  assembler.MoveImmediate(Register::RCX, cases.Get(end - 1).value - min_value);
+  assembler.Arithmetic(ArithmeticOperation::CMP, Register::RAX, Register::RCX);
+  assembler.Jump(Condition::CC_A, &(labels.Get(SWITCH_DEFAULT)));
+
+  for (unsigned j(0); j < num_targets; ++j) {
+    assembler.MoveImmediate(Register::RCX, masks[j]);
+    assembler.BitTest(Register::RCX, Register::RAX);
+    assembler.Jump(Condition::CC_B, &(labels.Get(targets[j])));
+  }
+  assembler.Jump(&(labels.Get(SWITCH_DEFAULT)));
+}
+
+
+// Emit one comparison per case.
+void CodeGenerator::EmitSwitchComparisons(Vector<SwitchCase> &cases,
+                                          unsigned begin, unsigned end,
+                                          Vector<Label> &labels) {
+  for (unsigned i(begin); i < end; ++i) {
+    const SwitchCase &switch_case(cases.Get(i));
+    assembler.MoveImmediate(Register::RCX, switch_case.value);
+    assembler.Arithmetic(
+        ArithmeticOperation::CMP, Register::RAX, Register::RCX);
+    assembler.Jump(Condition::CC_E, &(labels.Get(switch_case.target)));
+  }
+  assembler.Jump(&(labels.Get(SWITCH_DEFAULT)));
+}
+
+
+void CodeGenerator::VisitPreOrder(mir::LoopControlFlowGraph *cfg) {
+  Label header;
+  Label exit;
+
+  if (is_numbering) {
+    ++num_structures;
+  }
+  LowerChain(&(cfg->init), &(cfg->condition));
+  if (is_numbering) {
+    const unsigned begin(allocator.Position());
+    LowerBlock(&(cfg->condition.bb));
+    TestCondition(cfg->conditional_value);
+    LowerChain(&(cfg->body), &(cfg->condition));
+    allocator.AddLoop(begin, allocator.Position());
+    next_cfg = cfg->successor;
+    return;
+  }
+
+  assembler.Bind(&header);
+  LowerBlock(&(cfg->condition.bb));
+  TestCondition(cfg->conditional_value);
+  assembler.Jump(Condition::CC_E, &exit);
+  LowerChain(&(cfg->body), &(cfg->condition));
+  assembler.Jump(&header);
+  assembler.Bind(&exit);
+
+  next_cfg = cfg->successor;
+}
+
+}  // namespace x86_64
+}  // namespace pjit
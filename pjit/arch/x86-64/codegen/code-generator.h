@@ -0,0 +1,289 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * code-generator.h
+ *
+ *  Created on: 2014-01-08
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_ARCH_X86_64_CODEGEN_CODE_GENERATOR_H_
+#define PJIT_ARCH_X86_64_CODEGEN_CODE_GENERATOR_H_
+
+#include "pjit/base/base.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/containers/code-cache.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
+#include "pjit/arch/x86-64/codegen/assembler.h"
+#include "pjit/arch/x86-64/codegen/register-allocator.h"
+
+namespace pjit {
+
+struct TypeInfo;
+struct StructureFieldInfo;
+
+namespace mir {
+class Context;
+class Symbol;
+class Instruction;
+class BasicBlock;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+}  // namespace mir
+
+namespace x86_64 {
+
+
+// Native code that was generated from the MIR of a context.
+//
+// Symbols of the MIR that are not held in registers live in a frame of memory
+// that is supplied by the caller of the code. Persistent symbols always have
+// a place in the frame, even if they are pinned to registers, and so their
+// values can be initialized and inspected by the caller by means of their
+// offsets within the frame. Scalar values occupy 8 bytes of the frame, and are
+// stored sign- or zero-extended to 64 bits.
+class CompiledCode {
+ public:
+  typedef void (*EntryPoint)(void *frame);
+
+  CompiledCode(void);
+  ~CompiledCode(void);
+
+  // Returns true if this object holds compiled code.
+  inline bool IsValid(void) const {
+    return nullptr != code;
+  }
+
+  // Run the compiled code. `frame` must be 8-byte aligned and point to at
+  // least `FrameSize()` bytes of memory.
+  inline void Run(void *frame) const {
+    entry_point(frame);
+  }
+
+  inline unsigned FrameSize(void) const {
+    return frame_size;
+  }
+
+  inline unsigned CodeSize(void) const {
+    return code_size;
+  }
+
+  // Get the offset of a symbol within the frame. Returns false if the symbol
+  // is not used by the compiled code.
+  bool GetFrameOffset(const mir::Symbol *sym, unsigned *offset);
+
+  // Release the compiled code.
+  void Reset(void);
+
+ private:
+  friend class CodeGenerator;
+
+  struct FrameSlot {
+    unsigned offset = 0;
+    bool is_allocated = false;
+  };
+
+  void *code;
+  unsigned num_pages;
+
+  // The cache that owns `code`, or `nullptr` if `code` is in its own pages,
+  // and the generation of the cache's chunk in which `code` was allocated.
+  CodeCache *cache;
+  unsigned cache_generation;
+  unsigned code_size;
+  EntryPoint entry_point;
+
+  unsigned frame_size;
+
+  // Frame slots, indexed by symbol id.
+  Vector<FrameSlot> frame_slots;
+
+  PJIT_DISALLOW_COPY_AND_ASSIGN(CompiledCode);
+};
+
+
+// Lowers the MIR of a context into x86-64 machine code.
+//
+// The generated code is a function that takes a pointer to the frame in
+// `RDI`. Control-flow graphs are lowered structurally. Each MIR instruction
+// is independently selected into a short sequence of machine instructions
+// that moves its operands into scratch registers, and that moves its result
+// back into the register or frame slot of its destination. Registers are
+// assigned by a `RegisterAllocator` before any code is emitted. Falling off of
+// the end of the MIR returns to the caller.
+//
+// `OP_NEXT` begins the next iteration of the interpreter's instruction fetch /
+// decode / execute loop. If the MIR begins with the decoding of an opcode
+// (i.e. the first structured control-flow graph is a multi-way branch over
+// dense integer constants), then that branch is lowered into a jump table,
+// and every `OP_NEXT` is given its own copy of the fetch code and of the
+// indirect jump through the table (direct threading). Replicated jumps are
+// predicted separately, which suits interpreters, where the next opcode
+// correlates with the current one. Otherwise, `OP_NEXT` jumps back to the
+// beginning of the code (after pinned symbols have been loaded into their
+// registers).
+//
+// Note: The MIR must not be in SSA form.
+class CodeGenerator : public mir::ControlFlowGraphVisitor {
+ public:
+  explicit CodeGenerator(mir::Context *context_);
+  virtual ~CodeGenerator(void) = default;
+
+  // Generate code into `compiled`. Returns false if some instruction could
+  // not be lowered, or if no executable memory could be allocated.
+  //
+  // Note: A code generator can only be used to generate code once, as its
+  //       register allocation, labels, and tables describe a single
+  //       function. Later calls to either `Generate` fail without changing
+  //       `compiled`, so any code that it already holds stays valid.
+  bool Generate(CompiledCode *compiled);
+
+  // Generate code into a region of `cache`. The code cannot be run until the
+  // next `cache->Commit()`, which allows many functions to be generated and
+  // then made executable together.
+  bool Generate(CompiledCode *compiled, CodeCache *cache);
+
+  // Type dispatch on the kinds of control-flow graphs. These *do not* visit
+  // the successors of `cfg`.
+  virtual void VisitPreOrder(mir::SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(mir::ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(mir::MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(mir::LoopControlFlowGraph *cfg);
+
+ private:
+  mir::Context * const context;
+  CompiledCode *compiled;
+  Assembler assembler;
+  RegisterAllocator allocator;
+
+  // Target of `OP_NEXT`.
+  Label dispatch;
+
+  // The multi-way branch that decodes opcodes through a jump table, or
+  // `nullptr` if there is no such branch.
+  mir::MultiWayBranchControlFlowGraph *dispatch_mbr;
+
+  // Blocks that are executed from `dispatch` up to the jump through the
+  // table. These are replicated by every `OP_NEXT`, unless
+  // `can_replicate_dispatch` is false.
+  Vector<mir::BasicBlock *> dispatch_prefix;
+  bool can_replicate_dispatch;
+
+  // The jump table. Each target is an offset into the code.
+  Vector<unsigned> dispatch_targets;
+  U64 dispatch_min_value;
+  Label dispatch_table;
+
+  // Target of values that are outside the range of the jump table.
+  Label dispatch_default;
+
+  // A value of an arm of a (non-dispatching) multi-way branch, and the index
+  // of the label of its target.
+  struct SwitchCase {
+    U64 value;
+    unsigned target;
+  };
+
+  // A jump table of a non-dispatching multi-way branch. Its entries are the
+  // `size` entries of `switch_table_targets` starting at `begin`.
+  struct SwitchTable {
+    Label label;
+    unsigned begin = 0;
+    unsigned size = 0;
+  };
+
+  Vector<SwitchTable> switch_tables;
+  Vector<unsigned> switch_table_targets;
+
+  // How a range of sorted cases is lowered.
+  enum class SwitchClusterKind {
+    SINGLE_CASE,
+    JUMP_TABLE,
+    BIT_TESTS
+  };
+
+  struct SwitchCluster {
+    unsigned begin;
+    unsigned end;
+    SwitchClusterKind kind;
+  };
+
+  // Number of structured (non-sequential) control-flow graphs seen by the
+  // numbering pass.
+  unsigned num_structures;
+
+  // Whether or not every instruction has been successfully lowered.
+  bool is_valid;
+
+  // Whether or not this code generator has already been used.
+  bool has_assembled;
+
+  // Whether the type dispatch should only report the references of symbols
+  // to the register allocator (instead of emitting code).
+  bool is_numbering;
+
+  // Output of the type dispatch.
+  mir::ControlFlowGraph *next_cfg;
+
+  S32 FrameOffset(const mir::Symbol *sym);
+  void LoadValue(Register dest, const mir::Symbol *sym);
+  void StoreValue(const mir::Symbol *sym, Register src);
+  void LoadAddress(Register dest, const mir::Symbol *sym);
+  void LoadFieldAddress(Register dest, const mir::Symbol *obj,
+                        const StructureFieldInfo *field);
+  void Normalize(Register reg, const TypeInfo *type);
+  void CopyAggregate(unsigned size);
+  void TestCondition(const mir::Symbol *sym);
+
+  void NumberInstruction(const mir::Instruction *in);
+  void NumberUse(const mir::Symbol *sym);
+
+  void ChooseDispatch(mir::MultiWayBranchControlFlowGraph *cfg);
+  void LowerDispatch(mir::MultiWayBranchControlFlowGraph *cfg);
+  void EmitTableJump(void);
+  void EmitReplicatedDispatch(void);
+
+  bool CollectSwitchCases(mir::MultiWayBranchControlFlowGraph *cfg,
+                          Vector<SwitchCase> &cases);
+  void LowerSwitch(mir::MultiWayBranchControlFlowGraph *cfg,
+                   Vector<SwitchCase> &cases);
+  void ClusterSwitchCases(Vector<SwitchCase> &cases,
+                          Vector<SwitchCluster> &clusters);
+  bool IsSwitchTable(Vector<SwitchCase> &cases, unsigned begin, unsigned end);
+  bool IsBitTestCluster(Vector<SwitchCase> &cases, unsigned begin,
+                        unsigned end);
+  void EmitSwitch(Vector<SwitchCase> &cases, Vector<SwitchCluster> &clusters,
+                  unsigned begin, unsigned end, const TypeInfo *type,
+                  Vector<Label> &labels);
+  void EmitSwitchTable(Vector<SwitchCase> &cases, unsigned begin,
+                       unsigned end, Vector<Label> &labels);
+  void EmitSwitchBitTests(Vector<SwitchCase> &cases, unsigned begin,
+                          unsigned end, Vector<Label> &labels);
+  void EmitSwitchComparisons(Vector<SwitchCase> &cases, unsigned begin,
+                             unsigned end, Vector<Label> &labels);
+
+  bool Assemble(CompiledCode *compiled);
+  void EmitPrologue(void);
+  void EmitEpilogue(void);
+
+  void LowerChain(mir::ControlFlowGraph *cfg, mir::ControlFlowGraph *stop);
+  void LowerBlock(mir::BasicBlock *bb);
+  void LowerInstruction(const mir::Instruction *in);
+  void LowerBinary(const mir::Instruction *in);
+  void LowerFloatBinary(const mir::Instruction *in);
+  void LowerCompare(const mir::Instruction *in);
+  void LowerConvert(const mir::Instruction *in);
+  void LowerLoad(const mir::Symbol *dest, const TypeInfo *type);
+  void LowerStore(const mir::Symbol *src, const TypeInfo *type);
+  void LowerCall(const mir::Instruction *in, unsigned num_operands);
+
+  CodeGenerator(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(CodeGenerator);
+};
+
+}  // namespace x86_64
+}  // namespace pjit
+
+#endif  // PJIT_ARCH_X86_64_CODEGEN_CODE_GENERATOR_H_
@@ -0,0 +1,412 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * register-allocator.cc
+ *
+ *  Created on: 2014-01-09
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/arch/x86-64/codegen/register-allocator.h"
+
+#include "pjit/base/type-info.h"
+#include "pjit/mir/symbol.h"
+
+namespace pjit {
+namespace x86_64 {
+
+// Registers that are available for allocation. The code generator uses
+// `RAX`, `RCX`, `RDX`, `RSI`, and `RDI` as scratch registers, and `RBX` to
+// hold the frame.
+static const Register kCallerSavedRegisters[] = {
+  Register::R8, Register::R9, Register::R10, Register::R11
+};
+
+static const Register kCalleeSavedRegisters[] = {
+  Register::RBP, Register::R12, Register::R13, Register::R14, Register::R15
+};
+
+// Registers given to pinned symbols, in order.
+static const Register kPinnedRegisters[] = {
+  Register::R15, Register::R14, Register::R13
+};
+
+static_assert(
+    RegisterAllocator::MAX_NUM_PINNED_REGISTERS ==
+        sizeof(kPinnedRegisters) / sizeof(kPinnedRegisters[0]),
+    "Every pinned symbol must have a register.");
+
+
+static U32 RegisterMask(Register reg) {
+  return 1U << static_cast<unsigned>(reg);
+}
+
+
+template <unsigned kNumRegisters>
+static U32 RegisterMask(const Register (&regs)[kNumRegisters]) {
+  U32 mask(0);
+  for (unsigned i(0); i < kNumRegisters; ++i) {
+    mask |= RegisterMask(regs[i]);
+  }
+  return mask;
+}
+
+
+// Returns true if a symbol may be held in a register. Globals must always be
+// accessed through memory, and aggregates do not fit into registers.
+static bool IsAllocatable(const mir::Symbol *sym) {
+  if (sym->behavior & mir::SymbolBehavior::BehaviorGlobal) {
+    return false;
+  }
+  switch (sym->type->kind) {
+    case TypeKind::TYPE_KIND_POINTER:
+    case TypeKind::TYPE_KIND_INTEGER:
+    case TypeKind::TYPE_KIND_BOOLEAN:
+    case TypeKind::TYPE_KIND_FLOATING_POINT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+static bool IsProgramCounter(const mir::Symbol *sym) {
+  return mir::SymbolBehavior::BehaviorProgramCounter ==
+         (sym->behavior & mir::SymbolBehavior::BehaviorProgramCounter);
+}
+
+
+RegisterAllocator::RegisterAllocator(void)
+    : position(0),
+      block(0),
+      free_registers(RegisterMask(kCallerSavedRegisters) |
+                     RegisterMask(kCalleeSavedRegisters)),
+      used_registers(0) {}
+
+
+void RegisterAllocator::AddUse(const mir::Symbol *sym) {
+  AddReference(sym, position, false);
+}
+
+
+// Calls clobber every caller-saved register after the arguments of the call
+// have been read.
+void RegisterAllocator::AddCall(void) {
+  call_positions.PushBack(position + 1);
+}
+
+
+void RegisterAllocator::AddDefinition(const mir::Symbol *sym) {
+  AddReference(sym, position + 1, true);
+}
+
+
+void RegisterAllocator::AddCopy(const mir::Symbol *dest,
+                                const mir::Symbol *src) {
+  if (!dest || !dest->id || !src || !src->id || dest == src) {
+    return;
+  }
+  Interval &interval(intervals.Get(dest->id));
+  if (!interval.hint) {
+    interval.hint = src->id;
+  }
+}
+
+
+// Uses are numbered before definitions so that the interval of a symbol that
+// is last used by an instruction can share its register with the interval
+// of the symbol defined by that instruction.
+void RegisterAllocator::NextInstruction(void) {
+  position += 2;
+}
+
+
+void RegisterAllocator::NextBlock(void) {
+  ++block;
+}
+
+
+void RegisterAllocator::AddLoop(unsigned begin, unsigned end) {
+  loops.PushBack({begin, end});
+}
+
+
+void RegisterAllocator::AddReference(const mir::Symbol *sym, unsigned pos,
+                                     bool is_definition) {
+  if (!sym || !sym->id) {
+    return;
+  }
+
+  Interval &interval(intervals.Get(sym->id));
+  if (!interval.sym) {
+    interval.sym = sym;
+    interval.begin = pos;
+    interval.block = block;
+    interval.first_is_definition = is_definition;
+    interval.is_allocatable = IsAllocatable(sym);
+    interval.is_persistent = 0 != (
+        sym->behavior & mir::SymbolBehavior::BehaviorPersistent);
+    ordered_ids.PushBack(sym->id);
+  } else if (interval.block != block) {
+    interval.is_block_local = false;
+  }
+
+  interval.end = pos;
+  interval.num_references += 1;
+  if (is_definition) {
+    interval.num_definitions += 1;
+  }
+}
+
+
+// Assign registers to the reported symbols.
+void RegisterAllocator::Allocate(void) {
+  ExtendOverLoops();
+  SortByBegin();
+  Pin();
+  Scan();
+}
+
+
+bool RegisterAllocator::GetRegister(const mir::Symbol *sym, Register *reg) {
+  if (!sym->id || sym->id >= intervals.Size()) {
+    return false;
+  }
+  const Interval &interval(intervals.Get(sym->id));
+  if (!interval.has_register) {
+    return false;
+  }
+  *reg = interval.reg;
+  return true;
+}
+
+
+const mir::Symbol *RegisterAllocator::GetPinnedSymbol(unsigned i,
+                                                      Register *reg) {
+  const Interval &interval(intervals.Get(pinned.Get(i)));
+  *reg = interval.reg;
+  return interval.sym;
+}
+
+
+// A temporary is defined once, before any of its uses, and is only referenced
+// within a single basic block. Its value can never flow around the back-edge
+// of a loop.
+bool RegisterAllocator::IsTemporary(const Interval &interval) const {
+  return interval.is_block_local &&
+         1 == interval.num_definitions &&
+         interval.first_is_definition;
+}
+
+
+// Returns true if a call clobbers the caller-saved registers while the
+// interval is live.
+bool RegisterAllocator::CrossesCall(const Interval &interval) {
+  unsigned low(0);
+  unsigned high(call_positions.Size());
+  while (low < high) {
+    const unsigned mid((low + high) / 2);
+    if (call_positions.Get(mid) <= interval.begin) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low < call_positions.Size() &&
+         call_positions.Get(low) < interval.end;
+}
+
+
+// A value that is live anywhere within a loop might be needed again by the
+// next iteration of the loop. Loops are reported innermost-first, so the
+// extensions made for an inner loop are covered by those of its outer loops.
+void RegisterAllocator::ExtendOverLoops(void) {
+  for (const Loop &loop : loops) {
+    for (unsigned id : ordered_ids) {
+      Interval &interval(intervals.Get(id));
+      if (IsTemporary(interval) ||
+          interval.begin >= loop.end ||
+          interval.end < loop.begin) {
+        continue;
+      }
+      if (interval.begin > loop.begin) {
+        interval.begin = loop.begin;
+      }
+      if (interval.end < loop.end) {
+        interval.end = loop.end;
+      }
+    }
+  }
+}
+
+
+// Sort the intervals by their beginnings. The ids are already in order of
+// the first references to their symbols, and only loop extensions can move
+// the beginning of an interval, so an insertion sort is cheap.
+void RegisterAllocator::SortByBegin(void) {
+  for (unsigned i(1); i < ordered_ids.Size(); ++i) {
+    const unsigned id(ordered_ids.Get(i));
+    const unsigned begin(intervals.Get(id).begin);
+    unsigned j(i);
+    for (; j > 0; --j) {
+      const unsigned prev_id(ordered_ids.Get(j - 1));
+      if (intervals.Get(prev_id).begin <= begin) {
+        break;
+      }
+      ordered_ids.Get(j) = prev_id;
+    }
+    ordered_ids.Get(j) = id;
+  }
+}
+
+
+// Pin program counters, and then the most frequently referenced persistent
+// symbols, into callee-saved registers.
+void RegisterAllocator::Pin(void) {
+  while (pinned.Size() < MAX_NUM_PINNED_REGISTERS) {
+    Interval *best(nullptr);
+    for (unsigned id : ordered_ids) {
+      Interval &interval(intervals.Get(id));
+      if (!interval.is_allocatable || !interval.is_persistent ||
+          interval.has_register) {
+        continue;
+      }
+      if (!best) {
+        best = &interval;
+        continue;
+      }
+      const bool is_pc(IsProgramCounter(interval.sym));
+      const bool best_is_pc(IsProgramCounter(best->sym));
+      if ((is_pc && !best_is_pc) ||
+          (is_pc == best_is_pc &&
+           interval.num_references > best->num_references)) {
+        best = &interval;
+      }
+    }
+    if (!best) {
+      return;
+    }
+
+    const Register reg(kPinnedRegisters[pinned.Size()]);
+    best->reg = reg;
+    best->has_register = true;
+    free_registers &= ~RegisterMask(reg);
+    used_registers |= RegisterMask(reg);
+    pinned.PushBack(best->sym->id);
+  }
+}
+
+
+// Assign registers to the intervals of non-persistent symbols, in order of
+// their beginnings. Intervals that cross calls can only use callee-saved
+// registers.
+void RegisterAllocator::Scan(void) {
+  const U32 callee_saved(RegisterMask(kCalleeSavedRegisters));
+  const U32 all_registers(callee_saved | RegisterMask(kCallerSavedRegisters));
+
+  for (unsigned id : ordered_ids) {
+    Interval &interval(intervals.Get(id));
+    if (!interval.is_allocatable || interval.is_persistent) {
+      continue;
+    }
+
+    Expire(interval.begin);
+    const U32 allowed(CrossesCall(interval) ? callee_saved : all_registers);
+    Register reg(Register::RAX);
+    if (TakeHintedRegister(interval, allowed, &reg) ||
+        TakeRegister(allowed, &reg)) {
+      interval.reg = reg;
+      interval.has_register = true;
+      used_registers |= RegisterMask(reg);
+      active_ids.PushBack(id);
+    } else {
+      SpillAtInterval(id, allowed);
+    }
+  }
+
+  while (active_ids.Size()) {
+    active_ids.PopBack();
+  }
+}
+
+
+// Release the registers of the active intervals that end before `begin`.
+void RegisterAllocator::Expire(unsigned begin) {
+  for (unsigned i(0); i < active_ids.Size(); ) {
+    const Interval &interval(intervals.Get(active_ids.Get(i)));
+    if (interval.end < begin) {
+      free_registers |= RegisterMask(interval.reg);
+      active_ids.Get(i) = active_ids.Get(active_ids.Size() - 1);
+      active_ids.PopBack();
+    } else {
+      ++i;
+    }
+  }
+}
+
+
+// Take the register of the interval that `interval` copies from, if that
+// register is free and allowed. The source of the copy usually ends at the
+// copy, and so its register is free again.
+bool RegisterAllocator::TakeHintedRegister(const Interval &interval,
+                                           U32 allowed, Register *reg) {
+  if (!interval.hint) {
+    return false;
+  }
+  const Interval &source(intervals.Get(interval.hint));
+  const U32 mask(RegisterMask(source.reg));
+  if (!source.has_register || !(free_registers & allowed & mask)) {
+    return false;
+  }
+  *reg = source.reg;
+  free_registers &= ~mask;
+  return true;
+}
+
+
+// Take a free register from `allowed`, preferring caller-saved registers, as
+// they do not need to be preserved by the generated code.
+bool RegisterAllocator::TakeRegister(U32 allowed, Register *reg) {
+  const U32 available(free_registers & allowed);
+  for (Register candidate : kCallerSavedRegisters) {
+    if (available & RegisterMask(candidate)) {
+      *reg = candidate;
+      free_registers &= ~RegisterMask(candidate);
+      return true;
+    }
+  }
+  for (Register candidate : kCalleeSavedRegisters) {
+    if (available & RegisterMask(candidate)) {
+      *reg = candidate;
+      free_registers &= ~RegisterMask(candidate);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// No register is free for the interval `id`. Either the interval itself is
+// spilled, or it takes the register of the active interval that ends last.
+void RegisterAllocator::SpillAtInterval(unsigned id, U32 allowed) {
+  Interval &interval(intervals.Get(id));
+  unsigned victim_index(0);
+  Interval *victim(nullptr);
+  for (unsigned i(0); i < active_ids.Size(); ++i) {
+    Interval &active(intervals.Get(active_ids.Get(i)));
+    if ((allowed & RegisterMask(active.reg)) &&
+        (!victim || active.end > victim->end)) {
+      victim = &active;
+      victim_index = i;
+    }
+  }
+
+  if (victim && victim->end > interval.end) {
+    interval.reg = victim->reg;
+    interval.has_register = true;
+    victim->has_register = false;
+    active_ids.Get(victim_index) = id;
+  }
+}
+
+}  // namespace x86_64
+}  // namespace pjit
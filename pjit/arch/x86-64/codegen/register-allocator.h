@@ -0,0 +1,159 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * register-allocator.h
+ *
+ *  Created on: 2014-01-09
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_ARCH_X86_64_CODEGEN_REGISTER_ALLOCATOR_H_
+#define PJIT_ARCH_X86_64_CODEGEN_REGISTER_ALLOCATOR_H_
+
+#include "pjit/base/base.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/containers/vector.h"
+#include "pjit/arch/x86-64/codegen/assembler.h"
+
+namespace pjit {
+namespace mir {
+class Symbol;
+}  // namespace mir
+
+namespace x86_64 {
+
+
+// Assigns machine registers to the scalar symbols of the MIR using linear
+// scan register allocation.
+//
+// The code generator reports every reference to a symbol, in the same order
+// in which it emits code for the references. A live interval of a symbol
+// spans from its first to its last reference. Because the CFG is structured,
+// the only backward jumps are the back-edges of loops, and so an interval
+// that overlaps a loop is extended to cover the whole loop, unless it belongs
+// to a temporary that is defined once and only used in the block that defines
+// it.
+//
+// Persistent symbols (including program counters) are pinned: they are given
+// callee-saved registers for the entire lifetime of the generated code, and
+// therefore remain in registers across `OP_NEXT`. Program counters are pinned
+// first, followed by the most frequently referenced persistent symbols.
+// Persistent symbols that are not pinned, globals, and aggregates always live
+// in the frame.
+//
+// Copies are reported as hints: the destination of a copy is given the
+// register of its source if that register is free when the destination's
+// interval begins, which lets the code generator omit the copy.
+class RegisterAllocator {
+ public:
+  enum : unsigned {
+    MAX_NUM_PINNED_REGISTERS = 3
+  };
+
+  RegisterAllocator(void);
+
+  // Report the references of a single instruction. All uses must be reported
+  // before any call or definition.
+  void AddUse(const mir::Symbol *sym);
+  void AddCall(void);
+  void AddDefinition(const mir::Symbol *sym);
+  void NextInstruction(void);
+
+  // Report that the current instruction copies `src` into `dest`. Must be
+  // reported after the definition of `dest`.
+  void AddCopy(const mir::Symbol *dest, const mir::Symbol *src);
+
+  // Report that subsequent references belong to a new basic block.
+  void NextBlock(void);
+
+  // Report a loop. `begin` and `end` are the values of `Position()` before
+  // the loop header and after the last instruction of the loop body.
+  void AddLoop(unsigned begin, unsigned end);
+
+  inline unsigned Position(void) const {
+    return position;
+  }
+
+  // Assign registers to the reported symbols.
+  void Allocate(void);
+
+  // Get the register assigned to a symbol. Returns false if the symbol lives
+  // in the frame.
+  bool GetRegister(const mir::Symbol *sym, Register *reg);
+
+  // Pinned symbols, which must be loaded from the frame on entry to the code,
+  // and stored back to the frame on exit.
+  inline unsigned NumPinnedSymbols(void) const {
+    return pinned.Size();
+  }
+
+  const mir::Symbol *GetPinnedSymbol(unsigned i, Register *reg);
+
+  // Returns true if the callee-saved register `reg` is used by the allocated
+  // code, and so must be preserved.
+  inline bool IsUsed(Register reg) const {
+    return 0 != (used_registers & (1U << static_cast<unsigned>(reg)));
+  }
+
+ private:
+  struct Interval {
+    const mir::Symbol *sym = nullptr;
+    unsigned begin = 0;
+    unsigned end = 0;
+    unsigned block = 0;
+    unsigned num_definitions = 0;
+    unsigned num_references = 0;
+    Register reg = Register::RAX;
+    bool is_allocatable = false;
+    bool is_persistent = false;
+    bool is_block_local = true;
+    bool first_is_definition = false;
+    bool has_register = false;
+
+    // Id of the symbol whose register this interval should preferably take,
+    // or zero.
+    unsigned hint = 0;
+  };
+
+  struct Loop {
+    unsigned begin;
+    unsigned end;
+  };
+
+  // Live intervals, indexed by symbol id.
+  Vector<Interval> intervals;
+
+  // Ids of referenced symbols, in the order of their first references.
+  Vector<unsigned> ordered_ids;
+
+  // Intervals that currently hold registers during the scan.
+  Vector<unsigned> active_ids;
+
+  Vector<unsigned> pinned;
+  Vector<unsigned> call_positions;
+  Vector<Loop> loops;
+
+  unsigned position;
+  unsigned block;
+  U32 free_registers;
+  U32 used_registers;
+
+  void AddReference(const mir::Symbol *sym, unsigned pos, bool is_definition);
+  bool IsTemporary(const Interval &interval) const;
+  bool CrossesCall(const Interval &interval);
+  void ExtendOverLoops(void);
+  void SortByBegin(void);
+  void Pin(void);
+  void Scan(void);
+  void Expire(unsigned begin);
+  bool TakeHintedRegister(const Interval &interval, U32 allowed,
+                          Register *reg);
+  bool TakeRegister(U32 allowed, Register *reg);
+  void SpillAtInterval(unsigned id, U32 allowed);
+
+  PJIT_DISALLOW_COPY_AND_ASSIGN(RegisterAllocator);
+};
+
+}  // namespace x86_64
+}  // namespace pjit
+
+#endif  // PJIT_ARCH_X86_64_CODEGEN_REGISTER_ALLOCATOR_H_
@@ -33,6 +33,11 @@ struct AlignOf {
 #endif
 
 
+// Byte offset of the field `field` within the structure or union `type`.
+#define PJIT_OFFSET_OF(type, field) \
+  static_cast<unsigned>(__builtin_offsetof(type, field))
+
+
 #define PJIT_LIKELY(x) __builtin_expect((x),1)
 #define PJIT_UNLIKELY(x) __builtin_expect((x),0)
 
@@ -9,6 +9,9 @@
 #include "pjit/base/base.h"
 #include "pjit/base/memory.h"
 #include "pjit/base/libc.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/base/spin-lock.h"
+#include "pjit/base/unsafe-cast.h"
 
 #include <sys/mman.h>
 
@@ -23,31 +26,196 @@
 #ifndef MAP_SHARED
 # define MAP_SHARED 0
 #endif
+#ifndef MAP_NORESERVE
+# define MAP_NORESERVE 0
+#endif
 
 
 namespace pjit {
 
 
-// Allocates `num` number of pages from the OS with `MEMORY_READ_WRITE`
-// protection.
-void *AllocatePages(unsigned num) {
+enum : UnsignedSize {
+  // Size of each range of virtual addresses that is reserved from the OS.
+  // Small page allocations are carved out of the current reservation.
+  RESERVATION_SIZE = 64UL << 20,
+
+  // Reserved memory is committed (made accessible) in batches of this size.
+  // This is also the size of a transparent huge page, and so reservations
+  // are aligned to this size.
+  COMMIT_BATCH_SIZE = 2UL << 20,
+
+  // Allocations of at most this many pages come from the reservation, and are
+  // pooled when freed. Bigger allocations are mapped and unmapped directly.
+  MAX_POOLED_NUM_PAGES = 16,
+
+  // Maximum number of freed runs of each size that are kept in the pool.
+  // Runs that are freed when their size's pool is full are unmapped.
+  MAX_POOLED_NUM_RUNS = 64
+};
+
+
+// Freed runs of pages, all of the same size. Runs are referenced out-of-band
+// (rather than being linked through their own memory), so that the physical
+// memory of every page of a pooled run can be given back to the OS.
+class PageRunPool {
+ public:
+  unsigned num_runs;
+  void *runs[MAX_POOLED_NUM_RUNS];
+};
+
+
+// Lock that protects the reservation and the page pool.
+static SpinLock LOCK;
+
+
+// Bounds of the current reservation. Pages in `[NEXT_PAGE, COMMIT_LIMIT)` are
+// committed but not yet allocated, and pages in
+// `[COMMIT_LIMIT, RESERVATION_LIMIT)` are reserved but inaccessible.
+static UnsignedPointer NEXT_PAGE = 0;
+static UnsignedPointer COMMIT_LIMIT = 0;
+static UnsignedPointer RESERVATION_LIMIT = 0;
+
+
+// Pools of freed page runs, indexed by the number of pages in each run.
+static PageRunPool PAGE_POOL[MAX_POOLED_NUM_PAGES + 1];
+
+
+// Map some anonymous memory.
+static void *MapPages(UnsignedSize num_bytes, int prot, int flags) {
   void *ret(mmap(
       nullptr,
-      pjit::PAGE_FRAME_SIZE * num,
-      PROT_READ | PROT_WRITE,
-      MAP_PRIVATE | MAP_ANONYMOUS,
+      num_bytes,
+      prot,
+      MAP_PRIVATE | MAP_ANONYMOUS | flags,
       -1,
       0));
 
-  memset(ret, 0, pjit::PAGE_FRAME_SIZE);
+  return MAP_FAILED == ret ? nullptr : ret;
+}
+
+
+// Reserve a new range of virtual addresses. The range is aligned to a huge
+// page boundary by over-reserving and then trimming off the misaligned ends.
+static bool Reserve(void) {
+  const UnsignedSize num_bytes(RESERVATION_SIZE + COMMIT_BATCH_SIZE);
+  void *addr(MapPages(num_bytes, PROT_NONE, MAP_NORESERVE));
+  if (!addr) {
+    return false;
+  }
+
+  const UnsignedPointer begin(UnsafeCast<UnsignedPointer>(addr));
+  const UnsignedPointer end(begin + num_bytes);
+  const UnsignedPointer aligned_begin(
+      (begin + COMMIT_BATCH_SIZE - 1) & ~(COMMIT_BATCH_SIZE - 1));
+  const UnsignedPointer aligned_end(aligned_begin + RESERVATION_SIZE);
+
+  if (begin < aligned_begin) {
+    munmap(addr, aligned_begin - begin);
+  }
+  if (aligned_end < end) {
+    munmap(UnsafeCast<void *>(aligned_end), end - aligned_end);
+  }
+
+#if PJIT_FEATURE_HUGE_PAGES && defined(MADV_HUGEPAGE)
+  madvise(UnsafeCast<void *>(aligned_begin), RESERVATION_SIZE, MADV_HUGEPAGE);
+#endif
+
+  NEXT_PAGE = aligned_begin;
+  COMMIT_LIMIT = aligned_begin;
+  RESERVATION_LIMIT = aligned_end;
+  return true;
+}
+
+
+// Allocate `num_bytes` from the current reservation, committing another batch
+// of the reservation if necessary. Any uncommitted tail of an exhausted
+// reservation is abandoned.
+static void *AllocateFromReservation(UnsignedSize num_bytes) {
+  if (RESERVATION_LIMIT < (NEXT_PAGE + num_bytes) && !Reserve()) {
+    return nullptr;
+  }
 
+  if (COMMIT_LIMIT < (NEXT_PAGE + num_bytes)) {
+    if (mprotect(UnsafeCast<void *>(COMMIT_LIMIT), COMMIT_BATCH_SIZE,
+                 PROT_READ | PROT_WRITE)) {
+      return nullptr;
+    }
+    COMMIT_LIMIT += COMMIT_BATCH_SIZE;
+  }
+
+  void *ret(UnsafeCast<void *>(NEXT_PAGE));
+  NEXT_PAGE += num_bytes;
   return ret;
 }
 
 
-// Frees `num` pages back to the OS.
+// Allocates `num` number of pages from the OS with `MEMORY_READ_WRITE`
+// protection. Small allocations are satisfied from the page pool, or from the
+// current reservation.
+void *AllocatePages(unsigned num) {
+  const UnsignedSize num_bytes(pjit::PAGE_FRAME_SIZE * num);
+  if (MAX_POOLED_NUM_PAGES < num) {
+    return MapPages(num_bytes, PROT_READ | PROT_WRITE, 0);
+  }
+
+  // Pooled runs were given back to the OS when they were freed, and so they
+  // are zero-filled on demand.
+  LOCK.Acquire();
+  PageRunPool &pool(PAGE_POOL[num]);
+  void *ret(nullptr);
+  if (pool.num_runs) {
+    ret = pool.runs[--pool.num_runs];
+  } else {
+    ret = AllocateFromReservation(num_bytes);
+  }
+  LOCK.Release();
+  return ret;
+}
+
+
+// Frees `num` pages. The physical memory of small runs of pages is released
+// to the OS, and their addresses are returned to the page pool.
 void FreePages(void *addr, unsigned num) {
-  munmap(addr, num * pjit::PAGE_FRAME_SIZE);
+  const UnsignedSize num_bytes(pjit::PAGE_FRAME_SIZE * num);
+  if (MAX_POOLED_NUM_PAGES < num) {
+    munmap(addr, num_bytes);
+    return;
+  }
+
+  madvise(addr, num_bytes, MADV_DONTNEED);
+
+  LOCK.Acquire();
+  PageRunPool &pool(PAGE_POOL[num]);
+  const bool is_pooled(pool.num_runs < MAX_POOLED_NUM_RUNS);
+  if (is_pooled) {
+    pool.runs[pool.num_runs++] = addr;
+  }
+  LOCK.Release();
+
+  if (!is_pooled) {
+    munmap(addr, num_bytes);
+  }
+}
+
+
+// Unmaps every run of pages in the page pool.
+void TrimPagePool(void) {
+  for (unsigned num(1); num <= MAX_POOLED_NUM_PAGES; ++num) {
+    PageRunPool &pool(PAGE_POOL[num]);
+    for (;;) {
+      void *run(nullptr);
+      LOCK.Acquire();
+      if (pool.num_runs) {
+        run = pool.runs[--pool.num_runs];
+      }
+      LOCK.Release();
+
+      if (!run) {
+        break;
+      }
+      munmap(run, num * pjit::PAGE_FRAME_SIZE);
+    }
+  }
 }
 
 
@@ -55,7 +223,7 @@ void FreePages(void *addr, unsigned num) {
 void ProtectPages(void *addr, unsigned num, MemoryProtection prot) {
   int prot_bits(0);
   if (MemoryProtection::MEMORY_EXECUTABLE == prot) {
-    prot_bits = PROT_EXEC;
+    prot_bits = PROT_READ | PROT_EXEC;
   } else if (MemoryProtection::MEMORY_READ_ONLY == prot) {
     prot_bits = PROT_READ;
   } else if (MemoryProtection::MEMORY_READ_WRITE == prot) {
@@ -29,15 +29,20 @@ enum class MemoryProtection {
 };
 
 
-// Allocates `num` number of pages from the OS with `MEMORY_READ_WRITE`
-// protection.
+// Allocates `num` number of zero-filled pages with `MEMORY_READ_WRITE`
+// protection. Returns `nullptr` if the pages could not be allocated.
 void *AllocatePages(unsigned num);
 
 
-// Frees `num` pages back to the OS.
+// Frees `num` pages. Small runs of pages are kept in a pool for later reuse,
+// and so freed pages must have `MEMORY_READ_WRITE` protection.
 void FreePages(void *, unsigned num);
 
 
+// Returns every run of pages that is kept in the pool to the OS.
+void TrimPagePool(void);
+
+
 // Changes the memory protection of some pages.
 void ProtectPages(void *addr, unsigned num, MemoryProtection prot);
 
@@ -0,0 +1,41 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * spin-lock.h
+ *
+ *  Created on: 2014-01-06
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_BASE_SPIN_LOCK_H_
+#define PJIT_BASE_SPIN_LOCK_H_
+
+#include "pjit/base/base.h"
+
+namespace pjit {
+
+
+// A simple test-and-set spin lock, for guarding short critical sections.
+class SpinLock {
+ public:
+  constexpr SpinLock(void)
+      : is_locked(false) {}
+
+  void Acquire(void) {
+    while (__atomic_test_and_set(&is_locked, __ATOMIC_ACQUIRE)) {
+      while (__atomic_load_n(&is_locked, __ATOMIC_RELAXED)) {}
+    }
+  }
+
+  void Release(void) {
+    __atomic_clear(&is_locked, __ATOMIC_RELEASE);
+  }
+
+ private:
+  bool is_locked;
+
+  PJIT_DISALLOW_COPY_AND_ASSIGN(SpinLock);
+};
+
+}  // namespace pjit
+
+#endif  // PJIT_BASE_SPIN_LOCK_H_
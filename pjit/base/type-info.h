@@ -100,6 +100,11 @@ struct StructureFieldInfo {
     FIELD_ARRAY,
     FIELD_BITFIELD
   } kind;
+
+  // Byte offset of this field from the beginning of its structure or union.
+  // The location of a bitfield is instead described by `meta.bit_field`.
+  unsigned offset_in_bytes;
+
   union StructureFieldMetaData {
     unsigned array_length;
     struct {
@@ -169,6 +174,7 @@ struct StructureTypeInfo {
 #define PJIT_DEFINE_FIELD_IMPL(field_type, name, kind, num, copy_func) \
   { &(StaticTypeInfoFactory<PJIT_UNPACK field_type>::kTypeInfo.info), \
     StructureFieldInfo::kind, \
+    PJIT_OFFSET_OF(StructureTypeName, name), \
     {num}, \
     PJIT_TO_STRING(name), \
     copy_func(name) }
@@ -16,6 +16,7 @@
 #include "pjit/base/compiler.h"
 #include "pjit/base/numeric-types.h"
 #include "pjit/base/libc.h"
+#include "pjit/base/unsafe-cast.h"
 #include "pjit/base/visitor.h"
 
 namespace pjit {
@@ -24,10 +25,17 @@ namespace pjit {
 // Defines a simple, single-threaded allocator for a single kind of object. The
 // size of the allocated object must be strictly less than a page.
 //
+// Free slots are found in constant time: each page hands out never-before-used
+// slots with a bump index, and threads freed slots onto an intrusive free list
+// that is stored in the memory of the freed objects themselves.
+//
+// Allocation and reachability status is kept in per-page bitmaps, so that
+// resetting the marks for a garbage collection epoch is a `memset`, and
+// sweeping handles a word's worth of objects at a time.
+//
 // TODO(pag): Eventually this should be improved. Some improvements that could
 //            be made without changing too much:
-//              1) Use a bitset instead of an array of `ObjectMetaData`.
-//              2) Merge the `full_pages` and `partial_pages`, so that full
+//              1) Merge the `full_pages` and `partial_pages`, so that full
 //                 pages are at the end of the list and partial pages are at
 //                 the beginning.
 template <typename T, unsigned kNumPages=1>
@@ -77,7 +85,7 @@ class Allocator {
 
   void MarkReachable(const T *obj) {
     PageMetaData *page(ObjectToPage(obj));
-    page->status[obj - page->objects].is_reachable = true;
+    SetBit(page->is_reachable, static_cast<unsigned>(obj - page->objects));
   }
 
   void FreeUnreachable(void) {
@@ -116,6 +124,12 @@ class Allocator {
  private:
   struct PageMetaData;
 
+  // A freed object slot. Freed slots are chained together into a per-page
+  // free list, where the link is stored in the freed object's memory.
+  struct FreeObject {
+    FreeObject *next;
+  };
+
   // The basic implementation of the page meta-data. This excludes the actual
   // meta-data about individual objects.
   struct PageMetaDataImpl {
@@ -127,6 +141,15 @@ class Allocator {
     PageMetaData *next;
     unsigned num_allocated;
     unsigned num_free;
+
+    // Number of slots (starting from slot 0) that have ever been handed out.
+    // Slots at or beyond this index have never been allocated, and so are not
+    // on the `free_list`.
+    unsigned num_touched;
+
+    // Free list of previously allocated and then freed slots.
+    FreeObject *free_list;
+
     T *objects;
 
     explicit PageMetaDataImpl(void *allocator_)
@@ -135,6 +158,8 @@ class Allocator {
           next(nullptr),
           num_allocated(0),
           num_free(0),
+          num_touched(0),
+          free_list(nullptr),
           objects(nullptr) {}
   };
 
@@ -144,28 +169,29 @@ class Allocator {
     OBJECT_ALIGN = PJIT_ALIGNMENT_OF(T),
     IMPL_SIZE = sizeof(PageMetaDataImpl),
     ESTIMATED_NUM_OBJECTS = (SLAB_SIZE - IMPL_SIZE) / OBJECT_SIZE,
+    BITS_PER_WORD = 64,
+    NUM_STATUS_WORDS = (ESTIMATED_NUM_OBJECTS + BITS_PER_WORD - 1) /
+                       BITS_PER_WORD,
     POISON = 0xAB
   };
 
-  // Meta-data about allocated objects. These bits determine whether or not
-  // an object is allocated, as well as whether it has been marked as reachable
-  // or not within the current garbage collection epoch.
+  // Full page meta-data, including per-object meta-data. The bit for slot `i`
+  // of the `is_allocated` bitmap determines whether or not that object is
+  // allocated, and the corresponding bit of the `is_reachable` bitmap
+  // determines whether or not it has been marked as reachable within the
+  // current garbage collection epoch.
   //
   // Note: Garbage collection epochs are externally defined, and interface with
   //       the allocator by means of the `MarkAllUnreachable`, `MarkReachable`,
   //       and `FreeUnreachable` methods.
-  struct ObjectMetaData {
-    bool is_allocated:1;
-    bool is_reachable:1;
-  };
-
-  // Full page meta-data, including per-object meta-data.
   struct PageMetaData : public PageMetaDataImpl {
-    ObjectMetaData status[ESTIMATED_NUM_OBJECTS];
+    U64 is_allocated[NUM_STATUS_WORDS];
+    U64 is_reachable[NUM_STATUS_WORDS];
 
     explicit PageMetaData(void *allocator_)
         : PageMetaDataImpl(allocator_) {
-      memset(&(status[0]), 0, sizeof(ObjectMetaData) * ESTIMATED_NUM_OBJECTS);
+      memset(&(is_allocated[0]), 0, sizeof is_allocated);
+      memset(&(is_reachable[0]), 0, sizeof is_reachable);
     }
   };
 
@@ -181,6 +207,8 @@ class Allocator {
   };
 
   static_assert(OBJECT_SIZE < SLAB_SIZE, "Object to allocate is too big.");
+  static_assert(sizeof(FreeObject) <= OBJECT_SIZE,
+                "Object to allocate is too small to hold a free list link.");
   static_assert(0 < NUM_OBJECTS, "Object size is too big for the allocator.");
   static_assert(
       static_cast<unsigned>(NUM_OBJECTS) <=
@@ -197,6 +225,22 @@ class Allocator {
   Allocator(const Allocator<T> &) = delete;
   Allocator(const Allocator<T> &&) = delete;
 
+  // Manipulate the bit for slot `i` in one of a page's status bitmaps.
+  static inline void SetBit(U64 *bits, unsigned i) {
+    bits[i / BITS_PER_WORD] |= 1UL << (i % BITS_PER_WORD);
+  }
+
+  static inline void ClearBit(U64 *bits, unsigned i) {
+    bits[i / BITS_PER_WORD] &= ~(1UL << (i % BITS_PER_WORD));
+  }
+
+  // Returns the index of the lowest set bit of `bits`, and clears that bit.
+  static inline unsigned PopLowestBit(U64 &bits) {
+    const unsigned i(static_cast<unsigned>(__builtin_ctzl(bits)));
+    bits &= bits - 1;
+    return i;
+  }
+
   // Returns the Page containing this object.
   PageMetaData *ObjectToPage(const T *object) {
     const UnsignedPointer addr(reinterpret_cast<UnsignedPointer>(object));
@@ -217,7 +261,7 @@ class Allocator {
   // Unchain a page in a page list.
   void UnchainPage(PageMetaData *&list, PageMetaData *page) {
     PageMetaData *prev(page->prev);
-    PageMetaData *next(prev->next);
+    PageMetaData *next(page->next);
     if (prev) {
       prev->next = next;
     } else {
@@ -246,7 +290,7 @@ class Allocator {
   // return an otherwise uniniatlized object (i.e. the constructor is not
   // invoked here).
   T *AllocateFromPage(PageMetaData *page, unsigned i) {
-    page->status[i].is_allocated = true;
+    SetBit(page->is_allocated, i);
     page->num_free -= 1;
     page->num_allocated += 1;
 
@@ -260,61 +304,88 @@ class Allocator {
     return ret;
   }
 
+  // Add slot `i` of the Page `page` to the page's free list.
+  void AddToFreeList(PageMetaData *page, unsigned i) {
+    FreeObject *obj(UnsafeCast<FreeObject *>(&(page->objects[i])));
+    obj->next = page->free_list;
+    page->free_list = obj;
+  }
+
   // Free the object stored in slot `i` of the Page `page`.
   void FreeFromPage(PageMetaData *page, unsigned i) {
+    const bool was_full(!page->num_free);
 
-    page->status[i].is_allocated = false;
+    ClearBit(page->is_allocated, i);
     page->num_allocated -= 1;
 
     if (!page->num_allocated) {
-      UnchainPage(partial_pages, page);
+      UnchainPage(was_full ? full_pages : partial_pages, page);
       FreePages(page, kNumPages);
+      return;
+    }
 
-    } else if (!page->num_free) {
+    if (was_full) {
       UnchainPage(full_pages, page);
       ChainPage(partial_pages, page);
     }
 
     page->num_free += 1;
+    AddToFreeList(page, i);
   }
 
-  // Get an uninitialized (zero-initialized)
+  // Get an uninitialized (zero-initialized) object. Previously freed slots are
+  // preferred over never-before-used slots so that the working set of the page
+  // stays small.
   T *GetFreeObject(void) {
     if (!partial_pages) {
       ChainPage(partial_pages, AllocatePage());
     }
 
-    for (unsigned i(0); i < NUM_OBJECTS; ++i) {
-      if (!partial_pages->status[i].is_allocated) {
-        return AllocateFromPage(partial_pages, i);
-      }
+    PageMetaData *page(partial_pages);
+    FreeObject *obj(page->free_list);
+    if (obj) {
+      page->free_list = obj->next;
+      return AllocateFromPage(
+          page, static_cast<unsigned>(UnsafeCast<T *>(obj) - page->objects));
     }
 
-    return nullptr;
+    return AllocateFromPage(page, page->num_touched++);
   }
 
   void FreeObjectsOnPage(PageMetaData *page) {
-    for (unsigned i(0); i < NUM_OBJECTS; ++i) {
-      if (page->status[i].is_allocated) {
-        page->status[i].is_allocated = false;
-        page->objects[i].~T();
+    for (unsigned w(0); w < NUM_STATUS_WORDS; ++w) {
+      for (U64 live(page->is_allocated[w]); live; ) {
+        page->objects[w * BITS_PER_WORD + PopLowestBit(live)].~T();
       }
+      page->is_allocated[w] = 0;
     }
     page->num_allocated = 0;
     page->num_free = NUM_OBJECTS;
+    page->num_touched = 0;
+    page->free_list = nullptr;
   }
 
+  // Sweep the pages of `page`, one bitmap word (i.e. 64 objects) at a time.
   void FreeUnreachableObjectsOnPages(PageMetaData *page) {
     for (; nullptr != page; page = page->next) {
-      for (unsigned i(0); i < NUM_OBJECTS; ++i) {
-        if (page->status[i].is_allocated && !page->status[i].is_reachable) {
+      for (unsigned w(0); w < NUM_STATUS_WORDS; ++w) {
+        U64 dead(page->is_allocated[w] & ~(page->is_reachable[w]));
+        if (PJIT_LIKELY(!dead)) {
+          continue;
+        }
+
+        const unsigned num_dead(
+            static_cast<unsigned>(__builtin_popcountl(dead)));
+        page->is_allocated[w] &= ~dead;
+        page->num_allocated -= num_dead;
+        page->num_free += num_dead;
+
+        while (dead) {
+          const unsigned i(w * BITS_PER_WORD + PopLowestBit(dead));
           T *object(&(page->objects[i]));
-          page->status[i].is_allocated = false;
           object->~T();
           memset(object, POISON, sizeof(T));
-
-          --(page->num_allocated);
-          ++(page->num_free);
+          AddToFreeList(page, i);
         }
       }
     }
@@ -330,11 +401,7 @@ class Allocator {
 
   void MarkPagesUnreachable(PageMetaData *page) {
     for (; nullptr != page; page = page->next) {
-      for (unsigned i(0); i < NUM_OBJECTS; ++i) {
-        if (page->status[i].is_allocated) {
-          page->status[i].is_reachable = false;
-        }
-      }
+      memset(&(page->is_reachable[0]), 0, sizeof page->is_reachable);
     }
   }
 
@@ -342,9 +409,10 @@ class Allocator {
   void VisitPageList(PageMetaData *page,
                      typename VisitorFor<T>::Type *visitor) {
     for (; nullptr != page; page = page->next) {
-      for (unsigned i(0); i < NUM_OBJECTS; ++i) {
-        if (page->status[i].is_allocated) {
-          visitor->Visit(&(page->objects[i]));
+      for (unsigned w(0); w < NUM_STATUS_WORDS; ++w) {
+        for (U64 live(page->is_allocated[w]); live; ) {
+          visitor->Visit(&(page->objects[w * BITS_PER_WORD +
+                                         PopLowestBit(live)]));
         }
       }
     }
@@ -0,0 +1,73 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * arena.cc
+ *
+ *  Created on: 2014-01-04
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/containers/arena.h"
+
+namespace pjit {
+
+
+class ArenaChunk {
+ public:
+  ArenaChunk *next;
+};
+
+
+Arena::Arena(void)
+    : chunks(nullptr),
+      last_chunk(nullptr),
+      free_chunks(nullptr),
+      next(0),
+      limit(0) {}
+
+
+Arena::~Arena(void) {
+  Reset();
+  for (ArenaChunk *chunk(free_chunks), *next_chunk(nullptr);
+       nullptr != chunk; chunk = next_chunk) {
+    next_chunk = chunk->next;
+    FreePages(chunk, CHUNK_NUM_PAGES);
+  }
+  free_chunks = nullptr;
+}
+
+
+// Release every object allocated from this arena. This splices the list of
+// in-use chunks onto the free list, and so takes constant time.
+void Arena::Reset(void) {
+  if (chunks) {
+    last_chunk->next = free_chunks;
+    free_chunks = chunks;
+  }
+  chunks = nullptr;
+  last_chunk = nullptr;
+  next = 0;
+  limit = 0;
+}
+
+
+// Switch allocation to a new or recycled chunk.
+UnsignedPointer Arena::AllocateFromNewChunk(UnsignedPointer mask) {
+  ArenaChunk *chunk(free_chunks);
+  if (chunk) {
+    free_chunks = chunk->next;
+  } else {
+    chunk = UnsafeCast<ArenaChunk *>(AllocatePages(CHUNK_NUM_PAGES));
+  }
+
+  chunk->next = chunks;
+  chunks = chunk;
+  if (!last_chunk) {
+    last_chunk = chunk;
+  }
+
+  const UnsignedPointer base(UnsafeCast<UnsignedPointer>(chunk));
+  limit = base + CHUNK_SIZE;
+  return (base + sizeof(ArenaChunk) + mask) & ~mask;
+}
+
+}  // namespace pjit
@@ -0,0 +1,89 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * arena.h
+ *
+ *  Created on: 2014-01-04
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_CONTAINERS_ARENA_H_
+#define PJIT_CONTAINERS_ARENA_H_
+
+#include <new>  // NOLINT
+
+#include "pjit/base/base.h"
+#include "pjit/base/compiler.h"
+#include "pjit/base/libc.h"
+#include "pjit/base/memory.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/base/unsafe-cast.h"
+
+namespace pjit {
+
+class ArenaChunk;
+
+
+// A bump-pointer region allocator for objects of any type. Objects allocated
+// from an arena are never individually freed, and their destructors are never
+// invoked. Instead, every object is released in one step, either by `Reset`,
+// which keeps the arena's memory around for re-use, or by destroying the
+// arena, which returns its memory to the OS.
+class Arena {
+ public:
+  enum : unsigned {
+    CHUNK_NUM_PAGES = 16,
+    CHUNK_SIZE = CHUNK_NUM_PAGES * PAGE_FRAME_SIZE
+  };
+
+  Arena(void);
+  ~Arena(void);
+
+  template <typename T, typename... Args>
+  T *Allocate(Args... args) {
+    static_assert(sizeof(T) <= (CHUNK_SIZE / 2),
+                  "Object to allocate is too big for an arena.");
+    return new (AllocateBytes(sizeof(T), PJIT_ALIGNMENT_OF(T))) T(args...);
+  }
+
+  // Allocate `size` bytes of zero-initialized memory, aligned to `align`,
+  // which must be a power of two.
+  inline void *AllocateBytes(unsigned size, unsigned align) {
+    const UnsignedPointer mask(static_cast<UnsignedPointer>(align) - 1);
+    UnsignedPointer addr((next + mask) & ~mask);
+    if (PJIT_UNLIKELY(addr + size > limit)) {
+      addr = AllocateFromNewChunk(mask);
+    }
+    next = addr + size;
+
+    void *mem(UnsafeCast<void *>(addr));
+    memset(mem, 0, size);
+    return mem;
+  }
+
+  // Release every object allocated from this arena. The arena's chunks are
+  // kept around and re-used for future allocations.
+  void Reset(void);
+
+ private:
+  // Chunks currently being allocated from. The most recently allocated chunk
+  // is first.
+  ArenaChunk *chunks;
+  ArenaChunk *last_chunk;
+
+  // Chunks that have been released by `Reset` and can be re-used.
+  ArenaChunk *free_chunks;
+
+  // Bounds of the free space in the current chunk.
+  UnsignedPointer next;
+  UnsignedPointer limit;
+
+  // Switch allocation to a new or recycled chunk, and return the first
+  // address in that chunk that satisfies the alignment `mask`.
+  UnsignedPointer AllocateFromNewChunk(UnsignedPointer mask);
+
+  PJIT_DISALLOW_COPY_AND_ASSIGN(Arena);
+};
+
+}  // namespace pjit
+
+#endif  // PJIT_CONTAINERS_ARENA_H_
@@ -0,0 +1,222 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * code-cache.cc
+ *
+ *  Created on: 2014-01-10
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/containers/code-cache.h"
+
+#include "pjit/base/unsafe-cast.h"
+
+namespace pjit {
+
+
+static unsigned PageAlignDown(unsigned offset) {
+  return offset & ~(PAGE_FRAME_SIZE - 1U);
+}
+
+
+static unsigned PageAlignUp(unsigned offset) {
+  return PageAlignDown(offset + PAGE_FRAME_SIZE - 1U);
+}
+
+
+CodeCache::CodeCache(unsigned max_num_chunks_)
+    : CodeCache(max_num_chunks_, nullptr) {}
+
+
+CodeCache::CodeCache(unsigned max_num_chunks_,
+                     CodeCacheEvictionHandler *eviction_handler_)
+    : current_chunk(0),
+      next_victim(0),
+      max_num_chunks(max_num_chunks_),
+      eviction_handler(eviction_handler_),
+      num_live_regions(0),
+      num_protection_changes(0),
+      num_evictions(0) {}
+
+
+// Free every chunk. Chunks must be made writable before they can be freed.
+CodeCache::~CodeCache(void) {
+  for (CodeChunk &chunk : chunks) {
+    ProtectPages(chunk.begin, CHUNK_NUM_PAGES,
+                 MemoryProtection::MEMORY_READ_WRITE);
+    FreePages(chunk.begin, CHUNK_NUM_PAGES);
+  }
+}
+
+
+// Allocate a writable region of `size` bytes for some code.
+void *CodeCache::Allocate(unsigned size, unsigned *generation) {
+  if (!size || CHUNK_SIZE < size) {
+    return nullptr;
+  }
+
+  const unsigned aligned_size(
+      (size + CODE_ALIGNMENT - 1) & ~(CODE_ALIGNMENT - 1U));
+  if (!FindChunk(aligned_size)) {
+    return nullptr;
+  }
+
+  CodeChunk &chunk(chunks.Get(current_chunk));
+  const unsigned offset(chunk.num_used_bytes);
+  MakeWritable(chunk, offset, offset + size);
+  chunk.num_used_bytes += aligned_size;
+  chunk.num_live_regions += 1;
+  num_live_regions += 1;
+  *generation = chunk.generation;
+  return chunk.begin + offset;
+}
+
+
+// Make every region allocated since the last commit executable. Regions
+// within a chunk are allocated contiguously, so each chunk needs at most one
+// protection change.
+//
+// Committed pages must stay executable, so the next region allocated from a
+// chunk starts on a fresh page rather than on the last page of this commit.
+void CodeCache::Commit(void) {
+  for (CodeChunk &chunk : chunks) {
+    if (chunk.writable_begin < chunk.writable_end) {
+      ProtectPages(chunk.begin + chunk.writable_begin,
+                   (chunk.writable_end - chunk.writable_begin) /
+                       PAGE_FRAME_SIZE,
+                   MemoryProtection::MEMORY_EXECUTABLE);
+      num_protection_changes += 1;
+      chunk.writable_begin = 0;
+      chunk.writable_end = 0;
+      chunk.num_used_bytes = PageAlignUp(chunk.num_used_bytes);
+    }
+  }
+}
+
+
+// Free a region of code. A chunk is recycled as soon as all of its regions
+// have been freed.
+void CodeCache::Free(void *code, unsigned generation) {
+  U8 *addr(UnsafeCast<U8 *>(code));
+  for (CodeChunk &chunk : chunks) {
+    if (chunk.begin <= addr && addr < (chunk.begin + CHUNK_SIZE)) {
+      if (chunk.generation == generation && chunk.num_live_regions) {
+        chunk.num_live_regions -= 1;
+        num_live_regions -= 1;
+        if (!chunk.num_live_regions) {
+          Recycle(chunk);
+        }
+      }
+      return;
+    }
+  }
+}
+
+
+void CodeCache::GetStatistics(CodeCacheStatistics *stats) const {
+  stats->num_chunks = chunks.Size();
+  stats->num_live_regions = num_live_regions;
+  stats->num_protection_changes = num_protection_changes;
+  stats->num_evictions = num_evictions;
+}
+
+
+// Find a chunk with room for `size` more bytes, and make it the current chunk.
+// Empty chunks are preferred over new chunks, and new chunks are preferred
+// over evicting the oldest chunk.
+bool CodeCache::FindChunk(unsigned size) {
+  const unsigned num_chunks(chunks.Size());
+  if (num_chunks &&
+      (chunks.Get(current_chunk).num_used_bytes + size) <= CHUNK_SIZE) {
+    return true;
+  }
+
+  for (unsigned i(0); i < num_chunks; ++i) {
+    if (!chunks.Get(i).num_used_bytes) {
+      current_chunk = i;
+      return true;
+    }
+  }
+
+  if (num_chunks < max_num_chunks) {
+    void *mem(AllocatePages(CHUNK_NUM_PAGES));
+    if (!mem) {
+      return false;
+    }
+
+    // New pages are writable, and will be made executable by the next commit.
+    CodeChunk chunk;
+    chunk.begin = UnsafeCast<U8 *>(mem);
+    chunk.writable_end = CHUNK_SIZE;
+    chunks.PushBack(chunk);
+    current_chunk = num_chunks;
+    return true;
+  }
+
+  if (!num_chunks) {
+    return false;
+  }
+
+  // Evict the oldest chunk, other than the current one (unless it is the only
+  // one).
+  unsigned victim(next_victim % num_chunks);
+  if (victim == current_chunk && 1 < num_chunks) {
+    victim = (victim + 1) % num_chunks;
+  }
+  next_victim = victim + 1;
+
+  CodeChunk &chunk(chunks.Get(victim));
+  if (chunk.num_live_regions && eviction_handler) {
+    eviction_handler->Evict(chunk.begin, chunk.begin + chunk.num_used_bytes);
+  }
+  num_live_regions -= chunk.num_live_regions;
+  chunk.num_live_regions = 0;
+  Recycle(chunk);
+  num_evictions += 1;
+  current_chunk = victim;
+  return true;
+}
+
+
+// Make the pages containing the bytes `[begin, end)` of a chunk writable.
+// The writable range of a chunk is kept contiguous. Allocation proceeds
+// forward through a chunk, so the writable range is grown to the end of the
+// chunk in one step; the unused pages contain no code.
+void CodeCache::MakeWritable(CodeChunk &chunk, unsigned begin,
+                             unsigned end) {
+  begin = PageAlignDown(begin);
+  end = PageAlignUp(end);
+  if (end > chunk.writable_end) {
+    end = CHUNK_SIZE;
+  }
+
+  if (chunk.writable_begin == chunk.writable_end) {
+    chunk.writable_begin = begin;
+    chunk.writable_end = begin;
+  }
+
+  if (begin < chunk.writable_begin) {
+    ProtectPages(chunk.begin + begin,
+                 (chunk.writable_begin - begin) / PAGE_FRAME_SIZE,
+                 MemoryProtection::MEMORY_READ_WRITE);
+    num_protection_changes += 1;
+    chunk.writable_begin = begin;
+  }
+
+  if (end > chunk.writable_end) {
+    ProtectPages(chunk.begin + chunk.writable_end,
+                 (end - chunk.writable_end) / PAGE_FRAME_SIZE,
+                 MemoryProtection::MEMORY_READ_WRITE);
+    num_protection_changes += 1;
+    chunk.writable_end = end;
+  }
+}
+
+
+// Make an empty chunk available for allocation, in a new generation. Its
+// pages are left as they are until they are next allocated from.
+void CodeCache::Recycle(CodeChunk &chunk) {
+  chunk.num_used_bytes = 0;
+  chunk.generation += 1;
+}
+
+}  // namespace pjit
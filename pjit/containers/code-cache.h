@@ -0,0 +1,143 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * code-cache.h
+ *
+ *  Created on: 2014-01-10
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_CONTAINERS_CODE_CACHE_H_
+#define PJIT_CONTAINERS_CODE_CACHE_H_
+
+#include "pjit/base/base.h"
+#include "pjit/base/memory.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/containers/vector.h"
+
+namespace pjit {
+
+
+struct CodeCacheStatistics {
+  // Number of chunks of executable memory owned by the cache.
+  unsigned num_chunks;
+
+  // Number of allocated regions that have not been freed.
+  unsigned num_live_regions;
+
+  // Number of times that the protection of some pages was changed.
+  U64 num_protection_changes;
+
+  // Number of chunks whose code was evicted to make room for new code.
+  U64 num_evictions;
+};
+
+
+// Notified when the code cache evicts code that has not been freed. After
+// `Evict` returns, any pointers into the range `[begin, end)` are dangling.
+// Freeing them is harmless, as the generation of their chunk has changed.
+class CodeCacheEvictionHandler {
+ public:
+  CodeCacheEvictionHandler(void) = default;
+  virtual ~CodeCacheEvictionHandler(void) = default;
+  virtual void Evict(const void *begin, const void *end) = 0;
+};
+
+
+// A cache of executable code, for compiling many small functions.
+//
+// Memory is obtained from the OS in large chunks, and functions are packed
+// densely (with `CODE_ALIGNMENT`-byte alignment) into those chunks so that
+// the code occupies as few cache lines and pages as possible.
+//
+// Memory is never writable and executable at the same time. Newly allocated
+// regions are writable; `Commit` makes every region allocated since the
+// previous `Commit` executable, with one protection change per touched
+// chunk, so that a whole batch of functions costs a handful of system calls.
+//
+// Committed code stays executable while new code is written: the first
+// region allocated from a chunk after a `Commit` starts on a fresh page, so
+// writable pages never hold committed code. This leaves at most the unused
+// tail of one page per chunk per `Commit`.
+//
+// Freed regions are not re-used individually. Instead, a chunk is recycled
+// once every region in it has been freed. If the cache has reached its
+// maximum number of chunks, then the oldest chunk is evicted (after notifying
+// the eviction handler) to make room for new code.
+//
+// Every recycling of a chunk starts a new generation of the chunk. Regions
+// are freed along with the generation in which they were allocated, so that
+// freeing an evicted region cannot release code that now occupies its chunk.
+//
+// Note: A code cache is not thread-safe.
+class CodeCache {
+ public:
+  enum : unsigned {
+    CHUNK_NUM_PAGES = 64,
+    CHUNK_SIZE = CHUNK_NUM_PAGES * PAGE_FRAME_SIZE,
+    CODE_ALIGNMENT = 16
+  };
+
+  explicit CodeCache(unsigned max_num_chunks_);
+  CodeCache(unsigned max_num_chunks_,
+            CodeCacheEvictionHandler *eviction_handler_);
+  ~CodeCache(void);
+
+  // Allocate a writable region of `size` bytes for some code, and return the
+  // generation of its chunk in `generation`. Returns `nullptr` if `size` is
+  // larger than `CHUNK_SIZE`, or if no memory is available.
+  void *Allocate(unsigned size, unsigned *generation);
+
+  // Make every region allocated since the last commit executable.
+  void Commit(void);
+
+  // Free a region of code that was allocated in the generation `generation`
+  // of its chunk. Regions of older generations were evicted, and are ignored.
+  void Free(void *code, unsigned generation);
+
+  void GetStatistics(CodeCacheStatistics *stats) const;
+
+ private:
+  struct CodeChunk {
+    U8 *begin = nullptr;
+
+    // Number of bytes of the chunk that have been allocated, or that can no
+    // longer be allocated because their page has been committed.
+    unsigned num_used_bytes = 0;
+
+    unsigned num_live_regions = 0;
+
+    // Number of times this chunk has been recycled.
+    unsigned generation = 0;
+
+    // The range of pages (as byte offsets) that are writable, and so need to
+    // be made executable by the next commit.
+    unsigned writable_begin = 0;
+    unsigned writable_end = 0;
+  };
+
+  Vector<CodeChunk> chunks;
+
+  // Index of the chunk currently being allocated from.
+  unsigned current_chunk;
+
+  // Index of the next chunk to evict.
+  unsigned next_victim;
+
+  const unsigned max_num_chunks;
+  CodeCacheEvictionHandler * const eviction_handler;
+
+  unsigned num_live_regions;
+  U64 num_protection_changes;
+  U64 num_evictions;
+
+  bool FindChunk(unsigned size);
+  void MakeWritable(CodeChunk &chunk, unsigned begin, unsigned end);
+  void Recycle(CodeChunk &chunk);
+
+  CodeCache(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(CodeCache);
+};
+
+}  // namespace pjit
+
+#endif  // PJIT_CONTAINERS_CODE_CACHE_H_
@@ -0,0 +1,268 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * concurrent-allocator.h
+ *
+ *  Created on: 2014-01-05
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_CONTAINERS_CONCURRENT_ALLOCATOR_H_
+#define PJIT_CONTAINERS_CONCURRENT_ALLOCATOR_H_
+
+#include <new>  // NOLINT
+
+#include "pjit/base/base.h"
+#include "pjit/base/memory.h"
+#include "pjit/base/compiler.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/base/libc.h"
+#include "pjit/base/unsafe-cast.h"
+#include "pjit/containers/lock-free-stack.h"
+
+namespace pjit {
+
+
+// Defines an allocator for a single kind of object that can be shared by many
+// threads. Each thread allocates and frees objects through its own
+// `ThreadCache`, which holds two magazines (fixed-size stacks) of free object
+// slots. Threads only touch the shared state of the allocator when both of
+// their magazines are exhausted (or both are full), at which point whole
+// magazines are exchanged with the allocator's lock-free depot. New slabs of
+// objects are only allocated when the depot has no loaded magazines left.
+//
+// Objects can be freed by any thread's cache, regardless of which thread
+// allocated them.
+//
+// Note: Unlike `Allocator`, this allocator does not track which objects are
+//       live. It therefore cannot be garbage collected or visited, and objects
+//       that are still allocated when the allocator is destroyed are released
+//       without having their destructors invoked.
+//
+// Note: Nothing in pjit allocates through this allocator yet. A `mir::Context`
+//       uses its own single-threaded `Allocator`s (or its arena), which is
+//       enough for each thread to build its own context. This allocator is
+//       for objects that are shared by, and freed across, threads.
+template <typename T, unsigned kNumPages=1>
+class ConcurrentAllocator {
+ private:
+  struct Magazine;
+
+ public:
+
+  // Per-thread cache of free objects. A `ThreadCache` must only be used by a
+  // single thread, and must not outlive its allocator.
+  class ThreadCache {
+   public:
+    explicit ThreadCache(ConcurrentAllocator *allocator_)
+        : allocator(allocator_),
+          loaded(allocator_->GetEmptyMagazine()),
+          previous(allocator_->GetEmptyMagazine()) {}
+
+    // Return the cached objects to the allocator's depot, so that they are
+    // available to other threads.
+    ~ThreadCache(void) {
+      allocator->ReturnMagazine(loaded);
+      allocator->ReturnMagazine(previous);
+    }
+
+    template <typename... Args>
+    T *Allocate(Args... args) {
+      if (PJIT_UNLIKELY(!loaded->num_objects)) {
+        Reload();
+      }
+      void *mem(loaded->objects[--(loaded->num_objects)]);
+      memset(mem, 0, sizeof(T));
+      return new (mem) T(args...);
+    }
+
+    void Free(T *obj) {
+      if (!obj) {
+        return;
+      }
+
+      obj->~T();
+
+      memset(obj, POISON, sizeof *obj);  // Poison the memory;
+
+      if (PJIT_UNLIKELY(MAGAZINE_SIZE == loaded->num_objects)) {
+        Unload();
+      }
+      loaded->objects[loaded->num_objects++] = obj;
+    }
+
+   private:
+    ConcurrentAllocator * const allocator;
+
+    // Magazine from which objects are allocated and into which objects are
+    // freed.
+    Magazine *loaded;
+
+    // Backup magazine. Swapping `loaded` and `previous` before going to the
+    // depot avoids thrashing when a thread alternates between allocating and
+    // freeing objects at a magazine boundary.
+    Magazine *previous;
+
+    void Swap(void) {
+      Magazine *mag(loaded);
+      loaded = previous;
+      previous = mag;
+    }
+
+    // Called when `loaded` is empty.
+    void Reload(void) {
+      if (previous->num_objects) {
+        Swap();
+        return;
+      }
+
+      Magazine *full(allocator->full_magazines.Pop());
+      if (full) {
+        allocator->empty_magazines.Push(previous);
+        previous = loaded;
+        loaded = full;
+      } else {
+        allocator->FillFromNewSlab(loaded);
+      }
+    }
+
+    // Called when `loaded` is full.
+    void Unload(void) {
+      if (!previous->num_objects) {
+        Swap();
+        return;
+      }
+      allocator->full_magazines.Push(previous);
+      previous = loaded;
+      loaded = allocator->GetEmptyMagazine();
+    }
+
+    ThreadCache(void) = delete;
+    PJIT_DISALLOW_COPY_AND_ASSIGN(ThreadCache);
+  };
+
+  ConcurrentAllocator(void) = default;
+
+  ~ConcurrentAllocator(void) {
+    FreeChunkList(slabs.PopAll(), kNumPages);
+    FreeChunkList(magazine_pages.PopAll(), 1);
+  }
+
+ private:
+  enum : unsigned {
+    SLAB_SIZE = pjit::PAGE_FRAME_SIZE * kNumPages,
+    OBJECT_SIZE = sizeof(T),
+    OBJECT_ALIGN = PJIT_ALIGNMENT_OF(T),
+    MAGAZINE_SIZE = 62,
+    POISON = 0xAB
+  };
+
+  // The header of a slab of objects, or of a page of magazines. These are
+  // chained together so that they can be freed when the allocator is
+  // destroyed.
+  struct Chunk {
+    Chunk *next;
+  };
+
+  // A bounded stack of free object slots.
+  struct Magazine {
+    Magazine *next;
+    unsigned num_objects;
+    void *objects[MAGAZINE_SIZE];
+  };
+
+  enum : unsigned {
+    NEEDED_ALIGNMENT = (sizeof(Chunk) % OBJECT_ALIGN)
+        ? OBJECT_ALIGN - (sizeof(Chunk) % OBJECT_ALIGN) : 0,
+
+    BEGIN_OFFSET = sizeof(Chunk) + NEEDED_ALIGNMENT,
+
+    // Maximum number of objects that can be allocated from a single slab.
+    NUM_OBJECTS = (SLAB_SIZE - BEGIN_OFFSET) / OBJECT_SIZE,
+
+    // Number of magazines that fit into a single page.
+    NUM_MAGAZINES_PER_PAGE = (pjit::PAGE_FRAME_SIZE - sizeof(Chunk)) /
+                             sizeof(Magazine)
+  };
+
+  static_assert(OBJECT_SIZE < SLAB_SIZE, "Object to allocate is too big.");
+  static_assert(0 < NUM_OBJECTS, "Object size is too big for the allocator.");
+  static_assert(0 < NUM_MAGAZINES_PER_PAGE, "Magazines are too big.");
+
+  // Depot of magazines that contain at least one free object.
+  LockFreeStack<Magazine> full_magazines;
+
+  // Depot of magazines that contain no free objects.
+  LockFreeStack<Magazine> empty_magazines;
+
+  // Every slab and magazine page allocated by this allocator.
+  LockFreeStack<Chunk> slabs;
+  LockFreeStack<Chunk> magazine_pages;
+
+  // Returns an empty magazine. This allocates a new page of magazines if the
+  // depot has none left.
+  Magazine *GetEmptyMagazine(void) {
+    Magazine *mag(empty_magazines.Pop());
+    if (PJIT_LIKELY(nullptr != mag)) {
+      return mag;
+    }
+
+    Chunk *page(UnsafeCast<Chunk *>(AllocatePages(1)));
+    magazine_pages.Push(page);
+
+    Magazine *mags(UnsafeCast<Magazine *>(page + 1));
+    for (unsigned i(1); i < NUM_MAGAZINES_PER_PAGE; ++i) {
+      mags[i].num_objects = 0;
+      empty_magazines.Push(&(mags[i]));
+    }
+    mags[0].num_objects = 0;
+    return &(mags[0]);
+  }
+
+  // Return a magazine from a thread cache to the depot.
+  void ReturnMagazine(Magazine *mag) {
+    if (mag->num_objects) {
+      full_magazines.Push(mag);
+    } else {
+      empty_magazines.Push(mag);
+    }
+  }
+
+  // Allocate a new slab of objects. The objects of the slab are used to fill
+  // the (empty) magazine `mag`, and any remaining objects are placed into
+  // other magazines that are given to the depot.
+  void FillFromNewSlab(Magazine *mag) {
+    Chunk *slab(UnsafeCast<Chunk *>(AllocatePages(kNumPages)));
+    slabs.Push(slab);
+
+    Magazine * const first(mag);
+    UnsignedPointer addr(UnsafeCast<UnsignedPointer>(slab) + BEGIN_OFFSET);
+    const UnsignedPointer end(addr + NUM_OBJECTS * OBJECT_SIZE);
+
+    for (; addr < end; addr += OBJECT_SIZE) {
+      if (MAGAZINE_SIZE == mag->num_objects) {
+        if (first != mag) {
+          full_magazines.Push(mag);
+        }
+        mag = GetEmptyMagazine();
+      }
+      mag->objects[mag->num_objects++] = UnsafeCast<void *>(addr);
+    }
+
+    if (first != mag) {
+      full_magazines.Push(mag);
+    }
+  }
+
+  static void FreeChunkList(Chunk *chunk, unsigned num_pages) {
+    for (Chunk *next(nullptr); nullptr != chunk; chunk = next) {
+      next = chunk->next;
+      FreePages(chunk, num_pages);
+    }
+  }
+
+  PJIT_DISALLOW_COPY_AND_ASSIGN_TEMPLATE(ConcurrentAllocator, (T, kNumPages));
+};
+
+}  // namespace pjit
+
+#endif  // PJIT_CONTAINERS_CONCURRENT_ALLOCATOR_H_
@@ -0,0 +1,93 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * lock-free-stack.h
+ *
+ *  Created on: 2014-01-05
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_CONTAINERS_LOCK_FREE_STACK_H_
+#define PJIT_CONTAINERS_LOCK_FREE_STACK_H_
+
+#include "pjit/base/base.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/base/unsafe-cast.h"
+
+namespace pjit {
+
+
+// An intrusive, lock-free (Treiber) stack of objects of type `T`, where each
+// object has a `T *next` field. The ABA problem is avoided by tagging the top
+// of the stack with a modification counter, stored in the (otherwise unused)
+// high 16 bits of the top pointer.
+//
+// Note: Popping reads the `next` field of the top object, which might have
+//       concurrently been popped by another thread. Objects pushed onto a
+//       stack must therefore remain readable for the lifetime of the stack.
+template <typename T>
+class LockFreeStack {
+ public:
+  LockFreeStack(void)
+      : top(0) {}
+
+  void Push(T *obj) {
+    U64 old_top(__atomic_load_n(&top, __ATOMIC_RELAXED));
+    U64 new_top(0);
+    do {
+      __atomic_store_n(&(obj->next), Pointer(old_top), __ATOMIC_RELAXED);
+      new_top = Tag(obj, old_top);
+    } while (!__atomic_compare_exchange_n(
+        &top, &old_top, new_top, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  }
+
+  // Pop an object off of the stack. Returns `nullptr` if the stack is empty.
+  T *Pop(void) {
+    U64 old_top(__atomic_load_n(&top, __ATOMIC_ACQUIRE));
+    for (;;) {
+      T *obj(Pointer(old_top));
+      if (!obj) {
+        return nullptr;
+      }
+      const U64 new_top(
+          Tag(__atomic_load_n(&(obj->next), __ATOMIC_RELAXED), old_top));
+      if (__atomic_compare_exchange_n(
+          &top, &old_top, new_top, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        return obj;
+      }
+    }
+  }
+
+  // Pop every object off of the stack, and return them as a `next`-linked
+  // list.
+  T *PopAll(void) {
+    U64 old_top(__atomic_load_n(&top, __ATOMIC_ACQUIRE));
+    while (!__atomic_compare_exchange_n(
+        &top, &old_top, Tag(nullptr, old_top), true,
+        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {}
+    return Pointer(old_top);
+  }
+
+ private:
+  enum : U64 {
+    TAG_SHIFT = 48,
+    POINTER_MASK = (1UL << TAG_SHIFT) - 1
+  };
+
+  U64 top;
+
+  static inline T *Pointer(U64 tagged) {
+    return UnsafeCast<T *>(tagged & POINTER_MASK);
+  }
+
+  // Combine `obj` with the incremented tag of `old_top`.
+  static inline U64 Tag(T *obj, U64 old_top) {
+    const U64 tag(((old_top >> TAG_SHIFT) + 1) << TAG_SHIFT);
+    return tag | UnsafeCast<U64>(obj);
+  }
+
+  PJIT_DISALLOW_COPY_AND_ASSIGN_TEMPLATE(LockFreeStack, (T));
+};
+
+}  // namespace pjit
+
+#endif  // PJIT_CONTAINERS_LOCK_FREE_STACK_H_
@@ -10,158 +10,243 @@
 #include "pjit/base/memory.h"
 #include "pjit/base/libc.h"
 #include "pjit/base/numeric-types.h"
+#include "pjit/base/spin-lock.h"
 #include "pjit/containers/vector.h"
 
 namespace pjit {
 
 
-class GenericVectorPage {
- public:
-  GenericVectorPage *next;
-  unsigned min_index;  // Inclusive.
-  unsigned max_index;  // Exclusive.
-  unsigned max_assigned_index;
-  unsigned order;
-  UnsignedPointer object_pointer;
-};
-
-
 enum {
   // Do not cache generic vector slab allocations that have greater than or
   // equal to 2^kForceRetireMinScale pages.
-  kForceRetireMinScale = 3,
+  kForceRetireMinScale = 4,
+
+  // Maximum number of pages cached for each order of slab. Slabs that are
+  // freed when their order's cache is full are released to the OS.
+  kMaxCachedPagesPerOrder = 64,
 
   // Value with which to poison slab memory.
   kPoisonValue = 0xAB
 };
 
 
-// A cache of free pages available to any generic vector.
-GenericVectorPage *PAGE_CACHE[] = {
-  nullptr,  // 1 page.
-  nullptr,  // 2 pages.
-  nullptr  // 4 pages.
+// A bounded cache of free slabs, all of the same order. Slabs are referenced
+// out-of-band (rather than being linked through their own memory), so that
+// cached slabs can be protected in debug builds.
+class GenericVectorSlabCache {
+ public:
+  SpinLock lock;
+  unsigned num_slabs;
+  U64 num_hits;
+  U64 num_misses;
+  U64 num_evictions;
+  void *slabs[kMaxCachedPagesPerOrder];
 };
 
 
+// A cache of free slabs available to any generic vector.
+static GenericVectorSlabCache SLAB_CACHE[kForceRetireMinScale];
+
+
+// Change the protection of a cached slab. Cached slabs are only protected in
+// debug builds, so that slab reuse never needs a system call in release
+// builds.
+static void ProtectCachedSlab(void *slab, unsigned order,
+                              MemoryProtection prot) {
+#if PJIT_DEBUG
+  ProtectPages(slab, 1U << order, prot);
+#else
+  PJIT_UNUSED(slab);
+  PJIT_UNUSED(order);
+  PJIT_UNUSED(prot);
+#endif
+}
+
+
+// Returns the log base 2 of the biggest power of two number of objects of
+// size `object_size` that fit into a single page.
+static unsigned FirstSlabShift(unsigned object_size) {
+  unsigned shift(0);
+  while ((object_size << (shift + 1)) <= PAGE_FRAME_SIZE) {
+    ++shift;
+  }
+  return shift;
+}
+
+
 GenericVector::GenericVector(unsigned object_size_, unsigned object_align_,
-                             void (*object_constructor_)(void *))
+                             void (*object_constructor_)(void *),
+                             void (*object_destructor_)(void *))
     : object_size(object_size_),
       object_align(object_align_),
       object_constructor(object_constructor_),
-      scale(0),
-      pages(nullptr) {}
+      object_destructor(object_destructor_),
+      first_slab_shift(FirstSlabShift(object_size_)),
+      size(0) {
+  memset(&(slabs[0]), 0, sizeof slabs);
+}
 
 
 GenericVector::~GenericVector(void) {
-  for (GenericVectorPage *next(nullptr); nullptr != pages; pages = next) {
-    next = pages->next;
-    FreeSlab(pages);
+  Shrink(0);
+  for (unsigned slab(0); slab < MAX_NUM_SLABS; ++slab) {
+    if (slabs[slab]) {
+      FreeSlab(slabs[slab], slab);
+      slabs[slab] = nullptr;
+    }
   }
 }
 
 
-// Allocate a new memory slab for a generic allocator.
-GenericVectorPage *GenericVector::AllocateSlab(
-    const unsigned alloc_scale, const unsigned start_index) const {
+// Allocate the memory for slab number `slab`. Slab `slab` is backed by
+// `2^slab` pages. Returns `nullptr` if no memory is available.
+void *GenericVector::AllocateSlab(unsigned slab) {
+  void *mem(nullptr);
+  if (slab < kForceRetireMinScale) {
+    GenericVectorSlabCache &cache(SLAB_CACHE[slab]);
+    cache.lock.Acquire();
+    if (cache.num_slabs) {
+      mem = cache.slabs[--cache.num_slabs];
+      ++cache.num_hits;
+    } else {
+      ++cache.num_misses;
+    }
+    cache.lock.Release();
 
-  GenericVectorPage *page(nullptr);
-  if (scale < kForceRetireMinScale && nullptr != PAGE_CACHE[scale]) {
-    page = PAGE_CACHE[alloc_scale];
-    PAGE_CACHE[alloc_scale] = page->next;
+    if (mem) {
+      ProtectCachedSlab(mem, slab, MemoryProtection::MEMORY_READ_WRITE);
+    }
   }
 
-  const unsigned num_page_frames(1 << alloc_scale);
-  if (!page) {
-    page = UnsafeCast<GenericVectorPage *>(AllocatePages(num_page_frames));
-    ProtectPages(
-        page, num_page_frames, MemoryProtection::MEMORY_READ_WRITE);
+  // The last slab of a vector of entries bigger than half a page would need
+  // `2^32` pages, which cannot be requested.
+  const U64 num_pages(1ULL << slab);
+  if (!mem && num_pages <= ~0U) {
+    mem = AllocatePages(static_cast<unsigned>(num_pages));
+  }
+  if (!mem) {
+    return nullptr;
   }
 
-  const unsigned num_bytes(num_page_frames * PAGE_FRAME_SIZE);
-  memset(page, kPoisonValue, num_bytes);
+  memset(mem, kPoisonValue,
+         static_cast<UnsignedSize>(SlabSize(slab)) * object_size);
+  return mem;
+}
 
-  const UnsignedSize aligned_page_size(
-      PJIT_ALIGN_TO(sizeof(GenericVectorPage),
-                    static_cast<UnsignedSize>(object_align)));
-  const UnsignedSize max_available_bytes(num_bytes - aligned_page_size);
-  const UnsignedSize max_available_objects(max_available_bytes / object_size);
 
-  page->object_pointer = UnsafeCast<UnsignedPointer>(page) + aligned_page_size;
-  page->min_index = start_index;
-  page->max_index = static_cast<unsigned>(start_index + max_available_objects);
-  page->max_assigned_index = start_index;
-  page->order = scale;
-  page->next = nullptr;
+// Free a slab. This will either place the slab into the slab cache (and
+// protect the slab from reads/writes in debug builds), or it will free the
+// slab back to the OS.
+void GenericVector::FreeSlab(void *slab, unsigned order) {
+  if (order < kForceRetireMinScale) {
+    GenericVectorSlabCache &cache(SLAB_CACHE[order]);
+    ProtectCachedSlab(slab, order, MemoryProtection::MEMORY_INACCESSIBLE);
+
+    cache.lock.Acquire();
+    const bool is_cached(
+        cache.num_slabs <
+        (static_cast<unsigned>(kMaxCachedPagesPerOrder) >> order));
+    if (is_cached) {
+      cache.slabs[cache.num_slabs++] = slab;
+    } else {
+      ++cache.num_evictions;
+    }
+    cache.lock.Release();
 
-  return page;
+    if (is_cached) {
+      return;
+    }
+    ProtectCachedSlab(slab, order, MemoryProtection::MEMORY_READ_WRITE);
+  }
+  FreePages(slab, 1U << order);
 }
 
 
-// Free a slab. This will either place the slab back on a free list and protect
-// the slab from reads/writes, or it will free the slab back to the OS.
-void GenericVector::FreeSlab(GenericVectorPage *slab) {
-  const unsigned num_page_frames(1 << slab->order);
-  if (slab->order < kForceRetireMinScale) {
-    slab->next = PAGE_CACHE[slab->order];
-    PAGE_CACHE[slab->order] = slab;
-    ProtectPages(
-        slab, num_page_frames, MemoryProtection::MEMORY_INACCESSIBLE);
-  } else {
-    FreePages(slab, num_page_frames);
+// Collect statistics about the slab cache.
+void GenericVector::GetSlabCacheStatistics(SlabCacheStatistics *stats) {
+  memset(stats, 0, sizeof *stats);
+  for (unsigned order(0); order < kForceRetireMinScale; ++order) {
+    GenericVectorSlabCache &cache(SLAB_CACHE[order]);
+    cache.lock.Acquire();
+    stats->num_hits += cache.num_hits;
+    stats->num_misses += cache.num_misses;
+    stats->num_evictions += cache.num_evictions;
+    stats->num_cached_slabs += cache.num_slabs;
+    stats->num_cached_pages += cache.num_slabs << order;
+    cache.lock.Release();
   }
 }
 
 
-void GenericVector::ConstructEntries(GenericVectorPage *page, unsigned from,
-                                     unsigned to) {
-  for (UnsignedPointer i(page->object_pointer + from * object_size),
-                       max_i(page->object_pointer + to * object_size);
-      i < max_i; i += object_size) {
-    object_constructor(UnsafeCast<void *>(i));
+// Release every cached slab back to the OS. Freed slabs go into the page
+// pool, which is then trimmed so that their addresses are unmapped too.
+void GenericVector::TrimSlabCache(void) {
+  for (unsigned order(0); order < kForceRetireMinScale; ++order) {
+    GenericVectorSlabCache &cache(SLAB_CACHE[order]);
+    for (;;) {
+      void *slab(nullptr);
+      cache.lock.Acquire();
+      if (cache.num_slabs) {
+        slab = cache.slabs[--cache.num_slabs];
+      }
+      cache.lock.Release();
+
+      if (!slab) {
+        break;
+      }
+      ProtectCachedSlab(slab, order, MemoryProtection::MEMORY_READ_WRITE);
+      FreePages(slab, 1U << order);
+    }
   }
+  TrimPagePool();
 }
 
 
-void *GenericVector::Get(unsigned index) {
-  if (PJIT_UNLIKELY(!pages)) {
-    pages = AllocateSlab(scale++, 0);
+// Default-construct every entry from `size` up to (but excluding) `new_size`,
+// allocating slabs as needed.
+void GenericVector::Grow(unsigned new_size) {
+  while (size < new_size) {
+    unsigned offset(0);
+    const unsigned slab(SlabIndex(size, offset));
+    const unsigned slab_size(SlabSize(slab));
+    const unsigned remaining(new_size - size);
+    const unsigned max_offset(remaining < (slab_size - offset)
+                              ? offset + remaining : slab_size);
+
+    UnsignedPointer entry(
+        UnsafeCast<UnsignedPointer>(GetSlab(slab)) + offset * object_size);
+    for (unsigned i(offset); i < max_offset; ++i, entry += object_size) {
+      object_constructor(UnsafeCast<void *>(entry));
+    }
+    size += max_offset - offset;
   }
+}
 
-  for (;;) {
-    for (GenericVectorPage *page(pages);
-         PJIT_LIKELY(nullptr != page);
-         page = page->next) {
-
-     if (PJIT_LIKELY(index < page->max_index)) {  // In this page.
-        if (PJIT_UNLIKELY(index < page->min_index)) {  // In another page.
-          continue;
-        }
-
-        const unsigned relative_index(index - page->min_index);
-        const unsigned relative_offset(relative_index * object_size);
-
-        if (PJIT_UNLIKELY(index > page->max_assigned_index)) {
-          ConstructEntries(
-              page,
-              page->max_assigned_index - page->min_index,
-              relative_index + 1);
 
-          page->max_assigned_index = index;
-        }
+// Allocate the slabs needed to hold `num_entries` entries.
+void GenericVector::Reserve(unsigned num_entries) {
+  if (!num_entries) {
+    return;
+  }
+  unsigned offset(0);
+  const unsigned last_slab(SlabIndex(num_entries - 1, offset));
+  for (unsigned slab(0); slab <= last_slab; ++slab) {
+    GetSlab(slab);
+  }
+}
 
-        return UnsafeCast<void *>(page->object_pointer + relative_offset);
 
-      } else {  // Need to allocate a new page.
-        page = AllocateSlab(scale++, page->max_index);
-        page->next = pages;
-        pages = page;
-        break; // go around the outer loop again.
-      }
+// Destruct every entry from `new_size` up to (but excluding) `size`. The
+// memory of the entries' slabs is kept.
+void GenericVector::Shrink(unsigned new_size) {
+  if (object_destructor) {
+    for (unsigned i(new_size); i < size; ++i) {
+      object_destructor(EntryAddress(i));
     }
   }
-
-  return nullptr;
+  if (new_size < size) {
+    size = new_size;
+  }
 }
 
 }  // namespace pjit
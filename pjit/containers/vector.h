@@ -13,40 +13,133 @@
 
 #include "pjit/base/base.h"
 #include "pjit/base/compiler.h"
+#include "pjit/base/memory.h"
+#include "pjit/base/numeric-types.h"
 #include "pjit/base/unsafe-cast.h"
 
 namespace pjit {
 
-class GenericVectorPage;
 template <typename T> class Vector;
 
 
-// A generic vector implementation, based on page-granularity allocations. The
-// purpose of the generic vector is to
+// Statistics about the slab cache that is shared by all generic vectors.
+struct SlabCacheStatistics {
+  // Number of slab allocations that were satisfied by the cache.
+  U64 num_hits;
+
+  // Number of (cacheable) slab allocations that needed new pages.
+  U64 num_misses;
+
+  // Number of freed slabs that were released to the OS because their cache
+  // was full.
+  U64 num_evictions;
+
+  unsigned num_cached_slabs;
+  unsigned num_cached_pages;
+};
+
+
+// A generic vector implementation, based on page-granularity allocations.
+// Entries are stored in a directory of slabs, where slab `k` holds
+// `2^k * first_slab_size` entries, and where `first_slab_size` is the biggest
+// power of two number of entries that fit into a single page. Slab `k` is
+// therefore backed by at most `2^k` pages, and the slab and offset of any
+// index can be computed with a few shifts, without searching. Entries must
+// therefore fit into a single page.
+//
+// Entries are never moved once constructed, so pointers to entries remain
+// valid until the entries are popped, or until the vector is destroyed.
 class GenericVector {
+ public:
+  static void GetSlabCacheStatistics(SlabCacheStatistics *stats);
+
+  // Release every cached slab back to the OS, along with the rest of the page
+  // pool. Long-running programs can use this to return memory after a burst
+  // of vector-heavy work.
+  static void TrimSlabCache(void);
+
  private:
   template <typename> friend class Vector;
 
+  enum : unsigned {
+    // Indices are 32 bits, so no more than 33 slabs are ever needed.
+    MAX_NUM_SLABS = 33
+  };
+
   const unsigned object_size;
   const unsigned object_align;
   void (* const object_constructor)(void *);
 
-  unsigned scale;
+  // Destructor for entries. This is `nullptr` for trivially destructible
+  // entries.
+  void (* const object_destructor)(void *);
+
+  // Log base 2 of the number of entries in slab 0.
+  const unsigned first_slab_shift;
+
+  // Number of entries (starting at index 0) that have been constructed.
+  unsigned size;
 
-  GenericVectorPage *pages;
+  void *slabs[MAX_NUM_SLABS];
 
   GenericVector(void) = delete;
   GenericVector(unsigned object_size_, unsigned object_align_,
-                void (*object_constructor_)(void *));
+                void (*object_constructor_)(void *),
+                void (*object_destructor_)(void *));
   ~GenericVector(void);
 
-  GenericVectorPage *AllocateSlab(const unsigned scale,
-                                  const unsigned start_index) const;
+  // Returns the slab containing entry `index`, and sets `offset` to the index
+  // of that entry within the slab.
+  inline unsigned SlabIndex(unsigned index, unsigned &offset) const {
+    const U64 biased((static_cast<U64>(index) >> first_slab_shift) + 1);
+    const unsigned slab(
+        static_cast<unsigned>(63 - __builtin_clzl(biased)));
+    offset = static_cast<unsigned>(
+        index + (1UL << first_slab_shift) -
+        ((1UL << first_slab_shift) << slab));
+    return slab;
+  }
+
+  // Returns the number of entries in slab `slab`.
+  inline unsigned SlabSize(unsigned slab) const {
+    return static_cast<unsigned>((1UL << first_slab_shift) << slab);
+  }
+
+  void *AllocateSlab(unsigned slab);
+  void FreeSlab(void *slab, unsigned order);
+
+  // Make sure that the slab `slab` is allocated, and return it.
+  void *GetSlab(unsigned slab) {
+    if (PJIT_UNLIKELY(!slabs[slab])) {
+      slabs[slab] = AllocateSlab(slab);
+    }
+    return slabs[slab];
+  }
+
+  // Returns the address of entry `index`. The entry's slab must be allocated.
+  inline void *EntryAddress(unsigned index) const {
+    unsigned offset(0);
+    const unsigned slab(SlabIndex(index, offset));
+    return UnsafeCast<void *>(
+        UnsafeCast<UnsignedPointer>(slabs[slab]) + offset * object_size);
+  }
+
+  // Default-construct every entry from `size` up to (but excluding)
+  // `new_size`.
+  void Grow(unsigned new_size);
 
-  void ConstructEntries(GenericVectorPage *page, unsigned from, unsigned to);
-  void FreeSlab(GenericVectorPage *slab);
+  // Allocate the slabs needed to hold `num_entries` entries.
+  void Reserve(unsigned num_entries);
 
-  void *Get(unsigned index);
+  // Destruct every entry from `new_size` up to (but excluding) `size`.
+  void Shrink(unsigned new_size);
+
+  void *Get(unsigned index) {
+    if (PJIT_UNLIKELY(index >= size)) {
+      Grow(index + 1);
+    }
+    return EntryAddress(index);
+  }
 
   PJIT_DISALLOW_COPY_AND_ASSIGN(GenericVector);
 };
@@ -55,24 +148,197 @@ class GenericVector {
 template <typename T>
 class Vector {
  public:
+  // Iterates over the constructed entries of a vector, in order. Moving to
+  // the next entry only re-computes the slab at slab boundaries.
+  class Iterator {
+   public:
+    T &operator*(void) const {
+      return *entry;
+    }
+
+    T *operator->(void) const {
+      return entry;
+    }
+
+    Iterator &operator++(void) {
+      ++index;
+      if (PJIT_UNLIKELY(++entry == slab_end)) {
+        Seek();
+      }
+      return *this;
+    }
+
+    bool operator!=(const Iterator &that) const {
+      return index != that.index;
+    }
+
+    bool operator==(const Iterator &that) const {
+      return index == that.index;
+    }
+
+   private:
+    friend class Vector<T>;
+
+    Iterator(const GenericVector *vector_, unsigned index_)
+        : vector(vector_),
+          index(index_),
+          entry(nullptr),
+          slab_end(nullptr) {
+      Seek();
+    }
+
+    // Locate the entry for `index`.
+    void Seek(void) {
+      if (index >= vector->size) {
+        entry = nullptr;
+        slab_end = nullptr;
+        return;
+      }
+      unsigned offset(0);
+      const unsigned slab(vector->SlabIndex(index, offset));
+      T *slab_begin(UnsafeCast<T *>(vector->slabs[slab]));
+      entry = slab_begin + offset;
+      slab_end = slab_begin + vector->SlabSize(slab);
+    }
+
+    const GenericVector *vector;
+    unsigned index;
+    T *entry;
+    T *slab_end;
+  };
+
+  // A run of entries that are contiguous in memory.
+  struct Span {
+    T *entries;
+    unsigned size;
+  };
+
   Vector(void)
-     : vector(sizeof(T), PJIT_ALIGNMENT_OF(T), &construct) {}
+     : vector(sizeof(T), PJIT_ALIGNMENT_OF(T), &construct,
+              __has_trivial_destructor(T) ? nullptr : &destruct) {}
 
+  // Returns the entry at `index`. Any missing entries up to and including
+  // `index` are default-constructed.
   T &Get(unsigned index) {
     return *UnsafeCast<T *>(vector.Get(index));
   }
 
   void Set(unsigned index, T &&value) {
-    Get(index) = value;
+    if (index < vector.size) {
+      Get(index) = static_cast<T &&>(value);
+    } else {
+      vector.Grow(index);
+      PushBack(static_cast<T &&>(value));
+    }
+  }
+
+  unsigned Size(void) const {
+    return vector.size;
+  }
+
+  // Make sure that no memory needs to be allocated until the vector holds more
+  // than `num_entries` entries.
+  void Reserve(unsigned num_entries) {
+    vector.Reserve(num_entries);
+  }
+
+  void PushBack(T &&value) {
+    new (NextEntry()) T(static_cast<T &&>(value));
+    ++vector.size;
+  }
+
+  void PushBack(const T &value) {
+    new (NextEntry()) T(value);
+    ++vector.size;
+  }
+
+  // Destruct every entry of the vector. The memory of the vector is kept for
+  // re-use.
+  void Clear(void) {
+    vector.Shrink(0);
+  }
+
+  // Remove and return the last entry of the vector. The vector must not be
+  // empty.
+  T PopBack(void) {
+    T *entry(UnsafeCast<T *>(vector.EntryAddress(vector.size - 1)));
+    T value(static_cast<T &&>(*entry));
+    entry->~T();
+    --vector.size;
+    return value;
+  }
+
+  // Copy `num_values` entries from `values` onto the end of the vector. The
+  // copying is done one slab-sized span at a time.
+  void Append(const T *values, unsigned num_values) {
+    vector.Reserve(vector.size + num_values);
+    while (num_values) {
+      unsigned offset(0);
+      const unsigned slab(vector.SlabIndex(vector.size, offset));
+      const unsigned space(vector.SlabSize(slab) - offset);
+      const unsigned num_copies(space < num_values ? space : num_values);
+      T *entry(UnsafeCast<T *>(vector.slabs[slab]) + offset);
+      for (unsigned i(0); i < num_copies; ++i) {
+        new (&(entry[i])) T(values[i]);
+      }
+      vector.size += num_copies;
+      values += num_copies;
+      num_values -= num_copies;
+    }
+  }
+
+  // Returns the number of spans that together cover all of the entries of the
+  // vector.
+  unsigned NumSpans(void) const {
+    if (!vector.size) {
+      return 0;
+    }
+    unsigned offset(0);
+    return vector.SlabIndex(vector.size - 1, offset) + 1;
+  }
+
+  // Returns the entries of the vector that are stored in slab `n`. Iterating
+  // over spans `0` through `NumSpans() - 1` visits every entry of the vector,
+  // in order.
+  Span GetSpan(unsigned n) const {
+    const unsigned first_index(vector.SlabSize(n) - vector.SlabSize(0));
+    const unsigned max_index(first_index + vector.SlabSize(n));
+    Span span;
+    span.entries = UnsafeCast<T *>(vector.slabs[n]);
+    span.size = (max_index < vector.size ? max_index : vector.size) -
+                first_index;
+    return span;
+  }
+
+  Iterator begin(void) const {
+    return Iterator(&vector, 0);
+  }
+
+  Iterator end(void) const {
+    return Iterator(&vector, vector.size);
   }
 
  private:
+  static_assert(sizeof(T) <= PAGE_FRAME_SIZE,
+                "Vector entries must fit into a single page.");
+
   GenericVector vector;
 
+  // Returns the memory for the entry at index `Size()`.
+  void *NextEntry(void) {
+    unsigned offset(0);
+    const unsigned slab(vector.SlabIndex(vector.size, offset));
+    return UnsafeCast<T *>(vector.GetSlab(slab)) + offset;
+  }
+
   static void construct(void *mem) {
     new (mem) T;
   }
 
+  static void destruct(void *mem) {
+    UnsafeCast<T *>(mem)->~T();
+  }
+
   PJIT_DISALLOW_COPY_AND_ASSIGN_TEMPLATE(Vector, (T));
 };
 
@@ -24,11 +24,13 @@ IfStatementBuilder::IfStatementBuilder(mir::Context &context_)
       saved_if_builder(context->if_builder) {
   // Make and link a new successor in-between the current CFG's old successor
   // and our conditional CFG.
-  successor = context->seq_allocator.Allocate(context, context->current);
+  successor = context->Allocate(
+      context->seq_allocator, context, context->current);
   context->LinkSuccessor(successor);
 
   // Make and link a new conditional CFG into the successor chain.
-  conditional = context->cond_allocator.Allocate(
+  conditional = context->Allocate(
+      context->cond_allocator,
       context,
       context->current,
       successor);
@@ -48,7 +50,8 @@ CaseStatementBuilder::CaseStatementBuilder(mir::Context &context_,
                                            const mir::Symbol *symbol)
     : context(&context_) {
   mir::MultiWayBranchControlFlowGraph *mbr(context->mbr_builder->mbr);
-  mir::MultiWayBranchArm *arm(context->mbr_arm_allocator.Allocate(
+  mir::MultiWayBranchArm *arm(context->Allocate(
+      context->mbr_arm_allocator,
       context,
       mbr,  // Parent node of the CASE.
       symbol,  // Symbol that must match the switch `condition_value`.
@@ -61,6 +64,7 @@ CaseStatementBuilder::CaseStatementBuilder(mir::Context &context_,
 
   mbr->arms = arm;
   context->current = &(arm->if_true);
+  context->InvalidateControlFlow();
 }
 
 
@@ -78,12 +82,13 @@ SwitchStatementBuilder::SwitchStatementBuilder(mir::Context &context_)
       saved_mbr_builder(context->mbr_builder) {
   // Make and link a new successor in-between the current CFG's old successor
   // and our conditional CFG.
-  successor = context->seq_allocator.Allocate(context, context->current);
+  successor = context->Allocate(
+      context->seq_allocator, context, context->current);
   context->LinkSuccessor(successor);
 
   // Make and link a new conditional CFG into the successor chain.
-  mbr = context->mbr_allocator.Allocate(
-      context, context->current, successor);
+  mbr = context->Allocate(
+      context->mbr_allocator, context, context->current, successor);
 
   context->LinkCurrent(&(mbr->condition), mbr);
   context->mbr_builder = this;
@@ -102,11 +107,13 @@ LoopStatementBuilder::LoopStatementBuilder(mir::Context &context_)
       successor(nullptr) {
   // Make and link a new successor in-between the current CFG's old successor
   // and our conditional CFG.
-  successor = context->seq_allocator.Allocate(context, context->current);
+  successor = context->Allocate(
+      context->seq_allocator, context, context->current);
   context->LinkSuccessor(successor);
 
   // Make and link a new conditional CFG into the successor chain.
-  loop = context->loop_allocator.Allocate(
+  loop = context->Allocate(
+      context->loop_allocator,
       context,
       context->current,
       successor);
@@ -142,6 +142,26 @@ inline const mir::Symbol *GetRValue(mir::Context &context, T val) {
       PJIT_TO_STRING(name)));
 
 
+// Declare a variable whose value is preserved across `OP_NEXT`.
+#define PJIT_HIR_DECLARE_PERSISTENT(context, type, name) \
+  pjit::hir::SymbolicVariable<PJIT_HIR_DECLARED_TYPE type> name( \
+    context.MakeSymbol( \
+      pjit::GetTypeInfoForType<PJIT_HIR_DECLARED_TYPE type>(), \
+      PJIT_TO_STRING(name), \
+      pjit::mir::SymbolBehavior::BehaviorPersistent));
+
+
+// Declare the program counter of the interpreted machine. The program counter
+// is a persistent variable that is given priority for being kept in a
+// register.
+#define PJIT_HIR_DECLARE_PROGRAM_COUNTER(context, type, name) \
+  pjit::hir::SymbolicVariable<PJIT_HIR_DECLARED_TYPE type> name( \
+    context.MakeSymbol( \
+      pjit::GetTypeInfoForType<PJIT_HIR_DECLARED_TYPE type>(), \
+      PJIT_TO_STRING(name), \
+      pjit::mir::SymbolBehavior::BehaviorProgramCounter));
+
+
 #define PJIT_DECLARE_BINARY_OPERATOR(name, op) \
   template <typename L, typename R> \
   SymbolicValue< \
@@ -186,7 +206,7 @@ inline const mir::Symbol *GetRValue(mir::Context &context, T val) {
     const TypeInfo *output_type(GetTypeInfoForType<OutputType>()); \
     const mir::Symbol *right_conv(GetRValue(context, right)); \
     if (!TypesAreEqual<bool, OutputType>::RESULT) { \
-      context.EmitConvertType(output_type, right_conv); \
+      right_conv = context.EmitConvertType(output_type, right_conv); \
     } \
     const mir::Symbol *output_value(context.MakeSymbol(output_type)); \
     context.EmitInstruction( \
@@ -329,6 +349,14 @@ ASSIGN(mir::Context &context, L &&left, R &&right) {
 }
 
 
+// End the current iteration of the instruction fetch / decode / execute loop,
+// and begin the next one. Only persistent variables keep their values across
+// `NEXT`.
+inline void NEXT(mir::Context &context) {
+  context.EmitInstruction(mir::Operation::OP_NEXT, {});
+}
+
+
 // Interacts with the MIR context to construct ELSE statements.
 //
 // Note: This assumes that the ELSE statement is being used correctly (i.e.
@@ -14,7 +14,8 @@ namespace mir {
 
 BasicBlock::BasicBlock(void)
     : first(nullptr),
-      last(nullptr) {}
+      last(nullptr),
+      index(0) {}
 
 
 void BasicBlock::Append(Instruction *in) {
@@ -44,6 +45,52 @@ void BasicBlock::Prepend(Instruction *in) {
   first = in;
 }
 
+
+void BasicBlock::InsertBefore(Instruction *pos, Instruction *in) {
+  in->prev = pos->prev;
+  in->next = pos;
+
+  if (pos->prev) {
+    pos->prev->next = in;
+  } else {
+    first = in;
+  }
+
+  pos->prev = in;
+}
+
+
+void BasicBlock::InsertAfter(Instruction *pos, Instruction *in) {
+  in->prev = pos;
+  in->next = pos->next;
+
+  if (pos->next) {
+    pos->next->prev = in;
+  } else {
+    last = in;
+  }
+
+  pos->next = in;
+}
+
+
+void BasicBlock::Remove(Instruction *in) {
+  if (in->prev) {
+    in->prev->next = in->next;
+  } else {
+    first = in->next;
+  }
+
+  if (in->next) {
+    in->next->prev = in->prev;
+  } else {
+    last = in->prev;
+  }
+
+  in->prev = nullptr;
+  in->next = nullptr;
+}
+
 }  // namespace mir
 }  // namespace pjit
 
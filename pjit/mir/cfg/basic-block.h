@@ -16,6 +16,7 @@ namespace mir {
 
 class Instruction;
 class SequentialControlFlowGraph;
+class BasicBlockEdges;
 
 
 // Represents a short, straight-line sequence of instructions. Basic blocks do
@@ -27,11 +28,26 @@ class BasicBlock {
   void Append(Instruction *);
   void Prepend(Instruction *);
 
+  // Insert `in` immediately before/after the instruction `pos`, which must be
+  // in this basic block.
+  void InsertBefore(Instruction *pos, Instruction *in);
+  void InsertAfter(Instruction *pos, Instruction *in);
+
+  // Unlink the instruction `in` from this basic block.
+  void Remove(Instruction *in);
+
   Instruction *first;
   Instruction *last;
 
  private:
   friend class SequentialControlFlowGraph;
+  friend class BasicBlockEdges;
+  friend class DominatorTree;
+  friend class LoopNest;
+
+  // Position of this basic block in the reverse post-order of the most
+  // recently built `BasicBlockEdges` of its context.
+  unsigned index;
 
   BasicBlock(void);
 
@@ -41,7 +41,7 @@ void ConditionalControlFlowGraph::VisitPreOrder(
     PJIT_UNUSED(successor_chain);
   } while (0);
 
-  successor->last_visitor = visitor;
+  successor->visit_epoch = visitor->epoch;
 
   // Visit the `if_true` and `if_false` branches.
   for (SequentialControlFlowGraph *branch : {&if_true, &if_false}) {
@@ -52,7 +52,7 @@ void ConditionalControlFlowGraph::VisitPreOrder(
     PJIT_UNUSED(predecessor_chain);
   }
 
-  successor->last_visitor = nullptr;
+  successor->visit_epoch = 0;
 
   // The successor of the conditional CFG wasn't previously visited, so now
   // we can go and visit it.
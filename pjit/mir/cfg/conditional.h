@@ -25,6 +25,7 @@ namespace mir {
 class Context;
 class BasicBlockVisitor;
 class ControlFlowGraphVisitor;
+class GarbageCollectionVisitor;
 
 
 // Represents a single IF+ELSE control-flow graph. The structure begins with a
@@ -52,6 +53,19 @@ class ConditionalControlFlowGraph : public ControlFlowGraph {
  private:
   friend class hir::IfStatementBuilder;
   friend class hir::ElseStatementBuilder;
+  friend class GarbageCollectionVisitor;
+  friend class SSATransform;
+  friend class OutOfSSATransform;
+  friend class ConstantFoldingTransform;
+  friend class DeadCodeEliminationTransform;
+  friend class ValueNumberingTransform;
+  friend class LoopUnrollingTransform;
+  friend class BlockLocalTransform;
+  friend class ControlFlowGraphTraversal;
+  friend class BasicBlockEdges;
+  friend class DominatorTree;
+  friend class LoopNest;
+  friend class x86_64::CodeGenerator;
 
   // The control-flow graph containing the condition.
   //
@@ -20,11 +20,12 @@ namespace mir {
 ControlFlowGraph::ControlFlowGraph(Context *context_, ControlFlowGraph *parent_)
     : context(context_),
       parent(parent_),
-      last_visitor(nullptr) {}
+      visit_epoch(0) {}
 
 
 ControlFlowGraphVisitor::ControlFlowGraphVisitor(void)
-    : find_successors(nullptr),
+    : epoch(0),
+      find_successors(nullptr),
       find_predecessors(nullptr) {}
 
 
@@ -12,6 +12,10 @@
 #include "pjit/base/base.h"
 
 namespace pjit {
+namespace x86_64 {
+class CodeGenerator;
+}  // namespace x86_64
+
 namespace mir {
 
 // Forward declarations. Needed because there is a fair amount of sharing going
@@ -29,6 +33,13 @@ class BasicBlockVisitor;
 class BasicBlockFinder;
 class FirstBasicBlockFinder;
 class PredecessorBasicBlockFinder;
+class SSATransform;
+class OutOfSSATransform;
+class ConstantFoldingTransform;
+class DeadCodeEliminationTransform;
+class ValueNumberingTransform;
+class ControlFlowGraphTraversal;
+class BasicBlockEdges;
 
 
 // Represents an abstract control-flow graph. Every control-flow graph is
@@ -45,7 +56,9 @@ class ControlFlowGraph {
  protected:
   Context * const context;
   ControlFlowGraph *parent;
-  ControlFlowGraphVisitor *last_visitor;
+
+  // Epoch of the most recent traversal that visited this CFG.
+  unsigned visit_epoch;
 
   virtual void DoVisitPreOrder(ControlFlowGraphVisitor *) = 0;
   virtual void DoVisitPostOrder(ControlFlowGraphVisitor *) = 0;
@@ -58,13 +71,7 @@ class ControlFlowGraph {
   virtual void VisitPredecessor(ControlFlowGraph *, BasicBlockVisitor *) = 0;
 
   // Check whether or not we should visit the current CFG.
-  inline bool ShouldVisit(ControlFlowGraphVisitor *visitor) {
-    if (last_visitor == visitor) {
-      return false;
-    }
-    last_visitor = visitor;
-    return true;
-  }
+  inline bool ShouldVisit(ControlFlowGraphVisitor *visitor);
 
  private:
   friend class Context;
@@ -72,6 +79,15 @@ class ControlFlowGraph {
   friend class MultiWayBranchControlFlowGraph;
   friend class FirstBasicBlockFinder;
   friend class PredecessorBasicBlockFinder;
+  friend class SSATransform;
+  friend class OutOfSSATransform;
+  friend class ConstantFoldingTransform;
+  friend class DeadCodeEliminationTransform;
+  friend class ValueNumberingTransform;
+  friend class LoopUnrollingTransform;
+  friend class ControlFlowGraphTraversal;
+  friend class BasicBlockEdges;
+  friend class x86_64::CodeGenerator;
 
   ControlFlowGraph(void) = delete;
 
@@ -115,7 +131,16 @@ class ControlFlowGraphVisitor {
   virtual void VisitSuccessors(BasicBlockVisitor *);
   virtual void VisitPredecessors(BasicBlockVisitor *);
 
+  // Epoch of the current traversal. Every traversal started by a `Context`
+  // gets a new epoch, so that a CFG is visited at most once per traversal,
+  // even when the same visitor (or a visitor at the same address) is used for
+  // several traversals.
+  unsigned epoch;
+
  private:
+  friend class ControlFlowGraph;
+  friend class Context;
+
   // Finders used to discover the successors and predecessors of the currently
   // visited basic blocks. Successors and predecessors are defined structurally
   // and are not stored in any single container on a per-basic block basis.
@@ -129,6 +154,15 @@ class ControlFlowGraphVisitor {
 #undef PJIT_DEFINE_CONTROL_FLOW_GRAPH_VISITORS
 
 
+inline bool ControlFlowGraph::ShouldVisit(ControlFlowGraphVisitor *visitor) {
+  if (visit_epoch == visitor->epoch) {
+    return false;
+  }
+  visit_epoch = visitor->epoch;
+  return true;
+}
+
+
 }  // namespace mir
 }  // namespace pjit
 
@@ -0,0 +1,172 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * dominators.cc
+ *
+ *  Created on: 2014-01-18
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/cfg/dominators.h"
+
+#include "pjit/mir/context.h"
+#include "pjit/mir/cfg/edges.h"
+
+namespace pjit {
+namespace mir {
+
+
+DominatorTree::DominatorTree(Context *context_, bool is_post_dominator_tree_)
+    : context(context_),
+      is_post_dominator_tree(is_post_dominator_tree_),
+      traversal(context_),
+      edges(nullptr),
+      parent(),
+      number(),
+      size(),
+      depth(),
+      child_begin(),
+      children(),
+      order(),
+      worklist() {}
+
+
+// A basic block with a single predecessor (successor) is immediately
+// dominated (post-dominated) by it. The remaining basic blocks are handled by
+// the type dispatch on their CFGs.
+void DominatorTree::Build(void) {
+  edges = context->Edges();
+  parent.Clear();
+  for (unsigned i(0); i < edges->NumBlocks(); ++i) {
+    BasicBlock *bb(edges->Block(i));
+    BasicBlock *dominator(nullptr);
+    if (is_post_dominator_tree) {
+      if (1 == edges->NumSuccessors(bb)) {
+        dominator = edges->Successor(bb, 0);
+      }
+    } else if (1 == edges->NumPredecessors(bb)) {
+      dominator = edges->Predecessor(bb, 0);
+    }
+    parent.PushBack(dominator);
+  }
+  traversal.Traverse(this);
+
+  IndexChildren();
+  NumberTree(is_post_dominator_tree ? &(context->exit.bb) :
+                                      &(context->entry.bb));
+  edges = nullptr;
+}
+
+
+// Find the children of each basic block, in the same way as the edges are
+// indexed by `BasicBlockEdges::Index`.
+void DominatorTree::IndexChildren(void) {
+  const unsigned num_blocks(parent.Size());
+  child_begin.Clear();
+  children.Clear();
+  for (unsigned i(0); i <= num_blocks; ++i) {
+    child_begin.PushBack(0U);
+  }
+  for (unsigned i(0); i < num_blocks; ++i) {
+    if (BasicBlock *dominator = parent.Get(i)) {
+      ++child_begin.Get(dominator->index);
+      children.PushBack(nullptr);
+    }
+  }
+  unsigned offset(0);
+  for (unsigned i(0); i < num_blocks; ++i) {
+    offset += child_begin.Get(i);
+    child_begin.Get(i) = offset;
+  }
+  child_begin.Get(num_blocks) = offset;
+  for (unsigned i(num_blocks); i--; ) {
+    if (BasicBlock *dominator = parent.Get(i)) {
+      children.Get(--child_begin.Get(dominator->index)) = edges->Block(i);
+    }
+  }
+}
+
+
+// Number the basic blocks in pre-order, and then accumulate the sizes of the
+// sub-trees in the reverse of that order.
+void DominatorTree::NumberTree(BasicBlock *root) {
+  const unsigned num_blocks(parent.Size());
+  number.Clear();
+  size.Clear();
+  depth.Clear();
+  for (unsigned i(0); i < num_blocks; ++i) {
+    number.PushBack(0U);
+    size.PushBack(1U);
+    depth.PushBack(0U);
+  }
+
+  order.Clear();
+  worklist.Clear();
+  worklist.PushBack(root);
+  while (worklist.Size()) {
+    BasicBlock *bb(worklist.PopBack());
+    number.Get(bb->index) = order.Size();
+    if (BasicBlock *dominator = parent.Get(bb->index)) {
+      depth.Get(bb->index) = depth.Get(dominator->index) + 1;
+    }
+    order.PushBack(bb);
+    for (unsigned i(NumChildren(bb)); i--; ) {
+      worklist.PushBack(Child(bb, i));
+    }
+  }
+
+  for (unsigned i(order.Size()); i-- > 1; ) {
+    BasicBlock *bb(order.Get(i));
+    size.Get(parent.Get(bb->index)->index) += size.Get(bb->index);
+  }
+}
+
+
+// All arms of a branch start at its condition and end at its join, and so the
+// condition dominates the join, and the join post-dominates the condition.
+void DominatorTree::JoinBranch(BasicBlock *condition, BasicBlock *join) {
+  if (is_post_dominator_tree) {
+    if (1 < edges->NumSuccessors(condition)) {
+      parent.Get(condition->index) = join;
+    }
+  } else if (1 < edges->NumPredecessors(join)) {
+    parent.Get(join->index) = condition;
+  }
+}
+
+
+void DominatorTree::VisitPreOrder(SequentialControlFlowGraph *) {}
+
+
+void DominatorTree::VisitPreOrder(ConditionalControlFlowGraph *cfg) {
+  JoinBranch(&(cfg->condition.bb), &(cfg->successor->bb));
+}
+
+
+void DominatorTree::VisitPreOrder(MultiWayBranchControlFlowGraph *cfg) {
+  JoinBranch(&(cfg->condition.bb), &(cfg->successor->bb));
+}
+
+
+// The condition of a loop is reached from the end of `init` (the pre-header)
+// and from the end of `update` (the latch). The pre-header comes before the
+// condition in reverse post-order, and immediately dominates it. Every path
+// from the condition leaves the loop through its successor.
+void DominatorTree::VisitPreOrder(LoopControlFlowGraph *cfg) {
+  BasicBlock *header(&(cfg->condition.bb));
+  if (is_post_dominator_tree) {
+    if (1 < edges->NumSuccessors(header)) {
+      parent.Get(header->index) = &(cfg->successor->bb);
+    }
+  } else {
+    for (unsigned i(0); i < edges->NumPredecessors(header); ++i) {
+      BasicBlock *pred(edges->Predecessor(header, i));
+      if (pred->index < header->index) {
+        parent.Get(header->index) = pred;
+        break;
+      }
+    }
+  }
+}
+
+}  // namespace mir
+}  // namespace pjit
@@ -0,0 +1,140 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * dominators.h
+ *
+ *  Created on: 2014-01-18
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_CFG_DOMINATORS_H_
+#define PJIT_MIR_CFG_DOMINATORS_H_
+
+#include "pjit/base/base.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
+#include "pjit/mir/cfg/traversal.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+class BasicBlockEdges;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+
+
+// The dominator tree (or post-dominator tree) of the basic blocks of a
+// context, rooted at the entry (or exit) basic block.
+//
+// The tree is computed in linear time from the structure of the CFG instead of
+// by iterating to a fixed point: a basic block with a single predecessor (or
+// successor) is immediately dominated by it, and the only basic blocks with
+// more than one predecessor (or successor) are the joins (or conditions) of
+// branches, and the conditions of loops, whose immediate dominators follow
+// from their CFGs.
+//
+// Dominance queries take constant time, and use the pre-order numbering of
+// the tree: `a` dominates `b` iff `b` is in the sub-tree of `a`.
+//
+// Like the edges, the trees of a context are built lazily by
+// `Context::Dominators` and `Context::PostDominators`, and are rebuilt after
+// `Context::InvalidateControlFlow` has been called.
+class DominatorTree : public ControlFlowGraphVisitor {
+ public:
+  DominatorTree(Context *context_, bool is_post_dominator_tree_);
+  virtual ~DominatorTree(void) = default;
+
+  void Build(void);
+
+  // Returns the root of the tree, i.e. the entry or exit basic block.
+  inline BasicBlock *Root(void) {
+    return order.Get(0);
+  }
+
+  // Returns the immediate (post-)dominator of `bb`, or `nullptr` if `bb` is
+  // the root of the tree.
+  inline BasicBlock *ImmediateDominator(const BasicBlock *bb) {
+    return parent.Get(bb->index);
+  }
+
+  // Returns true if `a` (post-)dominates `b`. Every basic block dominates
+  // itself.
+  inline bool Dominates(const BasicBlock *a, const BasicBlock *b) {
+    const unsigned a_number(number.Get(a->index));
+    const unsigned b_number(number.Get(b->index));
+    return a_number <= b_number && b_number < a_number + size.Get(a->index);
+  }
+
+  inline bool StrictlyDominates(const BasicBlock *a, const BasicBlock *b) {
+    return a != b && Dominates(a, b);
+  }
+
+  // Returns the number of edges between `bb` and the root of the tree.
+  inline unsigned Depth(const BasicBlock *bb) {
+    return depth.Get(bb->index);
+  }
+
+  // Returns the basic blocks that are immediately (post-)dominated by `bb`.
+  inline unsigned NumChildren(const BasicBlock *bb) {
+    return child_begin.Get(bb->index + 1) - child_begin.Get(bb->index);
+  }
+
+  inline BasicBlock *Child(const BasicBlock *bb, unsigned n) {
+    return children.Get(child_begin.Get(bb->index) + n);
+  }
+
+  // Returns the basic blocks of the tree in pre-order, i.e. every basic block
+  // comes after its (post-)dominators.
+  inline BasicBlock *PreOrderBlock(unsigned n) {
+    return order.Get(n);
+  }
+
+  // Type dispatch on the kinds of control-flow graphs, which finds the
+  // immediate (post-)dominators of the joins and conditions of branches and
+  // loops. These *do not* visit the successors of `cfg`.
+  virtual void VisitPreOrder(SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(LoopControlFlowGraph *cfg);
+
+ private:
+  Context * const context;
+  const bool is_post_dominator_tree;
+
+  ControlFlowGraphTraversal traversal;
+
+  // The edges of the context while the tree is being built.
+  BasicBlockEdges *edges;
+
+  // Indexed by the reverse post-order index of each basic block: its parent
+  // in the tree, its pre-order number, the size of its sub-tree (including
+  // itself), and its depth.
+  Vector<BasicBlock *> parent;
+  Vector<unsigned> number;
+  Vector<unsigned> size;
+  Vector<unsigned> depth;
+
+  // The children of each basic block, stored like the edges of
+  // `BasicBlockEdges`.
+  Vector<unsigned> child_begin;
+  Vector<BasicBlock *> children;
+
+  // The basic blocks in pre-order, and the worklist used to order them.
+  Vector<BasicBlock *> order;
+  Vector<BasicBlock *> worklist;
+
+  void JoinBranch(BasicBlock *condition, BasicBlock *join);
+  void IndexChildren(void);
+  void NumberTree(BasicBlock *root);
+
+  DominatorTree(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(DominatorTree);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_CFG_DOMINATORS_H_
@@ -0,0 +1,144 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * edges.cc
+ *
+ *  Created on: 2014-01-16
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/cfg/edges.h"
+
+#include "pjit/mir/context.h"
+#include "pjit/mir/cfg/multi-way-branch.h"
+
+namespace pjit {
+namespace mir {
+namespace {
+
+// Finds the first basic block of a control-flow graph.
+class FirstBasicBlock : public BasicBlockVisitor {
+ public:
+  FirstBasicBlock(void)
+      : bb(nullptr) {}
+
+  virtual ~FirstBasicBlock(void) = default;
+
+  virtual void Visit(BasicBlock *bb_) {
+    bb = bb_;
+  }
+
+  BasicBlock *bb;
+
+ private:
+  PJIT_DISALLOW_COPY_AND_ASSIGN(FirstBasicBlock);
+};
+
+}  // namespace
+
+
+BasicBlockEdges::BasicBlockEdges(Context *context_)
+    : traversal(context_),
+      blocks(),
+      edges(),
+      successor_begin(),
+      successors(),
+      predecessor_begin(),
+      predecessors() {}
+
+
+// Number the basic blocks in reverse post-order, find the edges between them,
+// and then sort the edges by their sources and by their targets.
+void BasicBlockEdges::Build(void) {
+  blocks.Clear();
+  edges.Clear();
+
+  traversal.ReversePostOrder(blocks);
+  for (unsigned i(0); i < blocks.Size(); ++i) {
+    blocks.Get(i)->index = i;
+  }
+  traversal.Traverse(this);
+
+  Index(successor_begin, successors, true);
+  Index(predecessor_begin, predecessors, false);
+}
+
+
+// Sort the edges by their sources (if `is_forward` is true) or by their
+// targets, and store the other ends of the sorted edges into `adjacent`.
+void BasicBlockEdges::Index(Vector<unsigned> &begin,
+                            Vector<BasicBlock *> &adjacent, bool is_forward) {
+  begin.Clear();
+  adjacent.Clear();
+  for (unsigned i(0); i <= blocks.Size(); ++i) {
+    begin.PushBack(0U);
+  }
+
+  // Count the edges of each block, and then turn the counts into the offsets
+  // at which each block's edges end.
+  for (const Edge &edge : edges) {
+    ++begin.Get((is_forward ? edge.source : edge.target)->index);
+  }
+  unsigned offset(0);
+  for (unsigned i(0); i < blocks.Size(); ++i) {
+    offset += begin.Get(i);
+    begin.Get(i) = offset;
+  }
+  begin.Get(blocks.Size()) = offset;
+
+  for (unsigned i(0); i < edges.Size(); ++i) {
+    adjacent.PushBack(nullptr);
+  }
+
+  // Place the edges from the back, which leaves each block's offset at the
+  // beginning of its edges.
+  for (unsigned i(edges.Size()); i--; ) {
+    const Edge &edge(edges.Get(i));
+    BasicBlock *from(is_forward ? edge.source : edge.target);
+    BasicBlock *to(is_forward ? edge.target : edge.source);
+    adjacent.Get(--begin.Get(from->index)) = to;
+  }
+}
+
+
+void BasicBlockEdges::AddEdge(BasicBlock *source, ControlFlowGraph *target) {
+  FirstBasicBlock first;
+  target->VisitFirst(&first);
+  const Edge edge = {source, first.bb};
+  edges.PushBack(edge);
+}
+
+
+// The condition of a branch or loop has no successor, and the exit of the
+// context has no successors at all.
+void BasicBlockEdges::VisitPreOrder(SequentialControlFlowGraph *cfg) {
+  if (cfg->successor) {
+    AddEdge(&(cfg->bb), cfg->successor);
+  }
+}
+
+
+void BasicBlockEdges::VisitPreOrder(ConditionalControlFlowGraph *cfg) {
+  AddEdge(&(cfg->condition.bb), &(cfg->if_true));
+  AddEdge(&(cfg->condition.bb), &(cfg->if_false));
+}
+
+
+// Values that match no arm fall through to the successor, unless there is a
+// default arm.
+void BasicBlockEdges::VisitPreOrder(MultiWayBranchControlFlowGraph *cfg) {
+  for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+    AddEdge(&(cfg->condition.bb), &(arm->if_true));
+  }
+  if (!cfg->default_arm) {
+    AddEdge(&(cfg->condition.bb), cfg->successor);
+  }
+}
+
+
+void BasicBlockEdges::VisitPreOrder(LoopControlFlowGraph *cfg) {
+  AddEdge(&(cfg->condition.bb), &(cfg->body));
+  AddEdge(&(cfg->condition.bb), cfg->successor);
+}
+
+}  // namespace mir
+}  // namespace pjit
@@ -0,0 +1,113 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * edges.h
+ *
+ *  Created on: 2014-01-16
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_CFG_EDGES_H_
+#define PJIT_MIR_CFG_EDGES_H_
+
+#include "pjit/base/base.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
+#include "pjit/mir/cfg/traversal.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+
+
+// The successors and predecessors of every basic block of a context, stored
+// in compact arrays so that they can be iterated in constant time per edge,
+// instead of being re-discovered through the structure of the CFG (as with
+// the basic block finders).
+//
+// Basic blocks are numbered in reverse post-order. The edges of the `n`th
+// basic block are stored from the `n`th up to (but excluding) the `n + 1`th
+// entry of their arrays.
+//
+// The edges of a context are built lazily by `Context::Edges`, and are
+// rebuilt after `Context::InvalidateControlFlow` has been called. Changing
+// the instructions of a basic block does not invalidate its edges.
+class BasicBlockEdges : public ControlFlowGraphVisitor {
+ public:
+  explicit BasicBlockEdges(Context *context_);
+  virtual ~BasicBlockEdges(void) = default;
+
+  void Build(void);
+
+  inline unsigned NumBlocks(void) const {
+    return blocks.Size();
+  }
+
+  // Returns the `n`th basic block in reverse post-order.
+  inline BasicBlock *Block(unsigned n) {
+    return blocks.Get(n);
+  }
+
+  // Returns the position of `bb` in reverse post-order.
+  inline unsigned Index(const BasicBlock *bb) const {
+    return bb->index;
+  }
+
+  inline unsigned NumSuccessors(const BasicBlock *bb) {
+    return successor_begin.Get(bb->index + 1) - successor_begin.Get(bb->index);
+  }
+
+  inline BasicBlock *Successor(const BasicBlock *bb, unsigned n) {
+    return successors.Get(successor_begin.Get(bb->index) + n);
+  }
+
+  inline unsigned NumPredecessors(const BasicBlock *bb) {
+    return predecessor_begin.Get(bb->index + 1) -
+           predecessor_begin.Get(bb->index);
+  }
+
+  inline BasicBlock *Predecessor(const BasicBlock *bb, unsigned n) {
+    return predecessors.Get(predecessor_begin.Get(bb->index) + n);
+  }
+
+  // Type dispatch on the kinds of control-flow graphs, which finds the edges
+  // that leave the basic blocks of `cfg`. These *do not* visit the successors
+  // of `cfg`.
+  virtual void VisitPreOrder(SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(LoopControlFlowGraph *cfg);
+
+ private:
+  struct Edge {
+    BasicBlock *source;
+    BasicBlock *target;
+  };
+
+  ControlFlowGraphTraversal traversal;
+
+  Vector<BasicBlock *> blocks;
+  Vector<Edge> edges;
+
+  Vector<unsigned> successor_begin;
+  Vector<BasicBlock *> successors;
+  Vector<unsigned> predecessor_begin;
+  Vector<BasicBlock *> predecessors;
+
+  void AddEdge(BasicBlock *source, ControlFlowGraph *target);
+  void Index(Vector<unsigned> &begin, Vector<BasicBlock *> &adjacent,
+             bool is_forward);
+
+  BasicBlockEdges(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(BasicBlockEdges);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_CFG_EDGES_H_
@@ -0,0 +1,104 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * loop-nest.cc
+ *
+ *  Created on: 2014-01-18
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/cfg/loop-nest.h"
+
+#include "pjit/mir/context.h"
+#include "pjit/mir/cfg/edges.h"
+
+namespace pjit {
+namespace mir {
+
+
+LoopNest::LoopNest(Context *context_)
+    : context(context_),
+      traversal(context_),
+      edges(nullptr),
+      loops(),
+      block_loops(),
+      enclosing_loops() {}
+
+
+void LoopNest::Build(void) {
+  edges = context->Edges();
+  loops.Clear();
+  traversal.Traverse(this);
+  SortLoops();
+  NestLoops();
+  edges = nullptr;
+}
+
+
+// Loops are found in the order of their CFGs, which is the order of their
+// headers unless a loop is nested inside of the `init` of another loop. The
+// loops are almost always sorted, so an insertion sort takes linear time.
+void LoopNest::SortLoops(void) {
+  for (unsigned i(1); i < loops.Size(); ++i) {
+    const Loop loop(loops.Get(i));
+    unsigned j(i);
+    for (; j && loops.Get(j - 1).begin > loop.begin; --j) {
+      loops.Get(j) = loops.Get(j - 1);
+    }
+    loops.Get(j) = loop;
+  }
+}
+
+
+// Sweep over the basic blocks in reverse post-order, keeping a stack of the
+// loops whose ranges contain the current basic block.
+void LoopNest::NestLoops(void) {
+  block_loops.Clear();
+  enclosing_loops.Clear();
+  unsigned next_loop(0);
+  for (unsigned i(0); i < edges->NumBlocks(); ++i) {
+    while (enclosing_loops.Size() &&
+           loops.Get(enclosing_loops.Get(enclosing_loops.Size() - 1)).end < i) {
+      enclosing_loops.PopBack();
+    }
+    for (; next_loop < loops.Size() && loops.Get(next_loop).begin == i;
+         ++next_loop) {
+      Loop &loop(loops.Get(next_loop));
+      if (enclosing_loops.Size()) {
+        loop.parent = enclosing_loops.Get(enclosing_loops.Size() - 1);
+        loop.depth = loops.Get(loop.parent).depth + 1;
+      }
+      enclosing_loops.PushBack(next_loop);
+    }
+    block_loops.PushBack(enclosing_loops.Size() ?
+                         enclosing_loops.Get(enclosing_loops.Size() - 1) :
+                         static_cast<unsigned>(NO_LOOP));
+  }
+}
+
+
+void LoopNest::VisitPreOrder(SequentialControlFlowGraph *) {}
+void LoopNest::VisitPreOrder(ConditionalControlFlowGraph *) {}
+void LoopNest::VisitPreOrder(MultiWayBranchControlFlowGraph *) {}
+
+
+// The header of a loop has two predecessors: the pre-header, which comes
+// before the header in reverse post-order, and the latch, which comes after
+// every other basic block of the loop.
+void LoopNest::VisitPreOrder(LoopControlFlowGraph *cfg) {
+  BasicBlock *header(&(cfg->condition.bb));
+  Loop loop = {cfg, nullptr, header, nullptr, NO_LOOP, 1,
+               header->index, header->index};
+  for (unsigned i(0); i < edges->NumPredecessors(header); ++i) {
+    BasicBlock *pred(edges->Predecessor(header, i));
+    if (pred->index < header->index) {
+      loop.preheader = pred;
+    } else {
+      loop.latch = pred;
+      loop.end = pred->index;
+    }
+  }
+  loops.PushBack(loop);
+}
+
+}  // namespace mir
+}  // namespace pjit
@@ -0,0 +1,129 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * loop-nest.h
+ *
+ *  Created on: 2014-01-18
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_CFG_LOOP_NEST_H_
+#define PJIT_MIR_CFG_LOOP_NEST_H_
+
+#include "pjit/base/base.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
+#include "pjit/mir/cfg/traversal.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+class BasicBlockEdges;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+
+
+// The loop nesting forest of a context.
+//
+// Every loop of a context is a `LoopControlFlowGraph`, and so the loops are
+// found directly from the structure of the CFG: the header of a loop is its
+// `condition`, its pre-header is the last basic block of its `init`, and its
+// latch is the last basic block of its `update`. The basic blocks of a loop
+// are the header, the body, and the update, which are contiguous in reverse
+// post-order, and so nested loops are nested ranges of basic blocks.
+//
+// Loops are numbered in the reverse post-order of their headers, and so an
+// enclosing loop comes before the loops that it contains.
+//
+// The loop nest of a context is built lazily by `Context::Loops`, and is
+// rebuilt after `Context::InvalidateControlFlow` has been called.
+class LoopNest : public ControlFlowGraphVisitor {
+ public:
+  enum : unsigned {
+    NO_LOOP = ~0U
+  };
+
+  struct Loop {
+    LoopControlFlowGraph *cfg;
+    BasicBlock *preheader;
+    BasicBlock *header;
+    BasicBlock *latch;
+
+    // The innermost enclosing loop, or `NO_LOOP`.
+    unsigned parent;
+
+    // The number of loops that contain this loop, including itself.
+    unsigned depth;
+
+    // Reverse post-order indexes of the header and of the latch.
+    unsigned begin;
+    unsigned end;
+  };
+
+  explicit LoopNest(Context *context_);
+  virtual ~LoopNest(void) = default;
+
+  void Build(void);
+
+  inline unsigned NumLoops(void) const {
+    return loops.Size();
+  }
+
+  inline const Loop &GetLoop(unsigned n) {
+    return loops.Get(n);
+  }
+
+  // Returns the innermost loop that contains `bb`, or `NO_LOOP`.
+  inline unsigned InnermostLoop(const BasicBlock *bb) {
+    return block_loops.Get(bb->index);
+  }
+
+  // Returns the number of loops that contain `bb`.
+  inline unsigned LoopDepth(const BasicBlock *bb) {
+    const unsigned loop(InnermostLoop(bb));
+    return NO_LOOP == loop ? 0 : loops.Get(loop).depth;
+  }
+
+  inline bool Contains(unsigned loop, const BasicBlock *bb) {
+    const Loop &info(loops.Get(loop));
+    return info.begin <= bb->index && bb->index <= info.end;
+  }
+
+  // Type dispatch on the kinds of control-flow graphs, which finds the loops.
+  // These *do not* visit the successors of `cfg`.
+  virtual void VisitPreOrder(SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(LoopControlFlowGraph *cfg);
+
+ private:
+  Context * const context;
+
+  ControlFlowGraphTraversal traversal;
+
+  // The edges of the context while the loop nest is being built.
+  BasicBlockEdges *edges;
+
+  Vector<Loop> loops;
+
+  // The innermost loop of each basic block, indexed by its reverse post-order
+  // index.
+  Vector<unsigned> block_loops;
+
+  // Stack of the loops that enclose the current basic block.
+  Vector<unsigned> enclosing_loops;
+
+  void SortLoops(void);
+  void NestLoops(void);
+
+  LoopNest(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(LoopNest);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_CFG_LOOP_NEST_H_
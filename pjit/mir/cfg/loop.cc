@@ -36,7 +36,7 @@ void LoopControlFlowGraph::VisitPreOrder(
     return;
   }
 
-  condition.last_visitor = visitor;
+  condition.visit_epoch = visitor->epoch;
   visitor->VisitPreOrder(&init);
 
   do {  // Visit the body. This will also trigger visiting of the update block.
@@ -48,7 +48,7 @@ void LoopControlFlowGraph::VisitPreOrder(
     PJIT_UNUSED(predecessor_chain);
   } while (0);
 
-  condition.last_visitor = nullptr;
+  condition.visit_epoch = 0;
 
   do {
     // Successors of the condition are either the loop's successor, or the
@@ -24,6 +24,7 @@ namespace mir {
 class Context;
 class BasicBlockVisitor;
 class ControlFlowGraphVisitor;
+class GarbageCollectionVisitor;
 
 
 // Represents a single IF+ELSE control-flow graph. The structure begins with a
@@ -50,6 +51,20 @@ class LoopControlFlowGraph : public ControlFlowGraph {
 
  private:
   friend class hir::LoopStatementBuilder;
+  friend class GarbageCollectionVisitor;
+  friend class SSATransform;
+  friend class OutOfSSATransform;
+  friend class ConstantFoldingTransform;
+  friend class DeadCodeEliminationTransform;
+  friend class ValueNumberingTransform;
+  friend class LoopInvariantCodeMotionTransform;
+  friend class LoopUnrollingTransform;
+  friend class BlockLocalTransform;
+  friend class ControlFlowGraphTraversal;
+  friend class BasicBlockEdges;
+  friend class DominatorTree;
+  friend class LoopNest;
+  friend class x86_64::CodeGenerator;
 
   // The initialization, condition, and update blocks. Initialization also
   // acts as a loop pre-header.
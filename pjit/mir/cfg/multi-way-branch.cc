@@ -50,7 +50,7 @@ void MultiWayBranchControlFlowGraph::VisitPreOrder(
     PJIT_UNUSED(successor_chain);
   } while (0);
 
-  successor->last_visitor = visitor;
+  successor->visit_epoch = visitor->epoch;
 
   // Visit each arm of the multi-way branch.
   for (MultiWayBranchArm *arm(arms); nullptr != arm; arm = arm->next) {
@@ -61,7 +61,7 @@ void MultiWayBranchControlFlowGraph::VisitPreOrder(
     PJIT_UNUSED(predecessor_chain);
   }
 
-  successor->last_visitor = nullptr;
+  successor->visit_epoch = 0;
 
   // The successor of the conditional CFG wasn't previously visited, so now
   // we can go and visit it.
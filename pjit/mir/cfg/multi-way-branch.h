@@ -44,6 +44,16 @@ class MultiWayBranchArm {
   friend class MultiWayFirstBasicBlockFinder;
   friend class MultiWayPredecessorBasicBlockFinder;
   friend class GarbageCollectionVisitor;
+  friend class SSATransform;
+  friend class OutOfSSATransform;
+  friend class ConstantFoldingTransform;
+  friend class DeadCodeEliminationTransform;
+  friend class ValueNumberingTransform;
+  friend class LoopUnrollingTransform;
+  friend class BlockLocalTransform;
+  friend class ControlFlowGraphTraversal;
+  friend class BasicBlockEdges;
+  friend class x86_64::CodeGenerator;
 
   // The value that the switch condition value must equal to in order to take
   // this arm of the multi-way branch.
@@ -91,6 +101,18 @@ class MultiWayBranchControlFlowGraph : public ControlFlowGraph {
   friend class MultiWayFirstBasicBlockFinder;
   friend class MultiWayPredecessorBasicBlockFinder;
   friend class GarbageCollectionVisitor;
+  friend class SSATransform;
+  friend class OutOfSSATransform;
+  friend class ConstantFoldingTransform;
+  friend class DeadCodeEliminationTransform;
+  friend class ValueNumberingTransform;
+  friend class LoopUnrollingTransform;
+  friend class BlockLocalTransform;
+  friend class ControlFlowGraphTraversal;
+  friend class BasicBlockEdges;
+  friend class DominatorTree;
+  friend class LoopNest;
+  friend class x86_64::CodeGenerator;
 
   // The control-flow graph containing the condition.
   //
@@ -61,6 +61,17 @@ class SequentialControlFlowGraph : public ControlFlowGraph {
   friend class MultiWayBranchControlFlowGraph;
   friend class MultiWayFirstBasicBlockFinder;
   friend class MultiWayPredecessorBasicBlockFinder;
+  friend class SSATransform;
+  friend class OutOfSSATransform;
+  friend class ConstantFoldingTransform;
+  friend class DeadCodeEliminationTransform;
+  friend class ValueNumberingTransform;
+  friend class LoopUnrollingTransform;
+  friend class ControlFlowGraphTraversal;
+  friend class BasicBlockEdges;
+  friend class DominatorTree;
+  friend class LoopNest;
+  friend class x86_64::CodeGenerator;
 
   BasicBlock bb;
   ControlFlowGraph *successor;
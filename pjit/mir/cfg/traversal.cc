@@ -0,0 +1,133 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * traversal.cc
+ *
+ *  Created on: 2014-01-15
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/cfg/traversal.h"
+
+#include "pjit/mir/context.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/cfg/multi-way-branch.h"
+
+namespace pjit {
+namespace mir {
+
+
+ControlFlowGraphTraversal::ControlFlowGraphTraversal(Context *context_)
+    : context(context_),
+      worklist(),
+      visitor(nullptr),
+      blocks(nullptr),
+      stop(nullptr) {}
+
+
+void ControlFlowGraphTraversal::Traverse(ControlFlowGraphVisitor *visitor_) {
+  visitor = visitor_;
+  blocks = nullptr;
+  Run();
+}
+
+
+void ControlFlowGraphTraversal::ReversePostOrder(
+    Vector<BasicBlock *> &blocks_) {
+  visitor = nullptr;
+  blocks = &blocks_;
+  Run();
+}
+
+
+void ControlFlowGraphTraversal::PostOrder(Vector<BasicBlock *> &blocks_) {
+  const unsigned begin(blocks_.Size());
+  ReversePostOrder(blocks_);
+  for (unsigned i(begin), j(blocks_.Size()); i + 1 < j; ++i, --j) {
+    BasicBlock *bb(blocks_.Get(i));
+    blocks_.Get(i) = blocks_.Get(j - 1);
+    blocks_.Get(j - 1) = bb;
+  }
+}
+
+
+// Visit the CFGs in the worklist until it is empty. The work of a CFG is
+// pushed onto the worklist in the reverse of the order in which it should be
+// visited.
+void ControlFlowGraphTraversal::Run(void) {
+  epoch = context->NextEpoch();
+  AddWork(&(context->entry), nullptr);
+  while (worklist.Size()) {
+    const WorkItem item(worklist.PopBack());
+    if (!item.cfg || item.cfg == item.stop || !item.cfg->ShouldVisit(this)) {
+      continue;
+    }
+    if (visitor) {
+      item.cfg->DoVisitPreOrder(visitor);
+    }
+    stop = item.stop;
+    item.cfg->DoVisitPreOrder(this);
+  }
+}
+
+
+void ControlFlowGraphTraversal::AddBlock(BasicBlock *bb) {
+  if (visitor) {
+    visitor->VisitPreOrder(bb);
+  } else {
+    blocks->PushBack(bb);
+  }
+}
+
+
+void ControlFlowGraphTraversal::AddWork(ControlFlowGraph *cfg,
+                                        ControlFlowGraph *chain_stop) {
+  const WorkItem item = {cfg, chain_stop};
+  worklist.PushBack(item);
+}
+
+
+void ControlFlowGraphTraversal::VisitPreOrder(
+    SequentialControlFlowGraph *cfg) {
+  AddBlock(&(cfg->bb));
+  AddWork(cfg->successor, stop);
+}
+
+
+void ControlFlowGraphTraversal::VisitPreOrder(
+    ConditionalControlFlowGraph *cfg) {
+  AddWork(cfg->successor, stop);
+  AddWork(&(cfg->if_false), cfg->successor);
+  AddWork(&(cfg->if_true), cfg->successor);
+  AddWork(&(cfg->condition), nullptr);
+}
+
+
+// The arms are pushed in the order of `arms`, and then reversed, so that they
+// are visited in the order of `arms`.
+void ControlFlowGraphTraversal::VisitPreOrder(
+    MultiWayBranchControlFlowGraph *cfg) {
+  AddWork(cfg->successor, stop);
+  const unsigned begin(worklist.Size());
+  for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+    AddWork(&(arm->if_true), cfg->successor);
+  }
+  for (unsigned i(begin), j(worklist.Size()); i + 1 < j; ++i, --j) {
+    const WorkItem item(worklist.Get(i));
+    worklist.Get(i) = worklist.Get(j - 1);
+    worklist.Get(j - 1) = item;
+  }
+  AddWork(&(cfg->condition), nullptr);
+}
+
+
+// The body of a loop ends with its `update`, whose successor is the loop's
+// `condition`.
+void ControlFlowGraphTraversal::VisitPreOrder(LoopControlFlowGraph *cfg) {
+  AddWork(cfg->successor, stop);
+  AddWork(&(cfg->body), &(cfg->condition));
+  AddWork(&(cfg->condition), nullptr);
+  AddWork(&(cfg->init), &(cfg->condition));
+}
+
+}  // namespace mir
+}  // namespace pjit
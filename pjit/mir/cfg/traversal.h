@@ -0,0 +1,94 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * traversal.h
+ *
+ *  Created on: 2014-01-15
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_CFG_TRAVERSAL_H_
+#define PJIT_MIR_CFG_TRAVERSAL_H_
+
+#include "pjit/base/base.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+class BasicBlock;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+
+
+// Iteratively traverses the control-flow graphs of a context, using an
+// explicit worklist instead of the recursion of `ControlFlowGraph::
+// VisitPreOrder`, and so long chains of CFGs do not grow the stack.
+//
+// Control-flow graphs are visited in the order in which their basic blocks
+// execute: the condition of a branch comes before its arms, all arms come
+// before the successor of the branch, and a loop's `init`, `condition`, and
+// `body` (which ends with `update`) come before the successor of the loop.
+// The order of the basic blocks is a reverse post-order of the CFG, i.e. a
+// basic block comes after its predecessors, except for the predecessors that
+// reach it through the back edge of a loop.
+//
+// Every traversal has its own epoch, and each CFG is visited at most once per
+// traversal. The worklist is kept between traversals, so a traversal object
+// that is used more than once does not allocate after its first traversal.
+class ControlFlowGraphTraversal : public ControlFlowGraphVisitor {
+ public:
+  explicit ControlFlowGraphTraversal(Context *context_);
+  virtual ~ControlFlowGraphTraversal(void) = default;
+
+  // Visit every CFG with `visitor`, and then each of its basic blocks. The
+  // type dispatch of `visitor` on the kinds of CFGs *must not* visit the
+  // children nor the successors of the CFG.
+  void Traverse(ControlFlowGraphVisitor *visitor_);
+
+  // Append the basic blocks of the context to `blocks_`, in reverse post-order
+  // or in post-order.
+  void ReversePostOrder(Vector<BasicBlock *> &blocks_);
+  void PostOrder(Vector<BasicBlock *> &blocks_);
+
+  // Type dispatch on the kinds of control-flow graphs. These *do not* visit
+  // the successors of `cfg`, and instead add them to the worklist.
+  virtual void VisitPreOrder(SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(LoopControlFlowGraph *cfg);
+
+ private:
+  // A chain of CFGs to visit, from `cfg` up to (but excluding) `stop`.
+  struct WorkItem {
+    ControlFlowGraph *cfg;
+    ControlFlowGraph *stop;
+  };
+
+  Context * const context;
+
+  Vector<WorkItem> worklist;
+
+  // Outputs of the traversal. Basic blocks are given to `visitor` if it isn't
+  // `nullptr`, and are otherwise appended to `blocks`.
+  ControlFlowGraphVisitor *visitor;
+  Vector<BasicBlock *> *blocks;
+
+  // The end of the chain of the currently visited CFG.
+  ControlFlowGraph *stop;
+
+  void Run(void);
+  void AddBlock(BasicBlock *bb);
+  void AddWork(ControlFlowGraph *cfg, ControlFlowGraph *chain_stop);
+
+  ControlFlowGraphTraversal(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(ControlFlowGraphTraversal);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_CFG_TRAVERSAL_H_
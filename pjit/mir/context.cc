@@ -8,6 +8,7 @@
 
 #include "pjit/mir/context.h"
 #include "pjit/mir/instruction.h"
+#include "pjit/mir/cfg/traversal.h"
 #include "pjit/mir/visitors/garbage-collect/visit.h"
 
 namespace pjit {
@@ -15,35 +16,69 @@ namespace mir {
 
 
 Context::Context(void)
-    : next_symbol_id(1),
+    : Context(ContextAllocationMode::ALLOCATE_GARBAGE_COLLECTED) {}
+
+
+Context::Context(ContextAllocationMode mode_)
+    : mode(mode_),
+      next_symbol_id(1),
+      last_epoch(0),
       entry(this, nullptr),
       exit(this, &entry),
       current(&entry),
       if_builder(nullptr),
-      mbr_builder(nullptr) {
+      mbr_builder(nullptr),
+      control_flow_version(1),
+      edges_version(0),
+      dominators_version(0),
+      post_dominators_version(0),
+      loops_version(0),
+      edges(this),
+      dominators(this, false),
+      post_dominators(this, true),
+      loops(this) {
   entry.successor = &exit;
 }
 
 
 Symbol *Context::MakeSymbol(const TypeInfo *type) {
-  return symbol_allocator.Allocate(type, nullptr, next_symbol_id++);
+  return Allocate(symbol_allocator, type, nullptr, next_symbol_id++);
 }
 
 
 Symbol *Context::MakeSymbol(const TypeInfo *type, const char *name) {
-  return symbol_allocator.Allocate(type, name, next_symbol_id++);
+  return Allocate(symbol_allocator, type, name, next_symbol_id++);
+}
+
+
+Symbol *Context::MakeSymbol(const TypeInfo *type, const char *name,
+                            SymbolBehavior behavior) {
+  Symbol *sym(MakeSymbol(type, name));
+  sym->behavior = behavior;
+  return sym;
 }
 
 
 
+Symbol *Context::MakeConstant(const TypeInfo *type) {
+  return Allocate(symbol_allocator, type, static_cast<void *>(nullptr));
+}
+
+
 Symbol *Context::CopySymbol(const Symbol *that) {
-  return symbol_allocator.Allocate(that->type, that->value.name, that->id);
+  return Allocate(symbol_allocator, that->type, that->value.name, that->id);
+}
+
+
+Instruction *Context::MakeInstruction(
+    Operation op, std::initializer_list<const void *> args) {
+  return Allocate(instruction_allocator, op, args);
 }
 
 
 void Context::EmitInstruction(Operation op,
                               std::initializer_list<const void *> args) {
-  current->Append(instruction_allocator.Allocate(op, args));
+  current->Append(MakeInstruction(op, args));
 }
 
 
@@ -60,16 +95,63 @@ const Symbol *Context::EmitConvertType(const TypeInfo *to_type,
 
 
 void Context::VisitPreOrder(ControlFlowGraphVisitor *visitor) {
+  visitor->epoch = NextEpoch();
   visitor->VisitPreOrder(&entry);
 }
 
 
 void Context::VisitPostOrder(ControlFlowGraphVisitor *visitor) {
+  visitor->epoch = NextEpoch();
   visitor->VisitPostOrder(&entry);
 }
 
 
+void Context::InvalidateControlFlow(void) {
+  ++control_flow_version;
+}
+
+
+BasicBlockEdges *Context::Edges(void) {
+  if (edges_version != control_flow_version) {
+    edges.Build();
+    edges_version = control_flow_version;
+  }
+  return &edges;
+}
+
+
+DominatorTree *Context::Dominators(void) {
+  if (dominators_version != control_flow_version) {
+    dominators.Build();
+    dominators_version = control_flow_version;
+  }
+  return &dominators;
+}
+
+
+DominatorTree *Context::PostDominators(void) {
+  if (post_dominators_version != control_flow_version) {
+    post_dominators.Build();
+    post_dominators_version = control_flow_version;
+  }
+  return &post_dominators;
+}
+
+
+LoopNest *Context::Loops(void) {
+  if (loops_version != control_flow_version) {
+    loops.Build();
+    loops_version = control_flow_version;
+  }
+  return &loops;
+}
+
+
 void Context::GarbageCollect(void) {
+  if (ContextAllocationMode::ALLOCATE_ARENA == mode) {
+    return;
+  }
+
   symbol_allocator.MarkAllUnreachable();
   instruction_allocator.MarkAllUnreachable();
   seq_allocator.MarkAllUnreachable();
@@ -79,7 +161,8 @@ void Context::GarbageCollect(void) {
   loop_allocator.MarkAllUnreachable();
 
   GarbageCollectionVisitor gc_visitor(this);
-  VisitPreOrder(&gc_visitor);
+  ControlFlowGraphTraversal traversal(this);
+  traversal.Traverse(&gc_visitor);
 
   symbol_allocator.FreeUnreachable();
   instruction_allocator.FreeUnreachable();
@@ -91,8 +174,54 @@ void Context::GarbageCollect(void) {
 }
 
 
+void Context::Reset(void) {
+  if (ContextAllocationMode::ALLOCATE_ARENA == mode) {
+    arena.Reset();
+  } else {
+    symbol_allocator.FreeAll();
+    instruction_allocator.FreeAll();
+    seq_allocator.FreeAll();
+    cond_allocator.FreeAll();
+    mbr_allocator.FreeAll();
+    mbr_arm_allocator.FreeAll();
+    loop_allocator.FreeAll();
+  }
+  Initialize();
+}
+
+
+// Put the top-level CFGs and builder state into their initial state.
+void Context::Initialize(void) {
+  next_symbol_id = 1;
+
+  entry.bb.first = nullptr;
+  entry.bb.last = nullptr;
+  entry.successor = &exit;
+  entry.visit_epoch = 0;
+
+  exit.bb.first = nullptr;
+  exit.bb.last = nullptr;
+  exit.successor = nullptr;
+  exit.visit_epoch = 0;
+
+  current = &entry;
+  if_builder = nullptr;
+  mbr_builder = nullptr;
+  InvalidateControlFlow();
+}
+
+
+unsigned Context::NextEpoch(void) {
+  if (!++last_epoch) {
+    ++last_epoch;
+  }
+  return last_epoch;
+}
+
+
 // Link a successor into the CFG.
 void Context::LinkSuccessor(SequentialControlFlowGraph *successor) {
+  InvalidateControlFlow();
   if (current) {
     successor->successor = current->successor;
     if (successor->successor &&
@@ -106,6 +235,7 @@ void Context::LinkSuccessor(SequentialControlFlowGraph *successor) {
 // Link the new current CFG into the context.
 void Context::LinkCurrent(SequentialControlFlowGraph *new_current,
                           ControlFlowGraph *linked_successor) {
+  InvalidateControlFlow();
   if (current) {
     current->successor = linked_successor;
   }
@@ -15,6 +15,7 @@
 #include "pjit/base/type-traits.h"
 
 #include "pjit/containers/allocator.h"
+#include "pjit/containers/arena.h"
 
 #include "pjit/mir/symbol.h"
 #include "pjit/mir/instruction.h"
@@ -22,6 +23,9 @@
 #include "pjit/mir/cfg/conditional.h"
 #include "pjit/mir/cfg/multi-way-branch.h"
 #include "pjit/mir/cfg/loop.h"
+#include "pjit/mir/cfg/dominators.h"
+#include "pjit/mir/cfg/edges.h"
+#include "pjit/mir/cfg/loop-nest.h"
 
 namespace pjit {
 
@@ -33,9 +37,35 @@ class CaseStatementBuilder;
 class LoopStatementBuilder;
 }  // namespace hir
 
+namespace x86_64 {
+class CodeGenerator;
+}  // namespace x86_64
+
 namespace mir {
 
 class GarbageCollectionVisitor;
+class SSATransform;
+class OutOfSSATransform;
+class ConstantFoldingTransform;
+class DeadCodeEliminationTransform;
+class ValueNumberingTransform;
+class LoopUnrollingTransform;
+class ConversionSimplificationTransform;
+class ControlFlowGraphTraversal;
+
+
+// Determines how a `Context` allocates its MIR objects.
+enum class ContextAllocationMode {
+  // Objects are allocated from type-specific allocators, and unreachable
+  // objects can be reclaimed by `Context::GarbageCollect`.
+  ALLOCATE_GARBAGE_COLLECTED,
+
+  // Objects are bump-allocated from a single arena. Garbage collection is a
+  // no-op, and all objects are released at once by `Context::Reset` or by
+  // destroying the context. This suits short-lived contexts that are built,
+  // lowered, and then thrown away.
+  ALLOCATE_ARENA
+};
 
 
 // Represents a compilation "context" for the medium-level intermediate
@@ -45,13 +75,16 @@ class GarbageCollectionVisitor;
 // various control-flow graph classes to implicitly define the flow of control.
 // The compilation context is primarily responsible for managing allocations.
 // MIR compilation contexts are garbage collected using a simple mark and sweep
-// collector, implemented inside the `Allocator`.
+// collector, implemented inside the `Allocator`, unless they are arena-backed.
 class Context {
  public:
   Context(void);
+  explicit Context(ContextAllocationMode mode_);
 
   Symbol *MakeSymbol(const TypeInfo *type);
   Symbol *MakeSymbol(const TypeInfo *type, const char *name);
+  Symbol *MakeSymbol(const TypeInfo *type, const char *name,
+                     SymbolBehavior behavior);
 
   // Immediate constant.
   template <
@@ -63,11 +96,19 @@ class Context {
     >::Type = 0
   >
   Symbol *MakeSymbol(T val) {
-    return symbol_allocator.Allocate(val);
+    return Allocate(symbol_allocator, val);
   }
 
+  // Immediate constant of the type `type`. The value of the constant is zero,
+  // and can be changed by the caller before the constant is used.
+  Symbol *MakeConstant(const TypeInfo *type);
+
   Symbol *CopySymbol(const Symbol *that);
 
+  // Create an instruction without adding it to any basic block.
+  Instruction *MakeInstruction(Operation op,
+                               std::initializer_list<const void *> args);
+
   // Create and emit an instruction to the current basic block.
   void EmitInstruction(Operation op,
                        std::initializer_list<const void *> args);
@@ -79,6 +120,30 @@ class Context {
   void VisitPostOrder(ControlFlowGraphVisitor *visitor);
   void GarbageCollect(void);
 
+  // Note that control-flow graphs have been added, removed, or re-linked.
+  // This invalidates every cached analysis of the structure of the CFG.
+  void InvalidateControlFlow(void);
+
+  // Returns the successors and predecessors of every basic block, which are
+  // rebuilt if the control flow has changed since they were last built.
+  BasicBlockEdges *Edges(void);
+
+  // Returns the dominator tree, the post-dominator tree, and the loop nest of
+  // the CFG, which are rebuilt if the control flow has changed since they were
+  // last built.
+  DominatorTree *Dominators(void);
+  DominatorTree *PostDominators(void);
+  LoopNest *Loops(void);
+
+  // Release every MIR object owned by this context, and return the context to
+  // its initial, empty state. Arena-backed contexts release everything in one
+  // step, and re-use their memory for the next compilation.
+  void Reset(void);
+
+  // Visit every symbol owned by this context.
+  //
+  // Note: Arena-backed contexts do not track their symbols, and so nothing is
+  //       visited.
   inline void VisitSymbols(VisitorFor<Symbol>::Type *visitor) {
     symbol_allocator.Visit(visitor);
   }
@@ -94,10 +159,29 @@ class Context {
   friend class SequentialControlFlowGraph;
   friend class ConditionalControlFlowGraph;
   friend class GarbageCollectionVisitor;
+  friend class SSATransform;
+  friend class OutOfSSATransform;
+  friend class ConstantFoldingTransform;
+  friend class DeadCodeEliminationTransform;
+  friend class ValueNumberingTransform;
+  friend class LoopUnrollingTransform;
+  friend class ConversionSimplificationTransform;
+  friend class ControlFlowGraphTraversal;
+  friend class DominatorTree;
+  friend class x86_64::CodeGenerator;
+
+  const ContextAllocationMode mode;
 
   unsigned next_symbol_id;
 
-  // Very simple allocators for various kinds of MIR objects.
+  // Epoch of the most recently started traversal of the CFG.
+  unsigned last_epoch;
+
+  // Backing memory for all MIR objects when `mode` is `ALLOCATE_ARENA`.
+  Arena arena;
+
+  // Very simple allocators for various kinds of MIR objects. These are only
+  // used when `mode` is `ALLOCATE_GARBAGE_COLLECTED`.
   Allocator<Symbol> symbol_allocator;
   Allocator<Instruction> instruction_allocator;
   Allocator<SequentialControlFlowGraph> seq_allocator;
@@ -121,6 +205,37 @@ class Context {
   // The current HIR switch-statement builder.
   hir::SwitchStatementBuilder *mbr_builder;
 
+  // Version of the structure of the CFG, which changes whenever the control
+  // flow is invalidated, and the versions of the CFG whose analyses are in
+  // `edges`, `dominators`, `post_dominators`, and `loops`.
+  unsigned control_flow_version;
+  unsigned edges_version;
+  unsigned dominators_version;
+  unsigned post_dominators_version;
+  unsigned loops_version;
+  BasicBlockEdges edges;
+  DominatorTree dominators;
+  DominatorTree post_dominators;
+  LoopNest loops;
+
+  // Allocate a new MIR object, either from its type-specific allocator or
+  // from the arena, depending on the allocation mode.
+  template <typename T, typename... Args>
+  inline T *Allocate(Allocator<T> &allocator, Args... args) {
+    if (ContextAllocationMode::ALLOCATE_ARENA == mode) {
+      return arena.Allocate<T>(args...);
+    } else {
+      return allocator.Allocate(args...);
+    }
+  }
+
+  // Put the top-level CFGs and builder state into their initial state.
+  void Initialize(void);
+
+  // Returns the epoch of a new traversal of the CFG. Epochs are never zero,
+  // which is the epoch of CFGs that have not been visited.
+  unsigned NextEpoch(void);
+
   // Link a successor into the CFG.
   void LinkSuccessor(SequentialControlFlowGraph *successor);
 
@@ -0,0 +1,72 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * instruction.cc
+ *
+ *  Created on: 2014-01-07
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/instruction.h"
+
+namespace pjit {
+namespace mir {
+
+
+// Returns the role of the `i`th operand of an instruction with operation `op`.
+OperandKind GetOperandKind(Operation op, unsigned i) {
+  switch (op) {
+#define PJIT_DECLARE_BINARY_OPERATOR(opcode, _) \
+    case Operation::PJIT_CAT(OP_, opcode):
+#define PJIT_DECLARE_UNARY_OPERATOR(opcode, _)
+#include "pjit/mir/operator.h"
+#undef PJIT_DECLARE_BINARY_OPERATOR
+#undef PJIT_DECLARE_UNARY_OPERATOR
+      return i ? OperandKind::OPERAND_USE : OperandKind::OPERAND_DEFINITION;
+
+#define PJIT_DECLARE_BINARY_OPERATOR(opcode, _)
+#define PJIT_DECLARE_UNARY_OPERATOR(opcode, _) \
+    case Operation::PJIT_CAT(OP_, opcode):
+#include "pjit/mir/operator.h"
+#undef PJIT_DECLARE_BINARY_OPERATOR
+#undef PJIT_DECLARE_UNARY_OPERATOR
+    case Operation::OP_LOAD_MEMORY:
+    case Operation::OP_CONVERT_TYPE:
+    case Operation::OP_ASSIGN:
+      if (!i) {
+        return OperandKind::OPERAND_DEFINITION;
+      }
+      return 1 == i ? OperandKind::OPERAND_USE : OperandKind::OPERAND_NONE;
+
+    case Operation::OP_STORE_MEMORY:
+      return 2 > i ? OperandKind::OPERAND_USE : OperandKind::OPERAND_NONE;
+
+    case Operation::OP_LOAD_FIELD:
+      if (!i) {
+        return OperandKind::OPERAND_DEFINITION;
+      }
+      return 1 == i ? OperandKind::OPERAND_USE : OperandKind::OPERAND_FIELD;
+
+    case Operation::OP_STORE_FIELD:
+      return 1 == i ? OperandKind::OPERAND_FIELD : OperandKind::OPERAND_USE;
+
+    case Operation::OP_PHI:
+      if (!i) {
+        return OperandKind::OPERAND_DEFINITION;
+      }
+      return 1 == i ? OperandKind::OPERAND_USE : OperandKind::OPERAND_BLOCK;
+
+    case Operation::OP_CCALL1:
+      return 1 > i ? OperandKind::OPERAND_USE : OperandKind::OPERAND_NONE;
+    case Operation::OP_CCALL2:
+      return 2 > i ? OperandKind::OPERAND_USE : OperandKind::OPERAND_NONE;
+    case Operation::OP_CCALL3:
+      return OperandKind::OPERAND_USE;
+
+    case Operation::OP_NEXT:
+      return OperandKind::OPERAND_NONE;
+  }
+  return OperandKind::OPERAND_NONE;
+}
+
+}  // namespace mir
+}  // namespace pjit
@@ -22,6 +22,7 @@ struct StructureFieldInfo;
 namespace mir {
 
 class Symbol;
+class BasicBlock;
 
 
 // Medium-level IR instruction operation codes.
@@ -40,6 +41,15 @@ enum class Operation {
   OP_CONVERT_TYPE,
   OP_ASSIGN,
 
+  // SSA phi node. A phi node for some variable is represented as a group of
+  // consecutive `OP_PHI` instructions at the beginning of a join block, one
+  // per predecessor of the join block. Each instruction has the form
+  // `(dest, value, predecessor block)`, and all instructions in the group
+  // share the same `dest`.
+  OP_PHI,
+
+  // Call the C function in operand 0. The remaining operands (if any) are
+  // arguments to the function.
   OP_CCALL1,
   OP_CCALL2,
   OP_CCALL3,
@@ -54,9 +64,24 @@ enum class Operation {
 union Operand {
   const Symbol *symbol;
   const StructureFieldInfo *field;
+  const BasicBlock *block;
+};
+
+
+// Describes the role of an operand of an instruction.
+enum class OperandKind {
+  OPERAND_NONE,
+  OPERAND_DEFINITION,  // The instruction assigns a value to this symbol.
+  OPERAND_USE,  // The instruction reads the value of this symbol.
+  OPERAND_FIELD,
+  OPERAND_BLOCK
 };
 
 
+// Returns the role of the `i`th operand of an instruction with operation `op`.
+OperandKind GetOperandKind(Operation op, unsigned i);
+
+
 // A 2- or 3-operand instruction for the medium-level IR.
 class Instruction {
  public:
@@ -77,6 +102,15 @@ class Instruction {
     memcpy(&(operands[0]), ops.begin(), ops.size() * sizeof(const void *));
   }
 
+  // Returns the symbol defined by this instruction, or `nullptr` if this
+  // instruction does not define a symbol.
+  inline const Symbol *GetDefinition(void) const {
+    if (OperandKind::OPERAND_DEFINITION == GetOperandKind(operation, 0)) {
+      return operands[0].symbol;
+    }
+    return nullptr;
+  }
+
   Instruction(void) = delete;
 
   PJIT_DISALLOW_COPY_AND_ASSIGN(Instruction);
@@ -217,6 +217,7 @@ static int LogConstant(LogLevel level, const mir::Symbol *sym) {
       MAKE_SIMPLE_SYMBOL_LOGGER(S32, s32, "%d")
       MAKE_SIMPLE_SYMBOL_LOGGER(U64, u64, "%lu")
       MAKE_SIMPLE_SYMBOL_LOGGER(S64, s64, "%ld")
+      MAKE_SIMPLE_SYMBOL_LOGGER(bool, u8, "%u")
 
       // Floats are promoted to doubles through C-style variadic functions.
       MAKE_SIMPLE_SYMBOL_LOGGER(F32, f32, "%f")
@@ -318,6 +319,18 @@ int Log(LogLevel level, const mir::Instruction *in) {
       op_symbol = " = ";
       goto two_operands;
     }
+    case mir::Operation::OP_PHI: {
+      num_logged_bytes += Log(level, in->operands[0].symbol);
+      num_logged_bytes += Log(level, " = phi ");
+      num_logged_bytes += Log(level, in->operands[1].symbol);
+      num_logged_bytes += Log(level, ", b%p;",
+          reinterpret_cast<const void *>(in->operands[2].block));
+      goto done;
+    }
+    case mir::Operation::OP_NEXT: {
+      num_logged_bytes += Log(level, "next;");
+      goto done;
+    }
     default: {
       num_logged_bytes += Log(level, "???");
       goto done;
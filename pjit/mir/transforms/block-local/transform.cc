@@ -0,0 +1,123 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.cc
+ *
+ *  Created on: 2014-01-24
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/block-local/transform.h"
+
+#include "pjit/mir/context.h"
+#include "pjit/mir/symbol.h"
+#include "pjit/mir/instruction.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/cfg/sequential.h"
+#include "pjit/mir/cfg/conditional.h"
+#include "pjit/mir/cfg/multi-way-branch.h"
+#include "pjit/mir/cfg/loop.h"
+#include "pjit/mir/cfg/traversal.h"
+
+namespace pjit {
+namespace mir {
+
+
+BlockLocalTransform::BlockLocalTransform(Context *context_)
+    : context(context_),
+      position(0),
+      block_position(0),
+      memory_position(0),
+      only_count_uses(false) {}
+
+
+// Rewrite the entire MIR of the context. The uses of every symbol are counted
+// first, so that the rewrites can tell which values are only used once, and
+// which instructions are dead.
+void BlockLocalTransform::Transform(void) {
+  ControlFlowGraphTraversal traversal(context);
+  only_count_uses = true;
+  traversal.Traverse(this);
+  only_count_uses = false;
+  traversal.Traverse(this);
+}
+
+
+void BlockLocalTransform::VisitPreOrder(BasicBlock *bb) {
+  if (only_count_uses) {
+    for (const Instruction *in(bb->first); in; in = in->next) {
+      CountUses(in);
+    }
+  } else {
+    block_position = position + 1;
+    RewriteBlock(bb);
+  }
+}
+
+
+void BlockLocalTransform::CountUse(const Symbol *sym) {
+  if (sym && sym->id) {
+    variables.Get(sym->id).num_uses += 1;
+  }
+}
+
+
+void BlockLocalTransform::CountUses(const Instruction *in) {
+  for (unsigned i(0); i < Instruction::kMaxNumOperands; ++i) {
+    if (OperandKind::OPERAND_USE == GetOperandKind(in->operation, i)) {
+      CountUse(in->operands[i].symbol);
+    }
+  }
+}
+
+
+// Record that `in` is the most recent definition of its symbol.
+void BlockLocalTransform::Define(Instruction *in) {
+  position += 1;
+  switch (in->operation) {
+    case Operation::OP_STORE_MEMORY:
+    case Operation::OP_STORE_FIELD:
+    case Operation::OP_CCALL1:
+    case Operation::OP_CCALL2:
+    case Operation::OP_CCALL3:
+      memory_position = position;
+      break;
+    default:
+      break;
+  }
+  const Symbol *def(in->GetDefinition());
+  if (def && def->id) {
+    Variable &var(variables.Get(def->id));
+    var.definition = in;
+    var.position = position;
+  }
+}
+
+
+void BlockLocalTransform::VisitPreOrder(SequentialControlFlowGraph *) {}
+
+
+void BlockLocalTransform::VisitPreOrder(ConditionalControlFlowGraph *cfg) {
+  if (only_count_uses) {
+    CountUse(cfg->conditional_value);
+  }
+}
+
+
+void BlockLocalTransform::VisitPreOrder(MultiWayBranchControlFlowGraph *cfg) {
+  if (only_count_uses) {
+    CountUse(cfg->conditional_value);
+    for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+      CountUse(arm->value);
+    }
+  }
+}
+
+
+void BlockLocalTransform::VisitPreOrder(LoopControlFlowGraph *cfg) {
+  if (only_count_uses) {
+    CountUse(cfg->conditional_value);
+  }
+}
+
+}  // namespace mir
+}  // namespace pjit
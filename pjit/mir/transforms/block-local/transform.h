@@ -0,0 +1,99 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.h
+ *
+ *  Created on: 2014-01-24
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_TRANSFORMS_BLOCK_LOCAL_TRANSFORM_H_
+#define PJIT_MIR_TRANSFORMS_BLOCK_LOCAL_TRANSFORM_H_
+
+#include "pjit/base/base.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+class Symbol;
+class Instruction;
+class BasicBlock;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+
+
+// Base of the transforms that rewrite the instructions of each basic block
+// independently, using the definitions made earlier in the same block.
+//
+// A transform first counts the uses of every symbol in the entire MIR of the
+// context, and then rewrites every basic block with `RewriteBlock`. Both
+// passes are driven by a `ControlFlowGraphTraversal`, and so visit the basic
+// blocks in the order in which they execute. While a
+// block is rewritten, `Define` records the instructions that are kept, so that
+// their positions can be compared against `block_position` (to find the
+// definitions of the current block) and against `memory_position` (to find
+// the definitions that stores and calls to C functions might invalidate).
+class BlockLocalTransform : public ControlFlowGraphVisitor {
+ public:
+  virtual ~BlockLocalTransform(void) = default;
+
+  void Transform(void);
+
+  // Type dispatch on the kinds of control-flow graphs. These *do not* visit
+  // the children of `cfg`, and count the uses of the values that select the
+  // branches to take.
+  virtual void VisitPreOrder(SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(LoopControlFlowGraph *cfg);
+
+  virtual void VisitPreOrder(BasicBlock *bb);
+
+ protected:
+  struct Variable {
+    unsigned num_uses = 0;
+
+    // The most recent instruction that defined this variable, and its
+    // position in the order in which instructions are visited.
+    Instruction *definition = nullptr;
+    unsigned position = 0;
+  };
+
+  explicit BlockLocalTransform(Context *context_);
+
+  // Rewrite the instructions of `bb`, calling `Define` on every instruction
+  // that is kept.
+  virtual void RewriteBlock(BasicBlock *bb) = 0;
+
+  void CountUse(const Symbol *sym);
+  void CountUses(const Instruction *in);
+  void Define(Instruction *in);
+
+  Context * const context;
+
+  Vector<Variable> variables;
+
+  // Position of the most recently defined instruction, of the first
+  // instruction of the current basic block, and of the most recent store or
+  // call to a C function.
+  unsigned position;
+  unsigned block_position;
+  unsigned memory_position;
+
+ private:
+  // Whether the type dispatch should only count the uses of every symbol
+  // (instead of rewriting).
+  bool only_count_uses;
+
+  BlockLocalTransform(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(BlockLocalTransform);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_TRANSFORMS_BLOCK_LOCAL_TRANSFORM_H_
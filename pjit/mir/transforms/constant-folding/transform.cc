@@ -0,0 +1,646 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.cc
+ *
+ *  Created on: 2014-01-11
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/constant-folding/transform.h"
+
+#include "pjit/base/type-info.h"
+#include "pjit/mir/context.h"
+#include "pjit/mir/instruction.h"
+#include "pjit/mir/symbol.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/cfg/sequential.h"
+#include "pjit/mir/cfg/conditional.h"
+#include "pjit/mir/cfg/multi-way-branch.h"
+#include "pjit/mir/cfg/loop.h"
+#include "pjit/mir/transforms/util.h"
+
+namespace pjit {
+namespace mir {
+
+
+// Returns true if values of type `type` are integers (or booleans).
+static bool IsInteger(const TypeInfo *type) {
+  return TypeKind::TYPE_KIND_INTEGER == type->kind ||
+         TypeKind::TYPE_KIND_BOOLEAN == type->kind;
+}
+
+
+static bool IsFloat(const TypeInfo *type) {
+  return TypeKind::TYPE_KIND_FLOATING_POINT == type->kind;
+}
+
+
+// Returns true if integer overflow is undefined for the type `type`.
+static bool OverflowIsUndefined(const TypeInfo *type) {
+  return TypeKind::TYPE_KIND_INTEGER == type->kind &&
+         IntegerOverflowBehavior::INTEGER_OVERFLOW_UNDEFINED ==
+             UnsafeCast<const IntegerTypeInfo *>(type)->overflow_behavior;
+}
+
+
+// Returns true if `sym` is a constant that can be folded.
+static bool IsFoldable(const Symbol *sym) {
+  return sym && !sym->id && (IsInteger(sym->type) || IsFloat(sym->type) ||
+                             TypeKind::TYPE_KIND_POINTER == sym->type->kind);
+}
+
+
+// Returns the value of an integer, boolean, or pointer constant, sign- or
+// zero-extended to 64 bits.
+static U64 IntegerValue(const Symbol *sym) {
+  const TypeInfo *type(sym->type);
+  if (TypeKind::TYPE_KIND_POINTER == type->kind) {
+    return UnsafeCast<U64>(sym->value.pointer);
+  }
+
+  const bool is_signed(IsSigned(type));
+  switch (type->size_in_bytes) {
+    case 1:
+      if (TypeKind::TYPE_KIND_BOOLEAN == type->kind) {
+        return 0 != sym->value.u8;
+      }
+      return is_signed ? static_cast<U64>(sym->value.s8) : sym->value.u8;
+    case 2:
+      return is_signed ? static_cast<U64>(sym->value.s16) : sym->value.u16;
+    case 4:
+      return is_signed ? static_cast<U64>(sym->value.s32) : sym->value.u32;
+    default:
+      return sym->value.u64;
+  }
+}
+
+
+static F64 FloatValue(const Symbol *sym) {
+  if (4 == sym->type->size_in_bytes) {
+    return static_cast<F64>(sym->value.f32);
+  }
+  return sym->value.f64;
+}
+
+
+// Returns true if the value of a constant is non-zero. NaNs are non-zero.
+static bool IsTrue(const Symbol *sym) {
+  if (IsFloat(sym->type)) {
+    const F64 val(FloatValue(sym));
+    return !(val <= 0.0 && val >= 0.0);
+  }
+  return 0 != IntegerValue(sym);
+}
+
+
+static void SetIntegerValue(Symbol *sym, U64 val) {
+  switch (sym->type->size_in_bytes) {
+    case 1: sym->value.u8 = static_cast<U8>(val); break;
+    case 2: sym->value.u16 = static_cast<U16>(val); break;
+    case 4: sym->value.u32 = static_cast<U32>(val); break;
+    default: sym->value.u64 = val; break;
+  }
+}
+
+
+static void SetFloatValue(Symbol *sym, F64 val) {
+  if (4 == sym->type->size_in_bytes) {
+    sym->value.f32 = static_cast<F32>(val);
+  } else {
+    sym->value.f64 = val;
+  }
+}
+
+
+// Evaluate an integer arithmetic or bitwise operator, for a destination of
+// type `type`. Returns false if the operator cannot be folded.
+static bool EvaluateInteger(Operation op, const TypeInfo *type, U64 a, U64 b,
+                            U64 *result) {
+  const bool is_signed(IsSigned(type));
+  const S64 sa(static_cast<S64>(a));
+  const S64 sb(static_cast<S64>(b));
+  const S64 min_s64(static_cast<S64>(1ULL << 63));
+  U64 exact(0);
+  bool overflows(false);
+
+  switch (op) {
+    case Operation::OP_ADD:
+      exact = a + b;
+      overflows = is_signed ? 0 != (((a ^ exact) & (b ^ exact)) >> 63) :
+                              exact < a;
+      break;
+    case Operation::OP_SUBTRACT:
+      exact = a - b;
+      overflows = is_signed ? 0 != (((a ^ b) & (a ^ exact)) >> 63) : a < b;
+      break;
+    case Operation::OP_MULTIPLY:
+      exact = a * b;
+      if (!is_signed) {
+        overflows = a && exact / a != b;
+      } else if (-1 == sa) {
+        overflows = min_s64 == sb;
+      } else if (sa) {
+        overflows = static_cast<S64>(exact) / sa != sb;
+      }
+      break;
+    case Operation::OP_DIVIDE:
+      if (!b || (is_signed && min_s64 == sa && -1 == sb)) {
+        return false;
+      }
+      exact = is_signed ? static_cast<U64>(sa / sb) : a / b;
+      break;
+    case Operation::OP_BITWISE_XOR: exact = a ^ b; break;
+    case Operation::OP_BITWISE_OR: exact = a | b; break;
+    case Operation::OP_BITWISE_AND: exact = a & b; break;
+    default:
+      return false;
+  }
+
+  if (TypeKind::TYPE_KIND_BOOLEAN != type->kind &&
+      Truncate(exact, type) != exact) {
+    overflows = true;
+  }
+  if (overflows && OverflowIsUndefined(type)) {
+    return false;
+  }
+  *result = Truncate(exact, type);
+  return true;
+}
+
+
+// Evaluate a floating point arithmetic operator. Single-precision operators
+// are evaluated in single precision.
+static bool EvaluateFloat(Operation op, const TypeInfo *type, F64 a, F64 b,
+                          F64 *result) {
+  const bool is_double(8 == type->size_in_bytes);
+  const F32 fa(static_cast<F32>(a));
+  const F32 fb(static_cast<F32>(b));
+  switch (op) {
+    case Operation::OP_ADD:
+      *result = is_double ? a + b : static_cast<F64>(fa + fb);
+      return true;
+    case Operation::OP_SUBTRACT:
+      *result = is_double ? a - b : static_cast<F64>(fa - fb);
+      return true;
+    case Operation::OP_MULTIPLY:
+      *result = is_double ? a * b : static_cast<F64>(fa * fb);
+      return true;
+    case Operation::OP_DIVIDE:
+      *result = is_double ? a / b : static_cast<F64>(fa / fb);
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+// Evaluate a comparison. The signedness of integer comparisons is determined
+// by the type of the left operand, as in the code generator.
+static bool EvaluateCompare(Operation op, const Symbol *left,
+                            const Symbol *right, bool *result) {
+  if (IsFloat(left->type) || IsFloat(right->type)) {
+    if (!IsFloat(left->type) || !IsFloat(right->type)) {
+      return false;
+    }
+    const F64 a(FloatValue(left));
+    const F64 b(FloatValue(right));
+    switch (op) {
+      case Operation::OP_COMPARE_EQ: *result = a <= b && a >= b; break;
+      case Operation::OP_COMPARE_NE: *result = !(a <= b && a >= b); break;
+      case Operation::OP_COMPARE_LT: *result = a < b; break;
+      case Operation::OP_COMPARE_LTE: *result = a <= b; break;
+      case Operation::OP_COMPARE_GT: *result = a > b; break;
+      case Operation::OP_COMPARE_GTE: *result = a >= b; break;
+      default: return false;
+    }
+    return true;
+  }
+
+  const U64 a(IntegerValue(left));
+  const U64 b(IntegerValue(right));
+  const bool is_signed(IsSigned(left->type));
+  const bool is_less(is_signed ?
+      static_cast<S64>(a) < static_cast<S64>(b) : a < b);
+  switch (op) {
+    case Operation::OP_COMPARE_EQ: *result = a == b; break;
+    case Operation::OP_COMPARE_NE: *result = a != b; break;
+    case Operation::OP_COMPARE_LT: *result = is_less; break;
+    case Operation::OP_COMPARE_LTE: *result = is_less || a == b; break;
+    case Operation::OP_COMPARE_GT: *result = !is_less && a != b; break;
+    case Operation::OP_COMPARE_GTE: *result = !is_less; break;
+    default: return false;
+  }
+  return true;
+}
+
+
+ConstantFoldingTransform::ConstantFoldingTransform(Context *context_)
+    : context(context_),
+      changed(false),
+      only_count_definitions(false),
+      next_cfg(nullptr),
+      last_seq(nullptr) {}
+
+
+// Fold the entire MIR of the context, until nothing more can be folded.
+void ConstantFoldingTransform::Transform(void) {
+  do {
+    for (Variable &var : variables) {
+      var.num_definitions = 0;
+    }
+    only_count_definitions = true;
+    FoldChain(&(context->entry), nullptr);
+    only_count_definitions = false;
+
+    changed = false;
+    FoldChain(&(context->entry), nullptr);
+  } while (changed);
+}
+
+
+// Fold every control-flow graph in the successor chain beginning at `cfg`
+// and ending at (but not including) `stop`.
+void ConstantFoldingTransform::FoldChain(ControlFlowGraph *cfg,
+                                         ControlFlowGraph *stop) {
+  while (cfg != stop) {
+    cfg->DoVisitPreOrder(this);
+    cfg = next_cfg;
+  }
+}
+
+
+void ConstantFoldingTransform::FoldBlock(BasicBlock *bb) {
+  if (only_count_definitions) {
+    CountDefinitions(bb);
+    return;
+  }
+  for (Instruction *in(bb->first), *next(nullptr); nullptr != in; in = next) {
+    next = in->next;
+    FoldInstruction(bb, in);
+  }
+}
+
+
+// Count the definitions of every variable. A phi node counts as a single
+// definition.
+void ConstantFoldingTransform::CountDefinitions(BasicBlock *bb) {
+  for (Instruction *in(bb->first); nullptr != in; in = in->next) {
+    const Symbol *def(in->GetDefinition());
+    if (!def || !def->id) {
+      continue;
+    }
+    if (Operation::OP_PHI == in->operation && in->prev &&
+        Operation::OP_PHI == in->prev->operation &&
+        def == in->prev->operands[0].symbol) {
+      continue;
+    }
+    variables.Get(def->id).num_definitions += 1;
+  }
+}
+
+
+// Returns true if `sym` is a local, scalar variable with exactly one
+// definition.
+bool ConstantFoldingTransform::IsSingleDefinition(const Symbol *sym) {
+  return IsLocalScalar(sym) && 1 == variables.Get(sym->id).num_definitions;
+}
+
+
+// Returns the constant that should replace the used symbol `sym`, or `sym`
+// itself if it is not known to be constant.
+const Symbol *ConstantFoldingTransform::Propagate(const Symbol *sym) {
+  if (!sym || !sym->id || sym->id >= variables.Size()) {
+    return sym;
+  }
+  const Symbol *constant(variables.Get(sym->id).constant);
+  return constant ? constant : sym;
+}
+
+
+// Fold a single instruction, replacing it with an assignment of a constant if
+// all of its used operands are constants.
+void ConstantFoldingTransform::FoldInstruction(BasicBlock *bb,
+                                               Instruction *in) {
+  for (unsigned i(0); i < Instruction::kMaxNumOperands; ++i) {
+    if (OperandKind::OPERAND_USE == GetOperandKind(in->operation, i) &&
+        Operation::OP_PHI != in->operation) {
+      const Symbol *sym(Propagate(in->operands[i].symbol));
+      if (sym != in->operands[i].symbol) {
+        in->operands[i].symbol = sym;
+        changed = true;
+      }
+    }
+  }
+
+  const Symbol *dest(in->GetDefinition());
+  const Symbol *constant(nullptr);
+  switch (in->operation) {
+    case Operation::OP_ASSIGN:
+      if (IsFoldable(in->operands[1].symbol) &&
+          dest->type == in->operands[1].symbol->type) {
+        constant = in->operands[1].symbol;
+      }
+      break;
+
+    case Operation::OP_PHI:
+      constant = FoldPhi(in);
+      break;
+
+    default:
+      constant = Evaluate(in);
+      if (constant) {
+        bb->InsertBefore(in, context->MakeInstruction(
+            Operation::OP_ASSIGN, {dest, constant}));
+        bb->Remove(in);
+        changed = true;
+      }
+      break;
+  }
+
+  if (constant && IsSingleDefinition(dest)) {
+    Variable &var(variables.Get(dest->id));
+    if (!var.constant) {
+      var.constant = constant;
+      changed = true;
+    }
+  }
+}
+
+
+// Returns the constant defined by the phi node beginning at `in`, or
+// `nullptr` if the incoming values of the phi node are not all the same
+// constant. Only the first instruction of a phi node is folded.
+const Symbol *ConstantFoldingTransform::FoldPhi(const Instruction *in) {
+  const Symbol *dest(in->operands[0].symbol);
+  if (in->prev && Operation::OP_PHI == in->prev->operation &&
+      dest == in->prev->operands[0].symbol) {
+    return nullptr;
+  }
+
+  const Symbol *constant(nullptr);
+  for (; in && Operation::OP_PHI == in->operation &&
+         dest == in->operands[0].symbol; in = in->next) {
+    const Symbol *value(Propagate(in->operands[1].symbol));
+    if (!IsFoldable(value) || value->type != dest->type) {
+      return nullptr;
+    } else if (!constant) {
+      constant = value;
+    } else if (IntegerValue(constant) != IntegerValue(value)) {
+      return nullptr;
+    }
+  }
+  return constant;
+}
+
+
+// Evaluate an operator or type conversion whose used operands are all
+// constants. Returns the resulting constant, or `nullptr` if the instruction
+// cannot be folded.
+const Symbol *ConstantFoldingTransform::Evaluate(const Instruction *in) {
+  const Symbol *dest(in->GetDefinition());
+  if (!dest || !(IsInteger(dest->type) || IsFloat(dest->type))) {
+    return nullptr;
+  }
+
+  const Symbol *left(in->operands[1].symbol);
+  const Symbol *right(nullptr);
+  if (!IsFoldable(left)) {
+    return nullptr;
+  }
+
+  U64 int_result(0);
+  F64 float_result(0.0);
+  bool is_float_result(false);
+
+  switch (in->operation) {
+    case Operation::OP_ADD:
+    case Operation::OP_SUBTRACT:
+    case Operation::OP_MULTIPLY:
+    case Operation::OP_DIVIDE:
+    case Operation::OP_BITWISE_XOR:
+    case Operation::OP_BITWISE_OR:
+    case Operation::OP_BITWISE_AND:
+      right = in->operands[2].symbol;
+      if (!IsFoldable(right)) {
+        return nullptr;
+      } else if (IsFloat(dest->type)) {
+        if (!IsFloat(left->type) || !IsFloat(right->type) ||
+            !EvaluateFloat(in->operation, dest->type, FloatValue(left),
+                           FloatValue(right), &float_result)) {
+          return nullptr;
+        }
+        is_float_result = true;
+      } else if (!IsInteger(left->type) || !IsInteger(right->type) ||
+                 !EvaluateInteger(in->operation, dest->type,
+                                  IntegerValue(left), IntegerValue(right),
+                                  &int_result)) {
+        return nullptr;
+      }
+      break;
+
+    case Operation::OP_LOGICAL_OR:
+    case Operation::OP_LOGICAL_AND:
+      right = in->operands[2].symbol;
+      if (!IsFoldable(right) || IsFloat(dest->type)) {
+        return nullptr;
+      } else if (Operation::OP_LOGICAL_OR == in->operation) {
+        int_result = IsTrue(left) || IsTrue(right);
+      } else {
+        int_result = IsTrue(left) && IsTrue(right);
+      }
+      break;
+
+    case Operation::OP_COMPARE_EQ:
+    case Operation::OP_COMPARE_NE:
+    case Operation::OP_COMPARE_LT:
+    case Operation::OP_COMPARE_LTE:
+    case Operation::OP_COMPARE_GT:
+    case Operation::OP_COMPARE_GTE: {
+      bool holds(false);
+      right = in->operands[2].symbol;
+      if (!IsFoldable(right) || IsFloat(dest->type) ||
+          !EvaluateCompare(in->operation, left, right, &holds)) {
+        return nullptr;
+      }
+      int_result = holds;
+      break;
+    }
+
+    case Operation::OP_BITWISE_NOT:
+      if (!IsInteger(left->type) || IsFloat(dest->type)) {
+        return nullptr;
+      }
+      int_result = Truncate(~IntegerValue(left), dest->type);
+      break;
+
+    case Operation::OP_LOGICAL_NOT:
+      if (IsFloat(dest->type)) {
+        return nullptr;
+      }
+      int_result = !IsTrue(left);
+      break;
+
+    // Conversions match the code generator: integers are converted to and
+    // from floating point values as signed 64-bit integers, and values that
+    // are out of range are not folded.
+    case Operation::OP_CONVERT_TYPE:
+      if (IsFloat(dest->type)) {
+        if (IsFloat(left->type)) {
+          float_result = FloatValue(left);
+        } else {
+          float_result = static_cast<F64>(
+              static_cast<S64>(IntegerValue(left)));
+        }
+        is_float_result = true;
+      } else if (IsFloat(left->type)) {
+        const F64 val(FloatValue(left));
+        if (TypeKind::TYPE_KIND_BOOLEAN == dest->type->kind ||
+            !(-9.2e18 < val && val < 9.2e18)) {
+          return nullptr;
+        }
+        int_result = Truncate(
+            static_cast<U64>(static_cast<S64>(val)), dest->type);
+      } else {
+        int_result = Truncate(IntegerValue(left), dest->type);
+      }
+      break;
+
+    default:
+      return nullptr;
+  }
+
+  Symbol *constant(context->MakeConstant(dest->type));
+  if (is_float_result) {
+    SetFloatValue(constant, float_result);
+  } else {
+    SetIntegerValue(constant, Truncate(int_result, dest->type));
+  }
+  return constant;
+}
+
+
+// Replace the conditional or multi-way branch `cfg`, which is the successor
+// of `last_seq`, with its `condition` block followed by the branch `taken`
+// (or by nothing if `taken` is `nullptr`). The instructions of `condition`
+// and of the first block of `taken` are moved into `last_seq`, and the rest
+// of `taken` is linked into the chain in place of `cfg`.
+void ConstantFoldingTransform::Splice(ControlFlowGraph *cfg,
+                                      BasicBlock *condition,
+                                      SequentialControlFlowGraph *taken,
+                                      SequentialControlFlowGraph *successor) {
+  if (!last_seq || last_seq->successor != cfg) {
+    return;
+  } else if (successor->bb.first &&
+             Operation::OP_PHI == successor->bb.first->operation) {
+    return;
+  }
+
+  for (BasicBlock *bb : {condition, taken ? &(taken->bb) : nullptr}) {
+    while (bb && bb->first) {
+      Instruction *in(bb->first);
+      bb->Remove(in);
+      last_seq->bb.Append(in);
+    }
+  }
+
+  last_seq->successor = taken ? taken->successor : successor;
+  next_cfg = last_seq->successor;
+  changed = true;
+  context->InvalidateControlFlow();
+}
+
+
+void ConstantFoldingTransform::VisitPreOrder(SequentialControlFlowGraph *cfg) {
+  FoldBlock(&(cfg->bb));
+  last_seq = cfg;
+  next_cfg = cfg->successor;
+}
+
+
+void ConstantFoldingTransform::VisitPreOrder(
+    ConditionalControlFlowGraph *cfg) {
+  SequentialControlFlowGraph *pred(last_seq);
+  FoldBlock(&(cfg->condition.bb));
+  next_cfg = cfg->successor;
+
+  if (!only_count_definitions) {
+    cfg->conditional_value = Propagate(cfg->conditional_value);
+    if (IsFoldable(cfg->conditional_value)) {
+      last_seq = pred;
+      Splice(cfg, &(cfg->condition.bb),
+             IsTrue(cfg->conditional_value) ? &(cfg->if_true) :
+                                              &(cfg->if_false),
+             cfg->successor);
+      if (next_cfg != cfg->successor) {
+        return;
+      }
+    }
+  }
+
+  FoldChain(&(cfg->if_true), cfg->successor);
+  FoldChain(&(cfg->if_false), cfg->successor);
+  next_cfg = cfg->successor;
+}
+
+
+// A multi-way branch on a constant takes the first arm whose value is equal
+// to the constant, or the default arm if there is no such arm. If some arm
+// before the taken arm has a value that is not a constant, then the branch
+// cannot be removed.
+void ConstantFoldingTransform::VisitPreOrder(
+    MultiWayBranchControlFlowGraph *cfg) {
+  SequentialControlFlowGraph *pred(last_seq);
+  FoldBlock(&(cfg->condition.bb));
+  next_cfg = cfg->successor;
+
+  if (!only_count_definitions) {
+    cfg->conditional_value = Propagate(cfg->conditional_value);
+    if (IsFoldable(cfg->conditional_value) &&
+        !IsFloat(cfg->conditional_value->type)) {
+      const U64 value(IntegerValue(cfg->conditional_value));
+      MultiWayBranchArm *taken(cfg->default_arm);
+      bool is_known(true);
+      for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm;
+           arm = arm->next) {
+        if (arm == cfg->default_arm) {
+          continue;
+        } else if (!IsFoldable(arm->value) || IsFloat(arm->value->type)) {
+          is_known = false;
+          break;
+        } else if (IntegerValue(arm->value) == value) {
+          taken = arm;
+          break;
+        }
+      }
+      if (is_known) {
+        last_seq = pred;
+        Splice(cfg, &(cfg->condition.bb), taken ? &(taken->if_true) : nullptr,
+               cfg->successor);
+        if (next_cfg != cfg->successor) {
+          return;
+        }
+      }
+    }
+  }
+
+  for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+    FoldChain(&(arm->if_true), cfg->successor);
+  }
+  next_cfg = cfg->successor;
+}
+
+
+// The condition of a loop is not folded into the structure of the loop, as
+// the condition block might depend on the loop's body.
+void ConstantFoldingTransform::VisitPreOrder(LoopControlFlowGraph *cfg) {
+  FoldChain(&(cfg->init), &(cfg->condition));
+  FoldBlock(&(cfg->condition.bb));
+  if (!only_count_definitions) {
+    cfg->conditional_value = Propagate(cfg->conditional_value);
+  }
+  FoldChain(&(cfg->body), &(cfg->condition));
+  next_cfg = cfg->successor;
+}
+
+}  // namespace mir
+}  // namespace pjit
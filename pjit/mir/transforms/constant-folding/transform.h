@@ -0,0 +1,116 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.h
+ *
+ *  Created on: 2014-01-11
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_TRANSFORMS_CONSTANT_FOLDING_TRANSFORM_H_
+#define PJIT_MIR_TRANSFORMS_CONSTANT_FOLDING_TRANSFORM_H_
+
+#include "pjit/base/base.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+class Symbol;
+class Instruction;
+class BasicBlock;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+
+
+// Folds operators whose operands are constants, propagates constants into
+// their uses, and removes the branches that can never be taken.
+//
+// An operator from `pjit/mir/operator.h` (or a type conversion) whose used
+// operands are all constants is evaluated, and replaced by an `OP_ASSIGN` of
+// the resulting constant to the destination. Integer operators follow the
+// overflow behavior of their types: operators on types whose overflow is
+// undefined are only folded if they do not overflow, so that folding never
+// changes the value that the generated code would compute. Division by zero
+// is never folded, and neither is pointer arithmetic.
+//
+// A local, scalar variable with exactly one definition that assigns it a
+// constant is replaced by that constant at every use. This includes every
+// temporary introduced by the HIR, and every variable of MIR in SSA form. A
+// phi node whose incoming values are all the same constant also defines a
+// constant.
+//
+// A conditional or multi-way branch whose condition is a constant is replaced
+// by the branch that it takes, which is spliced into the enclosing chain of
+// control-flow graphs. Branches whose joins contain phi nodes are left in
+// place.
+//
+// The transform is repeated until nothing changes, as removing a branch can
+// leave a variable with just one definition.
+class ConstantFoldingTransform : public ControlFlowGraphVisitor {
+ public:
+  explicit ConstantFoldingTransform(Context *context_);
+  virtual ~ConstantFoldingTransform(void) = default;
+
+  void Transform(void);
+
+  // Type dispatch on the kinds of control-flow graphs. These *do not* visit
+  // the successors of `cfg`.
+  virtual void VisitPreOrder(SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(LoopControlFlowGraph *cfg);
+
+ private:
+  // Folding state of a single variable, indexed by symbol id.
+  struct Variable {
+    unsigned num_definitions = 0;
+
+    // The constant value of the variable, or `nullptr` if the variable is not
+    // known to be constant.
+    const Symbol *constant = nullptr;
+  };
+
+  Context * const context;
+
+  Vector<Variable> variables;
+
+  // Whether or not the current iteration of the transform changed the MIR.
+  bool changed;
+
+  // Whether the type dispatch should only count the definitions of variables
+  // (instead of folding).
+  bool only_count_definitions;
+
+  // Outputs of the type dispatch.
+  ControlFlowGraph *next_cfg;
+
+  // The most recently visited sequential control-flow graph, which precedes
+  // every non-sequential control-flow graph in its chain.
+  SequentialControlFlowGraph *last_seq;
+
+  void FoldChain(ControlFlowGraph *cfg, ControlFlowGraph *stop);
+  void FoldBlock(BasicBlock *bb);
+  void FoldInstruction(BasicBlock *bb, Instruction *in);
+  void CountDefinitions(BasicBlock *bb);
+
+  bool IsSingleDefinition(const Symbol *sym);
+  const Symbol *Propagate(const Symbol *sym);
+  const Symbol *FoldPhi(const Instruction *in);
+  const Symbol *Evaluate(const Instruction *in);
+
+  void Splice(ControlFlowGraph *cfg, BasicBlock *condition,
+              SequentialControlFlowGraph *taken,
+              SequentialControlFlowGraph *successor);
+
+  ConstantFoldingTransform(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(ConstantFoldingTransform);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_TRANSFORMS_CONSTANT_FOLDING_TRANSFORM_H_
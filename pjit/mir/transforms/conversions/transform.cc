@@ -0,0 +1,388 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.cc
+ *
+ *  Created on: 2014-01-22
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/conversions/transform.h"
+
+#include "pjit/base/type-info.h"
+#include "pjit/mir/context.h"
+#include "pjit/mir/symbol.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/transforms/util.h"
+
+namespace pjit {
+namespace mir {
+
+
+static bool IsInteger(const TypeInfo *type) {
+  return TypeKind::TYPE_KIND_INTEGER == type->kind;
+}
+
+
+// Returns true if conversions to and from `type` truncate or extend the bits
+// of a value.
+static bool IsIntegral(const TypeInfo *type) {
+  return TypeKind::TYPE_KIND_INTEGER == type->kind ||
+         TypeKind::TYPE_KIND_POINTER == type->kind;
+}
+
+
+// Returns true if the integral type `type` can represent every value of the
+// integral type `of_type`.
+static bool CanRepresent(const TypeInfo *type, const TypeInfo *of_type) {
+  if (type->size_in_bytes == of_type->size_in_bytes) {
+    return IsSigned(type) == IsSigned(of_type);
+  }
+  return type->size_in_bytes > of_type->size_in_bytes &&
+         (IsSigned(type) || !IsSigned(of_type));
+}
+
+
+// Returns true if loading a field of type `field_type`, which extends the
+// field to 64 bits, leaves a value of the integer type `type` in its
+// canonical (sign- or zero-extended) form.
+static bool LoadExtendsTo(const TypeInfo *type, const TypeInfo *field_type) {
+  return 8 == type->size_in_bytes || CanRepresent(type, field_type);
+}
+
+
+// Returns true if `in` loads a whole integer field.
+static bool IsIntegerFieldLoad(const Instruction *in) {
+  if (Operation::OP_LOAD_FIELD != in->operation) {
+    return false;
+  }
+  const StructureFieldInfo *field(in->operands[2].field);
+  return StructureFieldInfo::FIELD_NORMAL == field->kind &&
+         IsInteger(field->type);
+}
+
+
+// Returns true if the low-order bits of the result of `op` only depend on
+// the low-order bits of its operands.
+static bool IsNarrowable(Operation op) {
+  switch (op) {
+    case Operation::OP_ADD:
+    case Operation::OP_SUBTRACT:
+    case Operation::OP_MULTIPLY:
+    case Operation::OP_BITWISE_XOR:
+    case Operation::OP_BITWISE_OR:
+    case Operation::OP_BITWISE_AND:
+    case Operation::OP_BITWISE_NOT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+// Returns true if `in` has no side-effects besides defining a symbol.
+static bool IsRemovable(const Instruction *in) {
+  switch (in->operation) {
+#define PJIT_DECLARE_BINARY_OPERATOR(opcode, _) \
+    case Operation::PJIT_CAT(OP_, opcode):
+#define PJIT_DECLARE_UNARY_OPERATOR(opcode, _) \
+    case Operation::PJIT_CAT(OP_, opcode):
+#include "pjit/mir/operator.h"
+#undef PJIT_DECLARE_BINARY_OPERATOR
+#undef PJIT_DECLARE_UNARY_OPERATOR
+    case Operation::OP_LOAD_MEMORY:
+    case Operation::OP_LOAD_FIELD:
+    case Operation::OP_CONVERT_TYPE:
+    case Operation::OP_ASSIGN:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+ConversionSimplificationTransform::ConversionSimplificationTransform(
+    Context *context_)
+    : BlockLocalTransform(context_) {}
+
+
+void ConversionSimplificationTransform::RewriteBlock(BasicBlock *bb) {
+  for (Instruction *in(bb->first), *next(nullptr); in; in = next) {
+    next = in->next;
+    if (Operation::OP_CONVERT_TYPE == in->operation) {
+      in = SimplifyConversion(bb, in);
+    }
+    if (in) {
+      Define(in);
+    }
+  }
+}
+
+
+// Simplify the conversion `in`. Returns the instruction that replaces `in`,
+// or `nullptr` if `in` was removed.
+Instruction *ConversionSimplificationTransform::SimplifyConversion(
+    BasicBlock *bb, Instruction *in) {
+  const Symbol *dest(in->operands[0].symbol);
+  const Symbol *src(in->operands[1].symbol);
+  if (IsLocal(dest) && !variables.Get(dest->id).num_uses) {
+    Remove(bb, in);
+    return nullptr;
+  } else if (!IsIntegral(dest->type) || !IsIntegral(src->type)) {
+    return in;
+  }
+
+  const Instruction *def(Available(src));
+  if (!def) {
+    return in;
+  }
+  switch (def->operation) {
+    case Operation::OP_CONVERT_TYPE:
+      return CollapseConversion(bb, in, def);
+    case Operation::OP_LOAD_FIELD:
+      return FoldIntoLoad(bb, in, def);
+    default:
+      return NarrowConversion(bb, in, def);
+  }
+}
+
+
+// Replace `c = (C) b` where `b = (B) a` with `c = (C) a`.
+Instruction *ConversionSimplificationTransform::CollapseConversion(
+    BasicBlock *bb, Instruction *in, const Instruction *def) {
+  const Symbol *dest(in->operands[0].symbol);
+  const Symbol *middle(def->operands[0].symbol);
+  const Symbol *source(def->operands[1].symbol);
+  if (!IsIntegral(source->type)) {
+    return in;
+
+  // Widening `b` would use the bits of `b` that weren't copied from `a`.
+  } else if (dest->type->size_in_bytes > middle->type->size_in_bytes &&
+             !CanRepresent(middle->type, source->type)) {
+    return in;
+
+  } else if (dest->type == source->type) {
+    return Replace(bb, in, Emit(bb, in, Operation::OP_ASSIGN, {dest, source}));
+  } else {
+    return Replace(bb, in, Emit(bb, in, Operation::OP_CONVERT_TYPE,
+                                {dest, source}));
+  }
+}
+
+
+// Replace `c = (C) b` where `b` is loaded from a field with a load of the
+// field directly into `c`.
+Instruction *ConversionSimplificationTransform::FoldIntoLoad(
+    BasicBlock *bb, Instruction *in, const Instruction *def) {
+  const Symbol *dest(in->operands[0].symbol);
+  const Symbol *src(in->operands[1].symbol);
+  const StructureFieldInfo *field(def->operands[2].field);
+  const Variable &var(variables.Get(src->id));
+  if (!IsInteger(dest->type) || !IsIntegerFieldLoad(def) ||
+      !LoadExtendsTo(dest->type, field->type) ||
+      1 != var.num_uses || memory_position >= var.position) {
+    return in;
+  }
+  return Replace(bb, in, Emit(bb, in, Operation::OP_LOAD_FIELD,
+                              {dest, def->operands[1].symbol, field}));
+}
+
+
+// Replace `c = (C) b` where `b` is the result of a narrowable operator with
+// the same operator computed in the type `C`.
+Instruction *ConversionSimplificationTransform::NarrowConversion(
+    BasicBlock *bb, Instruction *in, const Instruction *def) {
+  const Symbol *dest(in->operands[0].symbol);
+  const Symbol *src(in->operands[1].symbol);
+  if (!IsInteger(dest->type) || !IsInteger(src->type) ||
+      dest->type->size_in_bytes > src->type->size_in_bytes ||
+      1 != variables.Get(src->id).num_uses ||
+      !CanNarrowOperator(def, dest->type, 1)) {
+    return in;
+  }
+  return Replace(bb, in, NarrowOperator(bb, in, def, dest));
+}
+
+
+bool ConversionSimplificationTransform::CanNarrowOperator(
+    const Instruction *def, const TypeInfo *type, unsigned depth) {
+  if (MAX_NARROWING_DEPTH < depth || !IsNarrowable(def->operation) ||
+      !IsInteger(def->GetDefinition()->type)) {
+    return false;
+  }
+  for (unsigned i(1); i < Instruction::kMaxNumOperands; ++i) {
+    if (OperandKind::OPERAND_USE == GetOperandKind(def->operation, i) &&
+        !CanNarrow(def->operands[i].symbol, type, depth)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// Returns true if the operand `sym` of a narrowable operator can be computed
+// in the type `type` without adding instructions: it is a constant, a
+// conversion, or a load or narrowable operator whose result isn't used
+// elsewhere.
+bool ConversionSimplificationTransform::CanNarrow(const Symbol *sym,
+                                                  const TypeInfo *type,
+                                                  unsigned depth) {
+  if (!IsInteger(sym->type) ||
+      sym->type->size_in_bytes < type->size_in_bytes) {
+    return false;
+  } else if (!sym->id) {
+    return true;
+  }
+  const Instruction *def(Available(sym));
+  if (!def) {
+    return false;
+  } else if (Operation::OP_CONVERT_TYPE == def->operation) {
+    return IsIntegral(def->operands[1].symbol->type);
+  }
+  const Variable &var(variables.Get(sym->id));
+  if (1 != var.num_uses) {
+    return false;
+  } else if (IsIntegerFieldLoad(def)) {
+    return memory_position < var.position &&
+           LoadExtendsTo(type, def->operands[2].field->type);
+  }
+  return CanNarrowOperator(def, type, depth + 1);
+}
+
+
+// Emit instructions before `before` that compute the value of `sym` in the
+// narrower type `type`. Returns the symbol that holds the narrowed value.
+const Symbol *ConversionSimplificationTransform::Narrow(BasicBlock *bb,
+                                                        Instruction *before,
+                                                        const Symbol *sym,
+                                                        const TypeInfo *type) {
+  if (!sym->id) {
+    Symbol *constant(context->MakeConstant(type));
+    switch (type->size_in_bytes) {
+      case 1: constant->value.u8 = static_cast<U8>(sym->value.u64); break;
+      case 2: constant->value.u16 = static_cast<U16>(sym->value.u64); break;
+      case 4: constant->value.u32 = static_cast<U32>(sym->value.u64); break;
+      default: constant->value.u64 = sym->value.u64; break;
+    }
+    return constant;
+  }
+
+  const Instruction *def(Available(sym));
+  const Symbol *narrowed(nullptr);
+  if (Operation::OP_CONVERT_TYPE == def->operation) {
+    const Symbol *source(def->operands[1].symbol);
+    if (source->type == type) {
+      return source;
+    }
+    narrowed = context->MakeSymbol(type);
+    Emit(bb, before, Operation::OP_CONVERT_TYPE, {narrowed, source});
+  } else if (Operation::OP_LOAD_FIELD == def->operation) {
+    narrowed = context->MakeSymbol(type);
+    Emit(bb, before, Operation::OP_LOAD_FIELD,
+         {narrowed, def->operands[1].symbol, def->operands[2].field});
+  } else {
+    narrowed = context->MakeSymbol(type);
+    NarrowOperator(bb, before, def, narrowed);
+  }
+  return narrowed;
+}
+
+
+// Emit a copy of the operator `def` before `before`, which computes its value
+// into `dest`, in the type of `dest`.
+Instruction *ConversionSimplificationTransform::NarrowOperator(
+    BasicBlock *bb, Instruction *before, const Instruction *def,
+    const Symbol *dest) {
+  const Symbol *operands[Instruction::kMaxNumOperands] = {dest};
+  for (unsigned i(1); i < Instruction::kMaxNumOperands; ++i) {
+    if (OperandKind::OPERAND_USE == GetOperandKind(def->operation, i)) {
+      operands[i] = Narrow(bb, before, def->operands[i].symbol, dest->type);
+    }
+  }
+  return Emit(bb, before, def->operation,
+              {operands[0], operands[1], operands[2]});
+}
+
+
+// Returns the instruction that defines the value of the local variable `sym`
+// in the current basic block, if none of the operands of that instruction
+// have been redefined since, and `nullptr` otherwise. Globals can be changed
+// by stores and by C functions.
+Instruction *ConversionSimplificationTransform::Available(const Symbol *sym) {
+  if (!IsLocal(sym)) {
+    return nullptr;
+  }
+  const Variable &var(variables.Get(sym->id));
+  Instruction *def(var.definition);
+  if (!def || var.position < block_position) {
+    return nullptr;
+  }
+  for (unsigned i(1); i < Instruction::kMaxNumOperands; ++i) {
+    const Symbol *operand(def->operands[i].symbol);
+    if (OperandKind::OPERAND_USE != GetOperandKind(def->operation, i) ||
+        !operand->id) {
+      continue;
+    } else if (variables.Get(operand->id).position >= var.position) {
+      return nullptr;
+    } else if ((operand->behavior & SymbolBehavior::BehaviorGlobal) &&
+               memory_position >= var.position) {
+      return nullptr;
+    }
+  }
+  return def;
+}
+
+
+// Make an instruction, and insert it into `bb` before `before`.
+Instruction *ConversionSimplificationTransform::Emit(
+    BasicBlock *bb, Instruction *before, Operation op,
+    std::initializer_list<const void *> args) {
+  Instruction *in(context->MakeInstruction(op, args));
+  bb->InsertBefore(before, in);
+  CountUses(in);
+  return in;
+}
+
+
+// Remove `in`, which is replaced by the (already inserted) `replacement`.
+Instruction *ConversionSimplificationTransform::Replace(
+    BasicBlock *bb, Instruction *in, Instruction *replacement) {
+  Remove(bb, in);
+  return replacement;
+}
+
+
+// Remove `in` from `bb`, along with the instructions of `bb` that are only
+// used by `in`.
+void ConversionSimplificationTransform::Remove(BasicBlock *bb,
+                                               Instruction *in) {
+  bb->Remove(in);
+  const Symbol *def(in->GetDefinition());
+  if (def && def->id) {
+    Variable &var(variables.Get(def->id));
+    if (var.definition == in) {
+      var.definition = nullptr;
+    }
+  }
+  for (unsigned i(1); i < Instruction::kMaxNumOperands; ++i) {
+    if (OperandKind::OPERAND_USE == GetOperandKind(in->operation, i)) {
+      ReleaseUse(bb, in->operands[i].symbol);
+    }
+  }
+}
+
+
+void ConversionSimplificationTransform::ReleaseUse(BasicBlock *bb,
+                                                   const Symbol *sym) {
+  if (!sym || !sym->id) {
+    return;
+  }
+  Variable &var(variables.Get(sym->id));
+  var.num_uses -= 1;
+  if (!var.num_uses && IsLocal(sym) && var.definition &&
+      var.position >= block_position && IsRemovable(var.definition)) {
+    Remove(bb, var.definition);
+  }
+}
+
+}  // namespace mir
+}  // namespace pjit
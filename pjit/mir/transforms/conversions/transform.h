@@ -0,0 +1,103 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.h
+ *
+ *  Created on: 2014-01-22
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_TRANSFORMS_CONVERSIONS_TRANSFORM_H_
+#define PJIT_MIR_TRANSFORMS_CONVERSIONS_TRANSFORM_H_
+
+#include <initializer_list>
+
+#include "pjit/base/base.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/mir/instruction.h"
+#include "pjit/mir/transforms/block-local/transform.h"
+
+namespace pjit {
+
+struct TypeInfo;
+
+namespace mir {
+
+class Context;
+class Symbol;
+class BasicBlock;
+
+
+// Simplifies the integer type conversions introduced by the HIR, which
+// converts both operands of every operator to the operator's (promoted) type,
+// and converts every assigned value to the type of the variable.
+//
+// Within a basic block, a conversion `c = (C) b` of a value `b` that was
+// computed in the same block is simplified as follows:
+//
+//    1) If `b = (B) a` is itself a conversion, and either `B` is at least as
+//       wide as `C`, or `B` can represent every value of `a`, then `c` is
+//       converted directly from `a` (or is a copy of `a` if it has type `C`).
+//       This collapses chains such as `S32 -> S64 -> S32`.
+//
+//    2) If `b` is the result of an operator whose low-order bits only depend
+//       on the low-order bits of its operands (addition, subtraction,
+//       multiplication, and bitwise operators), `C` is no wider than the type
+//       of `b`, and the operands are constants, conversions, loads, or other
+//       such operators, then the operator is computed in the type `C`. This
+//       removes the widening conversions whose results are only narrowed
+//       again.
+//
+//    3) If `b` is loaded from a narrower integer field (and memory has not
+//       changed since), and `C` can represent every value of the field (or is
+//       64 bits wide), then `c` is loaded directly, as loads already sign- or
+//       zero-extend fields according to their types.
+//
+// The instructions made dead by a simplification are removed, as are
+// conversions whose results are never used.
+class ConversionSimplificationTransform : public BlockLocalTransform {
+ public:
+  explicit ConversionSimplificationTransform(Context *context_);
+  virtual ~ConversionSimplificationTransform(void) = default;
+
+ protected:
+  virtual void RewriteBlock(BasicBlock *bb);
+
+ private:
+  enum : unsigned {
+    // Maximum depth of a tree of operators that is computed in a narrower
+    // type.
+    MAX_NARROWING_DEPTH = 4
+  };
+
+  Instruction *SimplifyConversion(BasicBlock *bb, Instruction *in);
+  Instruction *CollapseConversion(BasicBlock *bb, Instruction *in,
+                                  const Instruction *def);
+  Instruction *FoldIntoLoad(BasicBlock *bb, Instruction *in,
+                            const Instruction *def);
+  Instruction *NarrowConversion(BasicBlock *bb, Instruction *in,
+                                const Instruction *def);
+
+  bool CanNarrow(const Symbol *sym, const TypeInfo *type, unsigned depth);
+  bool CanNarrowOperator(const Instruction *def, const TypeInfo *type,
+                         unsigned depth);
+  const Symbol *Narrow(BasicBlock *bb, Instruction *before, const Symbol *sym,
+                       const TypeInfo *type);
+  Instruction *NarrowOperator(BasicBlock *bb, Instruction *before,
+                              const Instruction *def, const Symbol *dest);
+
+  Instruction *Available(const Symbol *sym);
+  Instruction *Emit(BasicBlock *bb, Instruction *before, Operation op,
+                    std::initializer_list<const void *> args);
+  Instruction *Replace(BasicBlock *bb, Instruction *in,
+                       Instruction *replacement);
+  void Remove(BasicBlock *bb, Instruction *in);
+  void ReleaseUse(BasicBlock *bb, const Symbol *sym);
+
+  ConversionSimplificationTransform(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(ConversionSimplificationTransform);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_TRANSFORMS_CONVERSIONS_TRANSFORM_H_
@@ -0,0 +1,193 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.cc
+ *
+ *  Created on: 2014-01-24
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/copy-propagation/transform.h"
+
+#include "pjit/base/type-info.h"
+#include "pjit/mir/context.h"
+#include "pjit/mir/symbol.h"
+#include "pjit/mir/instruction.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/transforms/util.h"
+
+namespace pjit {
+namespace mir {
+
+
+static bool IsGlobal(const Symbol *sym) {
+  return sym->behavior & SymbolBehavior::BehaviorGlobal;
+}
+
+
+CopyPropagationTransform::CopyPropagationTransform(Context *context_)
+    : BlockLocalTransform(context_) {}
+
+
+void CopyPropagationTransform::RewriteBlock(BasicBlock *bb) {
+  for (Instruction *in(bb->first), *next(nullptr); in; in = next) {
+    next = in->next;
+
+    // The operands of a PHI are used at the ends of its predecessors.
+    if (Operation::OP_PHI != in->operation) {
+      PropagateUses(in);
+    }
+    if (Operation::OP_ASSIGN == in->operation) {
+      const Symbol *dest(in->operands[0].symbol);
+      if (dest == in->operands[1].symbol) {
+        bb->Remove(in);
+        variables.Get(dest->id).num_uses -= 1;
+        continue;
+      } else if (CoalesceCopy(bb, in)) {
+        continue;
+      }
+    }
+    Define(in);
+    Reference(in);
+  }
+  RemoveDeadCopies(bb);
+}
+
+
+// Replace the uses of the operands of `in` with the symbols that were copied
+// into those operands.
+void CopyPropagationTransform::PropagateUses(Instruction *in) {
+  for (unsigned i(0); i < Instruction::kMaxNumOperands; ++i) {
+    if (OperandKind::OPERAND_USE != GetOperandKind(in->operation, i)) {
+      continue;
+    }
+    const Symbol *sym(in->operands[i].symbol);
+    const Symbol *copy(CopyOf(sym));
+    if (copy) {
+      in->operands[i].symbol = copy;
+      variables.Get(sym->id).num_uses -= 1;
+      variables.Get(copy->id).num_uses += 1;
+    }
+  }
+}
+
+
+// Replace `t = <expr>; x = t` with `x = <expr>`, where the copy `in` is the
+// only use of `t`. Returns true if `in` was removed.
+bool CopyPropagationTransform::CoalesceCopy(BasicBlock *bb, Instruction *in) {
+  const Symbol *dest(in->operands[0].symbol);
+  const Symbol *src(in->operands[1].symbol);
+  if (!IsLocal(src) || IsGlobal(dest) || !IsScalar(dest->type) ||
+      dest->type != src->type) {
+    return false;
+  }
+  Variable &src_var(variables.Get(src->id));
+  Instruction *def(src_var.definition);
+  if (1 != src_var.num_uses || !def || src_var.position < block_position ||
+      Operation::OP_PHI == def->operation) {
+    return false;
+  }
+
+  // `x` must not be used or defined between `def` and `in`. Uses of `x` by
+  // `def` itself read the old value of `x`, and so are fine.
+  Copy &dest_copy(copies.Get(dest->id));
+  if (dest_copy.reference_position > src_var.position) {
+    return false;
+  }
+
+  def->operands[0].symbol = dest;
+  bb->Remove(in);
+
+  Variable &dest_var(variables.Get(dest->id));
+  src_var.num_uses = 0;
+  src_var.definition = nullptr;
+  dest_var.definition = def;
+  dest_var.position = src_var.position;
+  dest_copy.reference_position = src_var.position;
+  dest_copy.source = nullptr;
+  if (Operation::OP_ASSIGN == def->operation) {
+    RecordCopy(def, src_var.position);
+  }
+  return true;
+}
+
+
+// Remove the copies into local variables that are never used. The block is
+// visited backward so that chains of dead copies are removed at once.
+void CopyPropagationTransform::RemoveDeadCopies(BasicBlock *bb) {
+  for (Instruction *in(bb->last), *prev(nullptr); in; in = prev) {
+    prev = in->prev;
+    const Symbol *dest(in->operands[0].symbol);
+    if (Operation::OP_ASSIGN != in->operation || !IsLocal(dest) ||
+        variables.Get(dest->id).num_uses) {
+      continue;
+    }
+    bb->Remove(in);
+    const Symbol *src(in->operands[1].symbol);
+    if (src->id) {
+      variables.Get(src->id).num_uses -= 1;
+    }
+  }
+}
+
+
+// Returns the symbol whose value was copied into `sym` in the current basic
+// block, if neither symbol has been redefined since the copy, and `nullptr`
+// otherwise. Globals can be changed by stores and by C functions.
+const Symbol *CopyPropagationTransform::CopyOf(const Symbol *sym) {
+  if (!sym || !sym->id) {
+    return nullptr;
+  }
+  const Copy &copy(copies.Get(sym->id));
+  const Symbol *source(copy.source);
+  if (!source || variables.Get(sym->id).position != copy.position ||
+      copy.position < block_position) {
+    return nullptr;
+  } else if (variables.Get(source->id).position >= copy.position) {
+    return nullptr;
+  } else if (IsGlobal(source) && memory_position >= copy.position) {
+    return nullptr;
+  }
+  return source;
+}
+
+
+// Record the references made by `in`, which has just been defined, and the
+// copy that `in` makes, if any.
+void CopyPropagationTransform::Reference(Instruction *in) {
+  for (unsigned i(0); i < Instruction::kMaxNumOperands; ++i) {
+    const Symbol *sym(in->operands[i].symbol);
+    if (OperandKind::OPERAND_USE == GetOperandKind(in->operation, i) &&
+        sym && sym->id) {
+      copies.Get(sym->id).reference_position = position;
+    }
+  }
+  const Symbol *def(in->GetDefinition());
+  if (def && def->id) {
+    Copy &copy(copies.Get(def->id));
+    copy.reference_position = position;
+    copy.source = nullptr;
+    if (Operation::OP_ASSIGN == in->operation) {
+      RecordCopy(in, position);
+    }
+  }
+}
+
+
+// Record that the copy `in`, at position `copy_position`, copies its source
+// into its destination. Only copies of scalar, non-constant values into
+// non-global symbols are propagated.
+void CopyPropagationTransform::RecordCopy(const Instruction *in,
+                                          unsigned copy_position) {
+  const Symbol *dest(in->operands[0].symbol);
+  const Symbol *src(in->operands[1].symbol);
+  if (!src->id || src == dest || dest->type != src->type ||
+      !IsScalar(dest->type) || IsGlobal(dest)) {
+    return;
+  }
+  Copy &copy(copies.Get(dest->id));
+  copy.source = src;
+  copy.position = copy_position;
+}
+
+}  // namespace mir
+}  // namespace pjit
@@ -0,0 +1,82 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.h
+ *
+ *  Created on: 2014-01-24
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_TRANSFORMS_COPY_PROPAGATION_TRANSFORM_H_
+#define PJIT_MIR_TRANSFORMS_COPY_PROPAGATION_TRANSFORM_H_
+
+#include "pjit/base/base.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/transforms/block-local/transform.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+class Symbol;
+class Instruction;
+class BasicBlock;
+
+
+// Removes the copies (`OP_ASSIGN`s) that the HIR emits for every write to a
+// variable, which otherwise form chains of copies between variables and
+// temporaries.
+//
+// Within a basic block:
+//
+//    1) A value `t = <expr>` that is only used by a copy `x = t` is computed
+//       directly into `x` (i.e. `x = <expr>`), so long as `x` is not used or
+//       defined between the two instructions. This coalesces the temporary
+//       holding the result of an operator with the variable being assigned.
+//
+//    2) After a copy `d = s`, later uses of `d` are replaced by uses of `s`,
+//       until either `d` or `s` is redefined (or, if `s` is a global, until
+//       memory changes).
+//
+// Copies into local variables that are no longer used are then removed.
+// Copies of constants are left to constant folding.
+class CopyPropagationTransform : public BlockLocalTransform {
+ public:
+  explicit CopyPropagationTransform(Context *context_);
+  virtual ~CopyPropagationTransform(void) = default;
+
+ protected:
+  virtual void RewriteBlock(BasicBlock *bb);
+
+ private:
+  struct Copy {
+    // Position of the most recent instruction that used or defined this
+    // variable.
+    unsigned reference_position = 0;
+
+    // The symbol copied into this variable by the copy at `position`. The
+    // copy is only valid while it is the most recent definition of this
+    // variable.
+    const Symbol *source = nullptr;
+    unsigned position = 0;
+  };
+
+  // Copies into every variable, indexed by symbol id like `variables`.
+  Vector<Copy> copies;
+
+  void PropagateUses(Instruction *in);
+  bool CoalesceCopy(BasicBlock *bb, Instruction *in);
+  void RemoveDeadCopies(BasicBlock *bb);
+
+  const Symbol *CopyOf(const Symbol *sym);
+
+  void Reference(Instruction *in);
+  void RecordCopy(const Instruction *in, unsigned copy_position);
+
+  CopyPropagationTransform(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(CopyPropagationTransform);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_TRANSFORMS_COPY_PROPAGATION_TRANSFORM_H_
@@ -0,0 +1,370 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.cc
+ *
+ *  Created on: 2014-01-12
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/dead-code/transform.h"
+
+#include "pjit/mir/context.h"
+#include "pjit/mir/instruction.h"
+#include "pjit/mir/symbol.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/cfg/sequential.h"
+#include "pjit/mir/cfg/conditional.h"
+#include "pjit/mir/cfg/multi-way-branch.h"
+#include "pjit/mir/cfg/loop.h"
+#include "pjit/mir/transforms/util.h"
+
+namespace pjit {
+namespace mir {
+
+
+// Returns the word of a live set that contains bit `index`. Missing words are
+// added as zeroes, as `Vector::Get` leaves new integer entries uninitialized.
+static U32 &LiveWord(Vector<U32> *set, unsigned index) {
+  while (set->Size() <= index / 32) {
+    set->PushBack(0U);
+  }
+  return set->Get(index / 32);
+}
+
+
+static bool IsLive(Vector<U32> *set, const Symbol *sym) {
+  const unsigned word(sym->id / 32);
+  return word < set->Size() && 0 != ((set->Get(word) >> (sym->id % 32)) & 1);
+}
+
+
+static void AddLive(Vector<U32> *set, const Symbol *sym) {
+  if (sym && sym->id) {
+    LiveWord(set, sym->id) |= 1U << (sym->id % 32);
+  }
+}
+
+
+static void RemoveLive(Vector<U32> *set, const Symbol *sym) {
+  if (sym && sym->id && sym->id / 32 < set->Size()) {
+    set->Get(sym->id / 32) &= ~(1U << (sym->id % 32));
+  }
+}
+
+
+static void CopyLive(Vector<U32> *dest, Vector<U32> *source) {
+  for (unsigned i(0); i < source->Size(); ++i) {
+    LiveWord(dest, i * 32) = source->Get(i);
+  }
+  for (unsigned i(source->Size()); i < dest->Size(); ++i) {
+    dest->Get(i) = 0;
+  }
+}
+
+
+// Add the symbols of `source` to `dest`. Returns true if `dest` changed.
+static bool UnionLive(Vector<U32> *dest, Vector<U32> *source) {
+  bool changed(false);
+  for (unsigned i(0); i < source->Size(); ++i) {
+    U32 &word(LiveWord(dest, i * 32));
+    const U32 new_word(word | source->Get(i));
+    changed = changed || new_word != word;
+    word = new_word;
+  }
+  return changed;
+}
+
+
+// Returns true if `in` has no side-effects besides defining a symbol.
+static bool IsRemovable(const Instruction *in) {
+  switch (in->operation) {
+#define PJIT_DECLARE_BINARY_OPERATOR(opcode, _) \
+    case Operation::PJIT_CAT(OP_, opcode):
+#define PJIT_DECLARE_UNARY_OPERATOR(opcode, _) \
+    case Operation::PJIT_CAT(OP_, opcode):
+#include "pjit/mir/operator.h"
+#undef PJIT_DECLARE_BINARY_OPERATOR
+#undef PJIT_DECLARE_UNARY_OPERATOR
+    case Operation::OP_LOAD_MEMORY:
+    case Operation::OP_LOAD_FIELD:
+    case Operation::OP_CONVERT_TYPE:
+    case Operation::OP_ASSIGN:
+    case Operation::OP_PHI:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+// Returns true if the sequential CFG `cfg` contains no instructions and
+// directly flows into `successor`.
+bool DeadCodeEliminationTransform::IsEmpty(
+    const SequentialControlFlowGraph *cfg, const ControlFlowGraph *successor) {
+  return !cfg->bb.first && cfg->successor == successor;
+}
+
+
+bool DeadCodeEliminationTransform::BeginsWithPhi(
+    const SequentialControlFlowGraph *cfg) {
+  return cfg->bb.first && Operation::OP_PHI == cfg->bb.first->operation;
+}
+
+
+// Move all instructions from `source` to the end of `dest`.
+static void MoveInstructions(BasicBlock *dest, BasicBlock *source) {
+  while (source->first) {
+    Instruction *in(source->first);
+    source->Remove(in);
+    dest->Append(in);
+  }
+}
+
+
+DeadCodeEliminationTransform::DeadCodeEliminationTransform(Context *context_)
+    : context(context_),
+      changed(false),
+      remove_dead_code(true),
+      only_find_successor(false),
+      live(nullptr),
+      can_collapse(false),
+      next_cfg(nullptr),
+      visited_seq(nullptr),
+      collapsed_condition(nullptr) {}
+
+
+// Eliminate dead code from the entire MIR of the context. Removing a branch
+// can make more code dead, so this is repeated until nothing changes.
+void DeadCodeEliminationTransform::Transform(void) {
+  do {
+    LiveSet live_set;
+    changed = false;
+    remove_dead_code = true;
+    EliminateChain(&(context->entry), nullptr, &(context->exit), &live_set);
+  } while (changed);
+}
+
+
+// Eliminate dead code from the chain of control-flow graphs beginning at `cfg`
+// and ending at (but not including) `stop`. On input, `live_set` contains the
+// symbols that are live at `stop`, and on output it contains the symbols that
+// are live at `cfg`.
+//
+// The sequential CFG `keep` is never merged into its predecessor, as other
+// CFGs refer to it as the end of the chain.
+void DeadCodeEliminationTransform::EliminateChain(ControlFlowGraph *cfg,
+                                                  ControlFlowGraph *stop,
+                                                  ControlFlowGraph *keep,
+                                                  LiveSet *live_set) {
+  Vector<ControlFlowGraph *> chain;
+  Vector<SequentialControlFlowGraph *> seqs;
+
+  only_find_successor = true;
+  for (; cfg != stop; cfg = next_cfg) {
+    visited_seq = nullptr;
+    cfg->DoVisitPreOrder(this);
+    chain.PushBack(cfg);
+    seqs.PushBack(visited_seq);
+  }
+  only_find_successor = false;
+
+  // Compute liveness backward through the chain. Every branch is preceded by
+  // a sequential CFG, which absorbs the condition of a branch whose arms are
+  // all empty.
+  for (unsigned i(chain.Size()); i-- > 0; ) {
+    SequentialControlFlowGraph *pred(i ? seqs.Get(i - 1) : nullptr);
+    live = live_set;
+    can_collapse = remove_dead_code && nullptr != pred;
+    collapsed_condition = nullptr;
+    chain.Get(i)->DoVisitPreOrder(this);
+    if (collapsed_condition) {
+      MoveInstructions(&(pred->bb), collapsed_condition);
+      pred->successor = next_cfg;
+      changed = true;
+      context->InvalidateControlFlow();
+    }
+  }
+
+  if (!remove_dead_code) {
+    return;
+  }
+
+  // Merge each sequential CFG into a directly preceding sequential CFG.
+  SequentialControlFlowGraph *pred(nullptr);
+  for (unsigned i(0); i < chain.Size(); ++i) {
+    SequentialControlFlowGraph *seq(seqs.Get(i));
+    if (!seq) {
+      if (!pred || pred->successor == chain.Get(i)) {
+        pred = nullptr;
+      }
+    } else if (pred && pred->successor == seq && seq != keep &&
+               !BeginsWithPhi(seq)) {
+      MoveInstructions(&(pred->bb), &(seq->bb));
+      pred->successor = seq->successor;
+      changed = true;
+      context->InvalidateControlFlow();
+    } else {
+      pred = seq;
+    }
+  }
+}
+
+
+// Remove dead instructions from a basic block, going backward from the end of
+// the block.
+void DeadCodeEliminationTransform::EliminateBlock(BasicBlock *bb,
+                                                  LiveSet *live_set) {
+  for (Instruction *in(bb->last), *prev(nullptr); nullptr != in; in = prev) {
+    prev = in->prev;
+    const Symbol *def(in->GetDefinition());
+    if (IsRemovable(in) && IsLocal(def) && !IsLive(live_set, def)) {
+      if (remove_dead_code) {
+        bb->Remove(in);
+      }
+      continue;
+    }
+
+    // The definitions of phi nodes are not killed, as their uses are treated
+    // as occurring at the beginning of the join block, and not at the end of
+    // the predecessor blocks.
+    if (Operation::OP_PHI != in->operation) {
+      RemoveLive(live_set, def);
+    }
+    for (unsigned i(0); i < Instruction::kMaxNumOperands; ++i) {
+      if (OperandKind::OPERAND_USE == GetOperandKind(in->operation, i)) {
+        AddLive(live_set, in->operands[i].symbol);
+      }
+    }
+  }
+}
+
+
+// The liveness of a loop is computed by iterating over the condition and body
+// until the symbols that are live at the beginning of the body stop changing.
+// Nothing is removed until the fixed point is reached.
+void DeadCodeEliminationTransform::EliminateLoop(LoopControlFlowGraph *cfg,
+                                                 LiveSet *live_set) {
+  const bool was_removing_dead_code(remove_dead_code);
+  LiveSet live_out;
+  LiveSet live_body;
+  LiveSet live_condition;
+  CopyLive(&live_out, live_set);
+
+  remove_dead_code = false;
+  for (bool changed_live(true); changed_live; ) {
+    CopyLive(&live_condition, &live_out);
+    UnionLive(&live_condition, &live_body);
+    AddLive(&live_condition, cfg->conditional_value);
+    EliminateBlock(&(cfg->condition.bb), &live_condition);
+    EliminateChain(&(cfg->body), &(cfg->condition), &(cfg->update),
+                   &live_condition);
+    changed_live = UnionLive(&live_body, &live_condition);
+  }
+  remove_dead_code = was_removing_dead_code;
+
+  CopyLive(&live_condition, &live_out);
+  UnionLive(&live_condition, &live_body);
+  AddLive(&live_condition, cfg->conditional_value);
+  EliminateBlock(&(cfg->condition.bb), &live_condition);
+  CopyLive(live_set, &live_condition);
+
+  EliminateChain(&(cfg->body), &(cfg->condition), &(cfg->update),
+                 &live_condition);
+  EliminateChain(&(cfg->init), &(cfg->condition), nullptr, live_set);
+}
+
+
+void DeadCodeEliminationTransform::VisitPreOrder(
+    SequentialControlFlowGraph *cfg) {
+  next_cfg = cfg->successor;
+  visited_seq = cfg;
+  if (!only_find_successor) {
+    EliminateBlock(&(cfg->bb), live);
+  }
+}
+
+
+void DeadCodeEliminationTransform::VisitPreOrder(
+    ConditionalControlFlowGraph *cfg) {
+  next_cfg = cfg->successor;
+  if (only_find_successor) {
+    return;
+  }
+
+  LiveSet *live_set(live);
+  const bool may_collapse(can_collapse);
+  LiveSet live_false;
+  CopyLive(&live_false, live_set);
+  EliminateChain(&(cfg->if_true), cfg->successor, nullptr, live_set);
+  EliminateChain(&(cfg->if_false), cfg->successor, nullptr, &live_false);
+  UnionLive(live_set, &live_false);
+
+  const bool collapse(may_collapse &&
+                      IsEmpty(&(cfg->if_true), cfg->successor) &&
+                      IsEmpty(&(cfg->if_false), cfg->successor) &&
+                      !BeginsWithPhi(cfg->successor));
+  if (!collapse) {
+    AddLive(live_set, cfg->conditional_value);
+  }
+  EliminateBlock(&(cfg->condition.bb), live_set);
+
+  next_cfg = cfg->successor;
+  collapsed_condition = collapse ? &(cfg->condition.bb) : nullptr;
+}
+
+
+// Control flows directly from the condition of a multi-way branch to its
+// successor if there is no default arm.
+void DeadCodeEliminationTransform::VisitPreOrder(
+    MultiWayBranchControlFlowGraph *cfg) {
+  next_cfg = cfg->successor;
+  if (only_find_successor) {
+    return;
+  }
+
+  LiveSet *live_set(live);
+  const bool may_collapse(can_collapse);
+  LiveSet live_out;
+  CopyLive(&live_out, live_set);
+  if (cfg->default_arm) {
+    for (U32 &word : *live_set) {
+      word = 0;
+    }
+  }
+
+  bool arms_are_empty(true);
+  for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+    LiveSet live_arm;
+    CopyLive(&live_arm, &live_out);
+    EliminateChain(&(arm->if_true), cfg->successor, nullptr, &live_arm);
+    UnionLive(live_set, &live_arm);
+    arms_are_empty = arms_are_empty && IsEmpty(&(arm->if_true),
+                                               cfg->successor);
+  }
+
+  const bool collapse(may_collapse && arms_are_empty &&
+                      !BeginsWithPhi(cfg->successor));
+  if (!collapse) {
+    AddLive(live_set, cfg->conditional_value);
+    for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+      AddLive(live_set, arm->value);
+    }
+  }
+  EliminateBlock(&(cfg->condition.bb), live_set);
+
+  next_cfg = cfg->successor;
+  collapsed_condition = collapse ? &(cfg->condition.bb) : nullptr;
+}
+
+
+void DeadCodeEliminationTransform::VisitPreOrder(LoopControlFlowGraph *cfg) {
+  next_cfg = cfg->successor;
+  if (!only_find_successor) {
+    EliminateLoop(cfg, live);
+    next_cfg = cfg->successor;
+    collapsed_condition = nullptr;
+  }
+}
+
+}  // namespace mir
+}  // namespace pjit
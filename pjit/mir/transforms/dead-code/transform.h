@@ -0,0 +1,106 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.h
+ *
+ *  Created on: 2014-01-12
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_TRANSFORMS_DEAD_CODE_TRANSFORM_H_
+#define PJIT_MIR_TRANSFORMS_DEAD_CODE_TRANSFORM_H_
+
+#include "pjit/base/base.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+class Symbol;
+class Instruction;
+class BasicBlock;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+
+
+// Removes instructions whose results are never read, and then removes the
+// control-flow graphs that are left empty.
+//
+// Liveness is computed backward over the structure of the CFG. Only local
+// variables can be dead: globals, persistent symbols, and program counters
+// are observable after the code runs, and are always live. Assignments,
+// operators, type conversions, loads, and phi nodes that define dead local
+// variables are removed; stores and calls to C functions are never removed.
+// The liveness of a loop is iterated to a fixed point before anything inside
+// of the loop is removed.
+//
+// A conditional or multi-way branch whose arms are all empty is replaced by
+// its condition block, and a sequential CFG that directly follows another
+// sequential CFG is merged into its predecessor, which removes empty
+// sequential CFGs. Loops are never removed, as they might not terminate.
+//
+// The removed control-flow graphs are reclaimed by `Context::GarbageCollect`.
+class DeadCodeEliminationTransform : public ControlFlowGraphVisitor {
+ public:
+  explicit DeadCodeEliminationTransform(Context *context_);
+  virtual ~DeadCodeEliminationTransform(void) = default;
+
+  void Transform(void);
+
+  // Type dispatch on the kinds of control-flow graphs. These *do not* visit
+  // the successors of `cfg`.
+  virtual void VisitPreOrder(SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(LoopControlFlowGraph *cfg);
+
+ private:
+  // A set of live symbols, as a bit set indexed by symbol id.
+  typedef Vector<U32> LiveSet;
+
+  Context * const context;
+
+  // Whether or not the current iteration of the transform changed the CFG.
+  bool changed;
+
+  // Whether dead instructions should be removed, or only treated as removed
+  // while computing the liveness of a loop.
+  bool remove_dead_code;
+
+  // Whether the type dispatch should only find the next CFG in a chain.
+  bool only_find_successor;
+
+  // Inputs to the type dispatch. On input, `live` contains the symbols that
+  // are live after the visited CFG, and on output it contains the symbols
+  // that are live before the visited CFG. `can_collapse` is true if the
+  // visited CFG is preceded by a sequential CFG into which it can collapse.
+  LiveSet *live;
+  bool can_collapse;
+
+  // Outputs of the type dispatch. If the visited CFG is a branch whose arms
+  // are all empty, then `collapsed_condition` is its condition block.
+  ControlFlowGraph *next_cfg;
+  SequentialControlFlowGraph *visited_seq;
+  BasicBlock *collapsed_condition;
+
+  void EliminateChain(ControlFlowGraph *cfg, ControlFlowGraph *stop,
+                      ControlFlowGraph *keep, LiveSet *live_set);
+  void EliminateBlock(BasicBlock *bb, LiveSet *live_set);
+  void EliminateLoop(LoopControlFlowGraph *cfg, LiveSet *live_set);
+
+  static bool IsEmpty(const SequentialControlFlowGraph *cfg,
+                      const ControlFlowGraph *successor);
+  static bool BeginsWithPhi(const SequentialControlFlowGraph *cfg);
+
+  DeadCodeEliminationTransform(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(DeadCodeEliminationTransform);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_TRANSFORMS_DEAD_CODE_TRANSFORM_H_
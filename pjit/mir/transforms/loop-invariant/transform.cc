@@ -0,0 +1,310 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.cc
+ *
+ *  Created on: 2014-01-19
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/loop-invariant/transform.h"
+
+#include "pjit/base/type-info.h"
+#include "pjit/mir/context.h"
+#include "pjit/mir/instruction.h"
+#include "pjit/mir/symbol.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/cfg/dominators.h"
+#include "pjit/mir/cfg/edges.h"
+#include "pjit/mir/cfg/loop.h"
+#include "pjit/mir/transforms/util.h"
+
+namespace pjit {
+namespace mir {
+
+
+// Returns true if `in` might change the contents of raw memory, or of any
+// field.
+static bool WritesAnyMemory(const Instruction *in) {
+  switch (in->operation) {
+    case Operation::OP_STORE_MEMORY:
+    case Operation::OP_CCALL1:
+    case Operation::OP_CCALL2:
+    case Operation::OP_CCALL3:
+    case Operation::OP_NEXT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+LoopInvariantCodeMotionTransform::LoopInvariantCodeMotionTransform(
+    Context *context_)
+    : context(context_),
+      writes_any_memory(false),
+      edges(nullptr),
+      loops(nullptr),
+      dominators(nullptr) {}
+
+
+// Hoist out of the innermost loops first. Loops are numbered so that enclosing
+// loops come first, and the pre-header of a nested loop belongs to the loop
+// that encloses it.
+void LoopInvariantCodeMotionTransform::Transform(void) {
+  edges = context->Edges();
+  loops = context->Loops();
+  dominators = context->Dominators();
+
+  CountDefinitions();
+  for (unsigned loop_id(loops->NumLoops()); loop_id--; ) {
+    HoistLoop(loop_id);
+  }
+
+  edges = nullptr;
+  loops = nullptr;
+  dominators = nullptr;
+}
+
+
+// Count the definitions of every variable in the context. Hoisting moves
+// definitions without adding or removing any, so the counts stay valid.
+void LoopInvariantCodeMotionTransform::CountDefinitions(void) {
+  for (Variable &var : variables) {
+    var.num_definitions = 0;
+    var.loop = LoopNest::NO_LOOP;
+    var.num_loop_definitions = 0;
+  }
+  for (unsigned i(0); i < edges->NumBlocks(); ++i) {
+    for (Instruction *in(edges->Block(i)->first); in; in = in->next) {
+      const Symbol *def(in->GetDefinition());
+      if (def && def->id) {
+        variables.Get(def->id).num_definitions += 1;
+      }
+    }
+  }
+}
+
+
+// Count the definitions in the loop, and find the memory that it writes.
+void LoopInvariantCodeMotionTransform::ScanLoop(unsigned loop_id) {
+  const LoopNest::Loop &loop(loops->GetLoop(loop_id));
+  writes_any_memory = false;
+  written_fields.Clear();
+  for (unsigned i(loop.begin); i <= loop.end; ++i) {
+    for (Instruction *in(edges->Block(i)->first); in; in = in->next) {
+      const Symbol *def(in->GetDefinition());
+      if (def && def->id) {
+        Variable &var(variables.Get(def->id));
+        if (var.loop != loop_id) {
+          var.loop = loop_id;
+          var.num_loop_definitions = 0;
+        }
+        var.num_loop_definitions += 1;
+      }
+      if (WritesAnyMemory(in)) {
+        writes_any_memory = true;
+      } else if (Operation::OP_STORE_FIELD == in->operation &&
+                 !IsWrittenField(in->operands[1].field)) {
+        written_fields.PushBack(in->operands[1].field);
+      }
+    }
+  }
+}
+
+
+// Move the invariant instructions of the loop to the end of its pre-header.
+// Basic blocks are visited in reverse post-order, so that the operands of an
+// instruction are hoisted before the instruction itself.
+void LoopInvariantCodeMotionTransform::HoistLoop(unsigned loop_id) {
+  const LoopNest::Loop &loop(loops->GetLoop(loop_id));
+  if (!loop.preheader || !loop.latch) {
+    return;
+  }
+
+  ScanLoop(loop_id);
+  const bool runs_body(AlwaysRunsBody(loop));
+  for (unsigned i(loop.begin); i <= loop.end; ++i) {
+    BasicBlock *bb(edges->Block(i));
+    const bool may_fault(bb == loop.header ||
+                         (runs_body && dominators->Dominates(bb, loop.latch)));
+    for (Instruction *in(bb->first), *next(nullptr); in; in = next) {
+      next = in->next;
+      if (IsInvariant(loop_id, in, may_fault)) {
+        bb->Remove(in);
+        loop.preheader->Append(in);
+        variables.Get(in->GetDefinition()->id).num_loop_definitions = 0;
+      }
+    }
+  }
+}
+
+
+// Returns true if `in` computes the same value on every iteration of the loop,
+// and can be hoisted into its pre-header. Instructions that can fault are only
+// hoisted if `may_fault` is true.
+bool LoopInvariantCodeMotionTransform::IsInvariant(unsigned loop_id,
+                                                   const Instruction *in,
+                                                   bool may_fault) {
+  unsigned num_operands(1);
+  bool can_fault(false);
+  switch (in->operation) {
+#define PJIT_DECLARE_BINARY_OPERATOR(opcode, _) \
+    case Operation::PJIT_CAT(OP_, opcode):
+#define PJIT_DECLARE_UNARY_OPERATOR(opcode, _)
+#include "pjit/mir/operator.h"
+#undef PJIT_DECLARE_BINARY_OPERATOR
+#undef PJIT_DECLARE_UNARY_OPERATOR
+      num_operands = 2;
+      break;
+
+#define PJIT_DECLARE_BINARY_OPERATOR(opcode, _)
+#define PJIT_DECLARE_UNARY_OPERATOR(opcode, _) \
+    case Operation::PJIT_CAT(OP_, opcode):
+#include "pjit/mir/operator.h"
+#undef PJIT_DECLARE_BINARY_OPERATOR
+#undef PJIT_DECLARE_UNARY_OPERATOR
+    case Operation::OP_CONVERT_TYPE:
+      break;
+
+    case Operation::OP_LOAD_FIELD:
+      if (writes_any_memory || IsWrittenField(in->operands[2].field)) {
+        return false;
+      }
+      can_fault = true;
+      break;
+
+    default:
+      return false;
+  }
+
+  const Symbol *def(in->GetDefinition());
+  if (!IsLocalScalar(def) || 1 != variables.Get(def->id).num_definitions) {
+    return false;
+  }
+  for (unsigned i(1); i <= num_operands; ++i) {
+    if (!IsInvariantOperand(loop_id, in->operands[i].symbol)) {
+      return false;
+    }
+  }
+
+  // Integer division by zero faults, as does dividing the most negative
+  // signed integer by -1.
+  if (Operation::OP_DIVIDE == in->operation &&
+      TypeKind::TYPE_KIND_FLOATING_POINT != def->type->kind) {
+    U64 divisor(0);
+    can_fault = !IntegerConstant(in->operands[2].symbol, &divisor) ||
+                !divisor || ~0ULL == divisor;
+  }
+  return may_fault || !can_fault;
+}
+
+
+// Returns true if `sym` has the same value on every iteration of the loop.
+// Globals can be changed by C functions, and are never invariant.
+bool LoopInvariantCodeMotionTransform::IsInvariantOperand(unsigned loop_id,
+                                                          const Symbol *sym) {
+  if (!sym) {
+    return false;
+  } else if (!sym->id) {
+    return true;
+  } else if (sym->behavior & SymbolBehavior::BehaviorGlobal) {
+    return false;
+  }
+  const Variable &var(variables.Get(sym->id));
+  return var.loop != loop_id || !var.num_loop_definitions;
+}
+
+
+bool LoopInvariantCodeMotionTransform::IsWrittenField(
+    const StructureFieldInfo *field) {
+  for (const StructureFieldInfo *written_field : written_fields) {
+    if (written_field == field) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// Returns true if the body of the loop runs at least once each time that the
+// loop is reached, which is the case when the condition of the loop compares
+// two constants, or two variables that are assigned constants at the end of
+// the pre-header (e.g. `for (i = 0; i < 8; ...)`), and the comparison holds.
+bool LoopInvariantCodeMotionTransform::AlwaysRunsBody(
+    const LoopNest::Loop &loop) {
+  const Symbol *cond(loop.cfg->conditional_value);
+  U64 value(0);
+  if (IntegerConstant(cond, &value)) {
+    return 0 != value;
+  } else if (!cond || !cond->id) {
+    return false;
+  }
+
+  const Instruction *compare(loop.header->last);
+  for (; compare && compare->GetDefinition() != cond; compare = compare->prev) {
+  }
+  if (!compare) {
+    return false;
+  }
+
+  const Symbol *left(nullptr);
+  const Symbol *right(nullptr);
+  switch (compare->operation) {
+    case Operation::OP_COMPARE_EQ:
+    case Operation::OP_COMPARE_NE:
+    case Operation::OP_COMPARE_LT:
+    case Operation::OP_COMPARE_LTE:
+    case Operation::OP_COMPARE_GT:
+    case Operation::OP_COMPARE_GTE:
+      left = EntryValue(loop, compare->operands[1].symbol, compare);
+      right = EntryValue(loop, compare->operands[2].symbol, compare);
+      break;
+    default:
+      return false;
+  }
+
+  U64 a(0);
+  U64 b(0);
+  if (!left || !right || left->type != right->type ||
+      !IntegerConstant(left, &a) || !IntegerConstant(right, &b)) {
+    return false;
+  }
+  const bool is_less(IsSigned(left->type) ?
+      static_cast<S64>(a) < static_cast<S64>(b) : a < b);
+  switch (compare->operation) {
+    case Operation::OP_COMPARE_EQ: return a == b;
+    case Operation::OP_COMPARE_NE: return a != b;
+    case Operation::OP_COMPARE_LT: return is_less;
+    case Operation::OP_COMPARE_LTE: return is_less || a == b;
+    case Operation::OP_COMPARE_GT: return !is_less && a != b;
+    default: return !is_less;
+  }
+}
+
+
+// Returns the constant value of `sym` when `use` (in the header of the loop)
+// runs for the first time, or `nullptr` if the value is not known.
+const Symbol *LoopInvariantCodeMotionTransform::EntryValue(
+    const LoopNest::Loop &loop, const Symbol *sym, const Instruction *use) {
+  if (!sym || !sym->id) {
+    return sym;
+  }
+  for (const Instruction *in(use->prev); in; in = in->prev) {
+    if (in->GetDefinition() == sym) {
+      return nullptr;
+    }
+  }
+  for (const Instruction *in(loop.preheader->last); in; in = in->prev) {
+    if (in->GetDefinition() == sym) {
+      if (Operation::OP_ASSIGN != in->operation) {
+        return nullptr;
+      }
+      const Symbol *value(in->operands[1].symbol);
+      return !value->id && value->type == sym->type ? value : nullptr;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace mir
+}  // namespace pjit
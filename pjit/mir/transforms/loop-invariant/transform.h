@@ -0,0 +1,99 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.h
+ *
+ *  Created on: 2014-01-19
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_TRANSFORMS_LOOP_INVARIANT_TRANSFORM_H_
+#define PJIT_MIR_TRANSFORMS_LOOP_INVARIANT_TRANSFORM_H_
+
+#include "pjit/base/base.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/loop-nest.h"
+
+namespace pjit {
+
+struct StructureFieldInfo;
+
+namespace mir {
+
+class Context;
+class Symbol;
+class Instruction;
+class BasicBlock;
+class BasicBlockEdges;
+class DominatorTree;
+
+
+// Hoists loop-invariant computations out of loops and into their pre-headers,
+// i.e. to the end of the last basic block of their `init`.
+//
+// Operators from `pjit/mir/operator.h`, type conversions, and loads from
+// fields are hoisted out of the `condition`, `body`, and `update` of a loop if
+// every operand is a constant or a variable that is not defined in the loop.
+// The destination must be a local, scalar variable with exactly one definition
+// (such as a temporary introduced by the HIR), so that the hoisted definition
+// cannot be observed by anything that previously saw another value. Loops are
+// processed from the innermost outward, so a computation can be hoisted out of
+// several loops.
+//
+// A load from a field is invariant if the loop does not call C functions, does
+// not store to raw memory, and does not store to the same field. Different
+// fields are assumed to never alias.
+//
+// Hoisting executes a computation even if the loop's body does not run. Loads
+// and integer divisions (unless by a constant other than zero and -1) can
+// fault, and so they are only hoisted from the basic blocks that run each time
+// the loop is reached: the loop's `condition`, and the basic blocks that run on
+// every iteration of a loop that is known to run at least one iteration, i.e.
+// whose condition compares constants that `init` assigns.
+class LoopInvariantCodeMotionTransform {
+ public:
+  explicit LoopInvariantCodeMotionTransform(Context *context_);
+  ~LoopInvariantCodeMotionTransform(void) = default;
+
+  void Transform(void);
+
+ private:
+  struct Variable {
+    unsigned num_definitions = 0;
+
+    // Number of definitions in the loop numbered `loop`.
+    unsigned loop = LoopNest::NO_LOOP;
+    unsigned num_loop_definitions = 0;
+  };
+
+  Context * const context;
+
+  Vector<Variable> variables;
+
+  // Memory written by the current loop.
+  bool writes_any_memory;
+  Vector<const StructureFieldInfo *> written_fields;
+
+  // Analyses of the context during the transform.
+  BasicBlockEdges *edges;
+  LoopNest *loops;
+  DominatorTree *dominators;
+
+  void CountDefinitions(void);
+  void HoistLoop(unsigned loop_id);
+  void ScanLoop(unsigned loop_id);
+  bool IsInvariant(unsigned loop_id, const Instruction *in,
+                   bool may_fault);
+  bool IsInvariantOperand(unsigned loop_id, const Symbol *sym);
+  bool IsWrittenField(const StructureFieldInfo *field);
+  bool AlwaysRunsBody(const LoopNest::Loop &loop);
+  const Symbol *EntryValue(const LoopNest::Loop &loop, const Symbol *sym,
+                           const Instruction *use);
+
+  LoopInvariantCodeMotionTransform(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(LoopInvariantCodeMotionTransform);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_TRANSFORMS_LOOP_INVARIANT_TRANSFORM_H_
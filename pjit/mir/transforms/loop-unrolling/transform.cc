@@ -0,0 +1,895 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.cc
+ *
+ *  Created on: 2014-01-20
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/loop-unrolling/transform.h"
+
+#include "pjit/base/type-info.h"
+#include "pjit/mir/context.h"
+#include "pjit/mir/symbol.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/cfg/sequential.h"
+#include "pjit/mir/cfg/conditional.h"
+#include "pjit/mir/cfg/multi-way-branch.h"
+#include "pjit/mir/cfg/loop.h"
+#include "pjit/mir/transforms/util.h"
+
+namespace pjit {
+namespace mir {
+
+
+static bool IsLess(U64 a, U64 b, bool is_signed) {
+  return is_signed ? static_cast<S64>(a) < static_cast<S64>(b) : a < b;
+}
+
+
+// Evaluate the comparison `a op b` of two extended integers.
+static bool Compare(Operation op, U64 a, U64 b, bool is_signed) {
+  switch (op) {
+    case Operation::OP_COMPARE_LT: return IsLess(a, b, is_signed);
+    case Operation::OP_COMPARE_LTE: return !IsLess(b, a, is_signed);
+    case Operation::OP_COMPARE_GT: return IsLess(b, a, is_signed);
+    case Operation::OP_COMPARE_GTE: return !IsLess(a, b, is_signed);
+    default: return false;
+  }
+}
+
+
+// Returns the comparison `op` with its operands swapped.
+static Operation SwapComparison(Operation op) {
+  switch (op) {
+    case Operation::OP_COMPARE_LT: return Operation::OP_COMPARE_GT;
+    case Operation::OP_COMPARE_LTE: return Operation::OP_COMPARE_GTE;
+    case Operation::OP_COMPARE_GT: return Operation::OP_COMPARE_LT;
+    case Operation::OP_COMPARE_GTE: return Operation::OP_COMPARE_LTE;
+    default: return op;
+  }
+}
+
+
+LoopUnrollingTransform::LoopUnrollingTransform(Context *context_)
+    : context(context_),
+      num_body_instructions(0),
+      loop_tag(0),
+      copy_tag(0),
+      mode(DispatchMode::UNROLL),
+      uses_are_stale(true),
+      last_seq(nullptr),
+      found_seq(nullptr),
+      next_cfg(nullptr) {}
+
+
+// Unroll every loop of the context. Nested loops are unrolled before the
+// loops that contain them.
+void LoopUnrollingTransform::Transform(void) {
+  uses_are_stale = true;
+  mode = DispatchMode::UNROLL;
+  last_seq = nullptr;
+  UnrollChain(&(context->entry), nullptr);
+}
+
+
+// Visit every control-flow graph in the successor chain beginning at `cfg`
+// and ending at (but not including) `stop`.
+void LoopUnrollingTransform::UnrollChain(ControlFlowGraph *cfg,
+                                         ControlFlowGraph *stop) {
+  while (cfg != stop) {
+    cfg->DoVisitPreOrder(this);
+    cfg = next_cfg;
+  }
+}
+
+
+// Count the uses of every variable in the context. This can happen in the
+// middle of unrolling, and so the state of the type dispatch is saved.
+void LoopUnrollingTransform::CountUses(void) {
+  const DispatchMode old_mode(mode);
+  SequentialControlFlowGraph *old_last_seq(last_seq);
+  ControlFlowGraph *old_next_cfg(next_cfg);
+
+  for (Variable &var : variables) {
+    var.num_uses = 0;
+  }
+  mode = DispatchMode::COUNT_USES;
+  UnrollChain(&(context->entry), nullptr);
+
+  mode = old_mode;
+  last_seq = old_last_seq;
+  next_cfg = old_next_cfg;
+  uses_are_stale = false;
+}
+
+
+void LoopUnrollingTransform::CountBlock(const BasicBlock *bb) {
+  for (const Instruction *in(bb->first); in; in = in->next) {
+    for (unsigned i(0); i < Instruction::kMaxNumOperands; ++i) {
+      if (OperandKind::OPERAND_USE == GetOperandKind(in->operation, i)) {
+        CountUse(in->operands[i].symbol);
+      }
+    }
+  }
+}
+
+
+void LoopUnrollingTransform::CountUse(const Symbol *sym) {
+  if (sym && sym->id) {
+    variables.Get(sym->id).num_uses += 1;
+  }
+}
+
+
+// Returns `cfg` if it is a sequential CFG, and `nullptr` otherwise.
+SequentialControlFlowGraph *LoopUnrollingTransform::AsSequential(
+    ControlFlowGraph *cfg) {
+  if (!cfg) {
+    return nullptr;
+  }
+  const DispatchMode old_mode(mode);
+  mode = DispatchMode::FIND_SEQUENTIAL;
+  found_seq = nullptr;
+  cfg->DoVisitPreOrder(this);
+  mode = old_mode;
+  return found_seq;
+}
+
+
+// Unroll the loop `cfg`, whose predecessor in its chain is `last_seq`, after
+// all of its nested loops have been unrolled.
+void LoopUnrollingTransform::UnrollLoop(LoopControlFlowGraph *cfg) {
+  SequentialControlFlowGraph *pred(last_seq);
+  SequentialControlFlowGraph *successor(cfg->successor);
+  last_seq = nullptr;
+  next_cfg = successor;
+
+  if (uses_are_stale) {
+    CountUses();
+  }
+  InductionVariable iv;
+  if (!CollectBody(cfg) || !ScanLoop(cfg) || !FindInductionVariable(cfg, &iv)) {
+    return;
+  }
+
+  if (FullyUnroll(cfg, iv, pred)) {
+    last_seq = pred;
+    return;
+  }
+
+  if (ReduceStrength(cfg, iv)) {
+    CountUses();
+    if (!ScanLoop(cfg)) {
+      return;
+    }
+  }
+  PartiallyUnroll(cfg, iv);
+}
+
+
+// Find the sequential CFGs of the body of the loop. Returns false if the loop
+// is not in the expected form.
+bool LoopUnrollingTransform::CollectBody(LoopControlFlowGraph *cfg) {
+  body.Clear();
+  if (cfg->init.successor != &(cfg->condition)) {
+    return false;
+  }
+  for (SequentialControlFlowGraph *seq(&(cfg->body)); seq != &(cfg->update);
+       seq = AsSequential(seq->successor)) {
+    if (!seq || seq == &(cfg->condition)) {
+      return false;
+    }
+    body.PushBack(seq);
+  }
+  return true;
+}
+
+
+// Count the definitions and uses of variables in an iteration of the loop,
+// i.e. in its condition, body, and update (in that order). Returns false if
+// the loop contains phi nodes.
+bool LoopUnrollingTransform::ScanLoop(LoopControlFlowGraph *cfg) {
+  ++loop_tag;
+  if (!ScanBlock(&(cfg->condition.bb))) {
+    return false;
+  }
+  num_body_instructions = 0;
+  for (SequentialControlFlowGraph *seq : body) {
+    if (!ScanBlock(&(seq->bb))) {
+      return false;
+    }
+  }
+  if (!ScanBlock(&(cfg->update.bb))) {
+    return false;
+  }
+
+  // The loop itself uses its condition.
+  const Symbol *cond(cfg->conditional_value);
+  if (cond && cond->id) {
+    Variable &var(GetLoopVariable(cond));
+    var.num_loop_uses += 1;
+    var.is_loop_carried = var.is_loop_carried || !var.is_defined;
+  }
+  return true;
+}
+
+
+bool LoopUnrollingTransform::ScanBlock(const BasicBlock *bb) {
+  for (const Instruction *in(bb->first); in; in = in->next) {
+    if (Operation::OP_PHI == in->operation) {
+      return false;
+    }
+    num_body_instructions += 1;
+    for (unsigned i(0); i < Instruction::kMaxNumOperands; ++i) {
+      const Symbol *sym(in->operands[i].symbol);
+      if (OperandKind::OPERAND_USE == GetOperandKind(in->operation, i) &&
+          sym && sym->id) {
+        Variable &var(GetLoopVariable(sym));
+        var.num_loop_uses += 1;
+        var.is_loop_carried = var.is_loop_carried || !var.is_defined;
+      }
+    }
+    const Symbol *def(in->GetDefinition());
+    if (def && def->id) {
+      Variable &var(GetLoopVariable(def));
+      var.num_loop_definitions += 1;
+      var.is_defined = true;
+    }
+  }
+  return true;
+}
+
+
+// Find the induction variable of the loop. The condition of the loop must be
+// a single comparison of the induction variable with a loop-invariant bound,
+// whose result is only used by the loop.
+bool LoopUnrollingTransform::FindInductionVariable(LoopControlFlowGraph *cfg,
+                                                   InductionVariable *iv) {
+  const Symbol *cond(cfg->conditional_value);
+  const Instruction *compare(cfg->condition.bb.first);
+  if (!cond || !cond->id || !compare || compare != cfg->condition.bb.last ||
+      compare->GetDefinition() != cond ||
+      1 != variables.Get(cond->id).num_uses) {
+    return false;
+  }
+
+  Operation comparison(compare->operation);
+  switch (comparison) {
+    case Operation::OP_COMPARE_LT:
+    case Operation::OP_COMPARE_LTE:
+    case Operation::OP_COMPARE_GT:
+    case Operation::OP_COMPARE_GTE:
+      break;
+    default:
+      return false;
+  }
+
+  const Symbol *var(compare->operands[1].symbol);
+  const Symbol *bound(compare->operands[2].symbol);
+  if (IsInvariant(var)) {
+    const Symbol *temp(var);
+    var = bound;
+    bound = temp;
+    comparison = SwapComparison(comparison);
+  }
+  if (!var->id || (var->behavior & SymbolBehavior::BehaviorGlobal) ||
+      TypeKind::TYPE_KIND_INTEGER != var->type->kind ||
+      var->type != bound->type || !IsInvariant(bound) ||
+      1 != GetLoopVariable(var).num_loop_definitions) {
+    return false;
+  }
+
+  iv->symbol = var;
+  iv->bound = bound;
+  iv->comparison = comparison;
+  return FindStep(cfg, iv);
+}
+
+
+// Find the definition of the induction variable in `update`, which must add a
+// constant to the induction variable, either directly (`i = i + 1`) or through
+// a temporary (`t = i + 1; i = t`).
+bool LoopUnrollingTransform::FindStep(LoopControlFlowGraph *cfg,
+                                      InductionVariable *iv) {
+  Instruction *def(cfg->update.bb.last);
+  for (; def && def->GetDefinition() != iv->symbol; def = def->prev) {}
+  if (!def) {
+    return false;
+  }
+
+  const Instruction *add(def);
+  if (Operation::OP_ASSIGN == def->operation) {
+    const Symbol *temp(def->operands[1].symbol);
+    if (!temp->id || temp->type != iv->symbol->type ||
+        1 != GetLoopVariable(temp).num_loop_definitions) {
+      return false;
+    }
+    for (add = def->prev; add && add->GetDefinition() != temp;
+         add = add->prev) {}
+    if (!add) {
+      return false;
+    }
+  }
+
+  const Symbol *left(add->operands[1].symbol);
+  const Symbol *right(add->operands[2].symbol);
+  U64 step(0);
+  if (Operation::OP_ADD == add->operation && left == iv->symbol &&
+      IntegerConstant(right, &step)) {
+  } else if (Operation::OP_ADD == add->operation && right == iv->symbol &&
+             IntegerConstant(left, &step)) {
+  } else if (Operation::OP_SUBTRACT == add->operation &&
+             left == iv->symbol && IntegerConstant(right, &step)) {
+    step = 0 - step;
+  } else {
+    return false;
+  }
+  if (left->type != right->type) {
+    return false;
+  }
+
+  // The step must be small enough that the direction in which the induction
+  // variable moves reveals when it wraps around.
+  const U64 magnitude(static_cast<S64>(step) < 0 ? 0 - step : step);
+  if (!magnitude ||
+      magnitude >= (1ULL << (iv->symbol->type->size_in_bytes * 8 - 2))) {
+    return false;
+  }
+  iv->step = step;
+  iv->definition = def;
+  return true;
+}
+
+
+// Replace a loop with a constant trip count by copies of its iterations. The
+// instructions of `init` and the copies are appended to `pred`, which is then
+// linked to the loop's successor.
+bool LoopUnrollingTransform::FullyUnroll(LoopControlFlowGraph *cfg,
+                                         const InductionVariable &iv,
+                                         SequentialControlFlowGraph *pred) {
+  U64 bound(0);
+  if (!pred || pred->successor != cfg || !IntegerConstant(iv.bound, &bound)) {
+    return false;
+  }
+
+  const Instruction *init(cfg->init.bb.last);
+  for (; init && init->GetDefinition() != iv.symbol; init = init->prev) {}
+  U64 first_value(0);
+  if (!init || Operation::OP_ASSIGN != init->operation ||
+      init->operands[1].symbol->type != iv.symbol->type ||
+      !IntegerConstant(init->operands[1].symbol, &first_value)) {
+    return false;
+  }
+
+  const TypeInfo *type(iv.symbol->type);
+  const bool is_signed(IsSigned(type));
+  const bool is_increasing(static_cast<S64>(iv.step) > 0);
+  unsigned trip_count(0);
+  for (U64 value(first_value);
+       Compare(iv.comparison, value, bound, is_signed); ++trip_count) {
+    if ((trip_count + 1) * num_body_instructions >
+        MAX_FULLY_UNROLLED_INSTRUCTIONS) {
+      return false;
+    }
+    const U64 next_value(Truncate(value + iv.step, type));
+    if (is_increasing != IsLess(value, next_value, is_signed)) {
+      return false;  // Wraps around.
+    }
+    value = next_value;
+  }
+
+  BasicBlock *bb(&(pred->bb));
+  while (Instruction *in = cfg->init.bb.first) {
+    cfg->init.bb.Remove(in);
+    bb->Append(in);
+  }
+
+  U64 value(first_value);
+  for (unsigned n(0); n < trip_count; ++n) {
+    ++copy_tag;
+    const Symbol *induction_value(MakeIntegerConstant(type, value));
+    for (unsigned i(0); i <= body.Size(); ++i) {
+      const BasicBlock *from(i < body.Size() ? &(body.Get(i)->bb) :
+                                               &(cfg->update.bb));
+      for (const Instruction *in(from->first); in; in = in->next) {
+        bb->Append(Clone(in, iv.symbol, induction_value));
+        if (in == iv.definition) {
+          induction_value = nullptr;
+        }
+      }
+    }
+    value = Truncate(value + iv.step, type);
+  }
+
+  pred->successor = cfg->successor;
+  context->InvalidateControlFlow();
+  uses_are_stale = true;
+  return true;
+}
+
+
+// Replace the multiplications by affine functions of the induction variable
+// with copies of new variables, which are initialized at the end of `init`,
+// and incremented right after each update of the induction variable.
+bool LoopUnrollingTransform::ReduceStrength(LoopControlFlowGraph *cfg,
+                                            const InductionVariable &iv) {
+  Variable &induction(GetLoopVariable(iv.symbol));
+  induction.is_induction = true;
+  induction.is_exact =
+      (Operation::OP_COMPARE_LT == iv.comparison && 1ULL == iv.step) ||
+      (Operation::OP_COMPARE_GT == iv.comparison && ~0ULL == iv.step);
+  induction.coefficient = 1;
+  induction.induction_definition = nullptr;
+
+  reductions.Clear();
+  for (unsigned i(0); i <= body.Size(); ++i) {
+    BasicBlock *bb(i ? &(body.Get(i - 1)->bb) : &(cfg->condition.bb));
+    for (Instruction *in(bb->first); in; in = in->next) {
+      FindInductionExpression(bb, in);
+    }
+  }
+  if (!reductions.Size()) {
+    return false;
+  }
+
+  for (const Reduction &reduction : reductions) {
+    EmitEntryValue(&(cfg->init.bb), reduction.in->GetDefinition(),
+                   reduction.reduced);
+  }
+
+  Instruction *pos(iv.definition);
+  for (const Reduction &reduction : reductions) {
+    const Symbol *def(reduction.in->GetDefinition());
+    const Symbol *increment(MakeIntegerConstant(
+        def->type, variables.Get(def->id).coefficient * iv.step));
+    Instruction *add(context->MakeInstruction(
+        Operation::OP_ADD, {reduction.reduced, reduction.reduced, increment}));
+    cfg->update.bb.InsertAfter(pos, add);
+    pos = add;
+
+    reduction.bb->InsertBefore(reduction.in, context->MakeInstruction(
+        Operation::OP_ASSIGN, {def, reduction.reduced}));
+    reduction.bb->Remove(reduction.in);
+  }
+  return true;
+}
+
+
+// Determine whether `in` defines an affine function of the induction variable,
+// and if so, whether it should be strength-reduced. Multiplications by
+// constants are reduced, as are additions of indexes to pointers, which scale
+// the index by the size of the pointed-to type.
+void LoopUnrollingTransform::FindInductionExpression(BasicBlock *bb,
+                                                     Instruction *in) {
+  const Symbol *def(in->GetDefinition());
+  if (!IsLocalScalar(def)) {
+    return;
+  }
+  Variable &var(GetLoopVariable(def));
+  if (1 != var.num_loop_definitions || var.is_loop_carried) {
+    return;
+  }
+
+  const TypeInfo *type(def->type);
+  const Symbol *left(in->operands[1].symbol);
+  const Symbol *right(in->operands[2].symbol);
+  U64 coefficient(0);
+  bool is_exact(false);
+  bool is_reduced(false);
+  switch (in->operation) {
+    case Operation::OP_MULTIPLY: {
+      U64 factor(0);
+      if (IntegerConstant(left, &factor) && IsInduction(right)) {
+        left = right;
+      } else if (!IntegerConstant(right, &factor) || !IsInduction(left)) {
+        return;
+      }
+      if (TypeKind::TYPE_KIND_INTEGER != type->kind || left->type != type) {
+        return;
+      }
+      coefficient = variables.Get(left->id).coefficient * factor;
+      is_reduced = true;
+      break;
+    }
+
+    // Extending an induction variable that never wraps around.
+    case Operation::OP_CONVERT_TYPE:
+      if (!IsInduction(left) || !variables.Get(left->id).is_exact ||
+          TypeKind::TYPE_KIND_INTEGER != left->type->kind) {
+        return;
+      } else if (TypeKind::TYPE_KIND_POINTER != type->kind &&
+                 (TypeKind::TYPE_KIND_INTEGER != type->kind ||
+                  type->size_in_bytes < left->type->size_in_bytes)) {
+        return;
+      }
+      coefficient = variables.Get(left->id).coefficient;
+      is_exact = true;
+      break;
+
+    case Operation::OP_ADD:
+      if (left->type != type || right->type != type) {
+        return;
+      } else if (TypeKind::TYPE_KIND_POINTER == type->kind) {
+        if (!IsInvariant(left) || !IsInduction(right)) {
+          return;
+        }
+        const TypeInfo *elem_type(
+            UnsafeCast<const PointerTypeInfo *>(type)->pointed_to_type);
+        coefficient = variables.Get(right->id).coefficient;
+        is_reduced = elem_type && 1 < elem_type->size_in_bytes;
+      } else if (TypeKind::TYPE_KIND_INTEGER != type->kind) {
+        return;
+      } else if (IsInduction(left) && IsInvariant(right)) {
+        coefficient = variables.Get(left->id).coefficient;
+      } else if (IsInvariant(left) && IsInduction(right)) {
+        coefficient = variables.Get(right->id).coefficient;
+      } else {
+        return;
+      }
+      break;
+
+    default:
+      return;
+  }
+
+  var.is_induction = true;
+  var.is_exact = is_exact;
+  var.coefficient = coefficient;
+  var.induction_definition = in;
+  if (is_reduced) {
+    const Reduction reduction = {bb, in, context->MakeSymbol(type)};
+    reductions.PushBack(reduction);
+  }
+}
+
+
+// Append instructions to `bb` that compute the value of `sym` on entry to the
+// loop, by re-computing its induction expression. The value is stored into
+// `dest` if it isn't `nullptr`. Returns the symbol holding the value.
+const Symbol *LoopUnrollingTransform::EmitEntryValue(BasicBlock *bb,
+                                                     const Symbol *sym,
+                                                     const Symbol *dest) {
+  const Instruction *def(nullptr);
+  if (IsInduction(sym)) {
+    def = variables.Get(sym->id).induction_definition;
+  }
+  if (!def) {
+    if (dest) {
+      bb->Append(context->MakeInstruction(Operation::OP_ASSIGN, {dest, sym}));
+      return dest;
+    }
+    return sym;
+  }
+
+  const Symbol *operands[Instruction::kMaxNumOperands] = {nullptr};
+  operands[0] = dest ? dest : context->MakeSymbol(sym->type);
+  for (unsigned i(1); i < Instruction::kMaxNumOperands; ++i) {
+    if (OperandKind::OPERAND_USE == GetOperandKind(def->operation, i)) {
+      operands[i] = EmitEntryValue(bb, def->operands[i].symbol, nullptr);
+    }
+  }
+  bb->Append(context->MakeInstruction(
+      def->operation, {operands[0], operands[1], operands[2]}));
+  return operands[0];
+}
+
+
+// Unroll the body of a loop `UNROLL_FACTOR` times. The loop continues while
+// the original condition holds and at least `UNROLL_FACTOR` iterations
+// remain, i.e. while the distance between the induction variable and the
+// bound is greater than (or equal to, if the bound is inclusive) the distance
+// covered by `UNROLL_FACTOR - 1` steps. The remaining iterations run in a copy
+// of the original loop that is linked in as the successor of the loop.
+bool LoopUnrollingTransform::PartiallyUnroll(LoopControlFlowGraph *cfg,
+                                             const InductionVariable &iv) {
+  const bool is_increasing(static_cast<S64>(iv.step) > 0);
+  Operation check(Operation::OP_COMPARE_GT);
+  bool needs_increasing(true);
+  switch (iv.comparison) {
+    case Operation::OP_COMPARE_LT: break;
+    case Operation::OP_COMPARE_LTE:
+      check = Operation::OP_COMPARE_GTE;
+      break;
+    case Operation::OP_COMPARE_GT:
+      needs_increasing = false;
+      break;
+    default:
+      check = Operation::OP_COMPARE_GTE;
+      needs_increasing = false;
+      break;
+  }
+
+  const TypeInfo *type(iv.symbol->type);
+  const U64 distance((UNROLL_FACTOR - 1) *
+                     (is_increasing ? iv.step : 0 - iv.step));
+  if (is_increasing != needs_increasing || !num_body_instructions ||
+      MAX_PARTIALLY_UNROLLED_INSTRUCTIONS < num_body_instructions ||
+      distance >= (1ULL << (type->size_in_bytes * 8 - 2))) {
+    return false;
+  }
+
+  // Make the loop that runs the remaining iterations.
+  SequentialControlFlowGraph *successor(cfg->successor);
+  SequentialControlFlowGraph *join(context->Allocate(
+      context->seq_allocator, context, static_cast<ControlFlowGraph *>(cfg)));
+  LoopControlFlowGraph *remainder(context->Allocate(
+      context->loop_allocator, context, static_cast<ControlFlowGraph *>(join),
+      successor));
+  join->successor = remainder;
+  successor->parent = remainder;
+  cfg->successor = join;
+
+  ++copy_tag;
+  remainder->condition.bb.Append(
+      Clone(cfg->condition.bb.first, nullptr, nullptr));
+  remainder->conditional_value =
+      CloneUse(cfg->conditional_value, nullptr, nullptr);
+  for (SequentialControlFlowGraph *seq : body) {
+    for (const Instruction *in(seq->bb.first); in; in = in->next) {
+      remainder->body.bb.Append(Clone(in, nullptr, nullptr));
+    }
+  }
+  for (const Instruction *in(cfg->update.bb.first); in; in = in->next) {
+    remainder->update.bb.Append(Clone(in, nullptr, nullptr));
+  }
+
+  // Merge the body into a single basic block, and put copies of the first
+  // `UNROLL_FACTOR - 1` iterations before the original body.
+  BasicBlock *bb(&(cfg->body.bb));
+  for (unsigned i(1); i < body.Size(); ++i) {
+    BasicBlock *from(&(body.Get(i)->bb));
+    while (Instruction *in = from->first) {
+      from->Remove(in);
+      bb->Append(in);
+    }
+  }
+  cfg->body.successor = &(cfg->update);
+
+  Instruction *first(bb->first);
+  for (unsigned n(1); n < UNROLL_FACTOR; ++n) {
+    ++copy_tag;
+    for (unsigned i(0); i < 2; ++i) {
+      for (const Instruction *in(i ? cfg->update.bb.first : first); in;
+           in = in->next) {
+        Instruction *copy(Clone(in, nullptr, nullptr));
+        if (first) {
+          bb->InsertBefore(first, copy);
+        } else {
+          bb->Append(copy);
+        }
+      }
+    }
+  }
+
+  // Check that enough iterations remain.
+  const Symbol *cond(cfg->conditional_value);
+  const Symbol *distance_left(context->MakeSymbol(type));
+  const Symbol *has_iterations(context->MakeSymbol(cond->type));
+  const Symbol *new_cond(context->MakeSymbol(cond->type));
+  BasicBlock *header(&(cfg->condition.bb));
+  if (is_increasing) {
+    header->Append(context->MakeInstruction(
+        Operation::OP_SUBTRACT, {distance_left, iv.bound, iv.symbol}));
+  } else {
+    header->Append(context->MakeInstruction(
+        Operation::OP_SUBTRACT, {distance_left, iv.symbol, iv.bound}));
+  }
+  header->Append(context->MakeInstruction(
+      check, {has_iterations, distance_left,
+              MakeIntegerConstant(type, distance)}));
+  header->Append(context->MakeInstruction(
+      Operation::OP_LOGICAL_AND, {new_cond, cond, has_iterations}));
+  cfg->conditional_value = new_cond;
+
+  context->InvalidateControlFlow();
+  uses_are_stale = true;
+  return true;
+}
+
+
+// Returns the variable of `sym`, whose information about the current loop is
+// reset if it was last scanned as part of another loop.
+LoopUnrollingTransform::Variable &LoopUnrollingTransform::GetLoopVariable(
+    const Symbol *sym) {
+  Variable &var(variables.Get(sym->id));
+  if (var.loop != loop_tag) {
+    var.loop = loop_tag;
+    var.num_loop_definitions = 0;
+    var.num_loop_uses = 0;
+    var.is_defined = false;
+    var.is_loop_carried = false;
+    var.is_induction = false;
+    var.is_exact = false;
+    var.coefficient = 0;
+    var.induction_definition = nullptr;
+  }
+  return var;
+}
+
+
+// Returns true if `sym` has the same value in every iteration of the current
+// loop. Globals can be changed by C functions, and are never invariant.
+bool LoopUnrollingTransform::IsInvariant(const Symbol *sym) {
+  if (!sym) {
+    return false;
+  } else if (!sym->id) {
+    return true;
+  } else if (sym->behavior & SymbolBehavior::BehaviorGlobal) {
+    return false;
+  }
+  const Variable &var(variables.Get(sym->id));
+  return var.loop != loop_tag || !var.num_loop_definitions;
+}
+
+
+bool LoopUnrollingTransform::IsInduction(const Symbol *sym) {
+  if (!sym || !sym->id) {
+    return false;
+  }
+  const Variable &var(variables.Get(sym->id));
+  return var.loop == loop_tag && var.is_induction;
+}
+
+
+// Returns true if `sym` is local to a single iteration of the current loop:
+// it is defined before being used by every iteration, and is not used outside
+// of the loop.
+bool LoopUnrollingTransform::IsRenamable(const Symbol *sym) {
+  if (!IsLocalScalar(sym)) {
+    return false;
+  }
+  const Variable &var(variables.Get(sym->id));
+  return var.loop == loop_tag && var.num_loop_definitions &&
+         !var.is_loop_carried && var.num_uses == var.num_loop_uses;
+}
+
+
+// Make a copy of `in` for the current copy of an iteration, in which uses of
+// `induction` are replaced by `induction_value` (if it isn't `nullptr`).
+Instruction *LoopUnrollingTransform::Clone(const Instruction *in,
+                                           const Symbol *induction,
+                                           const Symbol *induction_value) {
+  const void *operands[Instruction::kMaxNumOperands] = {nullptr};
+  for (unsigned i(0); i < Instruction::kMaxNumOperands; ++i) {
+    switch (GetOperandKind(in->operation, i)) {
+      case OperandKind::OPERAND_USE:
+        operands[i] = CloneUse(in->operands[i].symbol, induction,
+                               induction_value);
+        break;
+      case OperandKind::OPERAND_DEFINITION:
+      case OperandKind::OPERAND_NONE:
+        break;
+      default:
+        operands[i] = in->operands[i].symbol;
+        break;
+    }
+  }
+  for (unsigned i(0); i < Instruction::kMaxNumOperands; ++i) {
+    if (OperandKind::OPERAND_DEFINITION == GetOperandKind(in->operation, i)) {
+      operands[i] = CloneDefinition(in->operands[i].symbol);
+    }
+  }
+  return context->MakeInstruction(
+      in->operation, {operands[0], operands[1], operands[2]});
+}
+
+
+const Symbol *LoopUnrollingTransform::CloneUse(const Symbol *sym,
+                                               const Symbol *induction,
+                                               const Symbol *induction_value) {
+  if (!sym || !sym->id) {
+    return sym;
+  } else if (sym == induction && induction_value) {
+    return induction_value;
+  }
+  const Variable &var(variables.Get(sym->id));
+  return var.copy == copy_tag && var.copy_symbol ? var.copy_symbol : sym;
+}
+
+
+// Variables that are local to an iteration get a new symbol in every copy.
+const Symbol *LoopUnrollingTransform::CloneDefinition(const Symbol *sym) {
+  if (!IsRenamable(sym)) {
+    return sym;
+  }
+  Variable &var(variables.Get(sym->id));
+  var.copy = copy_tag;
+  if (sym->value.name) {
+    var.copy_symbol = context->MakeSymbol(sym->type, sym->value.name);
+  } else {
+    var.copy_symbol = context->MakeSymbol(sym->type);
+  }
+  return var.copy_symbol;
+}
+
+
+// Make an integer constant, or a pointer constant that holds a number of
+// elements (e.g. to increment a pointer).
+const Symbol *LoopUnrollingTransform::MakeIntegerConstant(const TypeInfo *type,
+                                                          U64 value) {
+  Symbol *sym(context->MakeConstant(type));
+  if (TypeKind::TYPE_KIND_POINTER == type->kind) {
+    sym->value.pointer = UnsafeCast<void *>(value);
+    return sym;
+  }
+  switch (type->size_in_bytes) {
+    case 1: sym->value.u8 = static_cast<U8>(value); break;
+    case 2: sym->value.u16 = static_cast<U16>(value); break;
+    case 4: sym->value.u32 = static_cast<U32>(value); break;
+    default: sym->value.u64 = value; break;
+  }
+  return sym;
+}
+
+
+void LoopUnrollingTransform::VisitPreOrder(SequentialControlFlowGraph *cfg) {
+  if (DispatchMode::FIND_SEQUENTIAL == mode) {
+    found_seq = cfg;
+    return;
+  } else if (DispatchMode::COUNT_USES == mode) {
+    CountBlock(&(cfg->bb));
+  } else {
+    last_seq = cfg;
+  }
+  next_cfg = cfg->successor;
+}
+
+
+void LoopUnrollingTransform::VisitPreOrder(ConditionalControlFlowGraph *cfg) {
+  if (DispatchMode::FIND_SEQUENTIAL == mode) {
+    found_seq = nullptr;
+    return;
+  } else if (DispatchMode::COUNT_USES == mode) {
+    CountBlock(&(cfg->condition.bb));
+    CountUse(cfg->conditional_value);
+  }
+  UnrollChain(&(cfg->if_true), cfg->successor);
+  UnrollChain(&(cfg->if_false), cfg->successor);
+  last_seq = nullptr;
+  next_cfg = cfg->successor;
+}
+
+
+void LoopUnrollingTransform::VisitPreOrder(
+    MultiWayBranchControlFlowGraph *cfg) {
+  if (DispatchMode::FIND_SEQUENTIAL == mode) {
+    found_seq = nullptr;
+    return;
+  } else if (DispatchMode::COUNT_USES == mode) {
+    CountBlock(&(cfg->condition.bb));
+    CountUse(cfg->conditional_value);
+  }
+  for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+    if (DispatchMode::COUNT_USES == mode) {
+      CountUse(arm->value);
+    }
+    UnrollChain(&(arm->if_true), cfg->successor);
+  }
+  last_seq = nullptr;
+  next_cfg = cfg->successor;
+}
+
+
+// Nested loops are unrolled before the loop itself.
+void LoopUnrollingTransform::VisitPreOrder(LoopControlFlowGraph *cfg) {
+  if (DispatchMode::FIND_SEQUENTIAL == mode) {
+    found_seq = nullptr;
+    return;
+  }
+  SequentialControlFlowGraph *pred(last_seq);
+  UnrollChain(&(cfg->init), &(cfg->condition));
+  if (DispatchMode::COUNT_USES == mode) {
+    CountBlock(&(cfg->condition.bb));
+    CountUse(cfg->conditional_value);
+  }
+  UnrollChain(&(cfg->body), &(cfg->condition));
+  next_cfg = cfg->successor;
+  last_seq = pred;
+  if (DispatchMode::UNROLL == mode) {
+    UnrollLoop(cfg);
+  }
+}
+
+}  // namespace mir
+}  // namespace pjit
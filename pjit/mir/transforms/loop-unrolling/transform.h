@@ -0,0 +1,195 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.h
+ *
+ *  Created on: 2014-01-20
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_TRANSFORMS_LOOP_UNROLLING_TRANSFORM_H_
+#define PJIT_MIR_TRANSFORMS_LOOP_UNROLLING_TRANSFORM_H_
+
+#include "pjit/base/base.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
+#include "pjit/mir/instruction.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+class Symbol;
+class BasicBlock;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+
+
+// Unrolls counted loops, and reduces the strength of the multiplications by
+// their induction variables.
+//
+// Only loops in the form produced by `PJIT_HIR_FOR` are changed: `init` is a
+// single basic block, the condition is a single comparison of an integer
+// induction variable with a constant or a loop-invariant bound, the body is
+// straight-line code (i.e. a chain of sequential CFGs, which includes nested
+// loops that have been fully unrolled), and the induction variable is only
+// defined by `update`, which adds a constant step to it.
+//
+// A loop whose trip count is a (small) constant is fully unrolled: the loop is
+// replaced by its `init`, followed by one copy of the body and of `update` per
+// iteration, where the induction variable is replaced by its constant value.
+//
+// The other loops are first strength-reduced: a multiplication by a constant
+// (including the implicit scaling of an index added to a pointer) whose value
+// is an affine function of the induction variable is replaced by a copy of a
+// new variable, which is computed once in `init` and then incremented after
+// each update of the induction variable. Then, if the body is small, it is
+// unrolled `UNROLL_FACTOR` times, and the loop's condition additionally checks
+// that at least that many iterations remain. The remaining iterations run in a
+// copy of the original loop that follows the unrolled loop.
+//
+// Variables that are local to an iteration (such as temporaries introduced by
+// the HIR) are renamed in each copy of an iteration, so that later transforms
+// (constant folding, value numbering, dead code elimination) can treat every
+// copy independently.
+class LoopUnrollingTransform : public ControlFlowGraphVisitor {
+ public:
+  explicit LoopUnrollingTransform(Context *context_);
+  virtual ~LoopUnrollingTransform(void) = default;
+
+  void Transform(void);
+
+  // Type dispatch on the kinds of control-flow graphs. These *do not* visit
+  // the successors of `cfg`.
+  virtual void VisitPreOrder(SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(LoopControlFlowGraph *cfg);
+
+ private:
+  enum : unsigned {
+    UNROLL_FACTOR = 4,
+
+    // Maximum number of instructions in the body and update of a loop,
+    // after full unrolling or before partial unrolling.
+    MAX_FULLY_UNROLLED_INSTRUCTIONS = 256,
+    MAX_PARTIALLY_UNROLLED_INSTRUCTIONS = 32
+  };
+
+  // What the type dispatch does with the visited CFGs.
+  enum class DispatchMode {
+    UNROLL,
+    COUNT_USES,
+    FIND_SEQUENTIAL
+  };
+
+  struct Variable {
+    // Number of uses in the whole context. Uses by CFGs (e.g. conditions of
+    // branches) are included.
+    unsigned num_uses = 0;
+
+    // Definitions and uses in the loop with tag `loop`. A variable is loop
+    // carried if it is used before being defined by an iteration.
+    unsigned loop = 0;
+    unsigned num_loop_definitions = 0;
+    unsigned num_loop_uses = 0;
+    bool is_defined = false;
+    bool is_loop_carried = false;
+
+    // Whether this variable is an affine function of the loop's induction
+    // variable, and the instruction that defines it (or `nullptr` for the
+    // induction variable itself). The coefficient is in elements for pointers.
+    // The value of an exact induction variable never wraps around.
+    bool is_induction = false;
+    bool is_exact = false;
+    U64 coefficient = 0;
+    Instruction *induction_definition = nullptr;
+
+    // The symbol that replaces this variable in the copy with tag `copy`.
+    unsigned copy = 0;
+    const Symbol *copy_symbol = nullptr;
+  };
+
+  // The induction variable of a loop, which is compared with `bound` by the
+  // loop's condition (with the induction variable on the left), and which is
+  // defined by `definition`.
+  struct InductionVariable {
+    const Symbol *symbol;
+    const Symbol *bound;
+    Operation comparison;
+    U64 step;
+    Instruction *definition;
+  };
+
+  // A multiplication that has been replaced with a copy of `reduced`.
+  struct Reduction {
+    BasicBlock *bb;
+    Instruction *in;
+    const Symbol *reduced;
+  };
+
+  Context * const context;
+
+  Vector<Variable> variables;
+
+  // The sequential CFGs of the current loop's body, excluding `update`.
+  Vector<SequentialControlFlowGraph *> body;
+  Vector<Reduction> reductions;
+  unsigned num_body_instructions;
+
+  // Tags of the current loop and of the current copy of an iteration.
+  unsigned loop_tag;
+  unsigned copy_tag;
+
+  DispatchMode mode;
+  bool uses_are_stale;
+
+  // Outputs of the type dispatch.
+  SequentialControlFlowGraph *last_seq;
+  SequentialControlFlowGraph *found_seq;
+  ControlFlowGraph *next_cfg;
+
+  void UnrollChain(ControlFlowGraph *cfg, ControlFlowGraph *stop);
+  void CountUses(void);
+  void CountBlock(const BasicBlock *bb);
+  void CountUse(const Symbol *sym);
+  SequentialControlFlowGraph *AsSequential(ControlFlowGraph *cfg);
+
+  void UnrollLoop(LoopControlFlowGraph *cfg);
+  bool CollectBody(LoopControlFlowGraph *cfg);
+  bool ScanLoop(LoopControlFlowGraph *cfg);
+  bool ScanBlock(const BasicBlock *bb);
+  bool FindInductionVariable(LoopControlFlowGraph *cfg,
+                             InductionVariable *iv);
+  bool FindStep(LoopControlFlowGraph *cfg, InductionVariable *iv);
+  bool FullyUnroll(LoopControlFlowGraph *cfg, const InductionVariable &iv,
+                   SequentialControlFlowGraph *pred);
+  bool ReduceStrength(LoopControlFlowGraph *cfg, const InductionVariable &iv);
+  void FindInductionExpression(BasicBlock *bb, Instruction *in);
+  const Symbol *EmitEntryValue(BasicBlock *bb, const Symbol *sym,
+                               const Symbol *dest);
+  bool PartiallyUnroll(LoopControlFlowGraph *cfg,
+                       const InductionVariable &iv);
+
+  Variable &GetLoopVariable(const Symbol *sym);
+  bool IsInvariant(const Symbol *sym);
+  bool IsInduction(const Symbol *sym);
+  bool IsRenamable(const Symbol *sym);
+
+  Instruction *Clone(const Instruction *in, const Symbol *induction,
+                     const Symbol *induction_value);
+  const Symbol *CloneUse(const Symbol *sym, const Symbol *induction,
+                         const Symbol *induction_value);
+  const Symbol *CloneDefinition(const Symbol *sym);
+  const Symbol *MakeIntegerConstant(const TypeInfo *type, U64 value);
+
+  LoopUnrollingTransform(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(LoopUnrollingTransform);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_TRANSFORMS_LOOP_UNROLLING_TRANSFORM_H_
@@ -0,0 +1,410 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.cc
+ *
+ *  Created on: 2014-01-07
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/mir-to-ssa/transform.h"
+
+#include "pjit/base/type-info.h"
+#include "pjit/mir/context.h"
+#include "pjit/mir/instruction.h"
+#include "pjit/mir/symbol.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/transforms/util.h"
+
+namespace pjit {
+namespace mir {
+
+
+SSATransform::SSATransform(Context *context_)
+    : context(context_),
+      next_stamp(1),
+      only_collect_definitions(false),
+      next_cfg(nullptr),
+      last_seq(nullptr) {}
+
+
+// Convert the entire MIR of the context into SSA form.
+void SSATransform::Transform(void) {
+  CollectDefinitions(&(context->entry), nullptr);
+  while (defined_ids.Size()) {
+    variables.Get(defined_ids.PopBack()).num_definitions++;
+  }
+
+  RenameChain(&(context->entry), nullptr);
+}
+
+
+// Returns true if `sym` is a local, scalar variable with more than one
+// definition.
+bool SSATransform::IsRenameable(const Symbol *sym) {
+  return IsLocalScalar(sym) && 1 < GetVariable(sym).num_definitions;
+}
+
+
+// Returns the renaming state for the variable `sym`. Multiple symbols can
+// share the same id (see `Context::CopySymbol`), so variables are identified
+// by id and not by symbol.
+SSATransform::Variable &SSATransform::GetVariable(const Symbol *sym) {
+  Variable &var(variables.Get(sym->id));
+  if (!var.original) {
+    var.original = sym;
+  }
+  return var;
+}
+
+
+// Returns the symbol of the definition of the variable `id` that reaches the
+// current program point.
+const Symbol *SSATransform::GetCurrent(unsigned id) {
+  const Variable &var(variables.Get(id));
+  return var.current ? var.current : var.original;
+}
+
+
+// Make `sym` the reaching definition of the variable `id`. The previous
+// reaching definition is logged so that it can be restored when leaving a
+// branch.
+void SSATransform::SetCurrent(unsigned id, const Symbol *sym) {
+  Variable &var(variables.Get(id));
+  definitions.PushBack({id, var.current});
+  var.current = sym;
+}
+
+
+// Restore the reaching definitions to what they were when there were only
+// `num_definitions` entries in the log.
+void SSATransform::Undo(unsigned num_definitions) {
+  while (definitions.Size() > num_definitions) {
+    const Definition def(definitions.PopBack());
+    variables.Get(def.id).current = def.previous;
+  }
+}
+
+
+// Returns the symbol that should replace the used symbol `sym`.
+const Symbol *SSATransform::RenameUse(const Symbol *sym) {
+  if (!IsRenameable(sym)) {
+    return sym;
+  }
+  return GetCurrent(sym->id);
+}
+
+
+// Make a new version of the variable `id`.
+const Symbol *SSATransform::MakeVersion(unsigned id) {
+  const Symbol *original(variables.Get(id).original);
+  Symbol *version(context->MakeSymbol(original->type));
+  version->behavior = original->behavior;
+  return version;
+}
+
+
+// Rename every control-flow graph in the successor chain beginning at `cfg`
+// and ending at (but not including) `stop`. Returns the last sequential
+// control-flow graph of the chain, i.e. the predecessor of `stop`.
+SequentialControlFlowGraph *SSATransform::RenameChain(
+    ControlFlowGraph *cfg, ControlFlowGraph *stop) {
+  SequentialControlFlowGraph *last(nullptr);
+  while (cfg != stop) {
+    last_seq = nullptr;
+    cfg->DoVisitPreOrder(this);
+    if (last_seq) {
+      last = last_seq;
+    }
+    cfg = next_cfg;
+  }
+  return last;
+}
+
+
+// Rename the uses and definitions of the instructions in a basic block. Phi
+// nodes have already been renamed when they were placed.
+void SSATransform::RenameBlock(BasicBlock *bb) {
+  for (Instruction *in(bb->first); nullptr != in; in = in->next) {
+    if (Operation::OP_PHI == in->operation) {
+      continue;
+    }
+
+    for (unsigned i(0); i < Instruction::kMaxNumOperands; ++i) {
+      if (OperandKind::OPERAND_USE == GetOperandKind(in->operation, i)) {
+        in->operands[i].symbol = RenameUse(in->operands[i].symbol);
+      }
+    }
+
+    const Symbol *def(in->GetDefinition());
+    if (IsRenameable(def)) {
+      const Symbol *version(MakeVersion(def->id));
+      SetCurrent(def->id, version);
+      in->operands[0].symbol = version;
+    }
+  }
+}
+
+
+// Collect the ids of the variables defined in the successor chain beginning
+// at `cfg` and ending at (but not including) `stop` into `defined_ids`. The
+// ids are not de-duplicated.
+void SSATransform::CollectDefinitions(ControlFlowGraph *cfg,
+                                      ControlFlowGraph *stop) {
+  const bool was_collecting(only_collect_definitions);
+  only_collect_definitions = true;
+  while (cfg != stop) {
+    cfg->DoVisitPreOrder(this);
+    cfg = next_cfg;
+  }
+  only_collect_definitions = was_collecting;
+}
+
+
+void SSATransform::CollectDefinitions(BasicBlock *bb) {
+  for (Instruction *in(bb->first); nullptr != in; in = in->next) {
+    const Symbol *def(in->GetDefinition());
+    if (IsLocalScalar(def)) {
+      GetVariable(def);
+      defined_ids.PushBack(def->id);
+    }
+  }
+}
+
+
+// Rename one branch of a conditional or multi-way branch, and record the
+// values of the variables defined in the branch as incoming values to the
+// phi nodes of `join`. The reaching definitions are then restored to what
+// they were before the branch.
+void SSATransform::RenameBranch(SequentialControlFlowGraph *branch,
+                                ControlFlowGraph *join,
+                                unsigned num_definitions) {
+  SequentialControlFlowGraph *pred(RenameChain(branch, join));
+  const unsigned pred_index(predecessors.Size());
+  const unsigned stamp(next_stamp++);
+
+  predecessors.PushBack(&(pred->bb));
+
+  for (unsigned i(num_definitions); i < definitions.Size(); ++i) {
+    const unsigned id(definitions.Get(i).id);
+    Variable &var(variables.Get(id));
+    if (stamp != var.stamp) {
+      var.stamp = stamp;
+      incoming_values.PushBack({pred_index, id, var.current});
+    }
+  }
+
+  Undo(num_definitions);
+}
+
+
+// Place phi nodes at the beginning of `join` for every variable that has an
+// incoming value from at least one of its predecessors. Predecessors without
+// an incoming value for some variable pass along the definition that reached
+// the beginning of the branching structure.
+void SSATransform::PlacePhis(SequentialControlFlowGraph *join,
+                             unsigned first_predecessor,
+                             unsigned first_incoming_value) {
+  const unsigned num_preds(predecessors.Size() - first_predecessor);
+  const unsigned first_phi(phis.Size());
+  const unsigned stamp(next_stamp++);
+  Instruction * const before(join->bb.first);
+  unsigned num_slots(0);
+
+  for (unsigned i(first_incoming_value); i < incoming_values.Size(); ++i) {
+    const unsigned id(incoming_values.Get(i).id);
+    Variable &var(variables.Get(id));
+    if (stamp == var.stamp) {
+      continue;
+    }
+
+    var.stamp = stamp;
+    var.slot = num_slots++;
+
+    const Symbol *dest(MakeVersion(id));
+    const Symbol *value(GetCurrent(id));
+    for (unsigned p(0); p < num_preds; ++p) {
+      phis.PushBack(InsertPhi(
+          &(join->bb), before, dest, value,
+          predecessors.Get(first_predecessor + p)));
+    }
+    SetCurrent(id, dest);
+  }
+
+  for (unsigned i(first_incoming_value); i < incoming_values.Size(); ++i) {
+    const IncomingValue &incoming(incoming_values.Get(i));
+    const unsigned slot(variables.Get(incoming.id).slot);
+    const unsigned p(incoming.predecessor - first_predecessor);
+    Instruction *phi(phis.Get(first_phi + slot * num_preds + p));
+    phi->operands[1].symbol = incoming.value;
+  }
+
+  while (phis.Size() > first_phi) {
+    phis.PopBack();
+  }
+  while (incoming_values.Size() > first_incoming_value) {
+    incoming_values.PopBack();
+  }
+  while (predecessors.Size() > first_predecessor) {
+    predecessors.PopBack();
+  }
+}
+
+
+// Create a phi instruction and insert it before `before`, or at the end of
+// `join` if `before` is `nullptr`.
+Instruction *SSATransform::InsertPhi(BasicBlock *join, Instruction *before,
+                                     const Symbol *dest, const Symbol *value,
+                                     const BasicBlock *predecessor) {
+  Instruction *phi(context->MakeInstruction(
+      Operation::OP_PHI, {dest, value, predecessor}));
+  if (before) {
+    join->InsertBefore(before, phi);
+  } else {
+    join->Append(phi);
+  }
+  return phi;
+}
+
+
+void SSATransform::VisitPreOrder(SequentialControlFlowGraph *cfg) {
+  if (only_collect_definitions) {
+    CollectDefinitions(&(cfg->bb));
+  } else {
+    RenameBlock(&(cfg->bb));
+    last_seq = cfg;
+  }
+  next_cfg = cfg->successor;
+}
+
+
+void SSATransform::VisitPreOrder(ConditionalControlFlowGraph *cfg) {
+  if (only_collect_definitions) {
+    CollectDefinitions(&(cfg->condition.bb));
+    CollectDefinitions(&(cfg->if_true), cfg->successor);
+    CollectDefinitions(&(cfg->if_false), cfg->successor);
+  } else {
+    RenameBlock(&(cfg->condition.bb));
+    cfg->conditional_value = RenameUse(cfg->conditional_value);
+
+    const unsigned num_definitions(definitions.Size());
+    const unsigned first_predecessor(predecessors.Size());
+    const unsigned first_incoming_value(incoming_values.Size());
+
+    RenameBranch(&(cfg->if_true), cfg->successor, num_definitions);
+    RenameBranch(&(cfg->if_false), cfg->successor, num_definitions);
+    PlacePhis(cfg->successor, first_predecessor, first_incoming_value);
+    last_seq = nullptr;
+  }
+  next_cfg = cfg->successor;
+}
+
+
+void SSATransform::VisitPreOrder(MultiWayBranchControlFlowGraph *cfg) {
+  if (only_collect_definitions) {
+    CollectDefinitions(&(cfg->condition.bb));
+    for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+      CollectDefinitions(&(arm->if_true), cfg->successor);
+    }
+  } else {
+    RenameBlock(&(cfg->condition.bb));
+    cfg->conditional_value = RenameUse(cfg->conditional_value);
+
+    const unsigned num_definitions(definitions.Size());
+    const unsigned first_predecessor(predecessors.Size());
+    const unsigned first_incoming_value(incoming_values.Size());
+
+    for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+      RenameBranch(&(arm->if_true), cfg->successor, num_definitions);
+    }
+
+    // Without a default arm, control can flow directly from the condition to
+    // the successor.
+    if (!cfg->default_arm) {
+      predecessors.PushBack(&(cfg->condition.bb));
+    }
+
+    PlacePhis(cfg->successor, first_predecessor, first_incoming_value);
+    last_seq = nullptr;
+  }
+  next_cfg = cfg->successor;
+}
+
+
+// The condition block of a loop is the loop header, and its predecessors are
+// the end of the initialization chain and the end of the body/update chain.
+// Every variable defined in the loop needs a phi node in the header. The
+// loop's successor is only reachable from the header, and so it never needs
+// phi nodes.
+void SSATransform::VisitPreOrder(LoopControlFlowGraph *cfg) {
+  if (only_collect_definitions) {
+    CollectDefinitions(&(cfg->init), &(cfg->condition));
+    CollectDefinitions(&(cfg->condition.bb));
+    CollectDefinitions(&(cfg->body), &(cfg->condition));
+    next_cfg = cfg->successor;
+    return;
+  }
+
+  SequentialControlFlowGraph *pre_header(
+      RenameChain(&(cfg->init), &(cfg->condition)));
+
+  const unsigned first_id(defined_ids.Size());
+  CollectDefinitions(&(cfg->condition.bb));
+  CollectDefinitions(&(cfg->body), &(cfg->condition));
+
+  BasicBlock * const header(&(cfg->condition.bb));
+  Instruction * const before(header->first);
+  const unsigned first_phi(phis.Size());
+  unsigned stamp(next_stamp++);
+
+  for (unsigned i(first_id); i < defined_ids.Size(); ++i) {
+    const unsigned id(defined_ids.Get(i));
+    Variable &var(variables.Get(id));
+    if (stamp == var.stamp || 1 >= var.num_definitions) {
+      continue;
+    }
+    var.stamp = stamp;
+
+    const Symbol *dest(MakeVersion(id));
+    InsertPhi(header, before, dest, GetCurrent(id), &(pre_header->bb));
+    phis.PushBack(InsertPhi(header, before, dest, nullptr, nullptr));
+    SetCurrent(id, dest);
+  }
+
+  RenameBlock(header);
+  cfg->conditional_value = RenameUse(cfg->conditional_value);
+
+  const unsigned num_definitions(definitions.Size());
+  SequentialControlFlowGraph *latch(
+      RenameChain(&(cfg->body), &(cfg->condition)));
+
+  // Fill in the back-edge operands of the header's phi nodes. This visits the
+  // variables in the same order as above.
+  stamp = next_stamp++;
+  for (unsigned i(first_id), p(first_phi); i < defined_ids.Size(); ++i) {
+    const unsigned id(defined_ids.Get(i));
+    Variable &var(variables.Get(id));
+    if (stamp == var.stamp || 1 >= var.num_definitions) {
+      continue;
+    }
+    var.stamp = stamp;
+
+    Instruction *phi(phis.Get(p++));
+    phi->operands[1].symbol = GetCurrent(id);
+    phi->operands[2].block = &(latch->bb);
+  }
+
+  Undo(num_definitions);
+
+  while (phis.Size() > first_phi) {
+    phis.PopBack();
+  }
+  while (defined_ids.Size() > first_id) {
+    defined_ids.PopBack();
+  }
+
+  last_seq = nullptr;
+  next_cfg = cfg->successor;
+}
+
+}  // namespace mir
+}  // namespace pjit
@@ -9,7 +9,141 @@
 #ifndef PJIT_MIR_TRANSFORMS_MIR_TO_SSA_TRANSFORM_H_
 #define PJIT_MIR_TRANSFORMS_MIR_TO_SSA_TRANSFORM_H_
 
+#include "pjit/base/base.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
 
+namespace pjit {
+namespace mir {
 
+class Context;
+class Symbol;
+class Instruction;
+class BasicBlock;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+
+
+// Converts the MIR of a context into static single assignment (SSA) form.
+//
+// Every definition of a local, scalar variable is given a new symbol, and
+// every use of a variable is re-written to use the symbol of the definition
+// that reaches it. Phi nodes are placed by exploiting the structure of the
+// control-flow graph, rather than by computing dominance frontiers:
+//
+//    1) The only join points in a structured CFG are the successors of
+//       conditional and multi-way branch CFGs, and the condition blocks of
+//       loops. Phi nodes are therefore only ever placed at these points.
+//
+//    2) A join point needs a phi node for a variable if and only if that
+//       variable is defined somewhere within one of the branches of the
+//       structure (or within the body of the loop).
+//
+// Variables that are not renamed keep their original symbols. These are
+// globals, persistent variables, variables of aggregate types, and variables
+// that are only defined once (e.g. the temporaries introduced by the HIR),
+// which are already in SSA form.
+class SSATransform : public ControlFlowGraphVisitor {
+ public:
+  explicit SSATransform(Context *context_);
+  virtual ~SSATransform(void) = default;
+
+  void Transform(void);
+
+  // Type dispatch on the kinds of control-flow graphs. These *do not* visit
+  // the successors of `cfg`.
+  virtual void VisitPreOrder(SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(LoopControlFlowGraph *cfg);
+
+ private:
+  // Renaming state of a single (original) variable, indexed by symbol id.
+  struct Variable {
+    const Symbol *original = nullptr;
+
+    // The symbol of the definition of this variable that reaches the current
+    // program point, or `nullptr` if the variable has not yet been defined
+    // (in which case the original symbol is used).
+    const Symbol *current = nullptr;
+
+    unsigned num_definitions = 0;
+
+    // Used for de-duplicating variables within sets.
+    unsigned stamp = 0;
+    unsigned slot = 0;
+  };
+
+  // An entry in the undo log of changes to `Variable::current`.
+  struct Definition {
+    unsigned id;
+    const Symbol *previous;
+  };
+
+  // The value that a variable has at the end of one of the predecessors of
+  // a join point.
+  struct IncomingValue {
+    unsigned predecessor;
+    unsigned id;
+    const Symbol *value;
+  };
+
+  Context * const context;
+
+  Vector<Variable> variables;
+  Vector<Definition> definitions;
+
+  // Stacks of scratch space used while placing phi nodes. Nested structures
+  // push onto, and then restore, these stacks.
+  Vector<IncomingValue> incoming_values;
+  Vector<BasicBlock *> predecessors;
+  Vector<Instruction *> phis;
+  Vector<unsigned> defined_ids;
+
+  unsigned next_stamp;
+
+  // Whether the type dispatch should only collect the variables defined in
+  // a control-flow graph (instead of renaming them).
+  bool only_collect_definitions;
+
+  // Outputs of the type dispatch.
+  ControlFlowGraph *next_cfg;
+  SequentialControlFlowGraph *last_seq;
+
+  bool IsRenameable(const Symbol *sym);
+  Variable &GetVariable(const Symbol *sym);
+  const Symbol *GetCurrent(unsigned id);
+  void SetCurrent(unsigned id, const Symbol *sym);
+  void Undo(unsigned num_definitions);
+  const Symbol *RenameUse(const Symbol *sym);
+  const Symbol *MakeVersion(unsigned id);
+
+  SequentialControlFlowGraph *RenameChain(ControlFlowGraph *cfg,
+                                          ControlFlowGraph *stop);
+  void RenameBlock(BasicBlock *bb);
+
+  void CollectDefinitions(ControlFlowGraph *cfg, ControlFlowGraph *stop);
+  void CollectDefinitions(BasicBlock *bb);
+
+  void RenameBranch(SequentialControlFlowGraph *branch,
+                    ControlFlowGraph *join,
+                    unsigned num_definitions);
+
+  void PlacePhis(SequentialControlFlowGraph *join,
+                 unsigned first_predecessor,
+                 unsigned first_incoming_value);
+
+  Instruction *InsertPhi(BasicBlock *join, Instruction *before,
+                         const Symbol *dest, const Symbol *value,
+                         const BasicBlock *predecessor);
+
+  SSATransform(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(SSATransform);
+};
+
+}  // namespace mir
+}  // namespace pjit
 
 #endif  // PJIT_MIR_TRANSFORMS_MIR_TO_SSA_TRANSFORM_H_
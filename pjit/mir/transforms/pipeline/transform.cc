@@ -0,0 +1,81 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.cc
+ *
+ *  Created on: 2014-01-27
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/pipeline/transform.h"
+
+#include "pjit/mir/context.h"
+#include "pjit/mir/transforms/constant-folding/transform.h"
+#include "pjit/mir/transforms/conversions/transform.h"
+#include "pjit/mir/transforms/copy-propagation/transform.h"
+#include "pjit/mir/transforms/dead-code/transform.h"
+#include "pjit/mir/transforms/loop-invariant/transform.h"
+#include "pjit/mir/transforms/loop-unrolling/transform.h"
+#include "pjit/mir/transforms/mir-to-ssa/transform.h"
+#include "pjit/mir/transforms/ssa-to-mir/transform.h"
+#include "pjit/mir/transforms/value-numbering/transform.h"
+
+namespace pjit {
+namespace mir {
+
+
+OptimizationPipeline::OptimizationPipeline(Context *context_)
+    : context(context_) {}
+
+
+// Each transform is scoped so that its analyses are released before the next
+// transform runs.
+void OptimizationPipeline::Transform(void) {
+  {
+    LoopUnrollingTransform unrolling(context);
+    unrolling.Transform();
+  }
+  {
+    LoopInvariantCodeMotionTransform licm(context);
+    licm.Transform();
+  }
+  {
+    ConversionSimplificationTransform conversions(context);
+    conversions.Transform();
+  }
+  {
+    CopyPropagationTransform copies(context);
+    copies.Transform();
+  }
+  {
+    SSATransform ssa(context);
+    ssa.Transform();
+  }
+  {
+    ConstantFoldingTransform folding(context);
+    folding.Transform();
+  }
+  {
+    ValueNumberingTransform gvn(context);
+    gvn.Transform();
+  }
+  {
+    DeadCodeEliminationTransform dce(context);
+    dce.Transform();
+  }
+  {
+    OutOfSSATransform out_of_ssa(context);
+    out_of_ssa.Transform();
+  }
+  {
+    CopyPropagationTransform copies(context);
+    copies.Transform();
+  }
+  {
+    DeadCodeEliminationTransform dce(context);
+    dce.Transform();
+  }
+  context->GarbageCollect();
+}
+
+}  // namespace mir
+}  // namespace pjit
@@ -0,0 +1,55 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.h
+ *
+ *  Created on: 2014-01-27
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_TRANSFORMS_PIPELINE_TRANSFORM_H_
+#define PJIT_MIR_TRANSFORMS_PIPELINE_TRANSFORM_H_
+
+#include "pjit/base/base.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+
+
+// Runs the MIR transforms over the context, in an order in which each
+// transform cleans up after, or sets up, the next:
+//
+//    1) Loop transforms, which expect the loops built by the HIR: unrolling,
+//       and then loop-invariant code motion of the (unrolled) loop bodies.
+//
+//    2) Block-local cleanups of the HIR's conversions and copies, which
+//       otherwise hide the values computed by operators from the later
+//       transforms.
+//
+//    3) Constant folding, value numbering, and dead code elimination, which
+//       are run in SSA form, and so see every definition of a variable as a
+//       different value.
+//
+//    4) Copy propagation (again) and dead code elimination, which remove the
+//       copies introduced by taking the MIR out of SSA form, followed by
+//       garbage collection of the unreachable MIR.
+//
+// The MIR is ready for code generation after `Transform` returns.
+class OptimizationPipeline {
+ public:
+  explicit OptimizationPipeline(Context *context_);
+
+  void Transform(void);
+
+ private:
+  Context * const context;
+
+  OptimizationPipeline(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(OptimizationPipeline);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_TRANSFORMS_PIPELINE_TRANSFORM_H_
@@ -0,0 +1,143 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.cc
+ *
+ *  Created on: 2014-01-07
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/ssa-to-mir/transform.h"
+
+#include "pjit/mir/context.h"
+#include "pjit/mir/instruction.h"
+#include "pjit/mir/symbol.h"
+#include "pjit/mir/cfg/basic-block.h"
+
+namespace pjit {
+namespace mir {
+
+
+OutOfSSATransform::OutOfSSATransform(Context *context_)
+    : context(context_),
+      next_stamp(1),
+      next_cfg(nullptr) {}
+
+
+// Remove every phi node from the MIR of the context.
+void OutOfSSATransform::Transform(void) {
+  LowerChain(&(context->entry), nullptr);
+}
+
+
+// Lower the phi nodes in the successor chain beginning at `cfg` and ending at
+// (but not including) `stop`.
+void OutOfSSATransform::LowerChain(ControlFlowGraph *cfg,
+                                   ControlFlowGraph *stop) {
+  while (cfg != stop) {
+    cfg->DoVisitPreOrder(this);
+    cfg = next_cfg;
+  }
+}
+
+
+// Replace the phi nodes at the beginning of `bb` with copies in the
+// predecessors of `bb`.
+void OutOfSSATransform::LowerPhis(BasicBlock *bb) {
+  Instruction *in(bb->first);
+  for (; nullptr != in && Operation::OP_PHI == in->operation; in = in->next) {
+    phis.PushBack(in);
+  }
+
+  for (unsigned i(0); i < phis.Size(); ++i) {
+    Instruction *phi(phis.Get(i));
+    if (phi) {
+      LowerParallelCopy(const_cast<BasicBlock *>(phi->operands[2].block), i);
+    }
+  }
+
+  while (phis.Size()) {
+    bb->Remove(bb->first);
+    phis.PopBack();
+  }
+}
+
+
+// Lower the phi nodes in `phis`, starting at `first_phi`, whose predecessor
+// is `pred` into a sequence of copies at the end of `pred`. Lowered phi nodes
+// are removed from `phis`.
+void OutOfSSATransform::LowerParallelCopy(BasicBlock *pred,
+                                          unsigned first_phi) {
+  const unsigned stamp(next_stamp++);
+  for (unsigned i(first_phi); i < phis.Size(); ++i) {
+    const Instruction *phi(phis.Get(i));
+    if (phi && phi->operands[2].block == pred) {
+      marks.Get(phi->operands[0].symbol->id).stamp = stamp;
+    }
+  }
+
+  // Save any value that would be overwritten by another copy.
+  for (unsigned i(first_phi); i < phis.Size(); ++i) {
+    Instruction *phi(phis.Get(i));
+    if (!phi || phi->operands[2].block != pred) {
+      continue;
+    }
+
+    const Symbol *value(phi->operands[1].symbol);
+    if (value->id && stamp == marks.Get(value->id).stamp &&
+        value != phi->operands[0].symbol) {
+      Symbol *temp(context->MakeSymbol(value->type));
+      temp->behavior = value->behavior;
+      pred->Append(context->MakeInstruction(
+          Operation::OP_ASSIGN, {temp, value}));
+      phi->operands[1].symbol = temp;
+    }
+  }
+
+  for (unsigned i(first_phi); i < phis.Size(); ++i) {
+    Instruction *phi(phis.Get(i));
+    if (!phi || phi->operands[2].block != pred) {
+      continue;
+    }
+
+    if (phi->operands[0].symbol != phi->operands[1].symbol) {
+      pred->Append(context->MakeInstruction(
+          Operation::OP_ASSIGN,
+          {phi->operands[0].symbol, phi->operands[1].symbol}));
+    }
+    phis.Get(i) = nullptr;
+  }
+}
+
+
+void OutOfSSATransform::VisitPreOrder(SequentialControlFlowGraph *cfg) {
+  LowerPhis(&(cfg->bb));
+  next_cfg = cfg->successor;
+}
+
+
+void OutOfSSATransform::VisitPreOrder(ConditionalControlFlowGraph *cfg) {
+  LowerPhis(&(cfg->condition.bb));
+  LowerChain(&(cfg->if_true), cfg->successor);
+  LowerChain(&(cfg->if_false), cfg->successor);
+  next_cfg = cfg->successor;
+}
+
+
+void OutOfSSATransform::VisitPreOrder(MultiWayBranchControlFlowGraph *cfg) {
+  LowerPhis(&(cfg->condition.bb));
+  for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+    LowerChain(&(arm->if_true), cfg->successor);
+  }
+  next_cfg = cfg->successor;
+}
+
+
+void OutOfSSATransform::VisitPreOrder(LoopControlFlowGraph *cfg) {
+  LowerChain(&(cfg->init), &(cfg->condition));
+  LowerPhis(&(cfg->condition.bb));
+  LowerChain(&(cfg->body), &(cfg->condition));
+  next_cfg = cfg->successor;
+}
+
+}  // namespace mir
+}  // namespace pjit
@@ -0,0 +1,84 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.h
+ *
+ *  Created on: 2014-01-07
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_TRANSFORMS_SSA_TO_MIR_TRANSFORM_H_
+#define PJIT_MIR_TRANSFORMS_SSA_TO_MIR_TRANSFORM_H_
+
+#include "pjit/base/base.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+class Instruction;
+class BasicBlock;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+
+
+// Converts MIR out of SSA form by replacing every phi node with copies
+// (`OP_ASSIGN` instructions) at the ends of the predecessors of the phi
+// node's block.
+//
+// The copies of a single predecessor execute as a parallel copy. If one
+// copy reads a variable that another copy writes, then the read value is
+// first saved into a temporary variable.
+//
+// Note: Copies are placed at the end of the predecessor blocks. This is safe
+//       even for edges whose source has multiple successors (e.g. the
+//       condition block of a multi-way branch without a default arm) because
+//       the destination of a phi node is only live after the join point.
+class OutOfSSATransform : public ControlFlowGraphVisitor {
+ public:
+  explicit OutOfSSATransform(Context *context_);
+  virtual ~OutOfSSATransform(void) = default;
+
+  void Transform(void);
+
+  // Type dispatch on the kinds of control-flow graphs. These *do not* visit
+  // the successors of `cfg`.
+  virtual void VisitPreOrder(SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(LoopControlFlowGraph *cfg);
+
+ private:
+  struct DestinationMark {
+    unsigned stamp = 0;
+  };
+
+  Context * const context;
+
+  // Marks the destinations of the copies of the current parallel copy,
+  // indexed by symbol id.
+  Vector<DestinationMark> marks;
+
+  // The phi nodes of the current block.
+  Vector<Instruction *> phis;
+
+  unsigned next_stamp;
+
+  // Output of the type dispatch.
+  ControlFlowGraph *next_cfg;
+
+  void LowerChain(ControlFlowGraph *cfg, ControlFlowGraph *stop);
+  void LowerPhis(BasicBlock *bb);
+  void LowerParallelCopy(BasicBlock *pred, unsigned first_phi);
+
+  OutOfSSATransform(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(OutOfSSATransform);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_TRANSFORMS_SSA_TO_MIR_TRANSFORM_H_
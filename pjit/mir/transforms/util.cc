@@ -0,0 +1,95 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * util.cc
+ *
+ *  Created on: 2014-01-11
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/util.h"
+
+#include "pjit/base/type-info.h"
+#include "pjit/base/unsafe-cast.h"
+#include "pjit/mir/symbol.h"
+
+namespace pjit {
+namespace mir {
+
+
+bool IsScalar(const TypeInfo *type) {
+  switch (type->kind) {
+    case TypeKind::TYPE_KIND_POINTER:
+    case TypeKind::TYPE_KIND_INTEGER:
+    case TypeKind::TYPE_KIND_BOOLEAN:
+    case TypeKind::TYPE_KIND_FLOATING_POINT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+bool IsSigned(const TypeInfo *type) {
+  return TypeKind::TYPE_KIND_INTEGER == type->kind &&
+         UnsafeCast<const IntegerTypeInfo *>(type)->is_signed;
+}
+
+
+bool IsLocal(const Symbol *sym) {
+  return sym && sym->id && SymbolBehavior::BehaviorLocal == sym->behavior;
+}
+
+
+bool IsLocalScalar(const Symbol *sym) {
+  return IsLocal(sym) && IsScalar(sym->type);
+}
+
+
+bool IntegerConstant(const Symbol *sym, U64 *value) {
+  if (!sym || sym->id) {
+    return false;
+  }
+  const TypeInfo *type(sym->type);
+  if (TypeKind::TYPE_KIND_BOOLEAN == type->kind) {
+    *value = 0 != sym->value.u8;
+    return true;
+  } else if (TypeKind::TYPE_KIND_INTEGER != type->kind) {
+    return false;
+  }
+  const bool is_signed(IsSigned(type));
+  switch (type->size_in_bytes) {
+    case 1:
+      *value = is_signed ? static_cast<U64>(sym->value.s8) : sym->value.u8;
+      break;
+    case 2:
+      *value = is_signed ? static_cast<U64>(sym->value.s16) : sym->value.u16;
+      break;
+    case 4:
+      *value = is_signed ? static_cast<U64>(sym->value.s32) : sym->value.u32;
+      break;
+    default:
+      *value = sym->value.u64;
+      break;
+  }
+  return true;
+}
+
+
+U64 Truncate(U64 val, const TypeInfo *type) {
+  if (TypeKind::TYPE_KIND_BOOLEAN == type->kind) {
+    return 0 != val;
+  }
+  const unsigned num_bits(type->size_in_bytes * 8);
+  if (64 <= num_bits) {
+    return val;
+  }
+  const U64 mask((1ULL << num_bits) - 1);
+  val &= mask;
+  if (IsSigned(type) && (val >> (num_bits - 1))) {
+    val |= ~mask;
+  }
+  return val;
+}
+
+}  // namespace mir
+}  // namespace pjit
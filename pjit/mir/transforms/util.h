@@ -0,0 +1,48 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * util.h
+ *
+ *  Created on: 2014-01-11
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_TRANSFORMS_UTIL_H_
+#define PJIT_MIR_TRANSFORMS_UTIL_H_
+
+#include "pjit/base/numeric-types.h"
+
+namespace pjit {
+
+struct TypeInfo;
+
+namespace mir {
+
+class Symbol;
+
+
+// Returns true if values of the type `type` fit in a register.
+bool IsScalar(const TypeInfo *type);
+
+// Returns true if `type` is a signed integer type.
+bool IsSigned(const TypeInfo *type);
+
+// Returns true if `sym` is a local variable, i.e. not a constant, and not a
+// persistent or global variable.
+bool IsLocal(const Symbol *sym);
+
+// Returns true if `sym` is a local, scalar variable.
+bool IsLocalScalar(const Symbol *sym);
+
+// Gets the value of an integer or boolean constant, sign- or zero-extended to
+// 64 bits. Booleans are either 0 or 1. Returns false if `sym` is not such a
+// constant.
+bool IntegerConstant(const Symbol *sym, U64 *value);
+
+// Truncate a 64-bit value to the size of the type `type`, and then sign- or
+// zero-extend it back to 64 bits. Booleans are truncated to either 0 or 1.
+U64 Truncate(U64 val, const TypeInfo *type);
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_TRANSFORMS_UTIL_H_
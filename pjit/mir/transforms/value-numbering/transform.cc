@@ -0,0 +1,479 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.cc
+ *
+ *  Created on: 2014-01-13
+ *      Author: Peter Goodman
+ */
+
+#include "pjit/mir/transforms/value-numbering/transform.h"
+
+#include "pjit/base/type-info.h"
+#include "pjit/mir/context.h"
+#include "pjit/mir/symbol.h"
+#include "pjit/mir/cfg/basic-block.h"
+#include "pjit/mir/cfg/sequential.h"
+#include "pjit/mir/cfg/conditional.h"
+#include "pjit/mir/cfg/multi-way-branch.h"
+#include "pjit/mir/cfg/loop.h"
+#include "pjit/mir/transforms/util.h"
+
+namespace pjit {
+namespace mir {
+
+
+// Returns true if the value of `sym` can be tracked by its version. Globals
+// can be changed by calls to C functions, and so are never tracked.
+static bool IsTracked(const Symbol *sym) {
+  return sym->id && !(sym->behavior & SymbolBehavior::BehaviorGlobal);
+}
+
+
+// Returns the bits of a constant, excluding any unused bytes of the value.
+static U64 ConstantBits(const Symbol *sym) {
+  if (TypeKind::TYPE_KIND_POINTER == sym->type->kind) {
+    return UnsafeCast<U64>(sym->value.pointer);
+  }
+  switch (sym->type->size_in_bytes) {
+    case 1: return sym->value.u8;
+    case 2: return sym->value.u16;
+    case 4: return sym->value.u32;
+    default: return sym->value.u64;
+  }
+}
+
+
+// Returns true if the order of the operands of `op` does not matter.
+static bool IsCommutative(Operation op) {
+  switch (op) {
+    case Operation::OP_ADD:
+    case Operation::OP_MULTIPLY:
+    case Operation::OP_BITWISE_XOR:
+    case Operation::OP_BITWISE_OR:
+    case Operation::OP_BITWISE_AND:
+    case Operation::OP_LOGICAL_OR:
+    case Operation::OP_LOGICAL_AND:
+    case Operation::OP_COMPARE_EQ:
+    case Operation::OP_COMPARE_NE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+// Returns true if `in` might change the contents of memory.
+static bool WritesMemory(const Instruction *in) {
+  switch (in->operation) {
+    case Operation::OP_STORE_MEMORY:
+    case Operation::OP_STORE_FIELD:
+    case Operation::OP_CCALL1:
+    case Operation::OP_CCALL2:
+    case Operation::OP_CCALL3:
+    case Operation::OP_NEXT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+static U64 Mix(U64 hash, U64 val) {
+  return (hash ^ val) * 0x9E3779B97F4A7C15ULL;
+}
+
+
+ValueNumberingTransform::ValueNumberingTransform(Context *context_)
+    : context(context_),
+      next_version(1),
+      only_redefine(false),
+      next_cfg(nullptr) {}
+
+
+// Number the entire MIR of the context.
+void ValueNumberingTransform::Transform(void) {
+  while (expressions.Size()) {
+    expressions.PopBack();
+  }
+  while (redefinitions.Size()) {
+    redefinitions.PopBack();
+  }
+  while (buckets.Size() < NUM_BUCKETS) {
+    buckets.PushBack(NO_EXPRESSION);
+  }
+  for (unsigned &bucket : buckets) {
+    bucket = NO_EXPRESSION;
+  }
+  NumberChain(&(context->entry), nullptr);
+}
+
+
+// Number every control-flow graph in the successor chain beginning at `cfg`
+// and ending at (but not including) `stop`. Each control-flow graph in the
+// chain dominates the control-flow graphs that follow it.
+void ValueNumberingTransform::NumberChain(ControlFlowGraph *cfg,
+                                          ControlFlowGraph *stop) {
+  while (cfg != stop) {
+    cfg->DoVisitPreOrder(this);
+    cfg = next_cfg;
+  }
+}
+
+
+void ValueNumberingTransform::NumberBlock(BasicBlock *bb) {
+  for (Instruction *in(bb->first), *next(nullptr); nullptr != in; in = next) {
+    next = in->next;
+    if (only_redefine) {
+      RedefineInstruction(in);
+    } else {
+      NumberInstruction(bb, in);
+    }
+  }
+}
+
+
+// Replace `in` with a copy if it re-computes an available expression, or
+// otherwise make the expression computed by `in` available.
+void ValueNumberingTransform::NumberInstruction(BasicBlock *bb,
+                                                Instruction *in) {
+  Expression expr;
+  const bool is_expression(MakeExpression(in, &expr));
+  if (is_expression) {
+    const Symbol *value(FindExpression(expr));
+    if (value == in->GetDefinition()) {
+      bb->Remove(in);
+      return;
+    } else if (value) {
+      Instruction *copy(context->MakeInstruction(
+          Operation::OP_ASSIGN, {in->GetDefinition(), value}));
+      bb->InsertBefore(in, copy);
+      bb->Remove(in);
+      RedefineInstruction(copy);
+      RecordCopy(copy);
+      return;
+    }
+  }
+
+  RedefineInstruction(in);
+  RecordCopy(in);
+  if (is_expression) {
+    expr.value = in->GetDefinition();
+    expr.value_version = Version(expr.value->id);
+    AddExpression(&expr);
+  }
+}
+
+
+// Change the versions of everything that `in` defines.
+void ValueNumberingTransform::RedefineInstruction(const Instruction *in) {
+  const Symbol *def(in->GetDefinition());
+  if (def && def->id) {
+    Redefine(def->id);
+  }
+  if (WritesMemory(in)) {
+    Redefine(MEMORY_VERSION);
+  }
+}
+
+
+// Remember that the symbol defined by the assignment `in` is a copy of the
+// assigned value.
+void ValueNumberingTransform::RecordCopy(const Instruction *in) {
+  const Symbol *def(in->GetDefinition());
+  if (Operation::OP_ASSIGN != in->operation || !IsTracked(def)) {
+    return;
+  }
+  const Symbol *source(Resolve(in->operands[1].symbol));
+  Copy &copy(copies.Get(def->id));
+  copy.source = nullptr;
+  if (source && source->type == def->type && source != def &&
+      IsScalar(def->type) && (!source->id || IsTracked(source))) {
+    copy.source = source;
+    copy.version = Version(def->id);
+    copy.source_version = source->id ? Version(source->id) : 0;
+  }
+}
+
+
+// Returns the symbol or constant of which `sym` is a valid copy, or `sym`
+// itself if it is not a copy.
+const Symbol *ValueNumberingTransform::Resolve(const Symbol *sym) {
+  if (!sym || !sym->id || sym->id >= copies.Size()) {
+    return sym;
+  }
+  const Copy &copy(copies.Get(sym->id));
+  if (copy.source && copy.version == Version(sym->id) &&
+      (!copy.source->id ||
+       copy.source_version == Version(copy.source->id))) {
+    return copy.source;
+  }
+  return sym;
+}
+
+
+// Returns the version of the symbol with id `id`. Missing versions are added
+// as zeroes, as `Vector::Get` leaves new integer entries uninitialized.
+unsigned &ValueNumberingTransform::Version(unsigned id) {
+  while (versions.Size() <= id) {
+    versions.PushBack(0U);
+  }
+  return versions.Get(id);
+}
+
+
+// Give a symbol a new version, remembering its old version so that it can be
+// restored when the current scope is closed.
+void ValueNumberingTransform::Redefine(unsigned id) {
+  unsigned &version(Version(id));
+  Redefinition redef;
+  redef.id = id;
+  redef.version = version;
+  redefinitions.PushBack(redef);
+  version = next_version++;
+}
+
+
+ValueNumberingTransform::Scope ValueNumberingTransform::OpenScope(void) {
+  Scope scope;
+  scope.num_expressions = expressions.Size();
+  scope.num_redefinitions = redefinitions.Size();
+  return scope;
+}
+
+
+// Remove the expressions added since `scope` was opened, and restore the
+// versions of the symbols redefined since then. The ids of the redefined
+// symbols are added to `redefined_ids`.
+void ValueNumberingTransform::CloseScope(Scope scope,
+                                         Vector<unsigned> *redefined_ids) {
+  while (expressions.Size() > scope.num_expressions) {
+    const Expression expr(expressions.PopBack());
+    buckets.Get(expr.hash % NUM_BUCKETS) = expr.next;
+  }
+  while (redefinitions.Size() > scope.num_redefinitions) {
+    const Redefinition redef(redefinitions.PopBack());
+    Version(redef.id) = redef.version;
+    redefined_ids->PushBack(redef.id);
+  }
+}
+
+
+// Fill in `expr` with the expression computed by `in`. Returns false if `in`
+// does not compute an expression that can be reused.
+bool ValueNumberingTransform::MakeExpression(const Instruction *in,
+                                             Expression *expr) {
+  unsigned num_operands(1);
+  bool reads_memory(false);
+  switch (in->operation) {
+#define PJIT_DECLARE_BINARY_OPERATOR(opcode, _) \
+    case Operation::PJIT_CAT(OP_, opcode):
+#define PJIT_DECLARE_UNARY_OPERATOR(opcode, _)
+#include "pjit/mir/operator.h"
+#undef PJIT_DECLARE_BINARY_OPERATOR
+#undef PJIT_DECLARE_UNARY_OPERATOR
+      num_operands = 2;
+      break;
+
+#define PJIT_DECLARE_BINARY_OPERATOR(opcode, _)
+#define PJIT_DECLARE_UNARY_OPERATOR(opcode, _) \
+    case Operation::PJIT_CAT(OP_, opcode):
+#include "pjit/mir/operator.h"
+#undef PJIT_DECLARE_BINARY_OPERATOR
+#undef PJIT_DECLARE_UNARY_OPERATOR
+    case Operation::OP_CONVERT_TYPE:
+      break;
+
+    case Operation::OP_LOAD_MEMORY:
+    case Operation::OP_LOAD_FIELD:
+      reads_memory = true;
+      break;
+
+    default:
+      return false;
+  }
+
+  const Symbol *def(in->GetDefinition());
+  if (!IsTracked(def) || !IsScalar(def->type)) {
+    return false;
+  }
+
+  expr->operation = in->operation;
+  expr->type = def->type;
+  for (unsigned i(0); i < num_operands; ++i) {
+    if (!MakeKey(in->operands[i + 1].symbol, &(expr->operands[i]))) {
+      return false;
+    }
+  }
+
+  if (reads_memory) {
+    expr->memory_version = Version(MEMORY_VERSION);
+    if (Operation::OP_LOAD_FIELD == in->operation) {
+      expr->operands[1].tag = in->operands[2].field;
+    }
+  }
+
+  // Put the operands of commutative operators into a canonical order. Only
+  // operands of the same type are reordered, as the code generator treats
+  // mixed (e.g. pointer and integer) operands differently.
+  const Symbol *left(in->operands[1].symbol);
+  const Symbol *right(in->operands[2].symbol);
+  if (IsCommutative(in->operation) && left->type == right->type &&
+      TypeKind::TYPE_KIND_FLOATING_POINT != left->type->kind) {
+    Key &a(expr->operands[0]);
+    Key &b(expr->operands[1]);
+    if (UnsafeCast<U64>(a.tag) > UnsafeCast<U64>(b.tag) ||
+        (a.tag == b.tag && a.value > b.value)) {
+      const Key temp(a);
+      a = b;
+      b = temp;
+    }
+  }
+
+  U64 hash(static_cast<U64>(expr->operation));
+  hash = Mix(hash, UnsafeCast<U64>(expr->type));
+  for (const Key &key : expr->operands) {
+    hash = Mix(hash, UnsafeCast<U64>(key.tag));
+    hash = Mix(hash, key.value);
+  }
+  expr->hash = static_cast<unsigned>(hash >> 32);
+  return true;
+}
+
+
+// Fill in `key` with the identity of the operand `sym`. Returns false if the
+// operand can not be part of a reusable expression.
+bool ValueNumberingTransform::MakeKey(const Symbol *sym, Key *key) {
+  sym = Resolve(sym);
+  if (!sym) {
+    return false;
+  } else if (sym->id) {
+    if (!IsTracked(sym)) {
+      return false;
+    }
+    key->value = sym->id;
+    key->version = Version(sym->id);
+  } else {
+    if (!IsScalar(sym->type)) {
+      return false;
+    }
+    key->tag = sym->type;
+    key->value = ConstantBits(sym);
+  }
+  return true;
+}
+
+
+// Returns the symbol holding the value of an available expression that is
+// equivalent to `expr`, or `nullptr` if there is no such expression.
+const Symbol *ValueNumberingTransform::FindExpression(
+    const Expression &expr) {
+  for (unsigned i(buckets.Get(expr.hash % NUM_BUCKETS)); NO_EXPRESSION != i; ) {
+    const Expression &avail(expressions.Get(i));
+    i = avail.next;
+    if (avail.hash != expr.hash || avail.operation != expr.operation ||
+        avail.type != expr.type ||
+        avail.memory_version != expr.memory_version ||
+        avail.value_version != Version(avail.value->id)) {
+      continue;
+    }
+    bool same_operands(true);
+    for (unsigned j(0); j < 2; ++j) {
+      const Key &a(avail.operands[j]);
+      const Key &b(expr.operands[j]);
+      same_operands = same_operands && a.tag == b.tag &&
+                      a.value == b.value && a.version == b.version;
+    }
+    if (same_operands) {
+      return avail.value;
+    }
+  }
+  return nullptr;
+}
+
+
+void ValueNumberingTransform::AddExpression(Expression *expr) {
+  unsigned &bucket(buckets.Get(expr->hash % NUM_BUCKETS));
+  expr->next = bucket;
+  bucket = expressions.Size();
+  expressions.PushBack(*expr);
+}
+
+
+void ValueNumberingTransform::VisitPreOrder(SequentialControlFlowGraph *cfg) {
+  NumberBlock(&(cfg->bb));
+  next_cfg = cfg->successor;
+}
+
+
+// The condition dominates both arms and the successor, but neither arm
+// dominates the successor. Any symbol redefined in either arm is redefined
+// again after both arms have been numbered.
+void ValueNumberingTransform::VisitPreOrder(ConditionalControlFlowGraph *cfg) {
+  NumberBlock(&(cfg->condition.bb));
+  if (only_redefine) {
+    NumberChain(&(cfg->if_true), cfg->successor);
+    NumberChain(&(cfg->if_false), cfg->successor);
+  } else {
+    Vector<unsigned> redefined_ids;
+    for (SequentialControlFlowGraph *branch : {&(cfg->if_true),
+                                              &(cfg->if_false)}) {
+      const Scope scope(OpenScope());
+      NumberChain(branch, cfg->successor);
+      CloseScope(scope, &redefined_ids);
+    }
+    for (unsigned id : redefined_ids) {
+      Redefine(id);
+    }
+  }
+  next_cfg = cfg->successor;
+}
+
+
+void ValueNumberingTransform::VisitPreOrder(
+    MultiWayBranchControlFlowGraph *cfg) {
+  NumberBlock(&(cfg->condition.bb));
+  if (only_redefine) {
+    for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+      NumberChain(&(arm->if_true), cfg->successor);
+    }
+  } else {
+    Vector<unsigned> redefined_ids;
+    for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
+      const Scope scope(OpenScope());
+      NumberChain(&(arm->if_true), cfg->successor);
+      CloseScope(scope, &redefined_ids);
+    }
+    for (unsigned id : redefined_ids) {
+      Redefine(id);
+    }
+  }
+  next_cfg = cfg->successor;
+}
+
+
+// Every symbol defined in the condition or body of a loop is redefined before
+// the condition is numbered, so that no expression computed before the loop
+// is reused if the loop's back-edge can change it. The body is scoped, but the
+// symbols it redefines are not redefined again after the loop: control only
+// leaves the loop from its condition, which observes the same versions.
+void ValueNumberingTransform::VisitPreOrder(LoopControlFlowGraph *cfg) {
+  NumberChain(&(cfg->init), &(cfg->condition));
+
+  const bool was_only_redefining(only_redefine);
+  only_redefine = true;
+  NumberBlock(&(cfg->condition.bb));
+  NumberChain(&(cfg->body), &(cfg->condition));
+  only_redefine = was_only_redefining;
+
+  if (!only_redefine) {
+    NumberBlock(&(cfg->condition.bb));
+    Vector<unsigned> redefined_ids;
+    const Scope scope(OpenScope());
+    NumberChain(&(cfg->body), &(cfg->condition));
+    CloseScope(scope, &redefined_ids);
+  }
+  next_cfg = cfg->successor;
+}
+
+}  // namespace mir
+}  // namespace pjit
@@ -0,0 +1,154 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transform.h
+ *
+ *  Created on: 2014-01-13
+ *      Author: Peter Goodman
+ */
+
+#ifndef PJIT_MIR_TRANSFORMS_VALUE_NUMBERING_TRANSFORM_H_
+#define PJIT_MIR_TRANSFORMS_VALUE_NUMBERING_TRANSFORM_H_
+
+#include "pjit/base/base.h"
+#include "pjit/base/numeric-types.h"
+#include "pjit/containers/vector.h"
+#include "pjit/mir/cfg/control-flow-graph.h"
+#include "pjit/mir/instruction.h"
+
+namespace pjit {
+namespace mir {
+
+class Context;
+class Symbol;
+class BasicBlock;
+class SequentialControlFlowGraph;
+class ConditionalControlFlowGraph;
+class MultiWayBranchControlFlowGraph;
+class LoopControlFlowGraph;
+
+
+// Replaces the re-computation of an expression with a copy of the symbol that
+// holds the previously computed value of the same expression.
+//
+// Expressions are operators from `pjit/mir/operator.h`, type conversions, and
+// loads from memory or from fields. Expressions are kept in a hash table that
+// is scoped by the dominance of the structured CFG: the expressions computed
+// in the condition of a branch or loop are available in its arms, body, and
+// successor, but those computed in one arm are not available in any other arm
+// nor in the successor.
+//
+// The MIR need not be in SSA form. Instead, every symbol has a version that
+// changes whenever the symbol is defined, and an expression can only be reused
+// if the versions of its operands and of the symbol holding its value have not
+// changed. Memory has a version that changes at every store and call to a C
+// function, which guards the re-use of loads. Operands that are copies of other
+// symbols or of constants (such as the temporaries introduced by the HIR) are
+// identified with the values that they copy.
+class ValueNumberingTransform : public ControlFlowGraphVisitor {
+ public:
+  explicit ValueNumberingTransform(Context *context_);
+  virtual ~ValueNumberingTransform(void) = default;
+
+  void Transform(void);
+
+  // Type dispatch on the kinds of control-flow graphs. These *do not* visit
+  // the successors of `cfg`.
+  virtual void VisitPreOrder(SequentialControlFlowGraph *cfg);
+  virtual void VisitPreOrder(ConditionalControlFlowGraph *cfg);
+  virtual void VisitPreOrder(MultiWayBranchControlFlowGraph *cfg);
+  virtual void VisitPreOrder(LoopControlFlowGraph *cfg);
+
+ private:
+  enum : unsigned {
+    NUM_BUCKETS = 256,
+    NO_EXPRESSION = ~0U,
+
+    // Version index used for memory. Symbol ids start at one.
+    MEMORY_VERSION = 0
+  };
+
+  // An operand of an expression. Variables are identified by their ids, and
+  // constants by their types and values.
+  struct Key {
+    const void *tag = nullptr;
+    U64 value = 0;
+    unsigned version = 0;
+  };
+
+  struct Expression {
+    Operation operation = Operation::OP_ASSIGN;
+    const TypeInfo *type = nullptr;
+    Key operands[2];
+    unsigned memory_version = 0;
+    unsigned hash = 0;
+
+    // The symbol that holds the value of this expression.
+    const Symbol *value = nullptr;
+    unsigned value_version = 0;
+
+    // Next expression in the same bucket.
+    unsigned next = NO_EXPRESSION;
+  };
+
+  // A symbol that was last assigned a copy of `source`. The copy is valid
+  // while neither symbol has been redefined since.
+  struct Copy {
+    const Symbol *source = nullptr;
+    unsigned version = 0;
+    unsigned source_version = 0;
+  };
+
+  // The previous version of a symbol, restored when a scope is closed.
+  struct Redefinition {
+    unsigned id;
+    unsigned version;
+  };
+
+  // Marks the beginning of a scope.
+  struct Scope {
+    unsigned num_expressions;
+    unsigned num_redefinitions;
+  };
+
+  Context * const context;
+
+  Vector<Expression> expressions;
+  Vector<unsigned> buckets;
+  Vector<unsigned> versions;
+  Vector<Redefinition> redefinitions;
+  Vector<Copy> copies;
+  unsigned next_version;
+
+  // Whether the type dispatch should only change the versions of the symbols
+  // defined within the visited CFG (instead of numbering it).
+  bool only_redefine;
+
+  // Outputs of the type dispatch.
+  ControlFlowGraph *next_cfg;
+
+  void NumberChain(ControlFlowGraph *cfg, ControlFlowGraph *stop);
+  void NumberBlock(BasicBlock *bb);
+  void NumberInstruction(BasicBlock *bb, Instruction *in);
+  void RedefineInstruction(const Instruction *in);
+  void RecordCopy(const Instruction *in);
+  const Symbol *Resolve(const Symbol *sym);
+
+  unsigned &Version(unsigned id);
+  void Redefine(unsigned id);
+
+  Scope OpenScope(void);
+  void CloseScope(Scope scope, Vector<unsigned> *redefined_ids);
+
+  bool MakeExpression(const Instruction *in, Expression *expr);
+  bool MakeKey(const Symbol *sym, Key *key);
+  const Symbol *FindExpression(const Expression &expr);
+  void AddExpression(Expression *expr);
+
+  ValueNumberingTransform(void) = delete;
+  PJIT_DISALLOW_COPY_AND_ASSIGN(ValueNumberingTransform);
+};
+
+}  // namespace mir
+}  // namespace pjit
+
+#endif  // PJIT_MIR_TRANSFORMS_VALUE_NUMBERING_TRANSFORM_H_
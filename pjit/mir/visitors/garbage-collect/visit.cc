@@ -20,11 +20,20 @@ GarbageCollectionVisitor::GarbageCollectionVisitor(Context *context_)
     : context(context_) {}
 
 
+// Mark a symbol that is referenced by a control-flow graph instead of by an
+// instruction. Such references remain after the instructions that define or
+// use the symbol are removed.
+void GarbageCollectionVisitor::MarkSymbol(const Symbol *sym) {
+  if (sym && context->symbol_allocator.OwnsObject(sym)) {
+    context->symbol_allocator.MarkReachable(sym);
+  }
+}
+
+
 void GarbageCollectionVisitor::VisitPreOrder(SequentialControlFlowGraph *cfg) {
   if (context->seq_allocator.OwnsObject(cfg)) {
     context->seq_allocator.MarkReachable(cfg);
   }
-  this->ControlFlowGraphVisitor::VisitPreOrder(cfg);
 }
 
 
@@ -32,7 +41,7 @@ void GarbageCollectionVisitor::VisitPreOrder(ConditionalControlFlowGraph *cfg) {
   if (context->cond_allocator.OwnsObject(cfg)) {
     context->cond_allocator.MarkReachable(cfg);
   }
-  this->ControlFlowGraphVisitor::VisitPreOrder(cfg);
+  MarkSymbol(cfg->conditional_value);
 }
 
 
@@ -41,10 +50,11 @@ void GarbageCollectionVisitor::VisitPreOrder(
   if (context->mbr_allocator.OwnsObject(cfg)) {
     context->mbr_allocator.MarkReachable(cfg);
   }
+  MarkSymbol(cfg->conditional_value);
   for (MultiWayBranchArm *arm(cfg->arms); nullptr != arm; arm = arm->next) {
     context->mbr_arm_allocator.MarkReachable(arm);
+    MarkSymbol(arm->value);
   }
-  this->ControlFlowGraphVisitor::VisitPreOrder(cfg);
 }
 
 
@@ -52,7 +62,7 @@ void GarbageCollectionVisitor::VisitPreOrder(LoopControlFlowGraph *cfg) {
   if (context->loop_allocator.OwnsObject(cfg)) {
     context->loop_allocator.MarkReachable(cfg);
   }
-  this->ControlFlowGraphVisitor::VisitPreOrder(cfg);
+  MarkSymbol(cfg->conditional_value);
 }
 
 
@@ -20,11 +20,12 @@ class ConditionalControlFlowGraph;
 class MultiWayBranchControlFlowGraph;
 class LoopControlFlowGraph;
 class BasicBlock;
+class Symbol;
 
 
-// Control-flow graph visitor that first prints out the instructions of a basic
-// block (grouped into a DOT node), and then prints out edges between basic
-// blocks.
+// Control-flow graph visitor that marks every reachable control-flow graph,
+// instruction, and symbol. It is driven by a `ControlFlowGraphTraversal`, and
+// so its type dispatch does not visit the children of the CFGs.
 class GarbageCollectionVisitor : public ControlFlowGraphVisitor {
  public:
   explicit GarbageCollectionVisitor(Context *context_);
@@ -38,6 +39,8 @@ class GarbageCollectionVisitor : public ControlFlowGraphVisitor {
  private:
   Context *context;
 
+  void MarkSymbol(const Symbol *sym);
+
   GarbageCollectionVisitor(void) = delete;
   PJIT_DISALLOW_COPY_AND_ASSIGN(GarbageCollectionVisitor);
 };
@@ -0,0 +1,64 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * code-cache.cc
+ *
+ *  Created on: 2014-01-27
+ *      Author: Peter Goodman
+ */
+
+#include <cstdio>
+
+#include "pjit/base/unsafe-cast.h"
+#include "pjit/containers/code-cache.h"
+
+
+// Checks that code committed to a code cache can still be run while newer code
+// is being written into the same chunk.
+
+
+typedef int (*Function)(void);
+
+
+// Allocate a function that returns `value`.
+static Function AllocateFunction(pjit::CodeCache *cache, int value) {
+  unsigned generation(0);
+  pjit::U8 *code(pjit::UnsafeCast<pjit::U8 *>(cache->Allocate(6, &generation)));
+  if (!code) {
+    return nullptr;
+  }
+  code[0] = 0xB8;  // MOV EAX, imm32
+  const unsigned imm(static_cast<unsigned>(value));
+  for (unsigned i(0); i < 4; ++i) {
+    code[1 + i] = static_cast<pjit::U8>(imm >> (i * 8));
+  }
+  code[5] = 0xC3;  // RET
+  return pjit::UnsafeCast<Function>(code);
+}
+
+
+int main(void) {
+  pjit::CodeCache cache(1);
+  unsigned num_failures(0);
+
+  Function first(AllocateFunction(&cache, 1));
+  cache.Commit();
+  for (int value(2); value <= 4; ++value) {
+    Function next(AllocateFunction(&cache, value));
+    if (!first || !next) {
+      printf("FAIL: could not allocate code\n");
+      return 1;
+    } else if (1 != first()) {
+      printf("FAIL: committed code changed while writing function %d\n",
+             value);
+      ++num_failures;
+    }
+    cache.Commit();
+    if (value != next()) {
+      printf("FAIL: function %d returned %d\n", value, next());
+      ++num_failures;
+    }
+  }
+
+  printf("%u failures\n", num_failures);
+  return num_failures ? 1 : 0;
+}
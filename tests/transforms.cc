@@ -0,0 +1,400 @@
+/* Copyright 2012-2013 Peter Goodman, all rights reserved. */
+/*
+ * transforms.cc
+ *
+ *  Created on: 2014-01-27
+ *      Author: Peter Goodman
+ */
+
+#include <cstdio>
+
+#include "pjit/base/unsafe-cast.h"
+#include "pjit/hir/hir-to-mir.h"
+#include "pjit/mir/transforms/constant-folding/transform.h"
+#include "pjit/mir/transforms/conversions/transform.h"
+#include "pjit/mir/transforms/copy-propagation/transform.h"
+#include "pjit/mir/transforms/dead-code/transform.h"
+#include "pjit/mir/transforms/loop-invariant/transform.h"
+#include "pjit/mir/transforms/loop-unrolling/transform.h"
+#include "pjit/mir/transforms/mir-to-ssa/transform.h"
+#include "pjit/mir/transforms/ssa-to-mir/transform.h"
+#include "pjit/mir/transforms/value-numbering/transform.h"
+#include "pjit/mir/transforms/pipeline/transform.h"
+#include "pjit/arch/x86-64/codegen/code-generator.h"
+
+
+// Runs some HIR programs without any transforms, after each MIR transform, and
+// after the whole optimization pipeline, and checks that every run computes
+// the same values, and that the pipeline shrinks the generated code of the
+// programs without loops (as unrolling grows the code of the others).
+
+
+// Mixed-width fields, so that the HIR converts between integer types.
+struct Record {
+  pjit::U8 a;
+  pjit::S8 b;
+  pjit::U16 c;
+  pjit::S16 d;
+  pjit::S32 e;
+  pjit::U32 f;
+  pjit::S64 g;
+};
+
+
+namespace pjit {
+
+PJIT_DECLARE_STRUCTURE_TYPE_INFO(Record);
+PJIT_DEFINE_STRUCTURE_TYPE_INFO(Record,
+    PJIT_DEFINE_FIELD((pjit::U8), a),
+    PJIT_DEFINE_FIELD((pjit::S8), b),
+    PJIT_DEFINE_FIELD((pjit::U16), c),
+    PJIT_DEFINE_FIELD((pjit::S16), d),
+    PJIT_DEFINE_FIELD((pjit::S32), e),
+    PJIT_DEFINE_FIELD((pjit::U32), f),
+    PJIT_DEFINE_FIELD((pjit::S64), g));
+
+}  // namespace pjit
+
+
+enum : unsigned {
+  MAX_NUM_VARIABLES = 16,
+  MEMORY_SIZE = 64,
+  FRAME_SIZE = 1024,
+  NUM_TRIALS = 32,
+  NUM_RESULTS = NUM_TRIALS * (MAX_NUM_VARIABLES + MEMORY_SIZE)
+};
+
+
+// A persistent variable of a program. Variables with a `mask` are given a
+// random value (masked by `mask`) before every run, and the others point to
+// the memory of the run.
+struct Variable {
+  const pjit::mir::Symbol *symbol;
+  pjit::U64 mask;
+};
+
+
+struct Program {
+  Variable variables[MAX_NUM_VARIABLES];
+  unsigned num_variables;
+};
+
+
+typedef void (BuildFunc)(pjit::mir::Context &, Program *);
+typedef void (OptimizeFunc)(pjit::mir::Context *);
+
+
+template <typename T>
+static void AddVariable(Program *program, const T &var, pjit::U64 mask) {
+  Variable &variable(program->variables[program->num_variables++]);
+  variable.symbol = var.GetSymbol();
+  variable.mask = mask;
+}
+
+
+// Loops with constant and variable trip counts, invariant computations, and
+// loads and stores in their bodies.
+static void BuildLoops(pjit::mir::Context &C, Program *program) {
+  using namespace pjit::hir;
+  PJIT_HIR_DECLARE_PERSISTENT(C, (long *), mem);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (Record *), p);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (int), n);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (int), x);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (long), sum);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (long), s2);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (long), s3);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (unsigned), u);
+  PJIT_HIR_DECLARE(C, (int), i);
+  PJIT_HIR_DECLARE(C, (int), j);
+  PJIT_HIR_DECLARE(C, (unsigned), k);
+  PJIT_HIR_DECLARE(C, (long), t);
+  AddVariable(program, mem, 0);
+  AddVariable(program, p, 0);
+  AddVariable(program, n, 0xF);
+  AddVariable(program, x, 0xFFFF);
+  AddVariable(program, sum, ~0ULL);
+  AddVariable(program, s2, ~0ULL);
+  AddVariable(program, s3, ~0ULL);
+  AddVariable(program, u, 0xFFFFFFFF);
+
+  PJIT_HIR_FOR(C, (ASSIGN(C, i, 0)), COMPARE_LT(C, i, 8),
+                  (ASSIGN(C, i, ADD(C, i, 1))))
+    ASSIGN(C, LOAD_MEMORY(C, ADD(C, mem, ADD(C, i, 32))),
+              LOAD_MEMORY(C, ADD(C, mem, MULTIPLY(C, i, 2))));
+    ASSIGN(C, sum, ADD(C, sum, MULTIPLY(C, PJIT_HIR_ACCESS_FIELD(C, p, g),
+                                          ADD(C, x, 3))));
+    PJIT_HIR_FOR(C, (ASSIGN(C, j, 0)), COMPARE_LT(C, j, n),
+                    (ASSIGN(C, j, ADD(C, j, 1))))
+      ASSIGN(C, s2, ADD(C, s2, ADD(C, MULTIPLY(C, x, 7), j)));
+    PJIT_HIR_END_FOR
+  PJIT_HIR_END_FOR
+
+  PJIT_HIR_FOR(C, (ASSIGN(C, i, n)), COMPARE_GT(C, i, 0),
+                  (ASSIGN(C, i, SUBTRACT(C, i, 1))))
+    ASSIGN(C, t, ADD(C, LOAD_MEMORY(C, ADD(C, mem, i)), DIVIDE(C, x, 3)));
+    ASSIGN(C, LOAD_MEMORY(C, ADD(C, mem, ADD(C, i, 16))), t);
+    ASSIGN(C, PJIT_HIR_ACCESS_FIELD(C, p, e),
+              ADD(C, PJIT_HIR_ACCESS_FIELD(C, p, e), 1));
+    ASSIGN(C, s3, ADD(C, MULTIPLY(C, s3, 3), ADD(C, t, PJIT_HIR_ACCESS_FIELD(
+        C, p, e))));
+  PJIT_HIR_END_FOR
+
+  PJIT_HIR_FOR(C, (ASSIGN(C, k, 5U)), COMPARE_GT(C, k, 0U),
+                  (ASSIGN(C, k, SUBTRACT(C, k, 1U))))
+    ASSIGN(C, u, ADD(C, MULTIPLY(C, u, 3U), MULTIPLY(C, k, k)));
+    PJIT_HIR_IF(C, COMPARE_EQ(C, k, 2U))
+      ASSIGN(C, u, ADD(C, u, 100U));
+    PJIT_HIR_END_IF
+  PJIT_HIR_END_FOR
+}
+
+
+// Operators on narrow integers, and chains of copies between variables.
+static void BuildConversions(pjit::mir::Context &C, Program *program) {
+  using namespace pjit::hir;
+  PJIT_HIR_DECLARE_PERSISTENT(C, (Record *), p);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (pjit::U8), u8);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (pjit::S8), s8);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (pjit::U16), u16);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (pjit::S32), s32);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (pjit::U32), u32);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (pjit::S64), s64);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (pjit::U64), u64);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (pjit::S64), r1);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (pjit::S64), r2);
+  PJIT_HIR_DECLARE(C, (pjit::S32), t);
+  PJIT_HIR_DECLARE(C, (pjit::S64), a);
+  PJIT_HIR_DECLARE(C, (pjit::S64), b);
+  PJIT_HIR_DECLARE(C, (pjit::S64), c);
+  AddVariable(program, p, 0);
+  AddVariable(program, u8, 0xFF);
+  AddVariable(program, s8, 0xFF);
+  AddVariable(program, u16, 0xFFFF);
+  AddVariable(program, s32, 0xFFFFFFFF);
+  AddVariable(program, u32, 0xFFFFFFFF);
+  AddVariable(program, s64, ~0ULL);
+  AddVariable(program, u64, ~0ULL);
+  AddVariable(program, r1, ~0ULL);
+  AddVariable(program, r2, ~0ULL);
+
+  ASSIGN(C, u8, ADD(C, MULTIPLY(C, u8, 3), PJIT_HIR_ACCESS_FIELD(C, p, a)));
+  ASSIGN(C, s8, BITWISE_XOR(C, s8, BITWISE_NOT(C, ADD(
+      C, PJIT_HIR_ACCESS_FIELD(C, p, b), 1))));
+  ASSIGN(C, u16, SUBTRACT(C, u16, PJIT_HIR_ACCESS_FIELD(C, p, d)));
+  ASSIGN(C, u64, ADD(C, u64, PJIT_HIR_ACCESS_FIELD(C, p, b)));
+  ASSIGN(C, u64, ADD(C, u64, PJIT_HIR_ACCESS_FIELD(C, p, c)));
+  ASSIGN(C, t, PJIT_HIR_ACCESS_FIELD(C, p, g));
+  ASSIGN(C, s32, ADD(C, s32, t));
+  ASSIGN(C, u32, MULTIPLY(C, ADD(C, s64, 7), PJIT_HIR_ACCESS_FIELD(C, p, f)));
+  ASSIGN(C, PJIT_HIR_ACCESS_FIELD(C, p, e),
+            ADD(C, PJIT_HIR_ACCESS_FIELD(C, p, a), 1));
+  ASSIGN(C, r1, ADD(C, PJIT_HIR_ACCESS_FIELD(C, p, a),
+                       PJIT_HIR_ACCESS_FIELD(C, p, e)));
+
+  ASSIGN(C, a, s64);
+  ASSIGN(C, b, a);
+  ASSIGN(C, c, ADD(C, a, b));
+  ASSIGN(C, a, b);
+  ASSIGN(C, b, c);
+  ASSIGN(C, c, a);
+  ASSIGN(C, a, b);
+  ASSIGN(C, b, c);
+  ASSIGN(C, r1, ADD(C, r1, MULTIPLY(C, a, b)));
+  ASSIGN(C, a, ADD(C, a, 1));
+  ASSIGN(C, r2, SUBTRACT(C, r2, a));
+  ASSIGN(C, s64, ADD(C, a, b));
+  PJIT_HIR_IF(C, COMPARE_LT(C, ADD(C, u8, 1), 100))
+    ASSIGN(C, u16, ADD(C, u16, MULTIPLY(C, u8, u16)));
+  PJIT_HIR_END_IF
+}
+
+
+// Branches on values that are computed more than once, and that are constant
+// along some paths.
+static void BuildBranches(pjit::mir::Context &C, Program *program) {
+  using namespace pjit::hir;
+  PJIT_HIR_DECLARE_PERSISTENT(C, (long *), mem);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (int), x);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (int), y);
+  PJIT_HIR_DECLARE_PERSISTENT(C, (long), sum);
+  PJIT_HIR_DECLARE(C, (int), z);
+  PJIT_HIR_DECLARE(C, (int), w);
+  AddVariable(program, mem, 0);
+  AddVariable(program, x, 0x7);
+  AddVariable(program, y, 0xFFFFFF);
+  AddVariable(program, sum, ~0ULL);
+
+  ASSIGN(C, z, 4);
+  ASSIGN(C, w, ADD(C, MULTIPLY(C, x, y), z));
+  PJIT_HIR_SWITCH(C, x)
+    PJIT_HIR_CASE(C, 1)
+      ASSIGN(C, y, ADD(C, MULTIPLY(C, x, y), z));
+    PJIT_HIR_END_CASE
+    PJIT_HIR_CASE(C, 2)
+      ASSIGN(C, z, MULTIPLY(C, z, 3));
+      ASSIGN(C, y, SUBTRACT(C, y, z));
+    PJIT_HIR_END_CASE
+    PJIT_HIR_CASE(C, 5)
+      ASSIGN(C, LOAD_MEMORY(C, ADD(C, mem, x)), w);
+    PJIT_HIR_END_CASE
+  PJIT_HIR_END_SWITCH
+  PJIT_HIR_IF(C, COMPARE_LT(C, ADD(C, MULTIPLY(C, x, y), z), w))
+    ASSIGN(C, sum, ADD(C, sum, LOAD_MEMORY(C, ADD(C, mem, x))));
+  PJIT_HIR_ELSE(C)
+    ASSIGN(C, sum, SUBTRACT(C, sum, ADD(C, MULTIPLY(C, x, y), z)));
+  PJIT_HIR_END_IF
+  ASSIGN(C, x, ADD(C, w, z));
+}
+
+
+template <typename T>
+static void Optimize(pjit::mir::Context *context) {
+  T transform(context);
+  transform.Transform();
+}
+
+
+static void OptimizeInSSA(pjit::mir::Context *context) {
+  Optimize<pjit::mir::SSATransform>(context);
+  Optimize<pjit::mir::ConstantFoldingTransform>(context);
+  Optimize<pjit::mir::DeadCodeEliminationTransform>(context);
+  Optimize<pjit::mir::OutOfSSATransform>(context);
+}
+
+
+static pjit::U64 NextRandom(pjit::U64 *state) {
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return *state >> 16;
+}
+
+
+// Build a program, transform it with `optimize` (if it is not `nullptr`), and
+// record the values of its variables and of its memory after each of
+// `NUM_TRIALS` runs into `results`.
+static bool Run(BuildFunc *build, OptimizeFunc *optimize,
+                pjit::U64 *results, unsigned *code_size) {
+  pjit::mir::Context C;
+  Program program;
+  program.num_variables = 0;
+  build(C, &program);
+  if (optimize) {
+    optimize(&C);
+  }
+
+  pjit::x86_64::CompiledCode code;
+  pjit::x86_64::CodeGenerator generator(&C);
+  if (!generator.Generate(&code) ||
+      FRAME_SIZE * sizeof(pjit::U64) < code.FrameSize()) {
+    return false;
+  }
+  *code_size = code.CodeSize();
+
+  pjit::U64 state(1);
+  for (unsigned trial(0); trial < NUM_TRIALS; ++trial) {
+    pjit::U64 frame[FRAME_SIZE] = {0};
+    pjit::U64 memory[MEMORY_SIZE];
+    for (pjit::U64 &word : memory) {
+      word = NextRandom(&state);
+    }
+    for (unsigned i(0); i < program.num_variables; ++i) {
+      const Variable &var(program.variables[i]);
+      unsigned offset(0);
+      if (!code.GetFrameOffset(var.symbol, &offset)) {
+        continue;
+      } else if (var.mask) {
+        frame[offset / sizeof(pjit::U64)] = NextRandom(&state) & var.mask;
+      } else {
+        frame[offset / sizeof(pjit::U64)] = pjit::UnsafeCast<pjit::U64>(
+            &(memory[0]));
+      }
+    }
+
+    code.Run(&(frame[0]));
+
+    for (unsigned i(0); i < MAX_NUM_VARIABLES; ++i) {
+      const Variable &var(program.variables[i]);
+      unsigned offset(0);
+      pjit::U64 value(0);
+      if (i < program.num_variables && var.mask &&
+          code.GetFrameOffset(var.symbol, &offset)) {
+        value = frame[offset / sizeof(pjit::U64)] & var.mask;
+      }
+      *results++ = value;
+    }
+    for (pjit::U64 word : memory) {
+      *results++ = word;
+    }
+  }
+  return true;
+}
+
+
+int main(void) {
+  static const struct {
+    const char *name;
+    BuildFunc *build;
+    bool shrinks;
+  } programs[] = {
+    {"loops", &BuildLoops, false},
+    {"conversions", &BuildConversions, true},
+    {"branches", &BuildBranches, true}
+  };
+  static const struct {
+    const char *name;
+    OptimizeFunc *optimize;
+  } transforms[] = {
+    {"loop-invariant",
+     &Optimize<pjit::mir::LoopInvariantCodeMotionTransform>},
+    {"loop-unrolling", &Optimize<pjit::mir::LoopUnrollingTransform>},
+    {"conversions", &Optimize<pjit::mir::ConversionSimplificationTransform>},
+    {"copy-propagation", &Optimize<pjit::mir::CopyPropagationTransform>},
+    {"value-numbering", &Optimize<pjit::mir::ValueNumberingTransform>},
+    {"constant-folding", &Optimize<pjit::mir::ConstantFoldingTransform>},
+    {"dead-code", &Optimize<pjit::mir::DeadCodeEliminationTransform>},
+    {"ssa", &OptimizeInSSA},
+    {"pipeline", &Optimize<pjit::mir::OptimizationPipeline>}
+  };
+
+  static pjit::U64 expected[NUM_RESULTS];
+  static pjit::U64 results[NUM_RESULTS];
+  unsigned num_failures(0);
+
+  for (const auto &program : programs) {
+    unsigned expected_size(0);
+    if (!Run(program.build, nullptr, &(expected[0]), &expected_size)) {
+      printf("FAIL %s: no code generated\n", program.name);
+      ++num_failures;
+      continue;
+    }
+    for (const auto &transform : transforms) {
+      unsigned size(0);
+      if (!Run(program.build, transform.optimize, &(results[0]), &size)) {
+        printf("FAIL %s/%s: no code generated\n", program.name,
+               transform.name);
+        ++num_failures;
+        continue;
+      }
+      for (unsigned i(0); i < NUM_RESULTS; ++i) {
+        if (expected[i] != results[i]) {
+          printf("FAIL %s/%s: result %u is %lu, expected %lu\n",
+                 program.name, transform.name, i,
+                 static_cast<unsigned long>(results[i]),
+                 static_cast<unsigned long>(expected[i]));
+          ++num_failures;
+          break;
+        }
+      }
+      printf("%s/%s: %u bytes of code, %u without transforms\n",
+             program.name, transform.name, size, expected_size);
+      if (program.shrinks && size >= expected_size &&
+          &Optimize<pjit::mir::OptimizationPipeline> == transform.optimize) {
+        printf("FAIL %s/%s: code did not shrink\n", program.name,
+               transform.name);
+        ++num_failures;
+      }
+    }
+  }
+
+  printf("%u failures\n", num_failures);
+  return num_failures ? 1 : 0;
+}